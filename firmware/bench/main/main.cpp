@@ -0,0 +1,19 @@
+#include <stdio.h>
+
+#include "microbench.h"
+
+/** Calls per batch. Fewer than on the host, so the suite finishes within the watchdog period. */
+#define TARGET_MICROBENCH_ITERATIONS 1000
+
+/**
+ * @brief Entrypoint. Times the per-loop kernels in CPU cycles per call and prints them to the console.
+ */
+extern "C" void app_main(void) {
+    static MicrobenchResult_t results[MICROBENCH_MAX_KERNELS];
+    uint8_t count = microbenchRun(results, MICROBENCH_MAX_KERNELS, TARGET_MICROBENCH_ITERATIONS);
+
+    printf("%-27s %10s\n", "kernel", "cycles");
+    for (uint8_t i = 0; i < count; i++) {
+        printf("%-27s %10.1f\n", results[i].name, results[i].ticksPerCall);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,303 @@
+#include <cstdio>
+#include <cstring>
+
+#include "halTime.h"
+
+#include "config.h"
+#include "configManager.h"
+#include "codec.h"
+#include "topics.h"
+#include "pressureManager.h"
+#include "tankGeometry.h"
+#include "switchoverPredictor.h"
+#include "volumeEstimator.h"
+#include "mqttManager.h"
+#include "processJournal.h"
+
+#include "microbench.h"
+
+/** Calls before the first batch, to warm the caches. */
+#define MICROBENCH_WARMUP 16
+/** Base topic of the dispatched topics. */
+#define MICROBENCH_BASE_TOPIC "VD1/"
+
+/**
+ * @brief A function on the per-loop path, called with the iteration number
+ * and the argument of the kernel. Returns a value depending on its work, so
+ * the call is not optimized away.
+ */
+typedef uint32_t (*MicrobenchKernel_t)(uint32_t i, int arg);
+
+typedef struct MicrobenchEntry_t {
+    const char *name;
+    MicrobenchKernel_t kernel;
+    int arg;
+} MicrobenchEntry_t;
+
+/** Representative payload of each received message type, in the order of MqttRxMessages_e. */
+static const char* const PAYLOADS[MQTT_RX_MAX] = {
+    nullptr,
+    "{\"id\":7,\"p\":[{\"z\":0,\"tv\":5},{\"z\":1,\"tt\":60000,\"to\":90000}]}",
+    "{\"id\":7}",
+    "{}",
+    "{\"tz\":\"CET-1CEST,M3.5.0,M10.5.0/3\",\"sch\":[{\"d\":127,\"m\":360,\"z\":0,\"tv\":5}]}",
+    "{\"mv\":0.52,\"tv\":0.5,\"to\":30}",
+    "{\"v\":150.8,\"dv\":12,\"n\":12}",
+    "{\"tt\":60000,\"to\":90000}",
+    "{}",
+    "{}",
+    "{\"on\":true}",
+    "{}",
+    ""
+};
+
+static ConfigManager configManager;
+static Config_t snapshot;
+static SwitchoverPredictor predictor;
+static VolumeEstimator estimator;
+static PressureSensorCalibrationPoint_t table[8];
+static PressureSensorCalibrationPoint_t fittedTable[MAX_PRESSURE_CALIBRATION_POINTS];
+static TankGeometry uprightTank;
+static TankGeometry strappedTank;
+static char topics[MQTT_RX_MAX][MQTT_TOPIC_MAX_BYTES];
+static uint8_t topicCount = 0;
+alignas(4) static char payload[RX_PAYLOAD_MAX_BYTES];
+static char json[TX_PAYLOAD_MAX_BYTES];
+static DispenseProcess_t slice;
+static DispenseSummary_t summary;
+static ProcessJournal journal;
+static volatile uint32_t sink = 0;
+
+/**
+ * @brief Copies the config, as each state handler does.
+ */
+static uint32_t configSnapshot(uint32_t i, int arg) {
+    configManager.getConfig(snapshot);
+    return snapshot.system.sleepInterval;
+}
+
+/**
+ * @brief Converts a sweep of sensor voltages to the tank volume.
+ */
+static uint32_t pressureToVolume(uint32_t i, int arg) {
+    return (uint32_t) PressureManager::interpolate(table, 8, 400 + (i * 37) % 1300);
+}
+
+/**
+ * @brief Converts a sweep of sensor voltages to the tank volume in a full table of evenly spaced voltages,
+ * as written by the pressure calibration process.
+ */
+static uint32_t pressureLookup(uint32_t i, int arg) {
+    return (uint32_t) PressureManager::lookup(fittedTable, MAX_PRESSURE_CALIBRATION_POINTS, 25, 400 + (i * 37) % 1300);
+}
+
+/**
+ * @brief Converts a sweep of sensor voltages to the volume of an upright tank by its compiled geometry.
+ */
+static uint32_t geometryUpright(uint32_t i, int arg) {
+    return (uint32_t) uprightTank.getVolume(400 + (i * 37) % 1300);
+}
+
+/**
+ * @brief Converts a sweep of sensor voltages to the tank volume by a full strapping table.
+ */
+static uint32_t geometryTable(uint32_t i, int arg) {
+    return (uint32_t) strappedTank.getVolume(400 + (i * 37) % 1300);
+}
+
+/**
+ * @brief Adds a reading of a steadily draining tank to the switchover predictor.
+ */
+static uint32_t predictorUpdate(uint32_t i, int arg) {
+    if (i % 1024 == 0) {
+        predictor.reset();
+    }
+    predictor.update((i % 1024) * 250, 100 - (i % 1024) * 0.05f);
+    return predictor.shouldSwitch();
+}
+
+/**
+ * @brief Adds a reading of a steadily draining tank and its metered volume to the volume estimator.
+ * A window closes every 50 readings, so its update is included at the rate of a dispense.
+ */
+static uint32_t estimatorUpdate(uint32_t i, int arg) {
+    if (i % 1024 == 0) {
+        estimator.begin();
+    }
+    estimator.update((i % 1024) * 100, (i % 1024) * 0.02f, 100 - (i % 1024) * 0.021f + (i % 7) * 0.1f);
+    return estimator.isDrifting();
+}
+
+/**
+ * @brief Finds the message type of each command topic in turn.
+ */
+static uint32_t topicDispatch(uint32_t i, int arg) {
+    const char *topic = topics[i % topicCount];
+
+    return codecMatchTopic(MICROBENCH_BASE_TOPIC, topic, strlen(topic));
+}
+
+/**
+ * @brief Decodes a payload and its job ID, as MqttManager::getNextMessage() does.
+ */
+static uint32_t decode(uint32_t i, int arg) {
+    uint32_t jobId = 0;
+
+    codecDecode((MqttRxMessages_e) arg, PAYLOADS[arg], payload, sizeof(payload));
+    codecGetUint(PAYLOADS[arg], "id", jobId);
+    return jobId + payload[0];
+}
+
+/**
+ * @brief Encodes a dispense slice.
+ */
+static uint32_t encodeSlice(uint32_t i, int arg) {
+    slice.time = i * 250;
+    slice.outputVolume = i * 0.05f;
+    codecEncodeSlice(slice, json, sizeof(json));
+    return json[10];
+}
+
+/**
+ * @brief Journals a dispense slice into RTC memory.
+ */
+static uint32_t journalSlice(uint32_t i, int arg) {
+    slice.time = i * 250;
+    slice.outputVolume = i * 0.05f;
+    journal.record(VALVES_TANK_DISPENSE, slice);
+    return slice.time;
+}
+
+/**
+ * @brief Encodes a dispense summary.
+ */
+static uint32_t encodeSummary(uint32_t i, int arg) {
+    summary.duration = i * 250;
+    summary.outputVolume = i * 0.05f;
+    codecEncodeSummary(summary, json, sizeof(json));
+    return json[10];
+}
+
+/**
+ * @brief Sets up the inputs of the kernels.
+ */
+static void setup() {
+    TankConfig_t tank = {};
+
+    for (int i = 0; i < 8; i++) {
+        table[i].analogVoltage = 400 + i * 171;
+        table[i].volume = i * 21;
+    }
+    for (int i = 0; i < MAX_PRESSURE_CALIBRATION_POINTS; i++) {
+        fittedTable[i].analogVoltage = 400 + i * 25;
+        fittedTable[i].volume = i * 3;
+    }
+
+    /** The default tank, and a tank strapped every 80 mm, both read by a sensor of 1000 mV per meter. */
+    tank.shape = TANK_CYLINDER;
+    tank.dimension1 = 0.4f;
+    tank.dimension2 = 1.2f;
+    uprightTank.configure(tank, 400, 1000);
+    tank.shape = TANK_TABLE;
+    tank.strappingPointCount = MAX_TANK_STRAPPING_POINTS;
+    for (int i = 0; i < MAX_TANK_STRAPPING_POINTS; i++) {
+        tank.strapping[i].height = i * 80;
+        tank.strapping[i].volume = i * i * 1000;
+    }
+    strappedTank.configure(tank, 400, 1000);
+
+    predictor.configure(12.45f, 0.3f, 0.1f, 10000, 0.2f);
+
+    topicCount = 0;
+    for (int i = MQTT_RX_MIN + 1; i < MQTT_RX_MAX; i++) {
+        if (MQTT_RX_TOPICS[i] != nullptr) {
+            snprintf(topics[topicCount++], MQTT_TOPIC_MAX_BYTES, "%s%s", MICROBENCH_BASE_TOPIC, MQTT_RX_TOPICS[i]);
+        }
+    }
+
+    slice = {};
+    slice.flowRate = 12.45f;
+    slice.tankLevel = 84.2f;
+    summary = {};
+    summary.outputTankVolume = 20.1f;
+    summary.outputSourceVolume = 4.9f;
+    summary.tankSwitchoverTime = 96500;
+    summary.overshoot = 0.012f;
+}
+
+/**
+ * @brief Returns the cost of a kernel call in the fastest of the batches.
+ */
+static float measure(MicrobenchEntry_t &entry, uint32_t iterations) {
+    uint32_t start = 0;
+    uint32_t elapsed = 0;
+    uint32_t fastest = UINT32_MAX;
+
+    for (uint32_t i = 0; i < MICROBENCH_WARMUP; i++) {
+        sink = sink + entry.kernel(i, entry.arg);
+    }
+
+    for (int batch = 0; batch < MICROBENCH_BATCHES; batch++) {
+        start = halCycleCount();
+        for (uint32_t i = 0; i < iterations; i++) {
+            sink = sink + entry.kernel(i, entry.arg);
+        }
+        elapsed = halCycleCount() - start;
+        if (elapsed < fastest) {
+            fastest = elapsed;
+        }
+    }
+
+    return (float) fastest / iterations;
+}
+
+/**
+ * @brief Times the functions on the per-loop path of the FSM: dispatching and
+ * decoding each received message type, encoding the dispense telemetry, the
+ * switchover predictor and volume estimator updates, the pressure to volume
+ * conversion by search, by lookup and by the tank geometry, the process journal, and the config snapshot. The kernels have no hardware
+ * dependencies, so they run on the target and on the host alike.
+ *
+ * @param results Overwritten with the result of each kernel.
+ * @param size Number of results the buffer holds.
+ * @param iterations Calls per batch.
+ * @returns Number of results.
+ */
+uint8_t microbenchRun(MicrobenchResult_t *results, uint8_t size, uint32_t iterations) {
+    static char decodeNames[MQTT_RX_MAX][32];
+    MicrobenchEntry_t entries[MICROBENCH_MAX_KERNELS] = {};
+    uint8_t count = 0;
+
+    setup();
+
+    entries[count++] = {"config snapshot", &configSnapshot, 0};
+    entries[count++] = {"pressure to volume", &pressureToVolume, 0};
+    entries[count++] = {"pressure lookup", &pressureLookup, 0};
+    entries[count++] = {"tank geometry", &geometryUpright, 0};
+    entries[count++] = {"tank strapping table", &geometryTable, 0};
+    entries[count++] = {"predictor update", &predictorUpdate, 0};
+    entries[count++] = {"estimator update", &estimatorUpdate, 0};
+    entries[count++] = {"topic dispatch", &topicDispatch, 0};
+    for (int i = MQTT_RX_MIN + 1; i < MQTT_RX_MAX; i++) {
+        /** Commands the operating mode leaves out are not received. */
+        if ( (MQTT_RX_TOPICS[i] == nullptr) && (i != MQTT_RX_CONNECTED) ) {
+            continue;
+        }
+        snprintf(decodeNames[i], sizeof(decodeNames[i]), "decode %s", (MQTT_RX_TOPICS[i] == nullptr) ? "connected" : MQTT_RX_TOPICS[i]);
+        entries[count++] = {decodeNames[i], &decode, i};
+    }
+    entries[count++] = {"encode slice", &encodeSlice, 0};
+    entries[count++] = {"journal slice", &journalSlice, 0};
+    entries[count++] = {"encode summary", &encodeSummary, 0};
+
+    if (count > size) {
+        count = size;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        results[i].name = entries[i].name;
+        results[i].iterations = iterations;
+        results[i].ticksPerCall = measure(entries[i], iterations);
+    }
+
+    return count;
+}
\ No newline at end of file
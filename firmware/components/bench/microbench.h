@@ -0,0 +1,36 @@
+#ifndef MICROBENCH_H
+#define MICROBENCH_H
+
+#include <stdint.h>
+
+/** Maximum number of kernels. */
+#define MICROBENCH_MAX_KERNELS 24
+/** Number of timed batches of each kernel. The fastest batch is reported. */
+#define MICROBENCH_BATCHES 5
+
+/**
+ * @brief Describes the cost of a kernel.
+ */
+typedef struct MicrobenchResult_t {
+    const char *name;
+    /** Calls per batch. */
+    uint32_t iterations;
+    /** Mean cost of a call in the fastest batch, in units of halCycleCount(). */
+    float ticksPerCall;
+} MicrobenchResult_t;
+
+/**
+ * @brief Times the functions on the per-loop path of the FSM: dispatching and
+ * decoding each received message type, encoding the dispense telemetry, the
+ * switchover predictor and volume estimator updates, the pressure to volume
+ * conversion by search, by lookup and by the tank geometry, the process journal, and the config snapshot. The kernels have no hardware
+ * dependencies, so they run on the target and on the host alike.
+ *
+ * @param results Overwritten with the result of each kernel.
+ * @param size Number of results the buffer holds.
+ * @param iterations Calls per batch.
+ * @returns Number of results.
+ */
+uint8_t microbenchRun(MicrobenchResult_t *results, uint8_t size, uint32_t iterations);
+
+#endif
\ No newline at end of file
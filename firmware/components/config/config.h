@@ -1,31 +1,197 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+#include <stdint.h>
+
 #define MAX_PRESSURE_CALIBRATION_POINTS 50
+#define MAX_ZONES 8
+#define MAX_SCHEDULE_ENTRIES 8
+#define MAX_TANK_STRAPPING_POINTS 16
+/** Bounds of SystemConfig_t::sleepInterval in seconds, so STATE_LISTEN always blocks and the interval fits in miliseconds. */
+#define SYSTEM_SLEEP_INTERVAL_MIN 10
+#define SYSTEM_SLEEP_INTERVAL_MAX 86400
 
+/**
+ * @brief Describes the shape of the tank. Numbered from zero, unlike the
+ * shape_type of the legacy firmware, which numbered the rectangle 1 and the cylinder 2.
+ */
 typedef enum TankShapes_e {
+    /** Upright rectangular prism. Length, width and height in dimension1 to dimension3, in meters. */
     TANK_RECTANGLE,
-    TANK_CYLINDER
+    /** Upright cylinder. Diameter and height in dimension1 and dimension2, in meters. */
+    TANK_CYLINDER,
+    /** Any shape, such as a tote, a horizontal cylinder or a cone bottom, by the strapping table of the tank config. */
+    TANK_TABLE
 } TankShapes_e;
 
+/**
+ * @brief Describes what is done with the K-factor the flow sensor is measured at against the tank level.
+ */
+typedef enum FlowRecalibration_e {
+    /** Not estimated. */
+    FLOW_RECALIBRATION_OFF,
+    /** Published as a proposal for the user to apply. */
+    FLOW_RECALIBRATION_PROPOSE,
+    /** Applied and persisted once confident. */
+    FLOW_RECALIBRATION_APPLY
+} FlowRecalibration_e;
+
 typedef struct SystemConfig_t {
+    /** 
+     * Maximum time in seconds the FSM stays blocked in STATE_LISTEN
+     * before waking to report power statistics. If deep sleep is enabled,
+     * the duration of each deep sleep instead.
+     */
     uint32_t sleepInterval;
+    /** If true, the chip enters automatic light sleep while no process is active. */
+    bool lightSleepEnabled;
+    /** If true, the device enters deep sleep for sleepInterval seconds once idle. */
+    bool deepSleepEnabled;
+    /** Time in miliseconds to listen for messages after becoming ready before entering deep sleep. */
+    uint32_t deepSleepAwakeTime;
+    /** RTC-capable GPIO which wakes the device from deep sleep when pulled low, or -1 for none. */
+    int8_t wakeGpio;
 } SystemConfig_t;
 
+typedef struct ConnectionConfig_t {
+    /** MQTT broker URI, e.g. mqtt://192.168.0.195:1883. */
+    char brokerUri[64];
+    char username[32];
+    char password[32];
+    /** Prefix of every MQTT topic, e.g. VD1/. */
+    char baseTopic[32];
+    /** 
+     * If true, the broker keeps the session of the device between connections,
+     * so subscriptions survive and QoS 1 commands are queued while disconnected.
+     */
+    bool persistentSession;
+    /** Delay before the first reconnection attempt, in miliseconds. Doubled after each failure. */
+    uint32_t backoffBase;
+    /** Maximum delay between reconnection attempts, in miliseconds. */
+    uint32_t backoffMax;
+    /** Number of consecutive failures after which the circuit opens. */
+    uint8_t circuitThreshold;
+    /** Time the circuit stays open before a single trial attempt, in miliseconds. */
+    uint32_t circuitCooldown;
+    /** If true, the static IP below is used instead of DHCP. */
+    bool staticIpEnabled;
+    /** IPv4 addresses in network byte order. */
+    uint32_t staticIp;
+    uint32_t gateway;
+    uint32_t netmask;
+    uint32_t dns;
+} ConnectionConfig_t;
+
 typedef struct DispenseConfig_t {
     float dataResolutionLiters;
+    /** If true, a dispense process interrupted by a reset is resumed on boot with what is left of its run plan. */
+    bool resumeInterrupted;
 } DispenseConfig_t;
 
+/**
+ * @brief Delays of a supply valve, measured by the valve characterisation process.
+ * Zero if not measured.
+ */
+typedef struct ValveLatency_t {
+    /** From the open command to the onset of flow pulses, in miliseconds. */
+    uint16_t openDelay;
+    /** From the close command to the last flow pulse, in miliseconds. */
+    uint16_t closeDelay;
+} ValveLatency_t;
+
+/**
+ * @brief Peak-and-hold drive of a valve coil. The coil is driven at full duty
+ * for the pull-in time, then held open at a lower PWM duty.
+ */
+typedef struct ValveDriveConfig_t {
+    /** Time the coil is driven at full duty after opening, in miliseconds. */
+    uint16_t pullInTime;
+    /** Duty holding the valve open after the pull-in time, in percent. 100 drives the coil at full duty throughout. */
+    uint8_t holdDuty;
+} ValveDriveConfig_t;
+
+typedef struct ValveConfig_t {
+    /** GPIO of each supply valve, or -1 if the supply is not installed. */
+    int8_t sourcePin;
+    int8_t tankPin;
+    int8_t drainPin;
+    /** GPIO of the flow sensor, or -1 to measure the source with its static flow rate. */
+    int8_t flowSensorPin;
+    /** Number of zone valves downstream of the supply valves. Zero for a single output line. */
+    uint8_t zoneCount;
+    /** GPIO of each zone valve. */
+    int8_t zonePins[MAX_ZONES];
+    /** The close command of a volume target is issued early by the volume in flight during closeDelay. */
+    ValveLatency_t sourceLatency;
+    ValveLatency_t tankLatency;
+    /** Drive of each valve. */
+    ValveDriveConfig_t sourceDrive;
+    ValveDriveConfig_t tankDrive;
+    ValveDriveConfig_t drainDrive;
+    ValveDriveConfig_t zoneDrives[MAX_ZONES];
+} ValveConfig_t;
+
+typedef struct ScheduleEntry_t {
+    /** Days of the week the entry fires on, bit 0 is Sunday. Zero disables the entry. */
+    uint8_t days;
+    /** Local time of day the entry fires at, in minutes after midnight. */
+    uint16_t minute;
+    uint8_t zone;
+    /** Dispense target, as in a dispense command. */
+    float targetVolume;
+    uint32_t targetTime;
+    uint32_t timeout;
+} ScheduleEntry_t;
+
+typedef struct ScheduleConfig_t {
+    /** POSIX TZ string of the local time, e.g. CET-1CEST,M3.5.0,M10.5.0/3. */
+    char timezone[32];
+    /** SNTP server the clock is synchronized to. */
+    char ntpServer[32];
+    /** Number of valid entries. Entries firing at the same time run back to back in table order. */
+    uint8_t entryCount;
+    ScheduleEntry_t entries[MAX_SCHEDULE_ENTRIES];
+} ScheduleConfig_t;
+
 typedef struct SourceConfig_t {
     float staticFlowRate;
 } SourceConfig_t;
 
+/**
+ * @brief Describes a point of a tank strapping table.
+ */
+typedef struct TankStrappingPoint_t {
+    /** Water height above the pressure sensor in millimeters. */
+    uint16_t height;
+    /** Tank volume at the height in milliliters. */
+    uint32_t volume;
+} TankStrappingPoint_t;
+
 typedef struct TankConfig_t {
     TankShapes_e shape;
     float dimension1;
     float dimension2;
     float dimension3;
     uint16_t tank_timeout;
+    /**
+     * Fraction of the source flow rate below which the projected tank flow
+     * switches over to the source early. Zero for the tank_timeout rule only.
+     */
+    float switchoverFraction;
+    /** Added to switchoverFraction to arm the early switchover. */
+    float switchoverHysteresis;
+    /** Interval the tank flow is projected over, in seconds. */
+    uint16_t switchoverHorizon;
+    /**
+     * If true, the source is opened alongside the tank at the switchover, and the tank
+     * is closed once it stops flowing. Requires a check valve on the tank outlet and
+     * a calibrated pressure sensor.
+     */
+    bool blendEnabled;
+    /** Number of valid points in the strapping table. */
+    uint8_t strappingPointCount;
+    /** Strapping table of a TANK_TABLE shape, in rising height order. */
+    TankStrappingPoint_t strapping[MAX_TANK_STRAPPING_POINTS];
 } TankConfig_t;
 
 typedef struct FlowSensorConfig_t {
@@ -33,10 +199,23 @@ typedef struct FlowSensorConfig_t {
     float minFlowRate;
     float calibrationTimeout;
     float calibrateMaxVolume;
+    /** Recalibration against the tank level during tank dispenses. Requires a calibrated pressure sensor. */
+    FlowRecalibration_e recalibration;
 } FlowSensorConfig_t;
 
 typedef struct PressureSensorConfig_t {
     float reportMode;
+    /** ADC1 GPIO of the sensor output, or -1 if not installed. */
+    int8_t pin;
+    /** Number of valid points in the calibration table. */
+    uint8_t calibrationPointCount;
+    /** Sensor output with no water above it, in millivolts. */
+    float offset;
+    /**
+     * Sensor output per meter of water, in millivolts. Zero if unknown. Without a calibration
+     * table, a known gain converts the sensor voltage into the tank volume by the tank geometry.
+     */
+    float gain;
 } PressureSensorConfig_t;
 
 typedef struct PressureSensorCalibrationPoint_t {
@@ -46,7 +225,10 @@ typedef struct PressureSensorCalibrationPoint_t {
 
 typedef struct Config_t {
     SystemConfig_t system;
+    ConnectionConfig_t connection;
     DispenseConfig_t dispense;
+    ValveConfig_t valves;
+    ScheduleConfig_t schedule;
     SourceConfig_t source;
     TankConfig_t tank;
     FlowSensorConfig_t flowSensor;
@@ -1,59 +1,331 @@
+#include <cstring>
+#include <stddef.h>
+
 #include "esp_err.h"
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "halNvs.h"
+#include "halSystem.h"
 
 #include "configManager.h"
+#include "defaults.h"
+#include "operatingMode.h"
 
 static const char* TAG = "ConfigManager";
 
+/** Marks the RTC config copy as valid. */
+#define CONFIG_RTC_MAGIC 0xC0F16A7E
+
+/**
+ * @brief Copy of the config retained in RTC memory through deep sleep.
+ */
+typedef struct ConfigRtcCopy_t {
+    uint32_t magic;
+    uint32_t generation;
+    Config_t config;
+    PressureSensorCalibrationPoint_t pressureCalibration[MAX_PRESSURE_CALIBRATION_POINTS];
+} ConfigRtcCopy_t;
+
+static RTC_NOINIT_ATTR ConfigRtcCopy_t rtcCopy;
+
+/**
+ * @brief Describes a section of the config, persisted as a blob of its own.
+ */
+typedef struct ConfigSection_t {
+    const char *key;
+    size_t offset;
+    size_t size;
+} ConfigSection_t;
+
+static const ConfigSection_t CONFIG_SECTIONS[] = {
+    {"system", offsetof(Config_t, system), sizeof(SystemConfig_t)},
+    {"connection", offsetof(Config_t, connection), sizeof(ConnectionConfig_t)},
+    {"dispense", offsetof(Config_t, dispense), sizeof(DispenseConfig_t)},
+    {"valves", offsetof(Config_t, valves), sizeof(ValveConfig_t)},
+    {"schedule", offsetof(Config_t, schedule), sizeof(ScheduleConfig_t)},
+    {"source", offsetof(Config_t, source), sizeof(SourceConfig_t)},
+    {"tank", offsetof(Config_t, tank), sizeof(TankConfig_t)},
+    {"flowSensor", offsetof(Config_t, flowSensor), sizeof(FlowSensorConfig_t)},
+    {"pressureSensor", offsetof(Config_t, pressureSensor), sizeof(PressureSensorConfig_t)}
+};
+#define CONFIG_SECTION_COUNT (sizeof(CONFIG_SECTIONS) / sizeof(CONFIG_SECTIONS[0]))
+
+/** The broker and credentials lead ConnectionConfig_t, so a connection section of another size keeps them. */
+#define CONFIG_CREDENTIALS_BYTES offsetof(ConnectionConfig_t, persistentSession)
+
 /**
  * @brief Constructor.
  */
 ConfigManager::ConfigManager() {
-    return;
+    config = {};
+    config.system.sleepInterval = SYSTEM_SLEEP_INTERVAL_DEFAULT;
+    config.system.lightSleepEnabled = SYSTEM_LIGHT_SLEEP_ENABLED_DEFAULT;
+    config.system.deepSleepEnabled = SYSTEM_DEEP_SLEEP_ENABLED_DEFAULT;
+    config.system.deepSleepAwakeTime = SYSTEM_DEEP_SLEEP_AWAKE_TIME_DEFAULT;
+    config.system.wakeGpio = SYSTEM_WAKE_GPIO_DEFAULT;
+    strlcpy(config.connection.brokerUri, CONNECTION_BROKER_URI_DEFAULT, sizeof(config.connection.brokerUri));
+    strlcpy(config.connection.username, CONNECTION_USERNAME_DEFAULT, sizeof(config.connection.username));
+    strlcpy(config.connection.password, CONNECTION_PASSWORD_DEFAULT, sizeof(config.connection.password));
+    strlcpy(config.connection.baseTopic, CONNECTION_BASE_TOPIC_DEFAULT, sizeof(config.connection.baseTopic));
+    config.connection.persistentSession = CONNECTION_PERSISTENT_SESSION_DEFAULT;
+    config.connection.backoffBase = CONNECTION_BACKOFF_BASE_DEFAULT;
+    config.connection.backoffMax = CONNECTION_BACKOFF_MAX_DEFAULT;
+    config.connection.circuitThreshold = CONNECTION_CIRCUIT_THRESHOLD_DEFAULT;
+    config.connection.circuitCooldown = CONNECTION_CIRCUIT_COOLDOWN_DEFAULT;
+    config.connection.staticIpEnabled = CONNECTION_STATIC_IP_ENABLED_DEFAULT;
+    config.dispense.dataResolutionLiters = DISPENSE_DATA_RESOLUTION_L_DEFAULT;
+    config.dispense.resumeInterrupted = DISPENSE_RESUME_INTERRUPTED_DEFAULT;
+    /** Only the valves and sensors of the operating mode of the build are installed by default. */
+    config.valves.sourcePin = DripMode::SOURCE ? VALVES_SOURCE_PIN_DEFAULT : -1;
+    config.valves.tankPin = DripMode::TANK ? VALVES_TANK_PIN_DEFAULT : -1;
+    config.valves.drainPin = DripMode::DRAIN ? VALVES_DRAIN_PIN_DEFAULT : -1;
+    config.valves.flowSensorPin = VALVES_FLOW_SENSOR_PIN_DEFAULT;
+    config.valves.zoneCount = VALVES_ZONE_COUNT_DEFAULT;
+    memset(config.valves.zonePins, -1, sizeof(config.valves.zonePins));
+    config.valves.sourceLatency.openDelay = VALVES_OPEN_DELAY_DEFAULT;
+    config.valves.sourceLatency.closeDelay = VALVES_CLOSE_DELAY_DEFAULT;
+    config.valves.tankLatency.openDelay = VALVES_OPEN_DELAY_DEFAULT;
+    config.valves.tankLatency.closeDelay = VALVES_CLOSE_DELAY_DEFAULT;
+    config.valves.sourceDrive.pullInTime = VALVES_PULL_IN_TIME_DEFAULT;
+    config.valves.sourceDrive.holdDuty = VALVES_HOLD_DUTY_DEFAULT;
+    config.valves.tankDrive = config.valves.sourceDrive;
+    config.valves.drainDrive = config.valves.sourceDrive;
+    for (int i = 0; i < MAX_ZONES; i++) {
+        config.valves.zoneDrives[i] = config.valves.sourceDrive;
+    }
+    strlcpy(config.schedule.timezone, SCHEDULE_TIMEZONE_DEFAULT, sizeof(config.schedule.timezone));
+    strlcpy(config.schedule.ntpServer, SCHEDULE_NTP_SERVER_DEFAULT, sizeof(config.schedule.ntpServer));
+    config.schedule.entryCount = 0;
+    config.source.staticFlowRate = SOURCE_STATIC_FLOW_RATE_DEFAULT;
+    config.tank.shape = TANK_SHAPE_DEFAULT;
+    config.tank.dimension1 = TANK_DIMENSION_1_DEFAULT;
+    config.tank.dimension2 = TANK_DIMENSION_2_DEFAULT;
+    config.tank.dimension3 = TANK_DIMENSION_3_DEFAULT;
+    config.tank.tank_timeout = TANK_TIMEOUT_DEFAULT;
+    config.tank.switchoverFraction = TANK_SWITCHOVER_FRACTION_DEFAULT;
+    config.tank.switchoverHysteresis = TANK_SWITCHOVER_HYSTERESIS_DEFAULT;
+    config.tank.switchoverHorizon = TANK_SWITCHOVER_HORIZON_DEFAULT;
+    config.tank.blendEnabled = TANK_BLEND_ENABLED_DEFAULT;
+    config.tank.strappingPointCount = 0;
+    memset(config.tank.strapping, 0, sizeof(config.tank.strapping));
+    config.flowSensor.defaultPulsesPerLiter = FLOW_PULSES_PER_L_DEFAULT;
+    config.flowSensor.minFlowRate = FLOW_MIN_FLOW_RATE_DEFAULT;
+    config.flowSensor.calibrationTimeout = FLOW_CALIBRATION_TIMEOUT_DEFAULT;
+    config.flowSensor.calibrateMaxVolume = FLOW_CALIBRATION_MAX_VOLUME_DEFAULT;
+    config.flowSensor.recalibration = FLOW_RECALIBRATION_DEFAULT;
+    config.pressureSensor.reportMode = PRESSURE_REPORT_MODE_DEFAULT;
+    config.pressureSensor.pin = DripMode::PRESSURE ? PRESSURE_PIN_DEFAULT : -1;
+    config.pressureSensor.calibrationPointCount = 0;
+    config.pressureSensor.offset = PRESSURE_OFFSET_DEFAULT;
+    config.pressureSensor.gain = PRESSURE_GAIN_DEFAULT;
+    memset(pressureCalibration, 0, sizeof(pressureCalibration));
+    config.pressureCalibrationTable = pressureCalibration;
+    generation = 0;
+    _restoredFromRtc = false;
 }
 
 /**
- * @brief Begins the ConfigManager.
- * 
+ * @brief Begins the ConfigManager. On wake from deep sleep, the config
+ * is restored from RTC memory instead of being read from non-volatile memory.
+ *
  * @return esp_err_t Return code.
  */
 esp_err_t ConfigManager::initialize() {
-    return ESP_OK;
+    esp_err_t err = ESP_OK;
+
+    /** NVS is also used by the WiFi driver, so it is initialized on every boot. */
+    err = halNvsInitialize();
+    if (err != ESP_OK) return err;
+
+    /** Skip reading the config on wake from deep sleep. RTC memory is only retained through deep sleep. */
+    if ( halResetWasDeepSleep() && (rtcCopy.magic == CONFIG_RTC_MAGIC) ) {
+        config = rtcCopy.config;
+        memcpy(pressureCalibration, rtcCopy.pressureCalibration, sizeof(pressureCalibration));
+        config.pressureCalibrationTable = pressureCalibration;
+        generation = rtcCopy.generation;
+        _restoredFromRtc = true;
+        return ESP_OK;
+    }
+
+    _restoredFromRtc = false;
+    return refresh();
+}
+
+/**
+ * @brief Returns the config generation, incremented each time
+ * the config is persisted.
+ */
+uint32_t ConfigManager::getGeneration() {
+    return generation;
+}
+
+/**
+ * @brief If true, the config was restored from RTC memory on wake.
+ */
+bool ConfigManager::restoredFromRtc() {
+    return _restoredFromRtc;
 }
 
 /**
  * @brief Retrieve the application configuration.
- * 
+ *
  * @param config Overwritten with the configuration.
  * @return esp_err_t Return code.
  */
 esp_err_t ConfigManager::getConfig(Config_t &config) {
+    config = this->config;
     return ESP_OK;
 }
 
 /**
  * @brief Updates the in-memory config object on the class instance.
- * 
+ *
  * @param config New config.
  * @return esp_err_t Return code.
  */
 esp_err_t ConfigManager::setConfig(Config_t &config) {
+    /** Copy the table contents if the new config points to another table. */
+    if ( (config.pressureCalibrationTable != nullptr) && (config.pressureCalibrationTable != pressureCalibration) ) {
+        memcpy(pressureCalibration, config.pressureCalibrationTable, sizeof(pressureCalibration));
+    }
+
+    this->config = config;
+    this->config.pressureCalibrationTable = pressureCalibration;
     return ESP_OK;
 }
 
 /**
  * @brief Persists the current config to non-volatile memory.
- * 
+ *
  * @return esp_err_t Return code.
  */
 esp_err_t ConfigManager::persist() {
-    return ESP_OK;
+    esp_err_t err = ESP_OK;
+    HalNvs_t handle = 0;
+
+    err = halNvsOpen(CONFIG_NVS_NAMESPACE, true, handle);
+    if (err != ESP_OK) return err;
+
+    for (size_t i = 0; i < CONFIG_SECTION_COUNT; i++) {
+        err = halNvsSetBlob(handle, CONFIG_SECTIONS[i].key, reinterpret_cast<uint8_t*>(&config) + CONFIG_SECTIONS[i].offset, CONFIG_SECTIONS[i].size);
+        if (err != ESP_OK) goto exit;
+    }
+
+    err = halNvsSetU32(handle, CONFIG_NVS_KEY_VERSION, CONFIG_VERSION);
+    if (err != ESP_OK) goto exit;
+
+    err = halNvsSetBlob(handle, CONFIG_NVS_KEY_PRESSURE, pressureCalibration, sizeof(pressureCalibration));
+    if (err != ESP_OK) goto exit;
+
+    err = halNvsSetU32(handle, CONFIG_NVS_KEY_GENERATION, generation + 1);
+    if (err != ESP_OK) goto exit;
+
+    err = halNvsCommit(handle);
+    if (err != ESP_OK) goto exit;
+
+    generation++;
+    retain();
+
+exit:
+    halNvsClose(handle);
+    return err;
 }
 
 /**
- * @brief Refreshes the in-memory config object to the non-volatile values. 
- * 
+ * @brief Refreshes the in-memory config object to the non-volatile values.
+ *
  * @return esp_err_t Return code.
  */
 esp_err_t ConfigManager::refresh() {
+    esp_err_t err = ESP_OK;
+    HalNvs_t handle = 0;
+    uint32_t version = 0;
+    size_t length = 0;
+
+    err = halNvsOpen(CONFIG_NVS_NAMESPACE, false, handle);
+    if (err == ESP_ERR_NOT_FOUND) {
+        /** Nothing persisted yet. Keep the defaults. */
+        ESP_LOGI(TAG, "No persisted config, using defaults.");
+        retain();
+        return ESP_OK;
+    }
+    if (err != ESP_OK) return err;
+
+    /** A config of a later firmware may mean something else in the same layout, so only its credentials are read. */
+    err = halNvsGetU32(handle, CONFIG_NVS_KEY_VERSION, version);
+    if (err == ESP_ERR_NOT_FOUND) {
+        ESP_LOGI(TAG, "No persisted config, using defaults.");
+    } else if ( (err == ESP_OK) && (version == CONFIG_VERSION) ) {
+        loadSections(handle, false);
+    } else {
+        ESP_LOGW(TAG, "Persisted config of unknown version %lu, using defaults.", (unsigned long) version);
+        loadSections(handle, true);
+    }
+
+    length = sizeof(pressureCalibration);
+    err = halNvsGetBlob(handle, CONFIG_NVS_KEY_PRESSURE, pressureCalibration, length);
+    if ( (err != ESP_OK) || (length != sizeof(pressureCalibration)) ) {
+        memset(pressureCalibration, 0, sizeof(pressureCalibration));
+    }
+
+    err = halNvsGetU32(handle, CONFIG_NVS_KEY_GENERATION, generation);
+    if (err != ESP_OK) {
+        generation = 0;
+    }
+
+    halNvsClose(handle);
+    retain();
     return ESP_OK;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Copies the in-memory config into RTC memory so it
+ * survives deep sleep.
+ */
+void ConfigManager::retain() {
+    rtcCopy.config = config;
+    memcpy(rtcCopy.pressureCalibration, pressureCalibration, sizeof(pressureCalibration));
+    rtcCopy.generation = generation;
+    rtcCopy.magic = CONFIG_RTC_MAGIC;
+}
+
+/**
+ * @brief Reads the sections of the persisted config.
+ * 
+ * @param handle Open NVS handle.
+ * @param credentialsOnly If true, only the broker and credentials are read, as the
+ * config was persisted at another version.
+ */
+void ConfigManager::loadSections(HalNvs_t handle, bool credentialsOnly) {
+    esp_err_t err = ESP_OK;
+    /** Scratch space larger than any section, so a section persisted larger still reads. */
+    Config_t stored = {};
+    uint8_t *buffer = reinterpret_cast<uint8_t*>(&stored);
+    uint8_t *target = nullptr;
+    size_t length = 0;
+    bool connection = false;
+
+    for (size_t i = 0; i < CONFIG_SECTION_COUNT; i++) {
+        connection = (CONFIG_SECTIONS[i].offset == offsetof(Config_t, connection));
+        if ( credentialsOnly && (connection == false) ) {
+            continue;
+        }
+
+        target = reinterpret_cast<uint8_t*>(&config) + CONFIG_SECTIONS[i].offset;
+        length = sizeof(stored);
+        err = halNvsGetBlob(handle, CONFIG_SECTIONS[i].key, buffer, length);
+        if (err == ESP_ERR_NOT_FOUND) {
+            continue;
+        }
+
+        /** A size mismatch means the layout of the section changed between firmware versions. */
+        if ( (err == ESP_OK) && (length == CONFIG_SECTIONS[i].size) && (credentialsOnly == false) ) {
+            memcpy(target, buffer, length);
+        } else if ( (err == ESP_OK) && connection && (length >= CONFIG_CREDENTIALS_BYTES) ) {
+            memcpy(target, buffer, CONFIG_CREDENTIALS_BYTES);
+            ESP_LOGW(TAG, "Persisted connection config incompatible, kept the broker and credentials.");
+        } else {
+            ESP_LOGW(TAG, "Persisted %s config incompatible, using defaults.", CONFIG_SECTIONS[i].key);
+        }
+    }
+}
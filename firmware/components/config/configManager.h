@@ -2,10 +2,27 @@
 #define CONFIG_MANAGER_H
 
 #include "esp_err.h"
+#include "halNvs.h"
 #include "config.h"
 
+/** NVS namespace and keys of the persistent config. Each section of Config_t has a key of its own. */
+#define CONFIG_NVS_NAMESPACE "config"
+#define CONFIG_NVS_KEY_VERSION "version"
+#define CONFIG_NVS_KEY_PRESSURE "pressureCal"
+#define CONFIG_NVS_KEY_GENERATION "generation"
+
+/**
+ * Layout version of the persisted config. Version 1 persists each section of Config_t
+ * as a blob of its own, so a section which changed size falls back to its defaults alone.
+ * Bump it on a change a size does not show, such as a field changing its unit, and migrate.
+ */
+#define CONFIG_VERSION 1
+
 /**
  * @brief Handles reading from and writing to the persistent config.
+ * The broker URI, credentials and base topic lead ConnectionConfig_t, so they are kept
+ * when its size changes, and are the only part kept of a config of an unknown version,
+ * such as one written by a later firmware.
  */
 class ConfigManager {
 public:
@@ -15,12 +32,24 @@ public:
     ConfigManager();
  
     /**
-     * @brief Begins the ConfigManager.
+     * @brief Begins the ConfigManager. On wake from deep sleep, the config
+     * is restored from RTC memory instead of being read from non-volatile memory.
      * 
      * @return esp_err_t Return code.
      */
     esp_err_t initialize();
 
+    /**
+     * @brief Returns the config generation, incremented each time
+     * the config is persisted.
+     */
+    uint32_t getGeneration();
+
+    /**
+     * @brief If true, the config was restored from RTC memory on wake.
+     */
+    bool restoredFromRtc();
+
     /**
      * @brief Retrieve the application configuration.
      * 
@@ -54,6 +83,23 @@ public:
 private:
     Config_t config;
     PressureSensorCalibrationPoint_t pressureCalibration[MAX_PRESSURE_CALIBRATION_POINTS];
+    uint32_t generation;
+    bool _restoredFromRtc;
+
+    /**
+     * @brief Copies the in-memory config into RTC memory so it
+     * survives deep sleep.
+     */
+    void retain();
+
+    /**
+     * @brief Reads the sections of the persisted config.
+     * 
+     * @param handle Open NVS handle.
+     * @param credentialsOnly If true, only the broker and credentials are read, as the
+     * config was persisted at another version.
+     */
+    void loadSections(HalNvs_t handle, bool credentialsOnly);
 };
 
 #endif
\ No newline at end of file
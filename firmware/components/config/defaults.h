@@ -1,4 +1,70 @@
 #ifndef CONFIG_DEFAULTS_H
 #define CONFIG_DEFAULTS_H
 
+/** System. */
+#define SYSTEM_SLEEP_INTERVAL_DEFAULT 300
+#define SYSTEM_LIGHT_SLEEP_ENABLED_DEFAULT true
+#define SYSTEM_DEEP_SLEEP_ENABLED_DEFAULT false
+#define SYSTEM_DEEP_SLEEP_AWAKE_TIME_DEFAULT 5000
+#define SYSTEM_WAKE_GPIO_DEFAULT -1
+
+/** Connection. */
+#define CONNECTION_BROKER_URI_DEFAULT "mqtt://192.168.0.195:1883"
+#define CONNECTION_USERNAME_DEFAULT ""
+#define CONNECTION_PASSWORD_DEFAULT ""
+#define CONNECTION_BASE_TOPIC_DEFAULT "VD1/"
+#define CONNECTION_PERSISTENT_SESSION_DEFAULT true
+#define CONNECTION_BACKOFF_BASE_DEFAULT 1000
+#define CONNECTION_BACKOFF_MAX_DEFAULT 60000
+#define CONNECTION_CIRCUIT_THRESHOLD_DEFAULT 8
+#define CONNECTION_CIRCUIT_COOLDOWN_DEFAULT 600000
+#define CONNECTION_STATIC_IP_ENABLED_DEFAULT false
+
+/** Dispense. */
+#define DISPENSE_DATA_RESOLUTION_L_DEFAULT 0.2
+#define DISPENSE_RESUME_INTERRUPTED_DEFAULT false
+
+/** Valves. Pins not reserved by the esp32c3 are 0, 1, 3 to 7, and 10. The pressure sensor uses pin 1. */
+#define VALVES_SOURCE_PIN_DEFAULT 3
+#define VALVES_TANK_PIN_DEFAULT 4
+#define VALVES_DRAIN_PIN_DEFAULT 5
+#define VALVES_FLOW_SENSOR_PIN_DEFAULT 6
+#define VALVES_ZONE_COUNT_DEFAULT 0
+#define VALVES_OPEN_DELAY_DEFAULT 0
+#define VALVES_CLOSE_DELAY_DEFAULT 0
+/** Full duty throughout, like the legacy firmware, until the hold duty of the installed valves is known. */
+#define VALVES_PULL_IN_TIME_DEFAULT 150
+#define VALVES_HOLD_DUTY_DEFAULT 100
+
+/** Schedule. */
+#define SCHEDULE_TIMEZONE_DEFAULT "UTC0"
+#define SCHEDULE_NTP_SERVER_DEFAULT "pool.ntp.org"
+
+/** Source. */
+#define SOURCE_STATIC_FLOW_RATE_DEFAULT 12.45
+
+/** Tank. */
+#define TANK_SHAPE_DEFAULT TANK_CYLINDER
+#define TANK_DIMENSION_1_DEFAULT 0.4
+#define TANK_DIMENSION_2_DEFAULT 1.2
+#define TANK_DIMENSION_3_DEFAULT 0
+#define TANK_TIMEOUT_DEFAULT 10
+#define TANK_SWITCHOVER_FRACTION_DEFAULT 0.3
+#define TANK_SWITCHOVER_HYSTERESIS_DEFAULT 0.1
+#define TANK_SWITCHOVER_HORIZON_DEFAULT 10
+#define TANK_BLEND_ENABLED_DEFAULT false
+
+/** Flow sensor. */
+#define FLOW_PULSES_PER_L_DEFAULT 1265.289
+#define FLOW_MIN_FLOW_RATE_DEFAULT 0.2
+#define FLOW_CALIBRATION_TIMEOUT_DEFAULT 30
+#define FLOW_CALIBRATION_MAX_VOLUME_DEFAULT 0.5
+#define FLOW_RECALIBRATION_DEFAULT FLOW_RECALIBRATION_OFF
+
+/** Pressure sensor. */
+#define PRESSURE_REPORT_MODE_DEFAULT 3
+#define PRESSURE_PIN_DEFAULT 1
+#define PRESSURE_OFFSET_DEFAULT 400
+#define PRESSURE_GAIN_DEFAULT 0
+
 #endif
\ No newline at end of file
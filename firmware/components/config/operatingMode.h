@@ -0,0 +1,69 @@
+#ifndef OPERATING_MODE_H
+#define OPERATING_MODE_H
+
+#include "sdkconfig.h"
+
+/**
+ * @brief Describes the supplies and sensors a build of the firmware handles, as a policy
+ * of the components which depend on the topology. The flags are compile time constants,
+ * so the branches and topics of what is not installed compile out of a specialised build.
+ *
+ * @tparam source The source valve is installed.
+ * @tparam tank The tank valve is installed.
+ * @tparam drain The tank drain valve is installed.
+ * @tparam pressure The tank pressure sensor is installed.
+ * @tparam runtime If true, the installed valves and sensors are read from the config at runtime instead,
+ * and the flags only tell which may be installed.
+ */
+template <bool source, bool tank, bool drain, bool pressure, bool runtime = false>
+struct OperatingMode {
+    static_assert(source || tank, "A mode needs a supply.");
+    static_assert(tank || ((drain == false) && (pressure == false)), "The drain and the pressure sensor belong to the tank.");
+
+    static constexpr bool SOURCE = source;
+    static constexpr bool TANK = tank;
+    static constexpr bool DRAIN = drain;
+    static constexpr bool PRESSURE = pressure;
+    /** Blending, the switchover and its saving need both supplies. */
+    static constexpr bool BLEND = source && tank;
+    static constexpr bool RUNTIME = runtime;
+};
+
+/** Any topology, read from the valve config like the legacy firmware. The default. */
+typedef OperatingMode<true, true, true, true, true> RuntimeMode;
+/** Mains or pump only, with an optional flow sensor. */
+typedef OperatingMode<true, false, false, false> SourceMode;
+/** A gravity tank without a source. */
+template <bool drain, bool pressure>
+using TankMode = OperatingMode<false, true, drain, pressure>;
+/** A tank switching over to a source. */
+template <bool drain, bool pressure>
+using TankSourceMode = OperatingMode<true, true, drain, pressure>;
+
+/**
+ * The mode of the build, from the choice in menuconfig. The host build passes the same
+ * options as compile definitions.
+ */
+#ifdef CONFIG_DRIP_MODE_DRAIN
+#define DRIP_MODE_DRAIN true
+#else
+#define DRIP_MODE_DRAIN false
+#endif
+
+#ifdef CONFIG_DRIP_MODE_PRESSURE
+#define DRIP_MODE_PRESSURE true
+#else
+#define DRIP_MODE_PRESSURE false
+#endif
+
+#if defined(CONFIG_DRIP_MODE_SOURCE)
+typedef SourceMode DripMode;
+#elif defined(CONFIG_DRIP_MODE_TANK)
+typedef TankMode<DRIP_MODE_DRAIN, DRIP_MODE_PRESSURE> DripMode;
+#elif defined(CONFIG_DRIP_MODE_TANK_SOURCE)
+typedef TankSourceMode<DRIP_MODE_DRAIN, DRIP_MODE_PRESSURE> DripMode;
+#else
+typedef RuntimeMode DripMode;
+#endif
+
+#endif
\ No newline at end of file
@@ -1,60 +1,776 @@
+#include <cstdio>
+#include <cstring>
+
 #include "esp_err.h"
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "wifi_provisioning/manager.h"
+#include "wifi_provisioning/scheme_softap.h"
+
+#include "halMqtt.h"
+#include "halNvs.h"
+#include "halSystem.h"
+#include "halTime.h"
 
 #include "connectionManager.h"
 
 static const char* TAG = "ConnectionManager";
 
+/** Internal events driving the connection state machine. */
+ESP_EVENT_DEFINE_BASE(CONNECTION_EVENT);
+
+/** Marks the cached access point as valid. */
+#define CONNECTION_CACHE_MAGIC 0xCAC4E0A9
+
+/** Maximum number of scan results compared when choosing an access point. */
+#define CONNECTION_MAX_SCAN_RECORDS 4
+
+/** Maximum wait when forwarding an event onto the default event loop, in miliseconds. */
+#define CONNECTION_POST_TIMEOUT_MS 100
+
+/** Copy of the cached access point retained through deep sleep, so NVS is only read on cold boot. */
+static RTC_DATA_ATTR ConnectionCache_t rtcCache;
+
+/**
+ * @brief Returns the difference between two timestamps in miliseconds,
+ * or zero if the difference is negative.
+ */
+static uint32_t elapsedMs(int64_t start, int64_t end) {
+    if (end <= start) {
+        return 0;
+    }
+    return (end - start) / 1000;
+}
+
 /**
  * @brief Constructor.
  */
 ConnectionManager::ConnectionManager() {
-    return;
+    _isProvisioning = false;
+    _isConnected = false;
+    state = CONNECTION_IDLE;
+    config = {};
+    clientId[0] = '\0';
+    cache = {};
+    timing = {};
+    netif = nullptr;
+    apNetif = nullptr;
+    mqttClient = nullptr;
+    timer = nullptr;
+    mqttStarted = false;
+    wifiUp = false;
+    usingCache = false;
+    failures = 0;
+    attemptTime = 0;
+    scanTime = 0;
+    associateTime = 0;
+    connectedTime = 0;
+    gotIpTime = 0;
+    mqttStartTime = 0;
 }
 
 /**
  * @brief Begin the ConnectionManager.
- * 
+ *
  * @return esp_err_t Return code.
  */
 esp_err_t ConnectionManager::initialize() {
+    esp_err_t err = ESP_OK;
+    wifi_init_config_t wifiInitConfig = WIFI_INIT_CONFIG_DEFAULT();
+
+    err = halTimerCreate(&onTimer, this, "connection", &timer);
+    if (err != ESP_OK) return err;
+
+    err = esp_netif_init();
+    if (err != ESP_OK) return err;
+
+    /** The default loop may already have been created by another component. */
+    err = esp_event_loop_create_default();
+    if ( (err != ESP_OK) && (err != ESP_ERR_INVALID_STATE) ) return err;
+
+    netif = esp_netif_create_default_wifi_sta();
+    if (netif == nullptr) {
+        return ESP_FAIL;
+    }
+
+    err = esp_wifi_init(&wifiInitConfig);
+    if (err != ESP_OK) return err;
+
+    err = esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &onEvent, this, nullptr);
+    if (err != ESP_OK) return err;
+
+    err = esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &onEvent, this, nullptr);
+    if (err != ESP_OK) return err;
+
+    err = esp_event_handler_instance_register(CONNECTION_EVENT, ESP_EVENT_ANY_ID, &onEvent, this, nullptr);
+    if (err != ESP_OK) return err;
+
+    err = esp_wifi_set_mode(WIFI_MODE_STA);
+    if (err != ESP_OK) return err;
+
+    err = esp_wifi_start();
+    if (err != ESP_OK) return err;
+
+    loadCache();
+    return ESP_OK;
+}
+
+/**
+ * @brief Applies the connection config and creates the MQTT client.
+ * Takes effect on the next connection.
+ *
+ * @param config Connection config.
+ * @return esp_err_t Return code.
+ */
+esp_err_t ConnectionManager::configure(ConnectionConfig_t &config) {
+    esp_err_t err = ESP_OK;
+    HalMqttConfig_t mqttConfig = {};
+    uint8_t mac[6] = {};
+
+    this->config = config;
+
+    /** The broker identifies a persistent session by the client ID, so it is derived from the MAC address. */
+    err = halReadMac(mac);
+    if (err != ESP_OK) return err;
+    snprintf(clientId, sizeof(clientId), "drip-%02x%02x%02x%02x%02x%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+
+    /** Reconnection is driven by the backoff in this class rather than by the client. */
+    mqttConfig.uri = this->config.brokerUri;
+    mqttConfig.clientId = clientId;
+    mqttConfig.username = this->config.username;
+    mqttConfig.password = this->config.password;
+    mqttConfig.persistentSession = this->config.persistentSession;
+
+    if (mqttClient != nullptr) {
+        return halMqttSetConfig(mqttClient, mqttConfig);
+    }
+
+    err = halMqttCreate(mqttConfig, &mqttClient);
+    if (err != ESP_OK) return err;
+
+    err = halMqttRegister(mqttClient, &onMqttEvent, this);
+    if (err != ESP_OK) return err;
+
     return ESP_OK;
 }
 
 /**
  * @brief If true, the ConnectionManager is currently provisioning.
- * 
- * @returns The isProvisioning flag. 
+ *
+ * @returns The isProvisioning flag.
  */
 bool ConnectionManager::isProvisioning() {
-    return true;
+    return _isProvisioning;
 }
 
 /**
  * @brief If true, the ConnectionManager has successful WiFi
  * and MQTT connection.
- * 
+ *
  * @returns the isConnected flag.
  */
 bool ConnectionManager::isConnected() {
-    return true;
+    return _isConnected;
 }
 
 /**
- * @brief Attempts to initiate a WiFi and MQTT connection.
- * Blocks until the connection is resolved or failed.
- * 
- * @param connected If set to true, the connection succeeded.
+ * @brief If true, a connection attempt is in progress, as opposed to
+ * being connected or waiting out a backoff delay.
+ */
+bool ConnectionManager::isConnecting() {
+    return (state == CONNECTION_ASSOCIATING) || (state == CONNECTION_SCANNING) || (state == CONNECTION_MQTT_CONNECTING);
+}
+
+/**
+ * @brief If true, WiFi credentials are stored and provisioning is not needed.
+ */
+bool ConnectionManager::hasCredentials() {
+    wifi_config_t wifiConfig = {};
+
+    if (esp_wifi_get_config(WIFI_IF_STA, &wifiConfig) != ESP_OK) {
+        return false;
+    }
+
+    return wifiConfig.sta.ssid[0] != '\0';
+}
+
+/**
+ * @brief Returns the current state of the connection.
+ */
+ConnectionStates_e ConnectionManager::getState() {
+    return state;
+}
+
+/**
+ * @brief Starts connecting WiFi and MQTT if not already started.
+ * Does not block. Reconnection after any failure is handled internally
+ * with exponential backoff, jitter, and a circuit breaker.
+ *
+ * @param connected Set to the current connection status.
  * @return esp_err_t Return code.
  */
 esp_err_t ConnectionManager::connect(bool &connected) {
-    return ESP_OK;
+    connected = _isConnected;
+
+    if (state != CONNECTION_IDLE) {
+        return ESP_OK;
+    }
+    if (mqttClient == nullptr) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    /** Run the first attempt on the event loop, like every later transition. */
+    return esp_event_post(CONNECTION_EVENT, CONNECTION_EVENT_TIMEOUT, nullptr, 0, pdMS_TO_TICKS(CONNECTION_POST_TIMEOUT_MS));
 }
 
 /**
- * @brief Begins the provisioning process.
- * 
+ * @brief Begins provisioning the WiFi credentials over an access point named
+ * after the MAC address. The credentials are stored by the WiFi driver, and
+ * provisioning ends once they connect. Does not block.
+ *
  * @return esp_err_t Return code.
  */
 esp_err_t ConnectionManager::beginProvisioning() {
+    esp_err_t err = ESP_OK;
+    wifi_prov_mgr_config_t provisioningConfig = {};
+    char serviceName[CONNECTION_CLIENT_ID_MAX_BYTES];
+    uint8_t mac[6] = {};
+
+    if (_isProvisioning) {
+        return ESP_OK;
+    }
+
+    /** The access point is only needed for provisioning, so it is created on the first. */
+    if (apNetif == nullptr) {
+        apNetif = esp_netif_create_default_wifi_ap();
+        if (apNetif == nullptr) {
+            return ESP_FAIL;
+        }
+
+        err = esp_event_handler_instance_register(WIFI_PROV_EVENT, ESP_EVENT_ANY_ID, &onProvisioningEvent, this, nullptr);
+        if (err != ESP_OK) return err;
+    }
+
+    err = halReadMac(mac);
+    if (err != ESP_OK) return err;
+    snprintf(serviceName, sizeof(serviceName), "drip-%02x%02x%02x", mac[3], mac[4], mac[5]);
+
+    provisioningConfig.scheme = wifi_prov_scheme_softap;
+    provisioningConfig.scheme_event_handler = WIFI_PROV_EVENT_HANDLER_NONE;
+    err = wifi_prov_mgr_init(provisioningConfig);
+    if (err != ESP_OK) return err;
+
+    /** The session is encrypted with the proof of possession, so the access point itself is open. */
+    _isProvisioning = true;
+    err = wifi_prov_mgr_start_provisioning(WIFI_PROV_SECURITY_1, CONFIG_DRIP_PROVISIONING_POP, serviceName, nullptr);
+    if (err != ESP_OK) goto err;
+
+    ESP_LOGI(TAG, "No WiFi credentials stored, provisioning over access point %s.", serviceName);
+    return ESP_OK;
+
+err:
+    _isProvisioning = false;
+    wifi_prov_mgr_deinit();
+    return err;
+}
+
+/**
+ * @brief Retrieves the duration of each phase of the last connection.
+ *
+ * @param timing Overwritten with the timing.
+ * @return esp_err_t Return code.
+ */
+esp_err_t ConnectionManager::getTiming(ConnectionTiming_t &timing) {
+    timing = this->timing;
+    return ESP_OK;
+}
+
+/**
+ * @brief Returns the MQTT client handle, or null before configure().
+ */
+HalMqttClient_t ConnectionManager::getMqttClient() {
+    return mqttClient;
+}
+
+/**
+ * @brief Handles WiFi, IP, and internal connection events. All state
+ * transitions happen here, on the default event loop task.
+ */
+void ConnectionManager::onEvent(void *arg, const char *base, int32_t id, void *data) {
+    ConnectionManager *self = static_cast<ConnectionManager*>(arg);
+    esp_netif_ip_info_t ipInfo = {};
+    esp_netif_dns_info_t dnsInfo = {};
+    uint8_t bssid[6] = {};
+    uint8_t channel = 0;
+
+    bool timeout = (base == CONNECTION_EVENT) && (id == CONNECTION_EVENT_TIMEOUT);
+    bool staDisconnected = (base == WIFI_EVENT) && (id == WIFI_EVENT_STA_DISCONNECTED);
+    bool mqttDisconnected = (base == CONNECTION_EVENT) && (id == CONNECTION_EVENT_MQTT_DISCONNECTED);
+
+    /** Track link state and phase timestamps regardless of the current state. */
+    if ( (base == WIFI_EVENT) && (id == WIFI_EVENT_STA_CONNECTED) ) {
+        self->connectedTime = halTimeMicros();
+
+        /** Skip DHCP entirely when a static IP is configured. */
+        if (self->config.staticIpEnabled) {
+            esp_netif_dhcpc_stop(self->netif);
+            ipInfo.ip.addr = self->config.staticIp;
+            ipInfo.gw.addr = self->config.gateway;
+            ipInfo.netmask.addr = self->config.netmask;
+            esp_netif_set_ip_info(self->netif, &ipInfo);
+            dnsInfo.ip.type = ESP_IPADDR_TYPE_V4;
+            dnsInfo.ip.u_addr.ip4.addr = self->config.dns;
+            esp_netif_set_dns_info(self->netif, ESP_NETIF_DNS_MAIN, &dnsInfo);
+        }
+        return;
+    }
+    if (staDisconnected) {
+        self->wifiUp = false;
+    }
+
+    switch (self->state) {
+        case CONNECTION_IDLE:
+        case CONNECTION_BACKOFF:
+        case CONNECTION_CIRCUIT_OPEN:
+            if (timeout) {
+                self->attempt();
+            }
+            break;
+
+        case CONNECTION_ASSOCIATING:
+            if ( (base == IP_EVENT) && (id == IP_EVENT_STA_GOT_IP) ) {
+                halTimerStop(self->timer);
+                self->gotIpTime = halTimeMicros();
+                self->wifiUp = true;
+                self->timing.auth = elapsedMs(self->associateTime, self->connectedTime);
+                self->timing.dhcp = elapsedMs(self->connectedTime, self->gotIpTime);
+                self->storeCache();
+
+                if (self->startMqtt() != ESP_OK) {
+                    self->fail();
+                    break;
+                }
+                self->state = CONNECTION_MQTT_CONNECTING;
+                self->armTimer(CONNECTION_MQTT_TIMEOUT_MS);
+
+            } else if (staDisconnected || timeout) {
+                halTimerStop(self->timer);
+                esp_wifi_disconnect();
+
+                /** The cached access point is gone or moved. Fall back to a full scan. */
+                if (self->usingCache) {
+                    ESP_LOGW(TAG, "Cached access point unavailable, falling back to a full scan.");
+                    self->usingCache = false;
+                    self->clearCache();
+                    if (self->startScan() == ESP_OK) {
+                        break;
+                    }
+                }
+                self->fail();
+            }
+            break;
+
+        case CONNECTION_SCANNING:
+            if ( (base == WIFI_EVENT) && (id == WIFI_EVENT_SCAN_DONE) ) {
+                halTimerStop(self->timer);
+                self->timing.scan = elapsedMs(self->scanTime, halTimeMicros());
+                if ( (self->selectAccessPoint(bssid, channel) != ESP_OK) || (self->associate(bssid, channel) != ESP_OK) ) {
+                    self->fail();
+                    break;
+                }
+                self->armTimer(CONNECTION_FULL_TIMEOUT_MS);
+
+            } else if (timeout) {
+                esp_wifi_scan_stop();
+                self->fail();
+            }
+            break;
+
+        case CONNECTION_MQTT_CONNECTING:
+            if ( (base == CONNECTION_EVENT) && (id == CONNECTION_EVENT_MQTT_CONNECTED) ) {
+                halTimerStop(self->timer);
+                self->succeed();
+
+            } else if (staDisconnected || mqttDisconnected || timeout) {
+                halTimerStop(self->timer);
+                self->fail();
+            }
+            break;
+
+        case CONNECTION_CONNECTED:
+            if (staDisconnected || mqttDisconnected) {
+                ESP_LOGW(TAG, "Connection lost.");
+                self->fail();
+            }
+            break;
+    }
+}
+
+/**
+ * @brief Forwards MQTT client events onto the default event loop.
+ */
+void ConnectionManager::onMqttEvent(void *arg, HalMqttEvent_t &event) {
+    switch (event.id) {
+        case HAL_MQTT_EVENT_CONNECTED:
+            esp_event_post(CONNECTION_EVENT, CONNECTION_EVENT_MQTT_CONNECTED, nullptr, 0, pdMS_TO_TICKS(CONNECTION_POST_TIMEOUT_MS));
+            break;
+
+        case HAL_MQTT_EVENT_DISCONNECTED:
+            esp_event_post(CONNECTION_EVENT, CONNECTION_EVENT_MQTT_DISCONNECTED, nullptr, 0, pdMS_TO_TICKS(CONNECTION_POST_TIMEOUT_MS));
+            break;
+
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Forwards timer expiry onto the default event loop.
+ */
+void ConnectionManager::onTimer(void *arg) {
+    esp_event_post(CONNECTION_EVENT, CONNECTION_EVENT_TIMEOUT, nullptr, 0, 0);
+}
+
+/**
+ * @brief Handles the events of the provisioning manager, on the default event loop task.
+ */
+void ConnectionManager::onProvisioningEvent(void *arg, const char *base, int32_t id, void *data) {
+    ConnectionManager *self = static_cast<ConnectionManager*>(arg);
+
+    switch (id) {
+        case WIFI_PROV_CRED_FAIL:
+            /** Wrong credentials are not stored, and the access point takes new ones. */
+            ESP_LOGW(TAG, "Provisioned credentials failed to connect.");
+            wifi_prov_mgr_reset_sm_state_on_failure();
+            break;
+
+        case WIFI_PROV_CRED_SUCCESS:
+            ESP_LOGI(TAG, "Provisioned credentials connected.");
+            break;
+
+        case WIFI_PROV_END:
+            /** Hand the station back to the state machine, which connects from the start as after a boot. */
+            wifi_prov_mgr_deinit();
+            esp_wifi_disconnect();
+            esp_wifi_set_mode(WIFI_MODE_STA);
+            self->_isProvisioning = false;
+            break;
+
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Begins a connection attempt from the first phase not already complete.
+ */
+void ConnectionManager::attempt() {
+    attemptTime = halTimeMicros();
+    timing = {};
+    timing.failures = failures;
+
+    /** WiFi is still up, only MQTT needs to reconnect. */
+    if (wifiUp) {
+        if (startMqtt() != ESP_OK) {
+            fail();
+            return;
+        }
+        state = CONNECTION_MQTT_CONNECTING;
+        armTimer(CONNECTION_MQTT_TIMEOUT_MS);
+        return;
+    }
+
+    /** Try a directed association to the cached access point. */
+    if (cache.magic == CONNECTION_CACHE_MAGIC) {
+        usingCache = true;
+        if (associate(cache.bssid, cache.channel) == ESP_OK) {
+            armTimer(CONNECTION_FAST_TIMEOUT_MS);
+            return;
+        }
+        clearCache();
+    }
+
+    /** Otherwise scan all channels first. */
+    usingCache = false;
+    if (startScan() != ESP_OK) {
+        fail();
+    }
+}
+
+/**
+ * @brief Records a successful connection and resets the failure count.
+ */
+void ConnectionManager::succeed() {
+    int64_t now = halTimeMicros();
+
+    timing.fastPath = usingCache;
+    timing.mqtt = elapsedMs(mqttStartTime, now);
+    timing.total = elapsedMs(attemptTime, now);
+
+    ESP_LOGI(TAG, "Connected via %s in %lu ms after %lu failures (scan %lu, auth %lu, dhcp %lu, mqtt %lu).",
+        timing.fastPath ? "cache" : "scan",
+        (unsigned long) timing.total,
+        (unsigned long) timing.failures,
+        (unsigned long) timing.scan,
+        (unsigned long) timing.auth,
+        (unsigned long) timing.dhcp,
+        (unsigned long) timing.mqtt
+    );
+
+    failures = 0;
+    state = CONNECTION_CONNECTED;
+    _isConnected = true;
+
+    /** Keep the station associated through light sleep. */
+    enableModemSleep();
+}
+
+/**
+ * @brief Records a failed attempt and schedules the next one after
+ * a jittered exponential backoff, or opens the circuit.
+ */
+void ConnectionManager::fail() {
+    uint32_t delay = 0;
+
+    _isConnected = false;
+    failures++;
+
+    /**
+     * Once open, the circuit stays open after every failed trial attempt,
+     * since the failure count is only reset by a successful connection.
+     */
+    if ( (config.circuitThreshold > 0) && (failures >= config.circuitThreshold) ) {
+        delay = config.circuitCooldown + (halRandom() % (config.circuitCooldown / 4 + 1));
+        state = CONNECTION_CIRCUIT_OPEN;
+        ESP_LOGW(TAG, "Circuit open after %lu failures, next attempt in %lu ms.", (unsigned long) failures, (unsigned long) delay);
+    } else {
+        delay = backoffDelay();
+        state = CONNECTION_BACKOFF;
+        ESP_LOGI(TAG, "Connection attempt %lu failed, next attempt in %lu ms.", (unsigned long) failures, (unsigned long) delay);
+    }
+
+    armTimer(delay);
+}
+
+/**
+ * @brief Requests an association with an access point.
+ *
+ * @param bssid Access point to associate, or null for any.
+ * @param channel Channel of the access point, or zero for all.
+ * @return esp_err_t Return code.
+ */
+esp_err_t ConnectionManager::associate(const uint8_t *bssid, uint8_t channel) {
+    esp_err_t err = ESP_OK;
+    wifi_config_t wifiConfig = {};
+
+    err = esp_wifi_get_config(WIFI_IF_STA, &wifiConfig);
+    if (err != ESP_OK) return err;
+
+    /** A known BSSID and channel skips the scan done by the driver before associating. */
+    if (bssid != nullptr) {
+        memcpy(wifiConfig.sta.bssid, bssid, sizeof(wifiConfig.sta.bssid));
+        wifiConfig.sta.bssid_set = true;
+        wifiConfig.sta.channel = channel;
+        wifiConfig.sta.scan_method = WIFI_FAST_SCAN;
+    } else {
+        wifiConfig.sta.bssid_set = false;
+        wifiConfig.sta.channel = 0;
+        wifiConfig.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+    }
+
+    err = esp_wifi_set_config(WIFI_IF_STA, &wifiConfig);
+    if (err != ESP_OK) return err;
+
+    associateTime = halTimeMicros();
+    err = esp_wifi_connect();
+    if (err != ESP_OK) return err;
+
+    state = CONNECTION_ASSOCIATING;
+    return ESP_OK;
+}
+
+/**
+ * @brief Starts a scan of all channels for the configured SSID.
+ *
+ * @return esp_err_t Return code.
+ */
+esp_err_t ConnectionManager::startScan() {
+    esp_err_t err = ESP_OK;
+    wifi_config_t wifiConfig = {};
+    wifi_scan_config_t scanConfig = {};
+
+    err = esp_wifi_get_config(WIFI_IF_STA, &wifiConfig);
+    if (err != ESP_OK) return err;
+
+    /** Only report access points of the configured network. */
+    scanConfig.ssid = wifiConfig.sta.ssid;
+    scanConfig.scan_type = WIFI_SCAN_TYPE_ACTIVE;
+    scanTime = halTimeMicros();
+    err = esp_wifi_scan_start(&scanConfig, false);
+    if (err != ESP_OK) return err;
+
+    state = CONNECTION_SCANNING;
+    armTimer(CONNECTION_SCAN_TIMEOUT_MS);
+    return ESP_OK;
+}
+
+/**
+ * @brief Selects the strongest access point from the scan results.
+ *
+ * @param bssid Overwritten with the strongest access point found.
+ * @param channel Overwritten with the channel of the access point.
+ * @return esp_err_t Return code. ESP_ERR_NOT_FOUND if no access point was found.
+ */
+esp_err_t ConnectionManager::selectAccessPoint(uint8_t *bssid, uint8_t &channel) {
+    esp_err_t err = ESP_OK;
+    wifi_ap_record_t records[CONNECTION_MAX_SCAN_RECORDS] = {};
+    uint16_t count = CONNECTION_MAX_SCAN_RECORDS;
+    int strongest = -1;
+
+    err = esp_wifi_scan_get_ap_records(&count, records);
+    if (err != ESP_OK) return err;
+
+    for (int i = 0; i < count; i++) {
+        if ( (strongest < 0) || (records[i].rssi > records[strongest].rssi) ) {
+            strongest = i;
+        }
+    }
+    if (strongest < 0) {
+        ESP_LOGW(TAG, "No access point found.");
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    memcpy(bssid, records[strongest].bssid, sizeof(records[strongest].bssid));
+    channel = records[strongest].primary;
     return ESP_OK;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Starts or reconnects the MQTT client.
+ *
+ * @return esp_err_t Return code.
+ */
+esp_err_t ConnectionManager::startMqtt() {
+    esp_err_t err = ESP_OK;
+
+    mqttStartTime = halTimeMicros();
+    if (mqttStarted) {
+        return halMqttReconnect(mqttClient);
+    }
+
+    err = halMqttStart(mqttClient);
+    if (err != ESP_OK) return err;
+
+    mqttStarted = true;
+    return ESP_OK;
+}
+
+/**
+ * @brief Arms the state timer.
+ *
+ * @param timeout Time until expiry in miliseconds.
+ */
+void ConnectionManager::armTimer(uint32_t timeout) {
+    halTimerStop(timer);
+    halTimerStartOnce(timer, (uint64_t) timeout * 1000);
+}
+
+/**
+ * @brief Returns the backoff delay after the current number of failures,
+ * with random jitter over the upper half of the delay.
+ */
+uint32_t ConnectionManager::backoffDelay() {
+    uint32_t exponent = (failures > 16) ? 16 : failures - 1;
+    uint64_t delay = (uint64_t) config.backoffBase << exponent;
+
+    if (delay > config.backoffMax) {
+        delay = config.backoffMax;
+    }
+
+    /** Spread devices that failed together, e.g. after an access point reboot, across the window. */
+    return (delay / 2) + (halRandom() % (delay / 2 + 1));
+}
+
+/**
+ * @brief Loads the cached access point from RTC memory, or NVS on cold boot.
+ */
+void ConnectionManager::loadCache() {
+    HalNvs_t handle = 0;
+    size_t length = sizeof(cache);
+
+    if (rtcCache.magic == CONNECTION_CACHE_MAGIC) {
+        cache = rtcCache;
+        return;
+    }
+
+    cache = {};
+    if (halNvsOpen(CONNECTION_NVS_NAMESPACE, false, handle) != ESP_OK) {
+        return;
+    }
+    if ( (halNvsGetBlob(handle, CONNECTION_NVS_KEY_CACHE, &cache, length) != ESP_OK) || (length != sizeof(cache)) ) {
+        cache = {};
+    }
+    halNvsClose(handle);
+
+    rtcCache = cache;
+}
+
+/**
+ * @brief Stores the access point of the current connection if it changed.
+ */
+void ConnectionManager::storeCache() {
+    wifi_ap_record_t apInfo = {};
+    HalNvs_t handle = 0;
+
+    if (esp_wifi_sta_get_ap_info(&apInfo) != ESP_OK) {
+        return;
+    }
+
+    /** Avoid flash writes when reconnecting to the same access point. */
+    if ( (cache.magic == CONNECTION_CACHE_MAGIC) &&
+        (memcmp(cache.bssid, apInfo.bssid, sizeof(cache.bssid)) == 0) &&
+        (cache.channel == apInfo.primary) ) {
+        return;
+    }
+
+    memcpy(cache.bssid, apInfo.bssid, sizeof(cache.bssid));
+    cache.channel = apInfo.primary;
+    cache.magic = CONNECTION_CACHE_MAGIC;
+    rtcCache = cache;
+
+    if (halNvsOpen(CONNECTION_NVS_NAMESPACE, true, handle) != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to persist the cached access point.");
+        return;
+    }
+    if (halNvsSetBlob(handle, CONNECTION_NVS_KEY_CACHE, &cache, sizeof(cache)) == ESP_OK) {
+        halNvsCommit(handle);
+    }
+    halNvsClose(handle);
+}
+
+/**
+ * @brief Invalidates the cached access point.
+ */
+void ConnectionManager::clearCache() {
+    cache.magic = 0;
+    rtcCache.magic = 0;
+}
+
+/**
+ * @brief Enables WiFi modem sleep aligned to the AP DTIM interval,
+ * so the station stays associated while the chip is in light sleep.
+ *
+ * @return esp_err_t Return code.
+ */
+esp_err_t ConnectionManager::enableModemSleep() {
+    esp_err_t err = esp_wifi_set_ps(WIFI_PS_MIN_MODEM);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to enable modem sleep: %s", esp_err_to_name(err));
+    }
+
+    return err;
+}
@@ -1,10 +1,98 @@
 #ifndef CONNECTION_MANAGER_H
 #define CONNECTION_MANAGER_H
 
+#include <stdint.h>
+
 #include "esp_err.h"
 
+#include "halMqtt.h"
+#include "halTime.h"
+
+#include "config.h"
+
+/** NVS namespace and key of the cached access point. */
+#define CONNECTION_NVS_NAMESPACE "connection"
+#define CONNECTION_NVS_KEY_CACHE "apCache"
+
+/** Maximum length of the MQTT client ID. */
+#define CONNECTION_CLIENT_ID_MAX_BYTES 24
+
+/** Time to wait for a directed association to the cached access point, in miliseconds. */
+#define CONNECTION_FAST_TIMEOUT_MS 4000
+/** Time to wait for a scan of all channels, in miliseconds. */
+#define CONNECTION_SCAN_TIMEOUT_MS 10000
+/** Time to wait for an association after a full scan, in miliseconds. */
+#define CONNECTION_FULL_TIMEOUT_MS 15000
+/** Time to wait for the MQTT broker to accept the connection, in miliseconds. */
+#define CONNECTION_MQTT_TIMEOUT_MS 10000
+
+typedef enum ConnectionEvents_e {
+    /** The timer of the current state expired. */
+    CONNECTION_EVENT_TIMEOUT,
+    /** The MQTT broker accepted the connection. */
+    CONNECTION_EVENT_MQTT_CONNECTED,
+    /** The MQTT connection was lost or refused. */
+    CONNECTION_EVENT_MQTT_DISCONNECTED
+} ConnectionEvents_e;
+
+/**
+ * @brief Describes the possible states of the connection.
+ */
+typedef enum ConnectionStates_e {
+    /** Not started, or no credentials are stored. */
+    CONNECTION_IDLE,
+    /** Waiting for an association and an IP address. */
+    CONNECTION_ASSOCIATING,
+    /** Scanning all channels for the configured SSID. */
+    CONNECTION_SCANNING,
+    /** Waiting for the MQTT broker to accept the connection. */
+    CONNECTION_MQTT_CONNECTING,
+    /** WiFi and MQTT are connected. */
+    CONNECTION_CONNECTED,
+    /** Waiting out an exponential backoff delay after a failure. */
+    CONNECTION_BACKOFF,
+    /** Too many consecutive failures. Waiting out the cooldown before a single trial attempt. */
+    CONNECTION_CIRCUIT_OPEN
+} ConnectionStates_e;
+
+/**
+ * @brief Describes the access point of the last successful connection.
+ */
+typedef struct ConnectionCache_t {
+    uint32_t magic = 0;
+    uint8_t bssid[6] = {};
+    uint8_t channel = 0;
+} ConnectionCache_t;
+
+/**
+ * @brief Describes the duration of each phase of the last connection, in miliseconds.
+ */
+typedef struct ConnectionTiming_t {
+    /** If true, the cached access point was associated without a scan. */
+    bool fastPath = false;
+    /** Number of failed attempts before this connection. */
+    uint32_t failures = 0;
+    /** Time spent scanning all channels. Zero on the fast path. */
+    uint32_t scan = 0;
+    /** Time from the association request to the station being connected. */
+    uint32_t auth = 0;
+    /** Time from the station being connected to an IP address being assigned. */
+    uint32_t dhcp = 0;
+    /** Time from the MQTT client starting to the broker accepting the connection. */
+    uint32_t mqtt = 0;
+    /** Total time of the successful attempt. */
+    uint32_t total = 0;
+} ConnectionTiming_t;
+
 /**
  * @brief Handles connecting and provisioning WiFi and MQTT.
+ * The connection is driven entirely by WiFi, IP, and MQTT events,
+ * so no caller ever blocks on it.
+ *
+ * Each attempt first associates directly with the cached access point of the last connection,
+ * which needs no scan, and falls back to a scan of all channels for the strongest one.
+ * The backoff between attempts is jittered over the upper half of its delay, so units behind
+ * the same access point do not reconnect in lockstep.
  */
 class ConnectionManager {
 public:
@@ -15,45 +103,214 @@ public:
 
     /**
      * @brief Begin the ConnectionManager.
-     * 
+     *
      * @return esp_err_t Return code.
      */
     esp_err_t initialize();
 
+    /**
+     * @brief Applies the connection config and creates the MQTT client.
+     * Takes effect on the next connection.
+     *
+     * @param config Connection config.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t configure(ConnectionConfig_t &config);
+
     /**
      * @brief If true, the ConnectionManager is currently provisioning.
-     * 
-     * @returns The isProvisioning flag. 
+     *
+     * @returns The isProvisioning flag.
      */
     bool isProvisioning();
 
     /**
      * @brief If true, the ConnectionManager has successful WiFi
      * and MQTT connection.
-     * 
+     *
      * @returns the isConnected flag.
      */
     bool isConnected();
 
     /**
-     * @brief Attempts to initiate a WiFi and MQTT connection.
-     * Blocks until the connection is resolved or failed.
-     * 
-     * @param connected If set to true, the connection succeeded.
+     * @brief If true, a connection attempt is in progress, as opposed to
+     * being connected or waiting out a backoff delay.
+     */
+    bool isConnecting();
+
+    /**
+     * @brief If true, WiFi credentials are stored and provisioning is not needed.
+     */
+    bool hasCredentials();
+
+    /**
+     * @brief Returns the current state of the connection.
+     */
+    ConnectionStates_e getState();
+
+    /**
+     * @brief Starts connecting WiFi and MQTT if not already started.
+     * Does not block. Reconnection after any failure is handled internally
+     * with exponential backoff, jitter, and a circuit breaker.
+     *
+     * @param connected Set to the current connection status.
      * @return esp_err_t Return code.
      */
     esp_err_t connect(bool &connected);
 
     /**
-     * @brief Begins the provisioning process.
-     * 
+     * @brief Begins provisioning the WiFi credentials over an access point named
+     * after the MAC address. The credentials are stored by the WiFi driver, and
+     * provisioning ends once they connect. Does not block.
+     *
      * @return esp_err_t Return code.
      */
     esp_err_t beginProvisioning();
 
+    /**
+     * @brief Retrieves the duration of each phase of the last connection.
+     *
+     * @param timing Overwritten with the timing.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t getTiming(ConnectionTiming_t &timing);
+
+    /**
+     * @brief Returns the MQTT client handle, or null before configure().
+     */
+    HalMqttClient_t getMqttClient();
+
 private:
-    bool _isProvisioning;
-    bool _isConnected;
+    volatile bool _isProvisioning;
+    volatile bool _isConnected;
+    volatile ConnectionStates_e state;
+    ConnectionConfig_t config;
+    char clientId[CONNECTION_CLIENT_ID_MAX_BYTES];
+    ConnectionCache_t cache;
+    ConnectionTiming_t timing;
+    /** The esp_netif_t of the station, declared opaquely so the header builds on the host. */
+    struct esp_netif_obj *netif;
+    /** The esp_netif_t of the access point, created once provisioning begins. */
+    struct esp_netif_obj *apNetif;
+    HalMqttClient_t mqttClient;
+    HalTimer_t timer;
+    bool mqttStarted;
+    bool wifiUp;
+    bool usingCache;
+    uint32_t failures;
+
+    /** Timestamps of the connection phases, in microseconds. */
+    int64_t attemptTime;
+    int64_t scanTime;
+    int64_t associateTime;
+    int64_t connectedTime;
+    int64_t gotIpTime;
+    int64_t mqttStartTime;
+
+    /**
+     * @brief Handles WiFi, IP, and internal connection events. All state
+     * transitions happen here, on the default event loop task.
+     */
+    static void onEvent(void *arg, const char *base, int32_t id, void *data);
+
+    /**
+     * @brief Forwards MQTT client events onto the default event loop.
+     */
+    static void onMqttEvent(void *arg, HalMqttEvent_t &event);
+
+    /**
+     * @brief Forwards timer expiry onto the default event loop.
+     */
+    static void onTimer(void *arg);
+
+    /**
+     * @brief Handles the events of the provisioning manager, on the default event loop task.
+     */
+    static void onProvisioningEvent(void *arg, const char *base, int32_t id, void *data);
+
+    /**
+     * @brief Begins a connection attempt from the first phase not already complete.
+     */
+    void attempt();
+
+    /**
+     * @brief Records a successful connection and resets the failure count.
+     */
+    void succeed();
+
+    /**
+     * @brief Records a failed attempt and schedules the next one after
+     * a jittered exponential backoff, or opens the circuit.
+     */
+    void fail();
+
+    /**
+     * @brief Requests an association with an access point.
+     *
+     * @param bssid Access point to associate, or null for any.
+     * @param channel Channel of the access point, or zero for all.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t associate(const uint8_t *bssid, uint8_t channel);
+
+    /**
+     * @brief Starts a scan of all channels for the configured SSID.
+     *
+     * @return esp_err_t Return code.
+     */
+    esp_err_t startScan();
+
+    /**
+     * @brief Selects the strongest access point from the scan results.
+     *
+     * @param bssid Overwritten with the strongest access point found.
+     * @param channel Overwritten with the channel of the access point.
+     * @return esp_err_t Return code. ESP_ERR_NOT_FOUND if no access point was found.
+     */
+    esp_err_t selectAccessPoint(uint8_t *bssid, uint8_t &channel);
+
+    /**
+     * @brief Starts or reconnects the MQTT client.
+     *
+     * @return esp_err_t Return code.
+     */
+    esp_err_t startMqtt();
+
+    /**
+     * @brief Arms the state timer.
+     *
+     * @param timeout Time until expiry in miliseconds.
+     */
+    void armTimer(uint32_t timeout);
+
+    /**
+     * @brief Returns the backoff delay after the current number of failures,
+     * with random jitter over the upper half of the delay.
+     */
+    uint32_t backoffDelay();
+
+    /**
+     * @brief Loads the cached access point from RTC memory, or NVS on cold boot.
+     */
+    void loadCache();
+
+    /**
+     * @brief Stores the access point of the current connection if it changed.
+     */
+    void storeCache();
+
+    /**
+     * @brief Invalidates the cached access point.
+     */
+    void clearCache();
+
+    /**
+     * @brief Enables WiFi modem sleep aligned to the AP DTIM interval,
+     * so the station stays associated while the chip is in light sleep.
+     *
+     * @return esp_err_t Return code.
+     */
+    esp_err_t enableModemSleep();
 };
 
-#endif
\ No newline at end of file
+#endif
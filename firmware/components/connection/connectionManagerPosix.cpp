@@ -0,0 +1,372 @@
+#include <cstdio>
+#include <cstring>
+
+#include "esp_err.h"
+#include "esp_log.h"
+
+#include "halMqtt.h"
+#include "halSystem.h"
+#include "halTime.h"
+#include "halPosix.h"
+
+#include "connectionManager.h"
+
+static const char* TAG = "ConnectionManager";
+
+/**
+ * Host build of the ConnectionManager. There is no WiFi on the host, so the
+ * link is always up and only the MQTT connection to the loopback broker of
+ * the HAL is driven, with the same backoff and circuit breaker as the device.
+ */
+
+/** Internal events driving the connection state machine. */
+static const char CONNECTION_EVENT[] = "CONNECTION_EVENT";
+
+/**
+ * @brief Returns the difference between two timestamps in miliseconds,
+ * or zero if the difference is negative.
+ */
+static uint32_t elapsedMs(int64_t start, int64_t end) {
+    if (end <= start) {
+        return 0;
+    }
+    return (end - start) / 1000;
+}
+
+/**
+ * @brief Constructor.
+ */
+ConnectionManager::ConnectionManager() {
+    _isProvisioning = false;
+    _isConnected = false;
+    state = CONNECTION_IDLE;
+    config = {};
+    clientId[0] = '\0';
+    cache = {};
+    timing = {};
+    netif = nullptr;
+    apNetif = nullptr;
+    mqttClient = nullptr;
+    timer = nullptr;
+    mqttStarted = false;
+    wifiUp = true;
+    usingCache = false;
+    failures = 0;
+    attemptTime = 0;
+    scanTime = 0;
+    associateTime = 0;
+    connectedTime = 0;
+    gotIpTime = 0;
+    mqttStartTime = 0;
+}
+
+/**
+ * @brief Begin the ConnectionManager.
+ *
+ * @return esp_err_t Return code.
+ */
+esp_err_t ConnectionManager::initialize() {
+    return halTimerCreate(&onTimer, this, "connection", &timer);
+}
+
+/**
+ * @brief Applies the connection config and creates the MQTT client.
+ * Takes effect on the next connection.
+ *
+ * @param config Connection config.
+ * @return esp_err_t Return code.
+ */
+esp_err_t ConnectionManager::configure(ConnectionConfig_t &config) {
+    esp_err_t err = ESP_OK;
+    HalMqttConfig_t mqttConfig = {};
+    uint8_t mac[6] = {};
+
+    this->config = config;
+
+    err = halReadMac(mac);
+    if (err != ESP_OK) return err;
+    snprintf(clientId, sizeof(clientId), "drip-%02x%02x%02x%02x%02x%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+
+    mqttConfig.uri = this->config.brokerUri;
+    mqttConfig.clientId = clientId;
+    mqttConfig.username = this->config.username;
+    mqttConfig.password = this->config.password;
+    mqttConfig.persistentSession = this->config.persistentSession;
+
+    if (mqttClient != nullptr) {
+        return halMqttSetConfig(mqttClient, mqttConfig);
+    }
+
+    err = halMqttCreate(mqttConfig, &mqttClient);
+    if (err != ESP_OK) return err;
+
+    return halMqttRegister(mqttClient, &onMqttEvent, this);
+}
+
+/**
+ * @brief If true, the ConnectionManager is currently provisioning.
+ *
+ * @returns The isProvisioning flag.
+ */
+bool ConnectionManager::isProvisioning() {
+    /** Provisioning ends once the host stores the credentials, as the provisioning manager ends once they connect. */
+    if ( _isProvisioning && halPosixHasWifiCredentials() ) {
+        ESP_LOGI(TAG, "Provisioned credentials stored.");
+        _isProvisioning = false;
+    }
+    return _isProvisioning;
+}
+
+/**
+ * @brief If true, the ConnectionManager has successful WiFi
+ * and MQTT connection.
+ *
+ * @returns the isConnected flag.
+ */
+bool ConnectionManager::isConnected() {
+    return _isConnected;
+}
+
+/**
+ * @brief If true, a connection attempt is in progress, as opposed to
+ * being connected or waiting out a backoff delay.
+ */
+bool ConnectionManager::isConnecting() {
+    return state == CONNECTION_MQTT_CONNECTING;
+}
+
+/**
+ * @brief If true, WiFi credentials are stored and provisioning is not needed.
+ * The host has no WiFi, so halPosixSetWifiCredentials() decides.
+ */
+bool ConnectionManager::hasCredentials() {
+    return halPosixHasWifiCredentials();
+}
+
+/**
+ * @brief Returns the current state of the connection.
+ */
+ConnectionStates_e ConnectionManager::getState() {
+    return state;
+}
+
+/**
+ * @brief Starts connecting MQTT if not already started. The loopback broker
+ * accepts the connection before this returns.
+ *
+ * @param connected Set to the current connection status.
+ * @return esp_err_t Return code.
+ */
+esp_err_t ConnectionManager::connect(bool &connected) {
+    if (state == CONNECTION_IDLE) {
+        if (mqttClient == nullptr) {
+            return ESP_ERR_INVALID_STATE;
+        }
+        attempt();
+    }
+
+    connected = _isConnected;
+    return ESP_OK;
+}
+
+/**
+ * @brief Begins provisioning. The host has no access point, so it waits for
+ * halPosixSetWifiCredentials() to store the credentials.
+ *
+ * @return esp_err_t Return code.
+ */
+esp_err_t ConnectionManager::beginProvisioning() {
+    if (_isProvisioning == false) {
+        ESP_LOGI(TAG, "No WiFi credentials stored, provisioning.");
+        _isProvisioning = true;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Retrieves the duration of each phase of the last connection.
+ *
+ * @param timing Overwritten with the timing.
+ * @return esp_err_t Return code.
+ */
+esp_err_t ConnectionManager::getTiming(ConnectionTiming_t &timing) {
+    timing = this->timing;
+    return ESP_OK;
+}
+
+/**
+ * @brief Returns the MQTT client handle, or null before configure().
+ */
+HalMqttClient_t ConnectionManager::getMqttClient() {
+    return mqttClient;
+}
+
+/**
+ * @brief Handles MQTT and timer events. Runs synchronously in the caller,
+ * as the host has a single thread.
+ */
+void ConnectionManager::onEvent(void *arg, const char *base, int32_t id, void *data) {
+    ConnectionManager *self = static_cast<ConnectionManager*>(arg);
+
+    bool timeout = (id == CONNECTION_EVENT_TIMEOUT);
+    bool mqttDisconnected = (id == CONNECTION_EVENT_MQTT_DISCONNECTED);
+
+    switch (self->state) {
+        case CONNECTION_IDLE:
+        case CONNECTION_BACKOFF:
+        case CONNECTION_CIRCUIT_OPEN:
+            if (timeout) {
+                self->attempt();
+            }
+            break;
+
+        case CONNECTION_MQTT_CONNECTING:
+            if (id == CONNECTION_EVENT_MQTT_CONNECTED) {
+                halTimerStop(self->timer);
+                self->succeed();
+
+            } else if (mqttDisconnected || timeout) {
+                halTimerStop(self->timer);
+                self->fail();
+            }
+            break;
+
+        case CONNECTION_CONNECTED:
+            if (mqttDisconnected) {
+                ESP_LOGW(TAG, "Connection lost.");
+                self->fail();
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Forwards MQTT client events to the state machine.
+ */
+void ConnectionManager::onMqttEvent(void *arg, HalMqttEvent_t &event) {
+    switch (event.id) {
+        case HAL_MQTT_EVENT_CONNECTED:
+            onEvent(arg, CONNECTION_EVENT, CONNECTION_EVENT_MQTT_CONNECTED, nullptr);
+            break;
+
+        case HAL_MQTT_EVENT_DISCONNECTED:
+            onEvent(arg, CONNECTION_EVENT, CONNECTION_EVENT_MQTT_DISCONNECTED, nullptr);
+            break;
+
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Forwards timer expiry to the state machine.
+ */
+void ConnectionManager::onTimer(void *arg) {
+    onEvent(arg, CONNECTION_EVENT, CONNECTION_EVENT_TIMEOUT, nullptr);
+}
+
+/**
+ * @brief Begins a connection attempt. Only MQTT needs connecting on the host.
+ */
+void ConnectionManager::attempt() {
+    attemptTime = halTimeMicros();
+    timing = {};
+    timing.failures = failures;
+
+    /** Set the state first, as the loopback broker may accept within startMqtt(). */
+    state = CONNECTION_MQTT_CONNECTING;
+    armTimer(CONNECTION_MQTT_TIMEOUT_MS);
+    if (startMqtt() != ESP_OK) {
+        halTimerStop(timer);
+        fail();
+    }
+}
+
+/**
+ * @brief Records a successful connection and resets the failure count.
+ */
+void ConnectionManager::succeed() {
+    int64_t now = halTimeMicros();
+
+    timing.mqtt = elapsedMs(mqttStartTime, now);
+    timing.total = elapsedMs(attemptTime, now);
+
+    ESP_LOGI(TAG, "Connected in %lu ms after %lu failures.", (unsigned long) timing.total, (unsigned long) timing.failures);
+
+    failures = 0;
+    state = CONNECTION_CONNECTED;
+    _isConnected = true;
+}
+
+/**
+ * @brief Records a failed attempt and schedules the next one after
+ * a jittered exponential backoff, or opens the circuit.
+ */
+void ConnectionManager::fail() {
+    uint32_t delay = 0;
+
+    _isConnected = false;
+    failures++;
+
+    if ( (config.circuitThreshold > 0) && (failures >= config.circuitThreshold) ) {
+        delay = config.circuitCooldown + (halRandom() % (config.circuitCooldown / 4 + 1));
+        state = CONNECTION_CIRCUIT_OPEN;
+        ESP_LOGW(TAG, "Circuit open after %lu failures, next attempt in %lu ms.", (unsigned long) failures, (unsigned long) delay);
+    } else {
+        delay = backoffDelay();
+        state = CONNECTION_BACKOFF;
+        ESP_LOGI(TAG, "Connection attempt %lu failed, next attempt in %lu ms.", (unsigned long) failures, (unsigned long) delay);
+    }
+
+    armTimer(delay);
+}
+
+/**
+ * @brief Starts or reconnects the MQTT client.
+ *
+ * @return esp_err_t Return code.
+ */
+esp_err_t ConnectionManager::startMqtt() {
+    esp_err_t err = ESP_OK;
+
+    mqttStartTime = halTimeMicros();
+    if (mqttStarted) {
+        return halMqttReconnect(mqttClient);
+    }
+
+    mqttStarted = true;
+    err = halMqttStart(mqttClient);
+    if (err != ESP_OK) {
+        mqttStarted = false;
+    }
+
+    return err;
+}
+
+/**
+ * @brief Arms the state timer.
+ *
+ * @param timeout Time until expiry in miliseconds.
+ */
+void ConnectionManager::armTimer(uint32_t timeout) {
+    halTimerStop(timer);
+    halTimerStartOnce(timer, (uint64_t) timeout * 1000);
+}
+
+/**
+ * @brief Returns the backoff delay after the current number of failures,
+ * with random jitter over the upper half of the delay.
+ */
+uint32_t ConnectionManager::backoffDelay() {
+    uint32_t exponent = (failures > 16) ? 16 : failures - 1;
+    uint64_t delay = (uint64_t) config.backoffBase << exponent;
+
+    if (delay > config.backoffMax) {
+        delay = config.backoffMax;
+    }
+
+    return (delay / 2) + (halRandom() % (delay / 2 + 1));
+}
\ No newline at end of file
@@ -0,0 +1,129 @@
+#include "esp_err.h"
+#include "esp_attr.h"
+#include "halTime.h"
+#include "halPulse.h"
+
+#include "flowDriver.h"
+
+/**
+ * @brief Constructor.
+ */
+FlowDriver::FlowDriver() {
+    gpioManager = nullptr;
+    pin = -1;
+    pulses = 0;
+    lastPulseTime = 0;
+    onsetTime = 0;
+}
+
+/**
+ * @brief Claims the sensor pin and starts counting.
+ * 
+ * @param gpioManager Allocates the pin.
+ * @param pin GPIO of the sensor output.
+ * @return esp_err_t Return code.
+ */
+esp_err_t FlowDriver::initialize(GpioManager *gpioManager, int8_t pin) {
+    esp_err_t err = ESP_OK;
+
+    if (gpioManager == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (this->pin >= 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    /** The sensor has an open collector output. */
+    err = gpioManager->claimInput(pin, true, "FlowDriver");
+    if (err != ESP_OK) return err;
+
+    err = halPulseAttach(pin, &onPulse, this);
+    if (err != ESP_OK) {
+        gpioManager->release(pin);
+        return err;
+    }
+
+    this->gpioManager = gpioManager;
+    this->pin = pin;
+    return ESP_OK;
+}
+
+/**
+ * @brief Stops counting and releases the sensor pin.
+ * Has no effect if not initialized.
+ * 
+ * @return esp_err_t Return code.
+ */
+esp_err_t FlowDriver::deinitialize() {
+    if (pin < 0) {
+        return ESP_OK;
+    }
+
+    halPulseDetach(pin);
+    gpioManager->release(pin);
+    pin = -1;
+    return ESP_OK;
+}
+
+/**
+ * @brief If true, the sensor is installed and counting.
+ */
+bool FlowDriver::isInstalled() {
+    return pin >= 0;
+}
+
+/**
+ * @brief Returns the number of pulses counted since initialization.
+ * Wraps around, so callers should only use differences between readings.
+ */
+uint32_t FlowDriver::getPulses() {
+    return pulses;
+}
+
+/**
+ * @brief Returns the time of the last pulse in microseconds since boot, or zero if none was counted.
+ */
+int64_t FlowDriver::getLastPulseTime() {
+    int64_t time = 0;
+
+    /** A 64 bit read is not atomic on the esp32c3, so read again if a pulse arrived in between. */
+    do {
+        time = lastPulseTime;
+    } while (time != lastPulseTime);
+
+    return time;
+}
+
+/**
+ * @brief Clears the onset time, so it is set by the next pulse.
+ */
+void FlowDriver::resetOnset() {
+    onsetTime = 0;
+}
+
+/**
+ * @brief Returns the time of the first pulse since resetOnset() in microseconds since boot, or zero if none was counted.
+ */
+int64_t FlowDriver::getOnsetTime() {
+    int64_t time = 0;
+
+    do {
+        time = onsetTime;
+    } while (time != onsetTime);
+
+    return time;
+}
+
+/**
+ * @brief Counts a pulse and records its time. Runs in interrupt context.
+ */
+void IRAM_ATTR FlowDriver::onPulse(void *arg) {
+    FlowDriver *self = static_cast<FlowDriver*>(arg);
+    int64_t now = halTimeMicros();
+
+    self->pulses = self->pulses + 1;
+    self->lastPulseTime = now;
+    if (self->onsetTime == 0) {
+        self->onsetTime = now;
+    }
+}
\ No newline at end of file
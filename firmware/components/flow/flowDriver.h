@@ -0,0 +1,78 @@
+#ifndef FLOW_DRIVER_H
+#define FLOW_DRIVER_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#include "gpioManager.h"
+
+/**
+ * @brief Counts the pulses of a hall effect flow sensor.
+ * The esp32c3 has no pulse counter peripheral, so each rising
+ * edge is counted by a pin interrupt.
+ */
+class FlowDriver {
+public:
+    /**
+     * @brief Constructor.
+     */
+    FlowDriver();
+
+    /**
+     * @brief Claims the sensor pin and starts counting.
+     * 
+     * @param gpioManager Allocates the pin.
+     * @param pin GPIO of the sensor output.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t initialize(GpioManager *gpioManager, int8_t pin);
+
+    /**
+     * @brief Stops counting and releases the sensor pin.
+     * Has no effect if not initialized.
+     * 
+     * @return esp_err_t Return code.
+     */
+    esp_err_t deinitialize();
+
+    /**
+     * @brief If true, the sensor is installed and counting.
+     */
+    bool isInstalled();
+
+    /**
+     * @brief Returns the number of pulses counted since initialization.
+     * Wraps around, so callers should only use differences between readings.
+     */
+    uint32_t getPulses();
+
+    /**
+     * @brief Returns the time of the last pulse in microseconds since boot, or zero if none was counted.
+     */
+    int64_t getLastPulseTime();
+
+    /**
+     * @brief Clears the onset time, so it is set by the next pulse.
+     */
+    void resetOnset();
+
+    /**
+     * @brief Returns the time of the first pulse since resetOnset() in microseconds since boot, or zero if none was counted.
+     */
+    int64_t getOnsetTime();
+
+private:
+    GpioManager *gpioManager;
+    int8_t pin;
+    volatile uint32_t pulses;
+    volatile int64_t lastPulseTime;
+    volatile int64_t onsetTime;
+
+    /**
+     * @brief Counts a pulse. Runs in interrupt context.
+     */
+    static void onPulse(void *arg);
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,238 @@
+#include "esp_err.h"
+#include "esp_log.h"
+#include "halTime.h"
+
+#include "flowManager.h"
+#include "valveManager.h"
+
+static const char* TAG = "FlowManager";
+
+/**
+ * @brief Constructor.
+ * 
+ * @param valveManager Dispenses each calibration step and counts the pulses.
+ */
+template <typename Mode>
+FlowManagerT<Mode>::FlowManagerT(ValveManagerT<Mode> *valveManager) {
+    this->valveManager = valveManager;
+    config = {};
+    state = FLOW_SENSOR_IDLE;
+    calibrationTarget = {};
+    calibrationProcess = {};
+    calibrationSummary = {};
+    stepStartTime = 0;
+    stepStartPulses = 0;
+    pulseSum = 0;
+    volumeSum = 0;
+}
+
+/**
+ * @brief Begin the FlowManager.
+ * 
+ * @return esp_err_t Return code. 
+ */
+template <typename Mode>
+esp_err_t FlowManagerT<Mode>::initialize() {
+    return ESP_OK;
+}
+
+/**
+ * @brief Applies the flow sensor config. Only allowed while idle.
+ * 
+ * @param config Flow sensor config.
+ * @return esp_err_t Return code.
+ */
+template <typename Mode>
+esp_err_t FlowManagerT<Mode>::configure(FlowSensorConfig_t &config) {
+    if (state != FLOW_SENSOR_IDLE) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    this->config = config;
+    return ESP_OK;
+}
+
+/**
+ * @brief Begins a calibration process.
+ * 
+ * @param target Target for the process.
+ * @param state Overwritten with the initial state of the process.
+ * @param process Overwritten with the initial process variables.
+ * @return esp_err_t Return code.
+ */
+template <typename Mode>
+esp_err_t FlowManagerT<Mode>::beginCalibration(FlowCalibrateTarget_t &target, FlowSensorStates_e &state, FlowCalibrateProcess_t &process) {
+    esp_err_t err = ESP_OK;
+
+    state = this->state;
+    if (this->state != FLOW_SENSOR_IDLE) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    calibrationSummary = {};
+    pulseSum = 0;
+    volumeSum = 0;
+
+    err = beginStep(target);
+    state = this->state;
+    process = calibrationProcess;
+    return err;
+}
+
+/**
+ * @brief Updates the calibration process.
+ * 
+ * @param state Overwritten with the final state.
+ * @param process Overwritten with the final process variables.
+ * @param summary Overwritten with the final process summary.
+ * @return esp_err_t Return code.
+ */
+template <typename Mode>
+esp_err_t FlowManagerT<Mode>::loopCalibration(FlowSensorStates_e &state, FlowCalibrateProcess_t &process, FlowCalibrateSummary_t &summary) {
+    esp_err_t err = ESP_OK;
+    ValveStates_e valveState = VALVES_UNKNOWN;
+    DispenseProcess_t dispenseProcess = {};
+    DispenseSummary_t dispenseSummary = {};
+    bool stepComplete = false;
+
+    if (this->state == FLOW_SENSOR_CALIBRATION_DISPENSING) {
+        err = valveManager->loopDispense(valveState, dispenseProcess, dispenseSummary, stepComplete);
+        if (err != ESP_OK) goto exit;
+
+        calibrationProcess.time = (halTimeMicros() - stepStartTime) / 1000;
+        calibrationProcess.pulses = valveManager->getFlowPulses() - stepStartPulses;
+        if (Mode::PRESSURE) {
+            calibrationProcess.tankLevel = dispenseProcess.tankLevel;
+        }
+
+        /** The step ends once the line has settled, so the pulses after the close are counted too. */
+        if (valveState == VALVES_IDLE) {
+            this->state = FLOW_SENSOR_CALIBRATION_WAITING_FOR_MEASUREMENT;
+            ESP_LOGI(TAG, "Step dispensed %lu pulses.", (unsigned long) calibrationProcess.pulses);
+        }
+    }
+
+exit:
+    state = this->state;
+    process = calibrationProcess;
+    summary = calibrationSummary;
+    return err;
+}
+
+/**
+ * @brief Accepts a measurement into the calibration process.
+ * 
+ * @param state Overwritten with the final state.
+ * @param measurement The new measurement.
+ * @param target The new target.
+ * @param process Overwritten with the final process variables.
+ * @return esp_err_t Return code.
+ */
+template <typename Mode>
+esp_err_t FlowManagerT<Mode>::inputCalibration(FlowSensorStates_e &state, FlowCalibrateMeasurement_t &measurement, FlowCalibrateTarget_t &target, FlowCalibrateProcess_t &process) {
+    esp_err_t err = ESP_OK;
+
+    if (this->state != FLOW_SENSOR_CALIBRATION_WAITING_FOR_MEASUREMENT) {
+        err = ESP_ERR_INVALID_STATE;
+        goto exit;
+    }
+
+    /** A step without a measurement, e.g. one that only primed the line, is left out. */
+    if (measurement.measuredVolume > 0) {
+        pulseSum += calibrationProcess.pulses;
+        volumeSum += measurement.measuredVolume;
+        calibrationSummary.calibrationPointsCount++;
+    }
+
+    if (measurement.conclude) {
+        summarize();
+        this->state = FLOW_SENSOR_IDLE;
+        goto exit;
+    }
+
+    err = beginStep(target);
+
+exit:
+    state = this->state;
+    process = calibrationProcess;
+    return err;
+}
+
+/**
+ * @brief Ends the calibration process.
+ * 
+ * @param state Overwritten with the state.
+ * @param process Overwritten with the final process variables.
+ * @param summary Overwritten with the final process summary.
+ * @return esp_err_t Return code.
+ */
+template <typename Mode>
+esp_err_t FlowManagerT<Mode>::endCalibration(FlowSensorStates_e &state, FlowCalibrateProcess_t &process, FlowCalibrateSummary_t &summary) {
+    esp_err_t err = ESP_OK;
+    ValveStates_e valveState = VALVES_UNKNOWN;
+    DispenseProcess_t dispenseProcess = {};
+    DispenseSummary_t dispenseSummary = {};
+
+    if (this->state == FLOW_SENSOR_CALIBRATION_DISPENSING) {
+        err = valveManager->endDispense(valveState, dispenseProcess, dispenseSummary);
+    }
+    if (this->state != FLOW_SENSOR_IDLE) {
+        summarize();
+    }
+
+    this->state = FLOW_SENSOR_IDLE;
+    state = this->state;
+    process = calibrationProcess;
+    summary = calibrationSummary;
+    return err;
+}
+
+/**
+ * @brief Validates a target and dispenses it through the first zone.
+ * 
+ * @param target Target of the step.
+ * @return esp_err_t Return code. ESP_ERR_INVALID_ARG if the target volume is out of range.
+ */
+template <typename Mode>
+esp_err_t FlowManagerT<Mode>::beginStep(FlowCalibrateTarget_t &target) {
+    esp_err_t err = ESP_OK;
+    RunPlan_t plan = {};
+    ValveStates_e valveState = VALVES_UNKNOWN;
+    DispenseProcess_t dispenseProcess = {};
+    uint32_t timeout = (target.timeout > 0) ? target.timeout : (uint32_t) config.calibrationTimeout;
+
+    if ( (target.targetVolume <= 0) || (target.targetVolume > config.calibrateMaxVolume) ) {
+        ESP_LOGW(TAG, "Target volume %.2f L outside of (0, %.2f] L.", target.targetVolume, config.calibrateMaxVolume);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (timeout == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    plan.stepCount = 1;
+    plan.steps[0].targetVolume = target.targetVolume;
+    plan.steps[0].timeout = timeout * 1000;
+    plan.steps[0].zone = 0;
+
+    stepStartTime = halTimeMicros();
+    stepStartPulses = valveManager->getFlowPulses();
+    err = valveManager->beginDispense(plan, valveState, dispenseProcess);
+    if (err != ESP_OK) return err;
+
+    calibrationTarget = target;
+    calibrationProcess = {};
+    calibrationProcess.tankLevel = dispenseProcess.tankLevel;
+    state = FLOW_SENSOR_CALIBRATION_DISPENSING;
+    return ESP_OK;
+}
+
+/**
+ * @brief Writes the calibration from the measured steps into the summary.
+ */
+template <typename Mode>
+void FlowManagerT<Mode>::summarize() {
+    calibrationSummary.pulsesPerLiter = (volumeSum > 0) ? pulseSum / volumeSum : 0;
+}
+
+/** Only the mode of the build is compiled. */
+template class FlowManagerT<DripMode>;
\ No newline at end of file
@@ -1,6 +1,16 @@
 #ifndef FLOW_MANAGER_H
 #define FLOW_MANAGER_H
 
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#include "config.h"
+#include "operatingMode.h"
+
+template <typename Mode>
+class ValveManagerT;
+
 /**
  * @brief Describes the possible states of the flow sensor.
  */
@@ -18,7 +28,9 @@ typedef enum FlowSensorStates_e {
  * 
  */
 typedef struct FlowCalibrateTarget_t {
+    /** Volume to dispense in liters, as metered with the current calibration. */
     float targetVolume = 0;
+    /** Timeout of the step in seconds. Zero for the calibrationTimeout of the config. */
     uint32_t timeout = 0;
 } FlowCalibrateTarget_t;
 
@@ -29,7 +41,7 @@ typedef struct FlowCalibrateTarget_t {
 typedef struct FlowCalibrateMeasurement_t {
     float measuredVolume = 0;
     bool conclude = 0;
-};
+} FlowCalibrateMeasurement_t;
 
 /**
  * @brief Describes the realtime variables of a flow sensor calibration process.
@@ -44,19 +56,27 @@ typedef struct FlowCalibrateProcess_t {
  * @brief Describes a summary of the process variables for a whole flow sensor calibration process.
  */
 typedef struct FlowCalibrateSummary_t {
-    uint32_t pulsesPerLiter = 0;
+    /** Total pulses over total measured volume of every step, or zero if nothing was measured. */
+    float pulsesPerLiter = 0;
     uint16_t calibrationPointsCount = 0;
 } FlowCalibrateSummary_t;
 
 /**
- * @brief Handles the dispensation and draining process.
+ * @brief Handles the flow sensor calibration process. Each step dispenses
+ * a target volume through the first zone while counting the flow sensor
+ * pulses, then waits for the volume measured by the user.
+ *
+ * @tparam Mode OperatingMode of the build, as of the ValveManager.
  */
-class FlowManager {
+template <typename Mode>
+class FlowManagerT {
 public:
     /**
      * @brief Constructor.
+     * 
+     * @param valveManager Dispenses each calibration step and counts the pulses.
      */
-    FlowManager();
+    FlowManagerT(ValveManagerT<Mode> *valveManager);
 
     /**
      * @brief Begin the FlowManager.
@@ -65,6 +85,14 @@ public:
      */
     esp_err_t initialize();
 
+    /**
+     * @brief Applies the flow sensor config. Only allowed while idle.
+     * 
+     * @param config Flow sensor config.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t configure(FlowSensorConfig_t &config);
+
     /**
      * @brief Begins a calibration process.
      * 
@@ -108,10 +136,35 @@ public:
 
 
 private:
+    ValveManagerT<Mode> *valveManager;
+    FlowSensorConfig_t config;
     FlowSensorStates_e state;
     FlowCalibrateTarget_t calibrationTarget;
     FlowCalibrateProcess_t calibrationProcess;
     FlowCalibrateSummary_t calibrationSummary;
+    /** Time the current step began, in microseconds. */
+    int64_t stepStartTime;
+    /** Pulse count at the start of the current step. */
+    uint32_t stepStartPulses;
+    /** Pulses and measured volume in liters summed over every measured step. */
+    uint32_t pulseSum;
+    float volumeSum;
+
+    /**
+     * @brief Validates a target and dispenses it through the first zone.
+     * 
+     * @param target Target of the step.
+     * @return esp_err_t Return code. ESP_ERR_INVALID_ARG if the target volume is out of range.
+     */
+    esp_err_t beginStep(FlowCalibrateTarget_t &target);
+
+    /**
+     * @brief Writes the calibration from the measured steps into the summary.
+     */
+    void summarize();
 };
 
+/** The FlowManager of the operating mode of the build. */
+typedef FlowManagerT<DripMode> FlowManager;
+
 #endif
\ No newline at end of file
@@ -2,13 +2,20 @@
 
 #include "esp_log.h"
 #include "esp_err.h"
-#include "esp_system.h"
+#include "halSystem.h"
+#include "halTime.h"
 
 #include "configManager.h"
 #include "mqttManager.h"
 #include "connectionManager.h"
 #include "valveManager.h"
+#include "powerManager.h"
+#include "scheduleManager.h"
+#include "pressureManager.h"
+#include "traceManager.h"
+#include "resourceManager.h"
 #include "messages.h"
+#include "codec.h"
 
 #include "stateManager.h"
 
@@ -17,12 +24,29 @@ static const char* TAG = "StateManager";
 /**
  * @brief Constructor
  */
-StateManager::StateManager(ConfigManager *configManager, MqttManager *mqttManager, ConnectionManager *connectionManager, ValveManager *valveManager) {
+StateManager::StateManager(ConfigManager *configManager, MqttManager *mqttManager, ConnectionManager *connectionManager, ValveManager *valveManager, PowerManager *powerManager, GpioManager *gpioManager, ScheduleManager *scheduleManager, PressureManager *pressureManager, FlowManager *flowManager, PressureCalibrator *pressureCalibrator, TraceManager *traceManager, ResourceManager *resourceManager) {
     state = STATE_MIN;
-    configManager = configManager;
-    mqttManager = mqttManager;
-    connectionManager = connectionManager;
-    valveManager = valveManager;
+    bootReported = false;
+    fatalReported = false;
+    fatalTime = 0;
+    sleepReported = false;
+    sleepReportTime = 0;
+    sliceResolution = 0;
+    lastSliceVolume = 0;
+    activeJobId = 0;
+    journalState = VALVES_UNKNOWN;
+    this->configManager = configManager;
+    this->mqttManager = mqttManager;
+    this->connectionManager = connectionManager;
+    this->valveManager = valveManager;
+    this->powerManager = powerManager;
+    this->gpioManager = gpioManager;
+    this->scheduleManager = scheduleManager;
+    this->pressureManager = pressureManager;
+    this->flowManager = flowManager;
+    this->pressureCalibrator = pressureCalibrator;
+    this->traceManager = traceManager;
+    this->resourceManager = resourceManager;
 }
 
 /**
@@ -36,6 +60,13 @@ void StateManager::initialize() {
  * @brief Executes the current state.
  */
 void StateManager::handle_current_state() {
+    /** Only allow frequency scaling and light sleep while listening. */
+    if (state == STATE_LISTEN) {
+        powerManager->endActive();
+    } else {
+        powerManager->beginActive();
+    }
+
     switch (state) {
         case STATE_BOOT:
             boot();
@@ -67,11 +98,24 @@ void StateManager::handle_current_state() {
         case STATE_DRAIN:
             drain();
             break;
+        case STATE_SLEEP:
+            sleep();
+            break;
+        case STATE_VALVE_CHARACTERISE:
+            characterise();
+            break;
         default:
             mqttManager->txError(TAG, "State machine set to invalid state.");
             state = STATE_FATAL_ERROR;
             break;
     }
+
+    /** Stream the inputs captured during this iteration. */
+    if (traceManager->isActive()) {
+        transmitTrace();
+    }
+
+    resourceManager->sample();
 }
 
 /**
@@ -79,17 +123,78 @@ void StateManager::handle_current_state() {
  */
 void StateManager::boot() {
     esp_err_t err = ESP_OK;
+    Config_t config = {};
 
     /** Initialize managers. */
+    err = powerManager->initialize();
+    if (err != ESP_OK) goto err;
+
     err = configManager->initialize();
     if (err != ESP_OK) goto err;
 
+    /** The config restored from RTC memory is stale if another generation was persisted before sleeping. */
+    if ( powerManager->wokeFromDeepSleep() && (powerManager->getRetainedConfigGeneration() != configManager->getGeneration()) ) {
+        err = configManager->refresh();
+        if (err != ESP_OK) goto err;
+    }
+
+    err = configManager->getConfig(config);
+    if (err != ESP_OK) goto err;
+    powerManager->markBootPhase(BOOT_PHASE_CONFIG);
+    mqttManager->setConfigGeneration(configManager->getGeneration());
+
+    err = powerManager->configure(config.system);
+    if (err != ESP_OK) goto err;
+
+    err = gpioManager->initialize();
+    if (err != ESP_OK) goto err;
+
+    err = pressureManager->initialize();
+    if (err != ESP_OK) goto err;
+
+    err = valveManager->initialize();
+    if (err != ESP_OK) goto err;
+
+    err = flowManager->initialize();
+    if (err != ESP_OK) goto err;
+
+    err = flowManager->configure(config.flowSensor);
+    if (err != ESP_OK) goto err;
+
+    err = pressureCalibrator->initialize();
+    if (err != ESP_OK) goto err;
+
+    err = pressureCalibrator->configure(config);
+    if (err != ESP_OK) goto err;
+
+    /** Without the tank volume, the tank switches over to the source on the tank_timeout rule only. */
+    err = pressureManager->configure(config);
+    if (err != ESP_OK) {
+        mqttManager->txWarning(TAG, "Invalid pressure sensor config. Tank volume is unavailable.");
+    }
+
+    /** Keep running with a bad valve config, so it can still be corrected over MQTT. */
+    err = valveManager->configure(config);
+    if (err != ESP_OK) {
+        mqttManager->txError(TAG, "Invalid valve config. Dispensing is disabled.");
+    }
+
     err = connectionManager->initialize();
     if (err != ESP_OK) goto err;
 
-    err = mqttManager->initialize();
+    err = connectionManager->configure(config.connection);
+    if (err != ESP_OK) goto err;
+
+    /** Scheduled runs only need a valid clock, which survives deep sleep, so SNTP failures are not fatal. */
+    err = scheduleManager->configure(config.schedule);
+    if (err != ESP_OK) {
+        mqttManager->txWarning(TAG, "Failed to configure the schedule.");
+    }
+
+    err = mqttManager->initialize(connectionManager->getMqttClient(), config.connection.baseTopic);
     if (err != ESP_OK) goto err;
 
+    recoverProcess(config);
 
     state = STATE_CONNECT;
     return;
@@ -103,7 +208,39 @@ err:
  * @brief Handler for state STATE_FATAL_ERROR.
  */
 void StateManager::fatalError() {
-    // Placeholder for fatal error state logic
+    ResourceReport_t report = {};
+    MqttQueueStats_t queues = {};
+    MqttRxMessage_t *message = nullptr;
+    int64_t elapsed = 0;
+
+    /** Keep the margins with the error, as running out of memory is a likely cause. */
+    if (fatalReported == false) {
+        resourceManager->getReport(report);
+        mqttManager->getQueueStats(queues);
+        ESP_LOGE(TAG, "Fatal error. Receive queue peak %u, %lu dropped. Transmit buffer peak %u, %lu dropped.",
+            queues.rxPeak,
+            (unsigned long) queues.rxDropped,
+            queues.txPeak,
+            (unsigned long) queues.txDropped
+        );
+        ResourceManager::log(report);
+        mqttManager->txError(TAG, "Fatal error.");
+        mqttManager->txResourceReport(report);
+        fatalReported = true;
+        fatalTime = halTimeMicros();
+    }
+
+    /** The state cannot be left safely, so the device restarts once the report has had time to go out. */
+    elapsed = (halTimeMicros() - fatalTime) / 1000;
+    if (elapsed >= FATAL_ERROR_RESTART_MS) {
+        state = STATE_RESTART;
+        return;
+    }
+
+    /** Requests are discarded, so the queue only paces the wait. */
+    if (mqttManager->waitForMessage(FATAL_ERROR_RESTART_MS - elapsed)) {
+        mqttManager->getNextMessage(message);
+    }
 }
 
 /**
@@ -112,21 +249,32 @@ void StateManager::fatalError() {
 void StateManager::connect() {
     esp_err_t err = ESP_OK;
     bool connected = false;
-    
-    /** Attempt connection. */
+
+    /** Provision WiFi & MQTT if no credentials are stored. */
+    if (connectionManager->hasCredentials() == false) {
+        state = STATE_PROVISIONING;
+        return;
+    }
+
+    /** 
+     * Start connecting without waiting for the result. Messages transmitted
+     * until connected are buffered, and reconnection is handled by the ConnectionManager.
+     */
     err = connectionManager->connect(connected);
     if (err != ESP_OK) goto err;
 
-    /** Continue if connected or provision WiFi & MQTT if not. */
-    if (connected == true) {
-        state = STATE_LISTEN;
-        return;
+    /** Boot ends here. From now on the FSM task runs without the heap. */
+    armHeapGuard();
 
-    } else {
-        state = STATE_PROVISIONING;
+    /** An interrupted process resumes before anything else runs. */
+    if (jobQueue.count() > 0) {
+        beginNextJob();
         return;
     }
 
+    state = STATE_LISTEN;
+    return;
+
 err:
     state = STATE_FATAL_ERROR;
     return;
@@ -137,18 +285,22 @@ err:
  */
 void StateManager::accessPoint() {
     esp_err_t err = ESP_OK;
+    bool provisioning = connectionManager->isProvisioning();
+
+    /** Connect once provisioning stored the credentials, as after a boot. */
+    if ( (provisioning == false) && connectionManager->hasCredentials() ) {
+        state = STATE_CONNECT;
+        return;
+    }
 
-    /** Begin provisioning. */
-    if ( (connectionManager->isProvisioning() == false) && (connectionManager->isConnected() == false) ) {
+    if (provisioning == false) {
         err = connectionManager->beginProvisioning();
         if (err != ESP_OK) goto err;
     }
 
-    /** Move forward once connected. */
-    if (connectionManager->isConnected() == true) {
-        state = STATE_LISTEN;
-        return;
-    }
+    /** Nothing can be received until connected, so the queue only paces the polling. */
+    mqttManager->waitForMessage(PROVISIONING_POLL_PERIOD_MS);
+    return;
 
 err:
     state = STATE_FATAL_ERROR;
@@ -168,7 +320,7 @@ void StateManager::restart() {
     }
 
     /** Reset device. */
-    esp_restart();
+    halRestart();
 
     /** Should not reach here. */
     state = STATE_FATAL_ERROR;
@@ -182,11 +334,10 @@ void StateManager::listen() {
     esp_err_t err = ESP_OK;
     MqttRxMessage_t* message = nullptr;
     Config_t config = {}; 
-    
-    /** In case MQTT has not checked for any messages yet, wait until it has. */
-    if (mqttManager->numMessagesInQueue() == 0) {
-        return;
-    }
+    PowerStats_t powerStats = {};
+    uint32_t interval = 0;
+    uint32_t timeout = 0;
+    bool received = false;
 
     /** Retrieve config. */
     err = configManager->getConfig(config);
@@ -194,9 +345,59 @@ void StateManager::listen() {
         mqttManager->txError(TAG, "Failed to retrieve device config.");
         return;
     }
+
+    /** 
+     * In deep sleep mode, listen for a short window and then sleep until the next wake.
+     * Sleep is deferred while a connection attempt is in progress, but not while
+     * waiting out a backoff delay.
+     */
+    if (config.system.deepSleepEnabled) {
+        timeout = config.system.deepSleepAwakeTime;
     
-    /** Check for new MQTT messages. */
-    while(mqttManager->numMessagesInQueue() > 0) {
+    /** 
+     * Otherwise block until a message arrives. The power locks are released in this state,
+     * so the chip enters automatic light sleep while waiting. Power statistics 
+     * are reported each time the sleep interval elapses without a message.
+     */
+    } else {
+        /** A stored config may predate the bounds of a config change, so they are applied here too. */
+        interval = config.system.sleepInterval;
+        interval = (interval < SYSTEM_SLEEP_INTERVAL_MIN) ? SYSTEM_SLEEP_INTERVAL_MIN : interval;
+        interval = (interval > SYSTEM_SLEEP_INTERVAL_MAX) ? SYSTEM_SLEEP_INTERVAL_MAX : interval;
+        timeout = interval * 1000;
+    }
+
+    /** Wake for the next scheduled run at the latest. */
+    if (scheduleManager->getTimeUntilNext() < timeout) {
+        timeout = scheduleManager->getTimeUntilNext();
+    }
+    received = mqttManager->waitForMessage(timeout);
+    checkSchedule();
+
+    if (received == false) {
+        if (state != STATE_LISTEN) {
+            return;
+        }
+
+        if (config.system.deepSleepEnabled) {
+            if (connectionManager->isConnecting() == false) {
+                state = STATE_SLEEP;
+            }
+        } else if (timeout == interval * 1000) {
+            powerManager->getStats(powerStats, true);
+            err = mqttManager->txPowerReport(powerStats);
+            if (err != ESP_OK) {
+                mqttManager->txWarning(TAG, "Failed to transmit power report.");
+            }
+        }
+        return;
+    }
+    
+    /**
+     * Check for new MQTT messages. A request or a due schedule may start a process,
+     * so the rest of the batch is left to the state it entered.
+     */
+    while ( (state == STATE_LISTEN) && (mqttManager->numMessagesInQueue() > 0) ) {
 
         /** Get the next message from the queue. */
         err = mqttManager->getNextMessage(message);
@@ -223,11 +424,11 @@ void StateManager::listen() {
                 handleConfigChangeRequest(message);
                 break;
         
-            case MQTT_RX_FLOW_CALIBRATE;
+            case MQTT_RX_FLOW_CALIBRATE:
                 handleFlowCalibrateRequest(message);
                 break;
 
-            case MQTT_RX_PRESSURE_CALIBRATE;
+            case MQTT_RX_PRESSURE_CALIBRATE:
                 handlePressureCalibrateRequest(message);
                 break;
         
@@ -238,6 +439,22 @@ void StateManager::listen() {
             case MQTT_RX_PRESSURE_POLL:
                 handlePressurePollRequest(message);
                 break;
+
+            case MQTT_RX_VALVE_CHARACTERISE:
+                handleCharacteriseRequest(message);
+                break;
+
+            case MQTT_RX_TRACE_CAPTURE:
+                handleTraceRequest(message);
+                break;
+
+            case MQTT_RX_RESOURCE_REQUEST:
+                handleResourceRequest(message);
+                break;
+
+            case MQTT_RX_CONNECTED:
+                handleConnected();
+                break;
         
             default:
                 mqttManager->txWarning(TAG, "Message not valid in idle state.");
@@ -258,6 +475,11 @@ void StateManager::dispense() {
     ValveStates_e valveState = VALVES_UNKNOWN;
     DispenseProcess_t dispenseProcess = {};
     DispenseSummary_t dispenseSummary = {};
+    bool stepComplete = false;
+    bool endProcess = false;
+
+    /** Wait for the next update, returning early if a message arrives. */
+    mqttManager->waitForMessage(PROCESS_UPDATE_PERIOD_MS);
 
     /** Check for new MQTT messages. */
     while(mqttManager->numMessagesInQueue() > 0) {
@@ -266,7 +488,7 @@ void StateManager::dispense() {
         err = mqttManager->getNextMessage(message);
         if (err != ESP_OK) {
             mqttManager->txWarning(TAG, "Failed to retrieve MQTT message.");
-            return;
+            break;
         }
         if (message == nullptr) {
             mqttManager->txWarning(TAG, "Non-zero queue count returned null reference.");
@@ -278,23 +500,73 @@ void StateManager::dispense() {
 
             /** Handle deactivation. */
             case MQTT_RX_DEACTIVATE:
-                goto exit;
+                handleDeactivateRequest(message, endProcess);
+                if (endProcess) goto exit;
+                break;
+
+            /** Queue jobs to begin once this process ends. */
+            case MQTT_RX_DISPENSE_ACTIVATE:
+                handleDispenseRequest(message);
+                break;
+
+            case MQTT_RX_DRAIN:
+                handleDrainRequest(message);
+                break;
+
+            case MQTT_RX_TRACE_CAPTURE:
+                handleTraceRequest(message);
+                break;
+
+            case MQTT_RX_RESOURCE_REQUEST:
+                handleResourceRequest(message);
+                break;
+
+            case MQTT_RX_CONNECTED:
+                handleConnected();
                 break;
         
             default:
-                mqttManager->txWarning(TAG, "Only DEACTIVATE commands are accepted during dispensation.")
+                mqttManager->txWarning(TAG, "Only DEACTIVATE, dispense and drain commands are accepted during dispensation.");
                 break;
 
         }
         
     }
 
-    /** Update dispense state. */
-    err = valveManager->loopDispensation(valveState, dispenseProcess, dispenseSummary);
+    /** Queue scheduled runs which became due during the process. */
+    checkSchedule();
+
+    /** Update dispense state. Steps of the run plan follow each other within this call. */
+    err = valveManager->loopDispense(valveState, dispenseProcess, dispenseSummary, stepComplete);
     if (err != ESP_OK) {
         mqttManager->txError(TAG, "Error detected. Ending dispense process.");
         goto exit;
     }
+
+    /** 
+     * Report each completed zone, and slices at the configured volume resolution. Each is also
+     * journaled, as is each change of the valves, so a reset loses at most one slice.
+     */
+    if (stepComplete) {
+        err = mqttManager->txDispenseSummary(dispenseSummary);
+        if (err != ESP_OK) {
+            mqttManager->txError(TAG, "Failed to transmit dispense summary.");
+        }
+        lastSliceVolume = 0;
+        processJournal.recordStep(valveState, dispenseSummary);
+        journalState = valveState;
+    } else if ((dispenseProcess.outputVolume - lastSliceVolume) >= sliceResolution) {
+        err = mqttManager->txDispenseSlice(dispenseProcess);
+        if (err != ESP_OK) {
+            mqttManager->txError(TAG, "Failed to transmit dispense slice.");
+        }
+        lastSliceVolume = dispenseProcess.outputVolume;
+        processJournal.record(valveState, dispenseProcess);
+        journalState = valveState;
+    } else if (valveState != journalState) {
+        processJournal.record(valveState, dispenseProcess);
+        journalState = valveState;
+    }
     
     /** Handle state transition based on dispensation status. */
     switch (valveState) {
@@ -303,34 +575,36 @@ void StateManager::dispense() {
         default:
         case VALVES_UNKNOWN:
         case VALVES_TANK_DRAIN:
+        case VALVES_CHARACTERISE:
             mqttManager->txError(TAG, "ValveManager in an invalid state.");
             goto exit;
             break;
         
-        /** Continuing to dispense. */
+        /** Continuing to dispense, or metering the overshoot of the last step. */
         case VALVES_TANK_DISPENSE:
         case VALVES_SOURCE_DISPENSE:
+        case VALVES_BLENDED_DISPENSE:
+        case VALVES_CLOSING:
+            return;
             
-            err = mqttManager->txDispenseSlice(dispenseProcess);
-            if (err != ESP_OK) {
-                mqttManager->txError(TAG, "Failed to transmit dispense slice.");
-            }
-            break;
-            
-        /** Dispense has concluded. */
+        /** The last step has concluded and was already reported. */
         case VALVES_IDLE:
-            goto exit;
-            break;
+            processJournal.end();
+            recalibrateFlowSensor(dispenseSummary);
+            mqttManager->txInfo(TAG, "Concluded dispense process.");
+            beginNextJob();
+            return;
     }
 
 exit:
     /** End the process. */
-    err = valveManager->endDispenstaion(valveState, dispenseProcess, dispenseSummary);
+    err = valveManager->endDispense(valveState, dispenseProcess, dispenseSummary);
     if ( (err != ESP_OK) || (valveState != VALVES_IDLE) ) {
         mqttManager->txError(TAG, "Failed to deactivate dispensation.");
     }
+    processJournal.end();
     
-    /** Report the final variables, or none if none has been collected. */
+    /** Report the final variables of the interrupted step. */
     err = mqttManager->txDispenseSlice(dispenseProcess);
     if (err != ESP_OK) {
         mqttManager->txError(TAG, "Failed to transmit dispense slice.");
@@ -340,8 +614,8 @@ exit:
         mqttManager->txError(TAG, "Failed to transmit dispense summary.");
     }
 
-    mqttManager->txInfo(TAG, "Concluded dispense process.");
-    state = STATE_LISTEN;
+    mqttManager->txInfo(TAG, "Ended dispense process.");
+    beginNextJob();
     return;
 }
 
@@ -352,10 +626,16 @@ void StateManager::flowCalibrate() {
     esp_err_t err = ESP_OK;
     MqttRxMessage_t* message = nullptr;
     MqttRxFlowCalibrate_t *calibrateMessagePayload = nullptr;
+    FlowCalibrateMeasurement_t measurement = {};
+    FlowCalibrateTarget_t target = {};
     FlowSensorStates_e flowState = FLOW_SENSOR_UNKNOWN;
     FlowCalibrateProcess_t calibrationProcess = {};
     FlowCalibrateSummary_t calibrationSummary = {};
-    bool saveConfig = false;
+    Config_t config = {};
+    char log[96];
+
+    /** Wait for the next update, returning early if a message arrives. */
+    mqttManager->waitForMessage(PROCESS_UPDATE_PERIOD_MS);
 
     /** Check for new MQTT messages. */
     while(mqttManager->numMessagesInQueue() > 0) {
@@ -364,7 +644,7 @@ void StateManager::flowCalibrate() {
         err = mqttManager->getNextMessage(message);
         if (err != ESP_OK) {
             mqttManager->txWarning(TAG, "Failed to retrieve MQTT message.");
-            return;
+            break;
         }
         if (message == nullptr) {
             mqttManager->txWarning(TAG, "Non-zero queue count returned null reference.");
@@ -381,26 +661,41 @@ void StateManager::flowCalibrate() {
 
             case MQTT_RX_FLOW_CALIBRATE:
                 calibrateMessagePayload = reinterpret_cast<MqttRxFlowCalibrate_t*>(message->payload);
+                measurement.measuredVolume = calibrateMessagePayload->measuredVolume;
+                measurement.conclude = calibrateMessagePayload->conclude;
+                target.targetVolume = calibrateMessagePayload->targetVolume;
+                target.timeout = calibrateMessagePayload->timeout;
+
+                /** Process calibration message. */
+                err = flowManager->inputCalibration(flowState, measurement, target, calibrationProcess);
+                if (err == ESP_ERR_INVALID_STATE) {
+                    mqttManager->txWarning(TAG, "The calibration step is still dispensing.");
+                } else if (err != ESP_OK) {
+                    mqttManager->txError(TAG, "Error detected. Ending calibration process.");
+                    goto exit;
+                }
+                break;
+
+            case MQTT_RX_TRACE_CAPTURE:
+                handleTraceRequest(message);
+                break;
+
+            case MQTT_RX_RESOURCE_REQUEST:
+                handleResourceRequest(message);
+                break;
+
+            case MQTT_RX_CONNECTED:
+                handleConnected();
                 break;
         
             default:
-                mqttManager->txWarning(TAG, "Only DEACTIVATE and FLOW_CALIBRATE commands are accepted during flow sensor calibration.")
+                mqttManager->txWarning(TAG, "Only DEACTIVATE and FLOW_CALIBRATE commands are accepted during flow sensor calibration.");
                 break;
 
         }
         
     }
 
-
-    /** Process calibration message. */
-    if (calibrateMessagePayload != nullptr) {
-        err = flowManager->inputCalibration(flowState, calibrateMessagePayload->targetVolume, calibrateMessagePayload->conclude);
-        if (err != ESP_OK) {
-            mqttManager->txError(TAG, "Error detected. Ending calibration process.");
-            goto exit;
-        }
-    } 
-
     /** Update calibration state. */
     err = flowManager->loopCalibration(flowState, calibrationProcess, calibrationSummary);
     if (err != ESP_OK) {
@@ -408,7 +703,7 @@ void StateManager::flowCalibrate() {
         goto exit;
     }
     
-    /** Handle state transition based on dispensation status. */
+    /** Handle state transition based on calibration status. */
     switch (flowState) {
 
         /** Error state. */
@@ -421,109 +716,970 @@ void StateManager::flowCalibrate() {
         
         /** Continuing to dispense. */
         case FLOW_SENSOR_CALIBRATION_DISPENSING:
-            break
+            return;
 
         /** Waiting for measurement. */
         case FLOW_SENSOR_CALIBRATION_WAITING_FOR_MEASUREMENT:
-            break;
+            return;
             
         /** Calibration has concluded. */
         case FLOW_SENSOR_IDLE:
-            saveConfig = true;
-            goto exit;
             break;
     }
 
-exit:
-    /** End the process. */
-    err = flowManager->endCalibration(flowState, calibrationProcess, calibrationSummary);
-    if ( (err != ESP_OK) || (flowState != FLOW_SENSOR_IDLE) ) {
-        mqttManager->txError(TAG, "Failed to deactivate dispensation.");
+    if (calibrationSummary.pulsesPerLiter <= 0) {
+        mqttManager->txWarning(TAG, "No usable measurement. Calibration unchanged.");
+        goto end;
+    }
+
+    /** Apply the calibration to the next dispense process. */
+    configManager->getConfig(config);
+    config.flowSensor.defaultPulsesPerLiter = calibrationSummary.pulsesPerLiter;
+
+    err = configManager->setConfig(config);
+    if (err == ESP_OK) {
+        err = configManager->persist();
+    }
+    if (err != ESP_OK) {
+        mqttManager->txError(TAG, "Failed to persist flow sensor calibration.");
+        goto end;
     }
 
-    if (saveConfig) {
-        mqttManager->txInfo(TAG, "Saved flow sensor calibration data:...");
+    err = valveManager->configure(config);
+    if (err != ESP_OK) {
+        mqttManager->txError(TAG, "Failed to configure valves.");
+    }
 
-        /** TODO: Set and persist the config. */
+    /** Republish the retained config of the new generation. */
+    mqttManager->setConfigGeneration(configManager->getGeneration());
+    err = mqttManager->txConfig(config);
+    if (err != ESP_OK) {
+        mqttManager->txWarning(TAG, "Failed to transmit config.");
     }
 
+    snprintf(log, sizeof(log), "Saved flow sensor calibration of %.2f pulses/L from %u points.", calibrationSummary.pulsesPerLiter, calibrationSummary.calibrationPointsCount);
+    mqttManager->txInfo(TAG, log);
+
+end:
     mqttManager->txInfo(TAG, "Concluded calibration process.");
     state = STATE_LISTEN;
     return;
+
+exit:
+    /** End the process without changing the config. */
+    err = flowManager->endCalibration(flowState, calibrationProcess, calibrationSummary);
+    if ( (err != ESP_OK) || (flowState != FLOW_SENSOR_IDLE) ) {
+        mqttManager->txError(TAG, "Failed to deactivate dispensation.");
+    }
+
+    mqttManager->txInfo(TAG, "Ended calibration process.");
+    state = STATE_LISTEN;
+    return;
 }
 
 /**
  * @brief Handler for state STATE_PRESSURE_CALIBRATE.
  */
 void StateManager::pressureCalibrate() {
-    // Placeholder for pressure calibrate state logic
-}
+    esp_err_t err = ESP_OK;
+    MqttRxMessage_t* message = nullptr;
+    MqttRxPressureCalibrate_t *calibrateMessagePayload = nullptr;
+    PressureCalibrateTarget_t target = {};
+    PressureSensorStates_e pressureState = PRESSURE_SENSOR_UNKNOWN;
+    PressureCalibrateProcess_t calibrationProcess = {};
+    PressureCalibrateSummary_t calibrationSummary = {};
+    bool pointMeasured = false;
+    bool reconnected = false;
+    Config_t config = {};
+    char log[128];
+
+    /** Wait for the next update, returning early if a message arrives. */
+    mqttManager->waitForMessage(PROCESS_UPDATE_PERIOD_MS);
 
-/**
- * @brief Handler for state STATE_DRAIN.
- */
-void StateManager::drain() {
-    // Placeholder for drain state logic
-}
+    /** Check for new MQTT messages. */
+    while(mqttManager->numMessagesInQueue() > 0) {
 
-/**
- * @brief Handles state change for a dispense request.
- * 
- * @param message MQTT received message.
- * @return esp_err_t Return code.
- */
-esp_err_t StateManager::handleDispenseRequest(MqttRxMessage_t *message) {
-    esp_err_t err = ESP_OK;
-    char message[128];
-    MqttRxDispenseActivateMessage_t *payload = nullptr;
-    ValveStates_e valveState = VALVES_UNKNOWN; 
-    DispenseProcess_t dispenseProcess = {};
+        /** Get the next message from the queue. */
+        err = mqttManager->getNextMessage(message);
+        if (err != ESP_OK) {
+            mqttManager->txWarning(TAG, "Failed to retrieve MQTT message.");
+            break;
+        }
+        if (message == nullptr) {
+            mqttManager->txWarning(TAG, "Non-zero queue count returned null reference.");
+            break;
+        }
+        
+        /** Handle message. */
+        switch (message->messageCode) {
 
-    /** Reject null input. */
-    if (message == nullptr) {
-        mqttManager->txError(TAG, "Mqtt handler received null message.");
-        return ESP_ERR_INVALID_INPUT;
+            /** Handle deactivation. */
+            case MQTT_RX_DEACTIVATE:
+                goto exit;
+                break;
+
+            case MQTT_RX_PRESSURE_CALIBRATE:
+                calibrateMessagePayload = reinterpret_cast<MqttRxPressureCalibrate_t*>(message->payload);
+                target.tankVolume = calibrateMessagePayload->tankVolume;
+                target.stepVolume = calibrateMessagePayload->stepVolume;
+                target.stepCount = calibrateMessagePayload->stepCount;
+                target.timeout = calibrateMessagePayload->timeout;
+                target.conclude = calibrateMessagePayload->conclude;
+
+                /** Process calibration message. */
+                err = pressureCalibrator->inputCalibration(pressureState, target, calibrationProcess);
+                if (err == ESP_ERR_INVALID_STATE) {
+                    mqttManager->txWarning(TAG, "The calibration point is still being measured.");
+                } else if ( (err == ESP_ERR_INVALID_ARG) || (err == ESP_ERR_NOT_SUPPORTED) ) {
+                    mqttManager->txWarning(TAG, "Invalid calibration point. Send the tank volume, and drain steps only with a tank valve and flow sensor.");
+                } else if (err != ESP_OK) {
+                    mqttManager->txError(TAG, "Error detected. Ending calibration process.");
+                    goto exit;
+                }
+                break;
+
+            case MQTT_RX_TRACE_CAPTURE:
+                handleTraceRequest(message);
+                break;
+
+            case MQTT_RX_RESOURCE_REQUEST:
+                handleResourceRequest(message);
+                break;
+
+            case MQTT_RX_CONNECTED:
+                handleConnected();
+                reconnected = true;
+                break;
+        
+            default:
+                mqttManager->txWarning(TAG, "Only DEACTIVATE and PRESSURE_CALIBRATE commands are accepted during pressure sensor calibration.");
+                break;
+
+        }
+        
     }
-    
-    /** Typecast the payload. */
-    payload = reinterpret_cast<MqttRxDispenseActivateMessage_t*>(message->payload);
 
-    /** Begin the dispensation process. */
-    err = valveManager->beginDispensation(payload*, valveState, dispenseProcess);
+    /** Update calibration state. */
+    err = pressureCalibrator->loopCalibration(pressureState, calibrationProcess, calibrationSummary, pointMeasured);
     if (err != ESP_OK) {
-        mqttManager->txError(TAG, "Valve manager failure.");
+        mqttManager->txError(TAG, "Error detected. Ending calibration process.");
+        goto exit;
     }
 
-    /** Handle state transition based on dispensation status. */
-    switch (valveState) {
-        case VALVES_UNKNOWN:
-        case VALVES_IDLE:
-        case VALVES_TANK_DRAIN:
-            mqttManager->txError(TAG, "Failed to begin dispensation.");
-            break;
-
-        case VALVES_TANK_DISPENSE:
-        case VALVES_SOURCE_DISPENSE:
+    if (pointMeasured) {
+        snprintf(log, sizeof(log), "Measured point %u: %u mV at %.2f liters.", calibrationProcess.pointCount, calibrationProcess.millivolts, calibrationProcess.tankVolume);
+        mqttManager->txInfo(TAG, log);
+    }
 
-            snprintf(message, 
-                sizeof(message), 
-                "Beginning dispense process with a target volume: %.2f liters, time: %d min, timeout: %d min", 
-                payload->targetVolume, 
-                payload->targetTime / 1000, 
-                payload->timeout / 1000
-            );
-            mqttManager->txInfo(TAG, message);
-            state = STATE_DISPENSE;
-            break;
+    /** The process carried on while disconnected, so tell the user where it stands. */
+    if (reconnected) {
+        snprintf(log, 
+            sizeof(log), 
+            "Calibration continues after %u points at %.2f liters%s.", 
+            calibrationProcess.pointCount, 
+            calibrationProcess.tankVolume, 
+            (pressureState == PRESSURE_SENSOR_CALIBRATION_WAITING_FOR_VOLUME) ? ", waiting for the tank volume" : ""
+        );
+        mqttManager->txInfo(TAG, log);
+    }
+    
+    /** Handle state transition based on calibration status. */
+    switch (pressureState) {
 
+        /** Error state. */
         default:
-            mqttManager->txError(TAG, "Unrecognized value of ValveStates_e.");
+        case PRESSURE_SENSOR_UNKNOWN:
+            mqttManager->txError(TAG, "PressureCalibrator in an invalid state.");
+            goto exit;
             break;
-    }
+        
+        /** Continuing to drain or measure. */
+        case PRESSURE_SENSOR_CALIBRATION_DRAINING:
+        case PRESSURE_SENSOR_CALIBRATION_MEASURING:
+            return;
 
-    return ESP_OK;
+        /** Waiting for the next tank volume. */
+        case PRESSURE_SENSOR_CALIBRATION_WAITING_FOR_VOLUME:
+            return;
+            
+        /** Calibration has concluded. */
+        case PRESSURE_SENSOR_IDLE:
+            break;
+    }
+
+    if (calibrationSummary.pointCount < 2) {
+        mqttManager->txWarning(TAG, "No usable fit. Calibration unchanged.");
+        goto end;
+    }
+
+    /** Apply the calibration to the next tank volume reading. */
+    configManager->getConfig(config);
+    config.pressureSensor.calibrationPointCount = calibrationSummary.pointCount;
+    config.pressureCalibrationTable = calibrationSummary.points;
+
+    err = configManager->setConfig(config);
+    if (err == ESP_OK) {
+        err = configManager->persist();
+    }
+    if (err != ESP_OK) {
+        mqttManager->txError(TAG, "Failed to persist pressure sensor calibration.");
+        goto end;
+    }
+
+    /** The sensor ADC is claimed again, which allocates. */
+    configManager->getConfig(config);
+    halHeapGuardSuspend();
+    err = pressureManager->configure(config);
+    halHeapGuardResume();
+    if (err != ESP_OK) {
+        mqttManager->txError(TAG, "Failed to configure pressure sensor.");
+    }
+
+    /** Republish the retained config of the new generation. */
+    mqttManager->setConfigGeneration(configManager->getGeneration());
+    err = mqttManager->txConfig(config);
+    if (err != ESP_OK) {
+        mqttManager->txWarning(TAG, "Failed to transmit config.");
+    }
+
+    snprintf(log, 
+        sizeof(log), 
+        "Saved pressure sensor calibration of %u points from a degree %u fit of %u points, residual %.2f liters.", 
+        calibrationSummary.pointCount, 
+        calibrationSummary.degree, 
+        calibrationSummary.measuredCount, 
+        calibrationSummary.residual
+    );
+    mqttManager->txInfo(TAG, log);
+
+end:
+    mqttManager->txInfo(TAG, "Concluded calibration process.");
+    state = STATE_LISTEN;
+    return;
+
+exit:
+    /** End the process without changing the config. */
+    err = pressureCalibrator->endCalibration(pressureState, calibrationProcess);
+    if ( (err != ESP_OK) || (pressureState != PRESSURE_SENSOR_IDLE) ) {
+        mqttManager->txError(TAG, "Failed to deactivate dispensation.");
+    }
+
+    mqttManager->txInfo(TAG, "Ended calibration process.");
+    state = STATE_LISTEN;
+    return;
+}
+
+/**
+ * @brief Handler for state STATE_DRAIN.
+ */
+void StateManager::drain() {
+    esp_err_t err = ESP_OK;
+    MqttRxMessage_t* message = nullptr;
+    ValveStates_e valveState = VALVES_UNKNOWN;
+    DrainProcess_t drainProcess = {};
+    DrainSummary_t drainSummary = {};
+    bool endProcess = false;
+
+    /** Wait for the next update, returning early if a message arrives. */
+    mqttManager->waitForMessage(PROCESS_UPDATE_PERIOD_MS);
+
+    /** Check for new MQTT messages. */
+    while(mqttManager->numMessagesInQueue() > 0) {
+
+        /** Get the next message from the queue. */
+        err = mqttManager->getNextMessage(message);
+        if (err != ESP_OK) {
+            mqttManager->txWarning(TAG, "Failed to retrieve MQTT message.");
+            break;
+        }
+        if (message == nullptr) {
+            mqttManager->txWarning(TAG, "Non-zero queue count returned null reference.");
+            break;
+        }
+        
+        /** Handle message. */
+        switch (message->messageCode) {
+
+            /** Handle deactivation. */
+            case MQTT_RX_DEACTIVATE:
+                handleDeactivateRequest(message, endProcess);
+                if (endProcess) goto exit;
+                break;
+
+            /** Queue jobs to begin once this process ends. */
+            case MQTT_RX_DISPENSE_ACTIVATE:
+                handleDispenseRequest(message);
+                break;
+
+            case MQTT_RX_DRAIN:
+                handleDrainRequest(message);
+                break;
+
+            case MQTT_RX_TRACE_CAPTURE:
+                handleTraceRequest(message);
+                break;
+
+            case MQTT_RX_RESOURCE_REQUEST:
+                handleResourceRequest(message);
+                break;
+
+            case MQTT_RX_CONNECTED:
+                handleConnected();
+                break;
+        
+            default:
+                mqttManager->txWarning(TAG, "Only DEACTIVATE, dispense and drain commands are accepted during draining.");
+                break;
+
+        }
+        
+    }
+
+    /** Queue scheduled runs which became due during the process. */
+    checkSchedule();
+
+    /** Update drain state. */
+    err = valveManager->loopDrain(valveState, drainProcess, drainSummary);
+    if (err != ESP_OK) {
+        mqttManager->txError(TAG, "Error detected. Ending drain process.");
+        goto exit;
+    }
+
+    /** Handle state transition based on drain status. */
+    switch (valveState) {
+
+        /** Error state. */
+        default:
+        case VALVES_UNKNOWN:
+        case VALVES_TANK_DISPENSE:
+        case VALVES_SOURCE_DISPENSE:
+        case VALVES_BLENDED_DISPENSE:
+        case VALVES_CLOSING:
+        case VALVES_CHARACTERISE:
+            mqttManager->txError(TAG, "ValveManager in an invalid state.");
+            goto exit;
+            break;
+
+        /** Continuing to drain. */
+        case VALVES_TANK_DRAIN:
+            return;
+
+        /** The target time has elapsed. */
+        case VALVES_IDLE:
+            err = mqttManager->txDrainSummary(drainSummary);
+            if (err != ESP_OK) {
+                mqttManager->txError(TAG, "Failed to transmit drain summary.");
+            }
+            mqttManager->txInfo(TAG, "Concluded drain process.");
+            beginNextJob();
+            return;
+    }
+
+exit:
+    /** End the process. */
+    err = valveManager->endDrain(valveState, drainProcess, drainSummary);
+    if ( (err != ESP_OK) || (valveState != VALVES_IDLE) ) {
+        mqttManager->txError(TAG, "Failed to deactivate draining.");
+    }
+
+    err = mqttManager->txDrainSummary(drainSummary);
+    if (err != ESP_OK) {
+        mqttManager->txError(TAG, "Failed to transmit drain summary.");
+    }
+
+    mqttManager->txInfo(TAG, "Ended drain process.");
+    beginNextJob();
+    return;
+}
+
+/**
+ * @brief Handler for state STATE_VALVE_CHARACTERISE.
+ */
+void StateManager::characterise() {
+    esp_err_t err = ESP_OK;
+    MqttRxMessage_t* message = nullptr;
+    ValveStates_e valveState = VALVES_UNKNOWN;
+    CharacteriseSummary_t summary = {};
+    Config_t config = {};
+    bool endProcess = false;
+
+    /** Wait for the next update, returning early if a message arrives. */
+    mqttManager->waitForMessage(PROCESS_UPDATE_PERIOD_MS);
+
+    /** Check for new MQTT messages. */
+    while(mqttManager->numMessagesInQueue() > 0) {
+
+        /** Get the next message from the queue. */
+        err = mqttManager->getNextMessage(message);
+        if (err != ESP_OK) {
+            mqttManager->txWarning(TAG, "Failed to retrieve MQTT message.");
+            break;
+        }
+        if (message == nullptr) {
+            mqttManager->txWarning(TAG, "Non-zero queue count returned null reference.");
+            break;
+        }
+        
+        /** Handle message. */
+        switch (message->messageCode) {
+
+            /** Handle deactivation. */
+            case MQTT_RX_DEACTIVATE:
+                handleDeactivateRequest(message, endProcess);
+                if (endProcess) goto exit;
+                break;
+
+            /** Queue jobs to begin once this process ends. */
+            case MQTT_RX_DISPENSE_ACTIVATE:
+                handleDispenseRequest(message);
+                break;
+
+            case MQTT_RX_DRAIN:
+                handleDrainRequest(message);
+                break;
+
+            case MQTT_RX_TRACE_CAPTURE:
+                handleTraceRequest(message);
+                break;
+
+            case MQTT_RX_RESOURCE_REQUEST:
+                handleResourceRequest(message);
+                break;
+
+            case MQTT_RX_CONNECTED:
+                handleConnected();
+                break;
+        
+            default:
+                mqttManager->txWarning(TAG, "Only DEACTIVATE, dispense and drain commands are accepted during valve characterisation.");
+                break;
+
+        }
+        
+    }
+
+    /** Queue scheduled runs which became due during the process. */
+    checkSchedule();
+
+    /** Update characterisation state. */
+    err = valveManager->loopCharacterise(valveState, summary);
+    if (err != ESP_OK) {
+        mqttManager->txError(TAG, "Error detected. Ending valve characterisation.");
+        goto exit;
+    }
+
+    /** Handle state transition based on characterisation status. */
+    switch (valveState) {
+
+        /** Error state. */
+        default:
+        case VALVES_UNKNOWN:
+        case VALVES_TANK_DISPENSE:
+        case VALVES_SOURCE_DISPENSE:
+        case VALVES_BLENDED_DISPENSE:
+        case VALVES_CLOSING:
+        case VALVES_TANK_DRAIN:
+            mqttManager->txError(TAG, "ValveManager in an invalid state.");
+            goto exit;
+            break;
+
+        /** Continuing to characterise. */
+        case VALVES_CHARACTERISE:
+            return;
+
+        /** Every supply valve was cycled. */
+        case VALVES_IDLE:
+            break;
+    }
+
+    err = mqttManager->txValveLatency(summary);
+    if (err != ESP_OK) {
+        mqttManager->txWarning(TAG, "Failed to transmit valve latency.");
+    }
+
+    /** Supplies without a measurement keep their previous latency. */
+    configManager->getConfig(config);
+    if (summary.source.measured) {
+        config.valves.sourceLatency = summary.source.latency;
+    }
+    if (summary.tank.measured) {
+        config.valves.tankLatency = summary.tank.latency;
+    }
+
+    err = configManager->setConfig(config);
+    if (err == ESP_OK) {
+        err = configManager->persist();
+    }
+    if (err != ESP_OK) {
+        mqttManager->txError(TAG, "Failed to persist valve latency.");
+        beginNextJob();
+        return;
+    }
+
+    /** Apply the latency to the next dispense process. */
+    err = valveManager->configure(config);
+    if (err != ESP_OK) {
+        mqttManager->txError(TAG, "Failed to configure valves.");
+    }
+
+    /** Republish the retained config of the new generation. */
+    mqttManager->setConfigGeneration(configManager->getGeneration());
+    err = mqttManager->txConfig(config);
+    if (err != ESP_OK) {
+        mqttManager->txWarning(TAG, "Failed to transmit config.");
+    }
+
+    mqttManager->txInfo(TAG, "Concluded valve characterisation.");
+    beginNextJob();
+    return;
+
+exit:
+    /** End the process without changing the config. */
+    err = valveManager->endCharacterise(valveState);
+    if ( (err != ESP_OK) || (valveState != VALVES_IDLE) ) {
+        mqttManager->txError(TAG, "Failed to deactivate valve characterisation.");
+    }
+
+    mqttManager->txInfo(TAG, "Ended valve characterisation.");
+    beginNextJob();
+    return;
+}
+
+/**
+ * @brief Handler for state STATE_SLEEP.
+ */
+void StateManager::sleep() {
+    esp_err_t err = ESP_OK;
+    Config_t config = {};
+    PowerStats_t powerStats = {};
+    int64_t elapsed = 0;
+
+    err = configManager->getConfig(config);
+    if (err != ESP_OK) {
+        mqttManager->txError(TAG, "Failed to retrieve device config.");
+        goto listen;
+    }
+
+    /** A scheduled run is due, so it is started instead of sleeping through it. */
+    if (scheduleManager->getTimeUntilNext() == 0) {
+        goto listen;
+    }
+
+    /** Report the power statistics of this wake before sleeping. */
+    if (sleepReported == false) {
+        powerManager->getStats(powerStats, true);
+        err = mqttManager->txPowerReport(powerStats);
+        if (err != ESP_OK) {
+            mqttManager->txWarning(TAG, "Failed to transmit power report.");
+        }
+        sleepReported = true;
+        sleepReportTime = halTimeMicros();
+    }
+
+    /** Deep sleep drops the connection, so the report is given time to reach the broker first. */
+    elapsed = (halTimeMicros() - sleepReportTime) / 1000;
+    if ( mqttManager->isPublishPending() && (elapsed < DEEP_SLEEP_PUBLISH_TIMEOUT_MS) ) {
+        /** A command arriving meanwhile is handled before sleeping. */
+        if (mqttManager->waitForMessage(DEEP_SLEEP_PUBLISH_POLL_MS)) {
+            goto listen;
+        }
+        return;
+    }
+    sleepReported = false;
+
+    /** Does not return on success. */
+    err = powerManager->enterDeepSleep(config.system, scheduleManager->getTimeUntilNext(), configManager->getGeneration());
+    mqttManager->txError(TAG, "Failed to enter deep sleep.");
+    state = STATE_LISTEN;
+    return;
+
+listen:
+    sleepReported = false;
+    state = STATE_LISTEN;
+    return;
+}
+
+/**
+ * @brief Handles a connection being established. Republishes the config
+ * unless the session was resumed, flushes the messages buffered while
+ * disconnected, and reports the connection.
+ * 
+ * @return esp_err_t Return code.
+ */
+esp_err_t StateManager::handleConnected() {
+    esp_err_t err = ESP_OK;
+    ConnectionTiming_t timing = {};
+    WakeReport_t wakeReport = {};
+    Config_t config = {};
+
+    /** The retained config is up to date if the broker kept the session of this config generation. */
+    if (mqttManager->isSessionResumed() == false) {
+        configManager->getConfig(config);
+        err = mqttManager->txConfig(config);
+        if (err != ESP_OK) {
+            mqttManager->txWarning(TAG, "Failed to transmit config.");
+        }
+    }
+
+    err = mqttManager->flush();
+    if (err != ESP_OK) {
+        mqttManager->txWarning(TAG, "Failed to flush buffered messages.");
+    }
+
+    connectionManager->getTiming(timing);
+    err = mqttManager->txConnectionReport(timing);
+    if (err != ESP_OK) {
+        mqttManager->txWarning(TAG, "Failed to transmit connection report.");
+    }
+
+    /** Report the boot to command readiness latency on the first connection. */
+    if (bootReported == false) {
+        powerManager->markBootPhase(BOOT_PHASE_NETWORK);
+        powerManager->markBootPhase(BOOT_PHASE_READY);
+        powerManager->getWakeReport(wakeReport, configManager->restoredFromRtc());
+        err = mqttManager->txWakeReport(wakeReport);
+        if (err != ESP_OK) {
+            mqttManager->txWarning(TAG, "Failed to transmit wake report.");
+        }
+        bootReported = true;
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Begins a job, or queues it behind the active process.
+ * 
+ * @param job The job. Assigned an ID if it has none.
+ * @return esp_err_t Return code. ESP_ERR_NO_MEM if the queue is full,
+ * ESP_ERR_INVALID_STATE if the active or a waiting job has the same ID,
+ * ESP_ERR_INVALID_ARG if the ID is in the range of assigned IDs.
+ */
+esp_err_t StateManager::submitJob(Job_t &job) {
+    esp_err_t err = ESP_OK;
+    char log[64];
+
+    /** Assigned IDs have a range of their own, so a command cannot take one. */
+    if (job.id >= JOB_AUTO_ID_MIN) {
+        snprintf(log, sizeof(log), "ID out of range, rejected job %lu.", (unsigned long) job.id);
+        mqttManager->txWarning(TAG, log);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    jobQueue.assignId(job);
+
+    /** Queued jobs begin as soon as the active process ends, without waiting for the scheduler. */
+    if ( (state == STATE_DISPENSE) || (state == STATE_DRAIN) || (state == STATE_VALVE_CHARACTERISE) ) {
+        err = (job.id == activeJobId) ? ESP_ERR_INVALID_STATE : jobQueue.push(job);
+        if (err == ESP_ERR_INVALID_STATE) {
+            snprintf(log, sizeof(log), "Duplicate ID, rejected job %lu.", (unsigned long) job.id);
+            mqttManager->txWarning(TAG, log);
+        } else if (err != ESP_OK) {
+            snprintf(log, sizeof(log), "Job queue full, rejected job %lu.", (unsigned long) job.id);
+            mqttManager->txWarning(TAG, log);
+        }
+        reportQueue();
+        return err;
+    }
+
+    return beginJob(job);
+}
+
+/**
+ * @brief Begins the process of a job and enters its state.
+ * 
+ * @param job The job.
+ * @return esp_err_t Return code.
+ */
+esp_err_t StateManager::beginJob(Job_t &job) {
+    esp_err_t err = ESP_OK;
+    char log[160];
+    ValveStates_e valveState = VALVES_UNKNOWN; 
+    DispenseProcess_t dispenseProcess = {};
+    DrainProcess_t drainProcess = {};
+    Config_t config = {};
+
+    switch (job.type) {
+        case JOB_DISPENSE:
+            err = valveManager->beginDispense(job.plan, valveState, dispenseProcess);
+            if (err != ESP_OK) {
+                snprintf(log, sizeof(log), "Failed to begin dispensation of job %lu: %s", (unsigned long) job.id, esp_err_to_name(err));
+                mqttManager->txError(TAG, log);
+                return err;
+            }
+
+            configManager->getConfig(config);
+            sliceResolution = config.dispense.dataResolutionLiters;
+            lastSliceVolume = 0;
+            processJournal.begin(job.id, job.plan, valveState, dispenseProcess);
+            journalState = valveState;
+
+            snprintf(log, 
+                sizeof(log), 
+                "Beginning dispense job %lu of %d zones, first target volume: %.2f liters, time: %lu s, zone: %d", 
+                (unsigned long) job.id,
+                job.plan.stepCount,
+                job.plan.steps[0].targetVolume, 
+                (unsigned long) (job.plan.steps[0].targetTime / 1000), 
+                job.plan.steps[0].zone
+            );
+            state = STATE_DISPENSE;
+            break;
+
+        case JOB_DRAIN:
+            err = valveManager->beginDrain(job.drain, valveState, drainProcess);
+            if (err != ESP_OK) {
+                snprintf(log, sizeof(log), "Failed to begin draining of job %lu: %s", (unsigned long) job.id, esp_err_to_name(err));
+                mqttManager->txError(TAG, log);
+                return err;
+            }
+
+            snprintf(log, 
+                sizeof(log), 
+                "Beginning drain job %lu, target time: %lu s", 
+                (unsigned long) job.id,
+                (unsigned long) (job.drain.targetTime / 1000)
+            );
+            state = STATE_DRAIN;
+            break;
+
+        default:
+            return ESP_ERR_INVALID_ARG;
+    }
+
+    mqttManager->txInfo(TAG, log);
+    activeJobId = job.id;
+    reportQueue();
+    return ESP_OK;
+}
+
+/**
+ * @brief Begins the next queued job once the active process has ended,
+ * or returns to STATE_LISTEN if none is waiting.
+ */
+void StateManager::beginNextJob() {
+    Job_t job = {};
+
+    activeJobId = 0;
+
+    /** Jobs which fail to begin were reported, and are skipped. */
+    while (jobQueue.pop(job) == ESP_OK) {
+        if (beginJob(job) == ESP_OK) {
+            return;
+        }
+    }
+
+    state = STATE_LISTEN;
+    reportQueue();
+}
+
+/**
+ * @brief Reports a dispense process interrupted by a reset before this boot, and queues
+ * what is left of its run plan if DispenseConfig_t::resumeInterrupted is set.
+ *
+ * @param config Device config.
+ */
+void StateManager::recoverProcess(Config_t &config) {
+    esp_err_t err = ESP_OK;
+    ProcessRecovery_t recovery = {};
+    Job_t job = {};
+    char log[160];
+
+    err = processJournal.recover(recovery);
+    if (err != ESP_OK) {
+        return;
+    }
+
+    /** The resumed job gets a new ID, from the counter retained with the journal. */
+    if ( config.dispense.resumeInterrupted && (recovery.remaining.stepCount > 0) ) {
+        job.type = JOB_DISPENSE;
+        job.plan = recovery.remaining;
+        err = jobQueue.push(job);
+        if (err == ESP_OK) {
+            recovery.resumeId = job.id;
+        }
+    }
+
+    snprintf(log,
+        sizeof(log),
+        "Dispense job %lu was interrupted by a reset at step %u of %u, after %.2f liters. %s",
+        (unsigned long) recovery.jobId,
+        (recovery.step < recovery.stepCount) ? recovery.step + 1 : recovery.stepCount,
+        recovery.stepCount,
+        recovery.deliveredVolume,
+        (recovery.resumeId != 0) ? "Resuming the rest of its run." : "Not resumed."
+    );
+    mqttManager->txWarning(TAG, log);
+
+    err = mqttManager->txRecovery(recovery);
+    if (err != ESP_OK) {
+        mqttManager->txWarning(TAG, "Failed to transmit recovery summary.");
+    }
+}
+
+/**
+ * @brief Transmits the active job and the jobs waiting behind it.
+ */
+void StateManager::reportQueue() {
+    esp_err_t err = ESP_OK;
+    JobQueueStatus_t status = {};
+
+    status.activeId = activeJobId;
+    jobQueue.getStatus(status);
+    err = mqttManager->txQueueStatus(status);
+    if (err != ESP_OK) {
+        mqttManager->txWarning(TAG, "Failed to transmit queue status.");
+    }
+}
+
+/**
+ * @brief Submits the scheduled run if its deadline is due.
+ */
+void StateManager::checkSchedule() {
+    esp_err_t err = ESP_OK;
+    Job_t job = {};
+    bool due = false;
+
+    err = scheduleManager->getDueRun(job.plan, due);
+    if (err == ESP_ERR_TIMEOUT) {
+        mqttManager->txWarning(TAG, "Skipped a scheduled run missed by more than the late limit.");
+        return;
+    }
+    if ( (err != ESP_OK) || (due == false) ) {
+        return;
+    }
+
+    mqttManager->txInfo(TAG, "Scheduled run is due.");
+    job.type = JOB_DISPENSE;
+    submitJob(job);
+}
+
+/**
+ * @brief Checks the flow sensor against the tank level at the end of a dispense process.
+ * Proposes or applies the K-factor which matches the tank, as set by FlowSensorConfig_t::recalibration,
+ * and otherwise warns if the flow sensor drifts.
+ *
+ * @param summary Summary of the last step.
+ */
+void StateManager::recalibrateFlowSensor(DispenseSummary_t &summary) {
+    esp_err_t err = ESP_OK;
+    Config_t config = {};
+    float pulsesPerLiter = 0;
+    char log[128];
+
+    configManager->getConfig(config);
+    if (config.flowSensor.recalibration == FLOW_RECALIBRATION_OFF) {
+        err = ESP_ERR_NOT_SUPPORTED;
+    } else {
+        err = valveManager->proposeRecalibration(pulsesPerLiter);
+    }
+
+    if (err == ESP_ERR_INVALID_SIZE) {
+        snprintf(log, sizeof(log), "Tank level gives a flow sensor calibration of %.2f pulses/L, beyond the limit. Check the pressure sensor.", pulsesPerLiter);
+        mqttManager->txWarning(TAG, log);
+        return;
+    }
+    if (err != ESP_OK) {
+        if (summary.meterDrift) {
+            snprintf(log, sizeof(log), "Flow sensor reads %+.1f%% against the tank level. Recalibration advised.", (1 / summary.correction - 1) * 100);
+            mqttManager->txWarning(TAG, log);
+        }
+        return;
+    }
+    if (config.flowSensor.recalibration == FLOW_RECALIBRATION_PROPOSE) {
+        snprintf(log, sizeof(log), "Tank level gives a flow sensor calibration of %.2f pulses/L, currently %.2f.", pulsesPerLiter, config.flowSensor.defaultPulsesPerLiter);
+        mqttManager->txInfo(TAG, log);
+        return;
+    }
+
+    /** As for a manual calibration. The new K-factor restarts the estimate. */
+    config.flowSensor.defaultPulsesPerLiter = pulsesPerLiter;
+    err = configManager->setConfig(config);
+    if (err == ESP_OK) {
+        err = configManager->persist();
+    }
+    if (err != ESP_OK) {
+        mqttManager->txError(TAG, "Failed to persist flow sensor calibration.");
+        return;
+    }
+
+    err = valveManager->configure(config);
+    if (err != ESP_OK) {
+        mqttManager->txError(TAG, "Failed to configure valves.");
+    }
+
+    mqttManager->setConfigGeneration(configManager->getGeneration());
+    err = mqttManager->txConfig(config);
+    if (err != ESP_OK) {
+        mqttManager->txWarning(TAG, "Failed to transmit config.");
+    }
+
+    snprintf(log, sizeof(log), "Saved flow sensor calibration of %.2f pulses/L from the tank level.", pulsesPerLiter);
+    mqttManager->txInfo(TAG, log);
+}
+
+/**
+ * @brief Handles state change for a dispense request.
+ * 
+ * @param message MQTT received message.
+ * @return esp_err_t Return code.
+ */
+esp_err_t StateManager::handleDispenseRequest(MqttRxMessage_t *message) {
+    Job_t job = {};
+
+    /** Reject null input. */
+    if (message == nullptr) {
+        mqttManager->txError(TAG, "Mqtt handler received null message.");
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    /** Typecast the payload. */
+    job.id = message->jobId;
+    job.type = JOB_DISPENSE;
+    job.plan = *reinterpret_cast<MqttRxDispenseActivateMessage_t*>(message->payload);
+
+    return submitJob(job);
 }
 
+/**
+ * @brief Handles a deactivate request during a process. A waiting job
+ * is cancelled by its ID, otherwise the active process ends and the queue is cleared.
+ * 
+ * @param message MQTT received message.
+ * @param endProcess Set to true if the active process must end.
+ * @return esp_err_t Return code.
+ */
+esp_err_t StateManager::handleDeactivateRequest(MqttRxMessage_t *message, bool &endProcess) {
+    esp_err_t err = ESP_OK;
+    char log[64];
+
+    endProcess = false;
+
+    /** Reject null input. */
+    if (message == nullptr) {
+        mqttManager->txError(TAG, "Mqtt handler received null message.");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if ( (message->jobId != 0) && (message->jobId != activeJobId) ) {
+        err = jobQueue.remove(message->jobId);
+        if (err != ESP_OK) {
+            snprintf(log, sizeof(log), "Job %lu is not queued.", (unsigned long) message->jobId);
+            mqttManager->txWarning(TAG, log);
+            return err;
+        }
+
+        snprintf(log, sizeof(log), "Cancelled job %lu.", (unsigned long) message->jobId);
+        mqttManager->txInfo(TAG, log);
+        reportQueue();
+        return ESP_OK;
+    }
+
+    /** Deactivating the active process also stops everything queued behind it. */
+    jobQueue.clear();
+    endProcess = true;
+    return ESP_OK;
+}
 
 /**
  * @brief Handles state change for a config change request.
@@ -531,8 +1687,106 @@ esp_err_t StateManager::handleDispenseRequest(MqttRxMessage_t *message) {
  * @param message MQTT received message.
  * @return esp_err_t Return code.
  */
-esp_err_t handleConfigChangeRequest(MqttRxMessage_t *message) {
+esp_err_t StateManager::handleConfigChangeRequest(MqttRxMessage_t *message) {
+    esp_err_t err = ESP_OK;
+    Config_t config = {};
+    bool found = false;
+    bool tankFound = false;
+
+    /** Reject null input. */
+    if (message == nullptr) {
+        mqttManager->txError(TAG, "Mqtt handler received null message.");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    configManager->getConfig(config);
+
+    /** Only the schedule, the sleep interval, the resume of interrupted processes, the flow sensor recalibration, the tank geometry and the pressure sensor scale can be changed so far. */
+    err = codecDecodeSchedule(message->payload, config.schedule);
+    if ( (err != ESP_OK) && (err != ESP_ERR_NOT_FOUND) ) {
+        mqttManager->txError(TAG, "Invalid schedule in config change.");
+        return err;
+    }
+    found = (err == ESP_OK);
+
+    err = codecDecodeSystem(message->payload, config.system);
+    if ( (err != ESP_OK) && (err != ESP_ERR_NOT_FOUND) ) {
+        mqttManager->txError(TAG, "Invalid system fields in config change.");
+        return err;
+    }
+    found = found || (err == ESP_OK);
+
+    err = codecDecodeDispense(message->payload, config.dispense);
+    if ( (err != ESP_OK) && (err != ESP_ERR_NOT_FOUND) ) {
+        mqttManager->txError(TAG, "Invalid dispense fields in config change.");
+        return err;
+    }
+    found = found || (err == ESP_OK);
+
+    err = codecDecodeFlowSensor(message->payload, config.flowSensor);
+    if ( (err != ESP_OK) && (err != ESP_ERR_NOT_FOUND) ) {
+        mqttManager->txError(TAG, "Invalid flow sensor fields in config change.");
+        return err;
+    }
+    found = found || (err == ESP_OK);
+
+    err = codecDecodeTank(message->payload, config.tank);
+    if ( (err != ESP_OK) && (err != ESP_ERR_NOT_FOUND) ) {
+        mqttManager->txError(TAG, "Invalid tank fields in config change.");
+        return err;
+    }
+    tankFound = (err == ESP_OK);
+
+    err = codecDecodePressureSensor(message->payload, config.pressureSensor);
+    if ( (err != ESP_OK) && (err != ESP_ERR_NOT_FOUND) ) {
+        mqttManager->txError(TAG, "Invalid pressure sensor fields in config change.");
+        return err;
+    }
+    tankFound = tankFound || (err == ESP_OK);
+    found = found || tankFound;
+
+    if (found == false) {
+        mqttManager->txWarning(TAG, "Config change contains no supported fields.");
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    err = configManager->setConfig(config);
+    if (err != ESP_OK) goto err;
+
+    err = configManager->persist();
+    if (err != ESP_OK) goto err;
+
+    /** The time zone is set in the environment, which allocates. Config changes are not part of the steady state. */
+    halHeapGuardSuspend();
+    err = scheduleManager->configure(config.schedule);
+    halHeapGuardResume();
+    if (err != ESP_OK) {
+        mqttManager->txWarning(TAG, "Failed to configure the schedule.");
+    }
+
+    /** The tank geometry is compiled on configure. The sensor ADC is claimed again, which allocates. */
+    if (tankFound) {
+        halHeapGuardSuspend();
+        err = pressureManager->configure(config);
+        halHeapGuardResume();
+        if (err != ESP_OK) {
+            mqttManager->txWarning(TAG, "Invalid pressure sensor config. Tank volume is unavailable.");
+        }
+    }
+
+    /** Republish the retained config of the new generation. */
+    mqttManager->setConfigGeneration(configManager->getGeneration());
+    err = mqttManager->txConfig(config);
+    if (err != ESP_OK) {
+        mqttManager->txWarning(TAG, "Failed to transmit config.");
+    }
+
+    mqttManager->txInfo(TAG, "Applied config change.");
     return ESP_OK;
+
+err:
+    mqttManager->txError(TAG, "Failed to persist config change.");
+    return err;
 }
 
 /**
@@ -541,26 +1795,30 @@ esp_err_t handleConfigChangeRequest(MqttRxMessage_t *message) {
  * @param message MQTT received message.
  * @return esp_err_t Return code.
  */
-esp_err_t handleFlowCalibrateRequest(MqttRxMessage_t *message) {
+esp_err_t StateManager::handleFlowCalibrateRequest(MqttRxMessage_t *message) {
     esp_err_t err = ESP_OK;
-    char message[128];
+    char log[128];
     MqttRxFlowCalibrate_t *payload = nullptr;
+    FlowCalibrateTarget_t target = {};
     FlowSensorStates_e flowState = FLOW_SENSOR_UNKNOWN; 
     FlowCalibrateProcess_t calibrateProcess = {};
 
     /** Reject null input. */
     if (message == nullptr) {
         mqttManager->txError(TAG, "Mqtt handler received null message.");
-        return ESP_ERR_INVALID_INPUT;
+        return ESP_ERR_INVALID_ARG;
     }
     
     /** Typecast the payload. */
     payload = reinterpret_cast<MqttRxFlowCalibrate_t*>(message->payload);
+    target.targetVolume = payload->targetVolume;
+    target.timeout = payload->timeout;
 
     /** Begin the calibration process. */
-    err = flowManager->beginCalibration(payload*, flowState, calibrateProcess);
+    err = flowManager->beginCalibration(target, flowState, calibrateProcess);
     if (err != ESP_OK) {
         mqttManager->txError(TAG, "Flow manager failure.");
+        return err;
     }
 
     /** Handle state transition based on dispensation status. */
@@ -571,15 +1829,15 @@ esp_err_t handleFlowCalibrateRequest(MqttRxMessage_t *message) {
             mqttManager->txError(TAG, "Failed to begin dispensation.");
             break;
 
-        case SENSOR_CALIBRATING:
+        case FLOW_SENSOR_CALIBRATION_DISPENSING:
 
-            snprintf(message, 
-                sizeof(message), 
-                "Beginning calibration process with a target volume: %.2f liters, timeout: %d min", 
+            snprintf(log, 
+                sizeof(log), 
+                "Beginning calibration process with a target volume: %.2f liters, timeout: %lu s", 
                 payload->targetVolume, 
-                payload->timeout / (1000 * 60)
+                (unsigned long) payload->timeout
             );
-            mqttManager->txInfo(TAG, message);
+            mqttManager->txInfo(TAG, log);
             state = STATE_FLOW_CALIBRATE;
             break;
 
@@ -597,7 +1855,61 @@ esp_err_t handleFlowCalibrateRequest(MqttRxMessage_t *message) {
  * @param message MQTT received message.
  * @return esp_err_t Return code.
  */
-esp_err_t handlePressureCalibrateRequest(MqttRxMessage_t *message) {
+esp_err_t StateManager::handlePressureCalibrateRequest(MqttRxMessage_t *message) {
+    esp_err_t err = ESP_OK;
+    char log[128];
+    MqttRxPressureCalibrate_t *payload = nullptr;
+    PressureCalibrateTarget_t target = {};
+    PressureSensorStates_e pressureState = PRESSURE_SENSOR_UNKNOWN;
+    PressureCalibrateProcess_t calibrateProcess = {};
+
+    /** Reject null input. */
+    if (message == nullptr) {
+        mqttManager->txError(TAG, "Mqtt handler received null message.");
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    /** Typecast the payload. */
+    payload = reinterpret_cast<MqttRxPressureCalibrate_t*>(message->payload);
+    target.tankVolume = payload->tankVolume;
+    target.stepVolume = payload->stepVolume;
+    target.stepCount = payload->stepCount;
+    target.timeout = payload->timeout;
+    target.conclude = payload->conclude;
+
+    /** Begin the calibration process. */
+    err = pressureCalibrator->beginCalibration(target, pressureState, calibrateProcess);
+    if (err == ESP_ERR_NOT_SUPPORTED) {
+        mqttManager->txError(TAG, "No pressure sensor, or no tank valve and flow sensor for drain steps.");
+        return err;
+    }
+    if (err == ESP_ERR_INVALID_ARG) {
+        mqttManager->txError(TAG, "Calibration needs the tank volume of the first point.");
+        return err;
+    }
+    if (err != ESP_OK) {
+        mqttManager->txError(TAG, "Pressure calibrator failure.");
+        return err;
+    }
+
+    /** Handle state transition based on calibration status. */
+    switch (pressureState) {
+        case PRESSURE_SENSOR_CALIBRATION_MEASURING:
+            snprintf(log, 
+                sizeof(log), 
+                "Beginning calibration process at a tank volume: %.2f liters, drain steps: %.2f liters", 
+                payload->tankVolume, 
+                payload->stepVolume
+            );
+            mqttManager->txInfo(TAG, log);
+            state = STATE_PRESSURE_CALIBRATE;
+            break;
+
+        default:
+            mqttManager->txError(TAG, "Failed to begin calibration.");
+            break;
+    }
+
     return ESP_OK;
 }
 
@@ -607,8 +1919,21 @@ esp_err_t handlePressureCalibrateRequest(MqttRxMessage_t *message) {
  * @param message MQTT received message.
  * @return esp_err_t Return code.
  */
-esp_err_t handleDrainRequest(MqttRxMessage_t *message) {
-    return ESP_OK
+esp_err_t StateManager::handleDrainRequest(MqttRxMessage_t *message) {
+    Job_t job = {};
+
+    /** Reject null input. */
+    if (message == nullptr) {
+        mqttManager->txError(TAG, "Mqtt handler received null message.");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    /** Typecast the payload. */
+    job.id = message->jobId;
+    job.type = JOB_DRAIN;
+    job.drain = *reinterpret_cast<DrainTarget_t*>(message->payload);
+
+    return submitJob(job);
 }
 
 /**
@@ -617,6 +1942,154 @@ esp_err_t handleDrainRequest(MqttRxMessage_t *message) {
  * @param message MQTT received message.
  * @return esp_err_t Return code.
  */
-esp_err_t handlePressurePollRequest(MqttRxMessage_t *message) {
-    return ESP_OK
+esp_err_t StateManager::handlePressurePollRequest(MqttRxMessage_t *message) {
+    esp_err_t err = ESP_OK;
+    char log[96];
+    uint16_t millivolts = 0;
+    float volume = 0;
+    bool calibrated = false;
+
+    /** Reject null input. */
+    if (message == nullptr) {
+        mqttManager->txError(TAG, "Mqtt handler received null message.");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    err = pressureManager->readVoltage(millivolts);
+    if (err != ESP_OK) goto err;
+
+    /** An uncalibrated sensor still reports its voltage, so it can be calibrated by hand. */
+    calibrated = pressureManager->isCalibrated();
+    if (calibrated) {
+        err = pressureManager->getTankVolume(volume);
+        if (err != ESP_OK) goto err;
+    }
+
+    return mqttManager->txPressureReport(millivolts, volume, calibrated);
+
+err:
+    snprintf(log, sizeof(log), "Failed to read the pressure sensor: %s", esp_err_to_name(err));
+    mqttManager->txError(TAG, log);
+    return err;
+}
+
+/**
+ * @brief Handles state change for a valve characterisation request.
+ * 
+ * @param message MQTT received message.
+ * @return esp_err_t Return code.
+ */
+esp_err_t StateManager::handleCharacteriseRequest(MqttRxMessage_t *message) {
+    esp_err_t err = ESP_OK;
+    char log[96];
+    ValveStates_e valveState = VALVES_UNKNOWN;
+
+    /** Reject null input. */
+    if (message == nullptr) {
+        mqttManager->txError(TAG, "Mqtt handler received null message.");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    err = valveManager->beginCharacterise(valveState);
+    if (err != ESP_OK) {
+        snprintf(log, sizeof(log), "Failed to begin valve characterisation: %s", esp_err_to_name(err));
+        mqttManager->txError(TAG, log);
+        return err;
+    }
+
+    mqttManager->txInfo(TAG, "Began valve characterisation.");
+    state = STATE_VALVE_CHARACTERISE;
+    return ESP_OK;
+}
+
+/**
+ * @brief Handles a request to start or stop capturing a trace of the inputs.
+ * 
+ * @param message MQTT received message.
+ * @return esp_err_t Return code.
+ */
+esp_err_t StateManager::handleTraceRequest(MqttRxMessage_t *message) {
+    esp_err_t err = ESP_OK;
+    char log[96];
+    bool on = false;
+
+    /** Reject null input. */
+    if (message == nullptr) {
+        mqttManager->txError(TAG, "Mqtt handler received null message.");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    err = codecGetBool(message->payload, "on", on);
+    if (err != ESP_OK) {
+        mqttManager->txWarning(TAG, "Trace request has no \"on\" field.");
+        return err;
+    }
+
+    if (on == false) {
+        traceManager->stop();
+        mqttManager->txInfo(TAG, "Stopped trace capture.");
+        return ESP_OK;
+    }
+
+    err = traceManager->start();
+    if (err != ESP_OK) {
+        snprintf(log, sizeof(log), "Failed to start trace capture: %s", esp_err_to_name(err));
+        mqttManager->txWarning(TAG, log);
+        return err;
+    }
+
+    mqttManager->txInfo(TAG, "Started trace capture.");
+    return ESP_OK;
+}
+
+/**
+ * @brief Transmits the complete chunks of the trace being captured.
+ */
+void StateManager::transmitTrace() {
+    uint8_t chunk[TRACE_CHUNK_BYTES];
+    uint16_t length = 0;
+    uint32_t sequence = 0;
+
+    while (traceManager->read(chunk, length, sequence)) {
+        if (mqttManager->txTraceChunk(sequence, chunk, length) != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to transmit trace chunk %lu.", (unsigned long) sequence);
+        }
+    }
+}
+
+/**
+ * @brief Handles a request for the memory margins and the queue peaks.
+ * 
+ * @param message MQTT received message.
+ * @return esp_err_t Return code.
+ */
+esp_err_t StateManager::handleResourceRequest(MqttRxMessage_t *message) {
+    esp_err_t err = ESP_OK;
+    ResourceReport_t report = {};
+
+    /** Reject null input. */
+    if (message == nullptr) {
+        mqttManager->txError(TAG, "Mqtt handler received null message.");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    resourceManager->getReport(report);
+    err = mqttManager->txResourceReport(report);
+    if (err != ESP_OK) {
+        mqttManager->txWarning(TAG, "Failed to transmit resource report.");
+    }
+    return err;
+}
+
+/**
+ * @brief Guards the FSM task against heap allocations once booted. A float is
+ * formatted first, as the C library allocates the conversion buffers of a task on first use.
+ */
+void StateManager::armHeapGuard() {
+    char warmup[32];
+
+    snprintf(warmup, sizeof(warmup), "%.3f", 1234.5678f);
+    if (halHeapGuardArm() != ESP_OK) {
+        ESP_LOGD(TAG, "Heap allocations after boot are not observed.");
+    }
 }
\ No newline at end of file
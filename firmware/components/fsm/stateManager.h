@@ -6,6 +6,26 @@
 #include "mqttManager.h"
 #include "connectionManager.h"
 #include "valveManager.h"
+#include "powerManager.h"
+#include "gpioManager.h"
+#include "jobQueue.h"
+#include "processJournal.h"
+#include "scheduleManager.h"
+#include "pressureManager.h"
+#include "flowManager.h"
+#include "pressureCalibrator.h"
+#include "traceManager.h"
+#include "resourceManager.h"
+
+/** Update period of active processes, in miliseconds. */
+#define PROCESS_UPDATE_PERIOD_MS 100
+/** Period of checking whether provisioning has ended, in miliseconds. */
+#define PROVISIONING_POLL_PERIOD_MS 1000
+/** Time a fatal error is held before restarting, so its report can be transmitted, in miliseconds. */
+#define FATAL_ERROR_RESTART_MS 30000
+/** Maximum time the power report is waited on to reach the broker before deep sleep, and the period it is checked at, in miliseconds. */
+#define DEEP_SLEEP_PUBLISH_TIMEOUT_MS 2000
+#define DEEP_SLEEP_PUBLISH_POLL_MS 50
 
 /**
  * @brief Defines main application routines and transistions between states.
@@ -19,7 +39,15 @@ public:
         ConfigManager *configManager, 
         MqttManager *mqttManager, 
         ConnectionManager *connectionManager, 
-        ValveManager *valveManager
+        ValveManager *valveManager,
+        PowerManager *powerManager,
+        GpioManager *gpioManager,
+        ScheduleManager *scheduleManager,
+        PressureManager *pressureManager,
+        FlowManager *flowManager,
+        PressureCalibrator *pressureCalibrator,
+        TraceManager *traceManager,
+        ResourceManager *resourceManager
     );
 
     /**
@@ -35,12 +63,41 @@ public:
 private:
     /** Current state. */
     FsmStates_e state;
+    /** If true, the wake latency has been reported on the first connection. */
+    bool bootReported;
+    /** If true, the resources have been reported on entering STATE_FATAL_ERROR. */
+    bool fatalReported;
+    /** Time STATE_FATAL_ERROR was entered, in microseconds. */
+    int64_t fatalTime;
+    /** If true, the power report has been transmitted on entering STATE_SLEEP, at the time below in microseconds. */
+    bool sleepReported;
+    int64_t sleepReportTime;
+    /** Volume between dispense slice reports, in liters. */
+    float sliceResolution;
+    /** Step volume at the last dispense slice report, in liters. */
+    float lastSliceVolume;
+    /** Jobs received while a process is active. */
+    JobQueue jobQueue;
+    /** ID of the job of the active process, or zero if idle. */
+    uint32_t activeJobId;
+    /** Snapshots of the active dispense process, retained through resets. */
+    ProcessJournal processJournal;
+    /** State of the valves at the last snapshot. */
+    ValveStates_e journalState;
 
     /** Managers. */
     ConfigManager *configManager;
     MqttManager *mqttManager;
     ConnectionManager *connectionManager;
     ValveManager *valveManager;
+    PowerManager *powerManager;
+    GpioManager *gpioManager;
+    ScheduleManager *scheduleManager;
+    PressureManager *pressureManager;
+    FlowManager *flowManager;
+    PressureCalibrator *pressureCalibrator;
+    TraceManager *traceManager;
+    ResourceManager *resourceManager;
 
     /** State handlers. */
 
@@ -94,8 +151,80 @@ private:
      */
     void drain();
 
+    /**
+     * @brief Handler for state STATE_SLEEP.
+     */
+    void sleep();
+
+    /**
+     * @brief Handler for state STATE_VALVE_CHARACTERISE.
+     */
+    void characterise();
+
+    /** Job handlers. */
+
+    /**
+     * @brief Begins a job, or queues it behind the active process.
+     * 
+     * @param job The job. Assigned an ID if it has none.
+     * @return esp_err_t Return code. ESP_ERR_NO_MEM if the queue is full,
+     * ESP_ERR_INVALID_STATE if the active or a waiting job has the same ID,
+     * ESP_ERR_INVALID_ARG if the ID is in the range of assigned IDs.
+     */
+    esp_err_t submitJob(Job_t &job);
+
+    /**
+     * @brief Begins the process of a job and enters its state.
+     * 
+     * @param job The job.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t beginJob(Job_t &job);
+
+    /**
+     * @brief Begins the next queued job once the active process has ended,
+     * or returns to STATE_LISTEN if none is waiting.
+     */
+    void beginNextJob();
+
+    /**
+     * @brief Reports a dispense process interrupted by a reset before this boot, and queues
+     * what is left of its run plan if DispenseConfig_t::resumeInterrupted is set.
+     * 
+     * @param config Device config.
+     */
+    void recoverProcess(Config_t &config);
+
+    /**
+     * @brief Transmits the active job and the jobs waiting behind it.
+     */
+    void reportQueue();
+
+    /**
+     * @brief Submits the scheduled run if its deadline is due.
+     */
+    void checkSchedule();
+
+    /**
+     * @brief Checks the flow sensor against the tank level at the end of a dispense process.
+     * Proposes or applies the K-factor which matches the tank, as set by FlowSensorConfig_t::recalibration,
+     * and otherwise warns if the flow sensor drifts.
+     * 
+     * @param summary Summary of the last step.
+     */
+    void recalibrateFlowSensor(DispenseSummary_t &summary);
+
     /** Received MQTT message handlers. */
 
+    /**
+     * @brief Handles a connection being established. Republishes the config
+     * unless the session was resumed, flushes the messages buffered while
+     * disconnected, and reports the connection.
+     * 
+     * @return esp_err_t Return code.
+     */
+    esp_err_t handleConnected();
+
     /**
      * @brief Handles state change for a dispense request.
      * 
@@ -104,6 +233,16 @@ private:
      */
     esp_err_t handleDispenseRequest(MqttRxMessage_t *message);
 
+    /**
+     * @brief Handles a deactivate request during a process. A waiting job
+     * is cancelled by its ID, otherwise the active process ends and the queue is cleared.
+     * 
+     * @param message MQTT received message.
+     * @param endProcess Set to true if the active process must end.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t handleDeactivateRequest(MqttRxMessage_t *message, bool &endProcess);
+
     /**
      * @brief Handles state change for a config change request.
      * 
@@ -143,6 +282,40 @@ private:
      * @return esp_err_t Return code.
      */
     esp_err_t handlePressurePollRequest(MqttRxMessage_t *message);
+
+    /**
+     * @brief Handles state change for a valve characterisation request.
+     * 
+     * @param message MQTT received message.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t handleCharacteriseRequest(MqttRxMessage_t *message);
+
+    /**
+     * @brief Handles a request to start or stop capturing a trace of the inputs.
+     * 
+     * @param message MQTT received message.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t handleTraceRequest(MqttRxMessage_t *message);
+
+    /**
+     * @brief Transmits the complete chunks of the trace being captured.
+     */
+    void transmitTrace();
+
+    /**
+     * @brief Handles a request for the memory margins and the queue peaks.
+     * 
+     * @param message MQTT received message.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t handleResourceRequest(MqttRxMessage_t *message);
+
+    /**
+     * @brief Guards the FSM task against heap allocations once booted.
+     */
+    void armHeapGuard();
 };
 
 #endif
\ No newline at end of file
@@ -27,6 +27,10 @@ typedef enum FsmStates_e {
     STATE_PRESSURE_CALIBRATE,
     /** Tank drain process. */
     STATE_DRAIN,
+    /** Deep sleep until the next wake. */
+    STATE_SLEEP,
+    /** Valve latency characterisation process. */
+    STATE_VALVE_CHARACTERISE,
 
     STATE_MAX
 } FsmStates_e;
@@ -0,0 +1,184 @@
+#include "esp_err.h"
+#include "esp_log.h"
+#include "halGpio.h"
+
+#include "gpioManager.h"
+
+static const char* TAG = "GpioManager";
+
+/**
+ * @brief Constructor.
+ */
+GpioManager::GpioManager() {
+    claimedMask = 0;
+    outputMask = 0;
+}
+
+/**
+ * @brief Begin the GpioManager.
+ * 
+ * @return esp_err_t Return code.
+ */
+esp_err_t GpioManager::initialize() {
+    esp_err_t err = ESP_OK;
+
+    /** Shared by every component using pin interrupts. */
+    err = halGpioInstallIsrService();
+    if (err != ESP_OK) return err;
+
+    return pwmDriver.initialize();
+}
+
+/**
+ * @brief Claims a pin as a push-pull output, driven low.
+ * 
+ * @param pin GPIO number.
+ * @param owner Name of the claiming function, for logging.
+ * @return esp_err_t Return code. ESP_ERR_INVALID_ARG if the pin is reserved or not
+ * an output, ESP_ERR_INVALID_STATE if it is already claimed.
+ */
+esp_err_t GpioManager::claimOutput(int8_t pin, const char *owner) {
+    esp_err_t err = ESP_OK;
+
+    err = checkAvailable(pin, owner);
+    if (err != ESP_OK) return err;
+    if (!halGpioIsValidOutput(pin)) {
+        ESP_LOGE(TAG, "GPIO %d claimed by %s is not an output.", pin, owner);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    /** The level is set before enabling the output, so valves never pulse open on boot. */
+    err = halGpioConfigOutput(pin);
+    if (err != ESP_OK) return err;
+
+    claimedMask |= 1ULL << pin;
+    outputMask |= 1ULL << pin;
+    ESP_LOGI(TAG, "GPIO %d claimed as output by %s.", pin, owner);
+    return ESP_OK;
+}
+
+/**
+ * @brief Claims a pin as a valve output, driven low. A valve with a hold duty
+ * below 100 percent is driven with peak-and-hold PWM, or at full duty if no PWM channel is free.
+ * 
+ * @param pin GPIO number.
+ * @param drive Peak-and-hold parameters of the valve.
+ * @param owner Name of the claiming function, for logging.
+ * @return esp_err_t Return code. As claimOutput().
+ */
+esp_err_t GpioManager::claimValve(int8_t pin, ValveDriveConfig_t &drive, const char *owner) {
+    esp_err_t err = ESP_OK;
+
+    if (drive.holdDuty > 100) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    err = claimOutput(pin, owner);
+    if ( (err != ESP_OK) || (drive.holdDuty == 100) ) return err;
+
+    err = pwmDriver.attach(pin, drive.pullInTime, drive.holdDuty);
+    if (err == ESP_ERR_NOT_FOUND) {
+        ESP_LOGW(TAG, "No PWM channel left for GPIO %d, driving %s at full duty.", pin, owner);
+        return ESP_OK;
+    }
+    if (err != ESP_OK) {
+        release(pin);
+        return err;
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Claims a pin as an input.
+ * 
+ * @param pin GPIO number.
+ * @param pullUp If true, the internal pull-up is enabled.
+ * @param owner Name of the claiming function, for logging.
+ * @return esp_err_t Return code. ESP_ERR_INVALID_ARG if the pin is reserved,
+ * ESP_ERR_INVALID_STATE if it is already claimed.
+ */
+esp_err_t GpioManager::claimInput(int8_t pin, bool pullUp, const char *owner) {
+    esp_err_t err = ESP_OK;
+
+    err = checkAvailable(pin, owner);
+    if (err != ESP_OK) return err;
+
+    err = halGpioConfigInput(pin, pullUp);
+    if (err != ESP_OK) return err;
+
+    claimedMask |= 1ULL << pin;
+    ESP_LOGI(TAG, "GPIO %d claimed as input by %s.", pin, owner);
+    return ESP_OK;
+}
+
+/**
+ * @brief Releases a claimed pin and resets it to its default state.
+ * Has no effect if the pin is not claimed.
+ * 
+ * @param pin GPIO number.
+ * @return esp_err_t Return code.
+ */
+esp_err_t GpioManager::release(int8_t pin) {
+    if ( (pin < 0) || (pin >= HAL_GPIO_PIN_COUNT) || ((claimedMask & (1ULL << pin)) == 0) ) {
+        return ESP_OK;
+    }
+
+    pwmDriver.detach(pin);
+    claimedMask &= ~(1ULL << pin);
+    outputMask &= ~(1ULL << pin);
+    return halGpioReset(pin);
+}
+
+/**
+ * @brief Sets the level of a claimed output.
+ * 
+ * @param pin GPIO number.
+ * @param level True for high.
+ * @return esp_err_t Return code. ESP_ERR_INVALID_STATE if the pin is not a claimed output.
+ */
+esp_err_t GpioManager::setLevel(int8_t pin, bool level) {
+    if ( (pin < 0) || (pin >= HAL_GPIO_PIN_COUNT) || ((outputMask & (1ULL << pin)) == 0) ) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (pwmDriver.isAttached(pin)) {
+        return pwmDriver.set(pin, level);
+    }
+
+    return halGpioSetLevel(pin, level);
+}
+
+/**
+ * @brief Returns the number of pins not yet claimed or reserved.
+ */
+uint8_t GpioManager::getFreePinCount() {
+    uint8_t count = 0;
+
+    for (int pin = 0; pin < HAL_GPIO_PIN_COUNT; pin++) {
+        if ( ((GPIO_RESERVED_MASK | claimedMask) & (1ULL << pin)) == 0 ) {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+/**
+ * @brief Checks that a pin may be claimed.
+ * 
+ * @param pin GPIO number.
+ * @param owner Name of the claiming function, for logging.
+ * @return esp_err_t Return code.
+ */
+esp_err_t GpioManager::checkAvailable(int8_t pin, const char *owner) {
+    if ( (pin < 0) || (pin >= HAL_GPIO_PIN_COUNT) || ((GPIO_RESERVED_MASK & (1ULL << pin)) != 0) ) {
+        ESP_LOGE(TAG, "GPIO %d claimed by %s is reserved or does not exist.", pin, owner);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if ((claimedMask & (1ULL << pin)) != 0) {
+        ESP_LOGE(TAG, "GPIO %d claimed by %s is already in use.", pin, owner);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    return ESP_OK;
+}
\ No newline at end of file
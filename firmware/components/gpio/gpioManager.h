@@ -0,0 +1,111 @@
+#ifndef GPIO_MANAGER_H
+#define GPIO_MANAGER_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#include "config.h"
+#include "pwmDriver.h"
+
+/**
+ * Pins unavailable to the application on the esp32c3: strapping pins 2, 8 and 9,
+ * SPI flash pins 11 to 17, USB-JTAG pins 18 and 19, and UART0 console pins 20 and 21.
+ */
+#define GPIO_RESERVED_MASK ( \
+    (1ULL << 2) | (1ULL << 8) | (1ULL << 9) | \
+    (1ULL << 11) | (1ULL << 12) | (1ULL << 13) | (1ULL << 14) | (1ULL << 15) | (1ULL << 16) | (1ULL << 17) | \
+    (1ULL << 18) | (1ULL << 19) | (1ULL << 20) | (1ULL << 21) \
+)
+
+/**
+ * @brief Handles the allocation of the GPIO budget between components.
+ * Every pin used by the application is claimed here exactly once.
+ */
+class GpioManager {
+public:
+    /**
+     * @brief Constructor.
+     */
+    GpioManager();
+
+    /**
+     * @brief Begin the GpioManager.
+     * 
+     * @return esp_err_t Return code.
+     */
+    esp_err_t initialize();
+
+    /**
+     * @brief Claims a pin as a push-pull output, driven low.
+     * 
+     * @param pin GPIO number.
+     * @param owner Name of the claiming function, for logging.
+     * @return esp_err_t Return code. ESP_ERR_INVALID_ARG if the pin is reserved or not
+     * an output, ESP_ERR_INVALID_STATE if it is already claimed.
+     */
+    esp_err_t claimOutput(int8_t pin, const char *owner);
+
+    /**
+     * @brief Claims a pin as a valve output, driven low. A valve with a hold duty
+     * below 100 percent is driven with peak-and-hold PWM, or at full duty if no PWM channel is free.
+     * 
+     * @param pin GPIO number.
+     * @param drive Peak-and-hold parameters of the valve.
+     * @param owner Name of the claiming function, for logging.
+     * @return esp_err_t Return code. As claimOutput().
+     */
+    esp_err_t claimValve(int8_t pin, ValveDriveConfig_t &drive, const char *owner);
+
+    /**
+     * @brief Claims a pin as an input.
+     * 
+     * @param pin GPIO number.
+     * @param pullUp If true, the internal pull-up is enabled.
+     * @param owner Name of the claiming function, for logging.
+     * @return esp_err_t Return code. ESP_ERR_INVALID_ARG if the pin is reserved,
+     * ESP_ERR_INVALID_STATE if it is already claimed.
+     */
+    esp_err_t claimInput(int8_t pin, bool pullUp, const char *owner);
+
+    /**
+     * @brief Releases a claimed pin and resets it to its default state.
+     * Has no effect if the pin is not claimed.
+     * 
+     * @param pin GPIO number.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t release(int8_t pin);
+
+    /**
+     * @brief Sets the level of a claimed output. A high valve output is driven with peak-and-hold PWM.
+     * 
+     * @param pin GPIO number.
+     * @param level True for high.
+     * @return esp_err_t Return code. ESP_ERR_INVALID_STATE if the pin is not a claimed output.
+     */
+    esp_err_t setLevel(int8_t pin, bool level);
+
+    /**
+     * @brief Returns the number of pins not yet claimed or reserved.
+     */
+    uint8_t getFreePinCount();
+
+private:
+    PwmDriver pwmDriver;
+    /** Bit n is set if GPIO n is claimed. */
+    uint64_t claimedMask;
+    /** Bit n is set if GPIO n is claimed as an output. */
+    uint64_t outputMask;
+
+    /**
+     * @brief Checks that a pin may be claimed.
+     * 
+     * @param pin GPIO number.
+     * @param owner Name of the claiming function, for logging.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t checkAvailable(int8_t pin, const char *owner);
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,168 @@
+#include "esp_err.h"
+#include "esp_log.h"
+#include "halTime.h"
+#include "halPwm.h"
+
+#include "pwmDriver.h"
+
+static const char* TAG = "PwmDriver";
+
+/**
+ * @brief Constructor.
+ */
+PwmDriver::PwmDriver() {
+    initialized = false;
+    for (int i = 0; i < PWM_MAX_CHANNELS; i++) {
+        channels[i] = {};
+        channels[i].driver = this;
+        channels[i].channel = i;
+        channels[i].pin = -1;
+        channels[i].holdTimer = nullptr;
+    }
+}
+
+/**
+ * @brief Configures the LEDC timer shared by every channel, and creates the hold
+ * timer of each channel, so attaching after boot does not allocate.
+ *
+ * @return esp_err_t Return code.
+ */
+esp_err_t PwmDriver::initialize() {
+    esp_err_t err = ESP_OK;
+
+    if (initialized) {
+        return ESP_OK;
+    }
+
+    err = halPwmInitialize(PWM_FREQUENCY_HZ, PWM_RESOLUTION_BITS);
+    if (err != ESP_OK) return err;
+
+    for (int i = 0; i < PWM_MAX_CHANNELS; i++) {
+        err = halTimerCreate(&onPullInElapsed, &channels[i], "valveHold", &channels[i].holdTimer);
+        if (err != ESP_OK) return err;
+    }
+
+    initialized = true;
+    return ESP_OK;
+}
+
+/**
+ * @brief Routes a pin claimed as an output to a free LEDC channel, driven low.
+ *
+ * @param pin GPIO number.
+ * @param pullInTime Time the coil is driven at full duty after opening, in miliseconds.
+ * @param holdDuty Duty after the pull-in time, in percent.
+ * @return esp_err_t Return code. ESP_ERR_NOT_FOUND if no channel is free.
+ */
+esp_err_t PwmDriver::attach(int8_t pin, uint16_t pullInTime, uint8_t holdDuty) {
+    esp_err_t err = ESP_OK;
+    PwmChannel_t *channel = nullptr;
+
+    if ( (initialized == false) || (findChannel(pin) != nullptr) ) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (holdDuty > 100) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    channel = findChannel(-1);
+    if (channel == nullptr) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    err = halPwmAttach(channel->channel, pin);
+    if (err != ESP_OK) return err;
+
+    channel->pin = pin;
+    channel->pullInTime = pullInTime;
+    channel->holdDuty = (PWM_DUTY_MAX * holdDuty) / 100;
+    channel->on = false;
+    ESP_LOGI(TAG, "GPIO %d on channel %d, %u ms pull-in, %u%% hold.", pin, channel->channel, pullInTime, holdDuty);
+    return ESP_OK;
+}
+
+/**
+ * @brief Stops the channel of a pin and frees it. Has no effect if the pin is not attached.
+ *
+ * @param pin GPIO number.
+ * @return esp_err_t Return code.
+ */
+esp_err_t PwmDriver::detach(int8_t pin) {
+    PwmChannel_t *channel = findChannel(pin);
+
+    if ( (pin < 0) || (channel == nullptr) ) {
+        return ESP_OK;
+    }
+
+    channel->on = false;
+    halTimerStop(channel->holdTimer);
+    halPwmStop(channel->channel);
+    channel->pin = -1;
+    return ESP_OK;
+}
+
+/**
+ * @brief If true, the pin is driven by a LEDC channel.
+ */
+bool PwmDriver::isAttached(int8_t pin) {
+    return (pin >= 0) && (findChannel(pin) != nullptr);
+}
+
+/**
+ * @brief Opens a valve with its pull-in duty, or closes it.
+ *
+ * @param pin GPIO number.
+ * @param on True to open.
+ * @return esp_err_t Return code. ESP_ERR_INVALID_STATE if the pin is not attached.
+ */
+esp_err_t PwmDriver::set(int8_t pin, bool on) {
+    esp_err_t err = ESP_OK;
+    PwmChannel_t *channel = findChannel(pin);
+
+    if ( (pin < 0) || (channel == nullptr) ) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    /** Stop a pending hold before changing the duty, so it cannot apply after a close. */
+    channel->on = on;
+    halTimerStop(channel->holdTimer);
+    if (on == false) {
+        return setDuty(channel, 0);
+    }
+
+    err = setDuty(channel, PWM_DUTY_MAX);
+    if (err != ESP_OK) return err;
+
+    return halTimerStartOnce(channel->holdTimer, (uint64_t) channel->pullInTime * 1000);
+}
+
+/**
+ * @brief Returns the channel a pin is attached to, or nullptr.
+ */
+PwmDriver::PwmChannel_t* PwmDriver::findChannel(int8_t pin) {
+    for (int i = 0; i < PWM_MAX_CHANNELS; i++) {
+        if (channels[i].pin == pin) {
+            return &channels[i];
+        }
+    }
+
+    return nullptr;
+}
+
+/**
+ * @brief Sets the duty of a channel.
+ */
+esp_err_t PwmDriver::setDuty(PwmChannel_t *channel, uint32_t duty) {
+    return halPwmSetDuty(channel->channel, duty);
+}
+
+/**
+ * @brief Drops a channel to its holding duty. Runs in the timer task.
+ */
+void PwmDriver::onPullInElapsed(void *arg) {
+    PwmChannel_t *channel = static_cast<PwmChannel_t*>(arg);
+
+    if (channel->on) {
+        channel->driver->setDuty(channel, channel->holdDuty);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,104 @@
+#ifndef PWM_DRIVER_H
+#define PWM_DRIVER_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "halTime.h"
+
+/** PWM frequency of the valve coils, above the audible range. */
+#define PWM_FREQUENCY_HZ 20000
+/** Duty resolution in bits. 10 bits is the maximum at 20 kHz from the 80 MHz APB clock. */
+#define PWM_RESOLUTION_BITS 10
+#define PWM_DUTY_MAX ((1 << PWM_RESOLUTION_BITS) - 1)
+/** Number of LEDC channels of the esp32c3. */
+#define PWM_MAX_CHANNELS 6
+
+/**
+ * @brief Drives solenoid valve coils with peak-and-hold PWM on the LEDC peripheral.
+ * An opened valve is driven at full duty for its pull-in time, after which
+ * a timer drops it to its holding duty.
+ *
+ * The coil current settles at duty * V / R, so a held coil draws duty^2 of its full power,
+ * under a tenth at 30 percent. LEDC stops in light sleep, which is never entered while a valve is open.
+ */
+class PwmDriver {
+public:
+    /**
+     * @brief Constructor.
+     */
+    PwmDriver();
+
+    /**
+     * @brief Configures the LEDC timer shared by every channel, and creates the hold
+     * timer of each channel, so attaching after boot does not allocate.
+     *
+     * @return esp_err_t Return code.
+     */
+    esp_err_t initialize();
+
+    /**
+     * @brief Routes a pin claimed as an output to a free LEDC channel, driven low.
+     *
+     * @param pin GPIO number.
+     * @param pullInTime Time the coil is driven at full duty after opening, in miliseconds.
+     * @param holdDuty Duty after the pull-in time, in percent.
+     * @return esp_err_t Return code. ESP_ERR_NOT_FOUND if no channel is free.
+     */
+    esp_err_t attach(int8_t pin, uint16_t pullInTime, uint8_t holdDuty);
+
+    /**
+     * @brief Stops the channel of a pin and frees it. Has no effect if the pin is not attached.
+     *
+     * @param pin GPIO number.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t detach(int8_t pin);
+
+    /**
+     * @brief If true, the pin is driven by a LEDC channel.
+     */
+    bool isAttached(int8_t pin);
+
+    /**
+     * @brief Opens a valve with its pull-in duty, or closes it.
+     *
+     * @param pin GPIO number.
+     * @param on True to open.
+     * @return esp_err_t Return code. ESP_ERR_INVALID_STATE if the pin is not attached.
+     */
+    esp_err_t set(int8_t pin, bool on);
+
+private:
+    typedef struct PwmChannel_t {
+        PwmDriver *driver;
+        uint8_t channel;
+        /** GPIO number, or -1 if the channel is free. */
+        int8_t pin;
+        uint16_t pullInTime;
+        uint32_t holdDuty;
+        /** Set while the valve is open, so a late hold timer cannot reopen a closed valve. */
+        volatile bool on;
+        HalTimer_t holdTimer;
+    } PwmChannel_t;
+
+    bool initialized;
+    PwmChannel_t channels[PWM_MAX_CHANNELS];
+
+    /**
+     * @brief Returns the channel a pin is attached to, or nullptr.
+     */
+    PwmChannel_t* findChannel(int8_t pin);
+
+    /**
+     * @brief Sets the duty of a channel.
+     */
+    esp_err_t setDuty(PwmChannel_t *channel, uint32_t duty);
+
+    /**
+     * @brief Drops a channel to its holding duty. Runs in the timer task.
+     */
+    static void onPullInElapsed(void *arg);
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,144 @@
+#include "esp_err.h"
+
+#include "pwmDriverMock.h"
+
+/**
+ * @brief Constructor.
+ *
+ * @param supplyVoltage Coil supply voltage in volts.
+ * @param coilResistance Coil resistance in ohms.
+ */
+PwmDriverMock::PwmDriverMock(float supplyVoltage, float coilResistance) {
+    fullPower = supplyVoltage * supplyVoltage / coilResistance;
+    initialized = false;
+    for (int i = 0; i < PWM_MAX_CHANNELS; i++) {
+        channels[i] = {};
+        channels[i].pin = -1;
+    }
+}
+
+esp_err_t PwmDriverMock::initialize() {
+    initialized = true;
+    return ESP_OK;
+}
+
+esp_err_t PwmDriverMock::attach(int8_t pin, uint16_t pullInTime, uint8_t holdDuty) {
+    MockChannel_t *channel = nullptr;
+
+    if ( (initialized == false) || (findChannel(pin) != nullptr) ) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (holdDuty > 100) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    channel = findChannel(-1);
+    if (channel == nullptr) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    *channel = {};
+    channel->pin = pin;
+    channel->pullInTime = pullInTime;
+    channel->holdDuty = holdDuty / 100.0f;
+    return ESP_OK;
+}
+
+esp_err_t PwmDriverMock::detach(int8_t pin) {
+    MockChannel_t *channel = findChannel(pin);
+
+    if ( (pin < 0) || (channel == nullptr) ) {
+        return ESP_OK;
+    }
+
+    channel->pin = -1;
+    return ESP_OK;
+}
+
+bool PwmDriverMock::isAttached(int8_t pin) {
+    return (pin >= 0) && (findChannel(pin) != nullptr);
+}
+
+esp_err_t PwmDriverMock::set(int8_t pin, bool on) {
+    MockChannel_t *channel = findChannel(pin);
+
+    if ( (pin < 0) || (channel == nullptr) ) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    channel->on = on;
+    channel->onTime = 0;
+    channel->duty = on ? 1.0f : 0.0f;
+    return ESP_OK;
+}
+
+/**
+ * @brief Advances the time, integrating the energy of each channel and applying the hold duty once the pull-in time elapses.
+ *
+ * @param time Time to advance in miliseconds.
+ */
+void PwmDriverMock::advance(uint32_t time) {
+    MockChannel_t *channel = nullptr;
+    uint32_t pullIn = 0;
+
+    for (int i = 0; i < PWM_MAX_CHANNELS; i++) {
+        channel = &channels[i];
+        if ( (channel->pin < 0) || (channel->on == false) ) {
+            continue;
+        }
+
+        /** Split the step at the end of the pull-in time. */
+        pullIn = 0;
+        if (channel->onTime < channel->pullInTime) {
+            pullIn = channel->pullInTime - channel->onTime;
+            if (pullIn > time) {
+                pullIn = time;
+            }
+        }
+        channel->energy += fullPower * pullIn / 1000.0f;
+        channel->energy += fullPower * channel->holdDuty * channel->holdDuty * (time - pullIn) / 1000.0f;
+        channel->fullDutyEnergy += fullPower * time / 1000.0f;
+        channel->onTime += time;
+        channel->duty = (channel->onTime < channel->pullInTime) ? 1.0f : channel->holdDuty;
+    }
+}
+
+/**
+ * @brief Returns the current duty of a pin as a fraction of full duty, or zero if not attached.
+ */
+float PwmDriverMock::getDuty(int8_t pin) {
+    MockChannel_t *channel = findChannel(pin);
+
+    return ( (pin < 0) || (channel == nullptr) ) ? 0 : channel->duty;
+}
+
+/**
+ * @brief Returns the energy drawn by the coil of a pin since it was attached, in joules.
+ */
+float PwmDriverMock::getEnergy(int8_t pin) {
+    MockChannel_t *channel = findChannel(pin);
+
+    return ( (pin < 0) || (channel == nullptr) ) ? 0 : channel->energy;
+}
+
+/**
+ * @brief Returns the energy the coil of a pin would have drawn at full duty over the same open time, in joules.
+ */
+float PwmDriverMock::getFullDutyEnergy(int8_t pin) {
+    MockChannel_t *channel = findChannel(pin);
+
+    return ( (pin < 0) || (channel == nullptr) ) ? 0 : channel->fullDutyEnergy;
+}
+
+/**
+ * @brief Returns the channel a pin is attached to, or nullptr.
+ */
+PwmDriverMock::MockChannel_t* PwmDriverMock::findChannel(int8_t pin) {
+    for (int i = 0; i < PWM_MAX_CHANNELS; i++) {
+        if (channels[i].pin == pin) {
+            return &channels[i];
+        }
+    }
+
+    return nullptr;
+}
\ No newline at end of file
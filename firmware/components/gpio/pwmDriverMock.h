@@ -0,0 +1,87 @@
+#ifndef PWM_DRIVER_MOCK_H
+#define PWM_DRIVER_MOCK_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#include "pwmDriver.h"
+
+/** Coil of a typical 12 V, 0.5 A solenoid valve. */
+#define PWM_MOCK_SUPPLY_VOLTAGE 12.0f
+#define PWM_MOCK_COIL_RESISTANCE 24.0f
+
+/**
+ * @brief Host replacement of PwmDriver with a coil energy model, to quantify
+ * the saving of peak-and-hold drive. Not part of the firmware build.
+ *
+ * The PWM period is far shorter than the time constant of the coil, and the
+ * coil current freewheels through the flyback diode while the output is off,
+ * so the coil current settles at duty * V / R. The supply delivers that current
+ * for the on fraction of each period, so the power drawn is duty^2 * V^2 / R.
+ * Time is advanced by the caller instead of an esp_timer.
+ */
+class PwmDriverMock {
+public:
+    /**
+     * @brief Constructor.
+     *
+     * @param supplyVoltage Coil supply voltage in volts.
+     * @param coilResistance Coil resistance in ohms.
+     */
+    PwmDriverMock(float supplyVoltage = PWM_MOCK_SUPPLY_VOLTAGE, float coilResistance = PWM_MOCK_COIL_RESISTANCE);
+
+    /** Same as PwmDriver. */
+    esp_err_t initialize();
+    esp_err_t attach(int8_t pin, uint16_t pullInTime, uint8_t holdDuty);
+    esp_err_t detach(int8_t pin);
+    bool isAttached(int8_t pin);
+    esp_err_t set(int8_t pin, bool on);
+
+    /**
+     * @brief Advances the time, integrating the energy of each channel and applying the hold duty once the pull-in time elapses.
+     *
+     * @param time Time to advance in miliseconds.
+     */
+    void advance(uint32_t time);
+
+    /**
+     * @brief Returns the current duty of a pin as a fraction of full duty, or zero if not attached.
+     */
+    float getDuty(int8_t pin);
+
+    /**
+     * @brief Returns the energy drawn by the coil of a pin since it was attached, in joules.
+     */
+    float getEnergy(int8_t pin);
+
+    /**
+     * @brief Returns the energy the coil of a pin would have drawn at full duty over the same open time, in joules.
+     */
+    float getFullDutyEnergy(int8_t pin);
+
+private:
+    typedef struct MockChannel_t {
+        /** GPIO number, or -1 if the channel is free. */
+        int8_t pin;
+        uint16_t pullInTime;
+        float holdDuty;
+        float duty;
+        bool on;
+        /** Time since the open command in miliseconds. */
+        uint32_t onTime;
+        float energy;
+        float fullDutyEnergy;
+    } MockChannel_t;
+
+    float fullPower;
+    bool initialized;
+    MockChannel_t channels[PWM_MAX_CHANNELS];
+
+    /**
+     * @brief Returns the channel a pin is attached to, or nullptr.
+     */
+    MockChannel_t* findChannel(int8_t pin);
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,154 @@
+#include "esp_err.h"
+#include "esp_adc/adc_oneshot.h"
+#include "esp_adc/adc_cali.h"
+#include "esp_adc/adc_cali_scheme.h"
+
+#include "halAdc.h"
+#include "halTime.h"
+#include "halTrace.h"
+
+/** Number of ADC1 channels of the esp32c3. */
+#define HAL_ADC_MAX_CHANNELS 5
+
+/**
+ * @brief An open ADC channel.
+ */
+struct HalAdc {
+    bool open;
+    /** GPIO number, passed to the trace callback. */
+    int8_t pin;
+    adc_channel_t channel;
+    adc_cali_handle_t caliHandle;
+};
+
+static HalAdc channels[HAL_ADC_MAX_CHANNELS] = {};
+
+/** The ADC1 unit is shared by every open channel. */
+static adc_oneshot_unit_handle_t unitHandle = nullptr;
+static uint8_t openCount = 0;
+
+/**
+ * @brief Opens the ADC channel of a pin with the full input range and calibration.
+ * Only ADC1 pins are accepted, as ADC2 is unusable while WiFi is active.
+ *
+ * @param pin GPIO number.
+ * @param adc Overwritten with the handle.
+ * @return esp_err_t Return code. ESP_ERR_INVALID_ARG if the pin is not an ADC1 pin.
+ */
+esp_err_t halAdcOpen(int8_t pin, HalAdc_t *adc) {
+    esp_err_t err = ESP_OK;
+    adc_unit_t unit = ADC_UNIT_1;
+    adc_channel_t channel = ADC_CHANNEL_0;
+    adc_oneshot_unit_init_cfg_t unitConfig = {};
+    adc_oneshot_chan_cfg_t channelConfig = {};
+    adc_cali_curve_fitting_config_t caliConfig = {};
+    HalAdc *entry = nullptr;
+
+    err = adc_oneshot_io_to_channel(pin, &unit, &channel);
+    if ( (err != ESP_OK) || (unit != ADC_UNIT_1) || (channel >= HAL_ADC_MAX_CHANNELS) ) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    entry = &channels[channel];
+    if (entry->open) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (unitHandle == nullptr) {
+        unitConfig.unit_id = ADC_UNIT_1;
+        unitConfig.ulp_mode = ADC_ULP_MODE_DISABLE;
+        err = adc_oneshot_new_unit(&unitConfig, &unitHandle);
+        if (err != ESP_OK) return err;
+    }
+
+    channelConfig.atten = ADC_ATTEN_DB_12;
+    channelConfig.bitwidth = ADC_BITWIDTH_DEFAULT;
+    err = adc_oneshot_config_channel(unitHandle, channel, &channelConfig);
+    if (err != ESP_OK) goto err;
+
+    caliConfig.unit_id = ADC_UNIT_1;
+    caliConfig.chan = channel;
+    caliConfig.atten = ADC_ATTEN_DB_12;
+    caliConfig.bitwidth = ADC_BITWIDTH_DEFAULT;
+    err = adc_cali_create_scheme_curve_fitting(&caliConfig, &entry->caliHandle);
+    if (err != ESP_OK) goto err;
+
+    entry->open = true;
+    entry->pin = pin;
+    entry->channel = channel;
+    openCount++;
+    *adc = entry;
+    return ESP_OK;
+
+err:
+    if (openCount == 0) {
+        adc_oneshot_del_unit(unitHandle);
+        unitHandle = nullptr;
+    }
+    return err;
+}
+
+/**
+ * @brief Reads one raw conversion.
+ *
+ * @param adc Channel handle.
+ * @param raw Overwritten with the conversion.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halAdcReadRaw(HalAdc_t adc, int &raw) {
+    if ( (adc == nullptr) || (adc->open == false) ) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    return adc_oneshot_read(unitHandle, adc->channel, &raw);
+}
+
+/**
+ * @brief Converts a raw conversion to millivolts with the calibration of the channel.
+ *
+ * @param adc Channel handle.
+ * @param raw Raw conversion.
+ * @param millivolts Overwritten with the voltage.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halAdcToMillivolts(HalAdc_t adc, int raw, int &millivolts) {
+    esp_err_t err = ESP_OK;
+    HalTraceInput_t input = {};
+
+    if ( (adc == nullptr) || (adc->open == false) ) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    err = adc_cali_raw_to_voltage(adc->caliHandle, raw, &millivolts);
+    if ( (err == ESP_OK) && halTraceEnabled() ) {
+        input.id = HAL_TRACE_ADC;
+        input.time = halTimeMicros();
+        input.pin = adc->pin;
+        input.millivolts = millivolts;
+        halTraceEmit(input);
+    }
+
+    return err;
+}
+
+/**
+ * @brief Closes a channel. Has no effect on a null handle.
+ *
+ * @param adc Channel handle.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halAdcClose(HalAdc_t adc) {
+    if ( (adc == nullptr) || (adc->open == false) ) {
+        return ESP_OK;
+    }
+
+    adc_cali_delete_scheme_curve_fitting(adc->caliHandle);
+    adc->caliHandle = nullptr;
+    adc->open = false;
+    openCount--;
+    if (openCount == 0) {
+        adc_oneshot_del_unit(unitHandle);
+        unitHandle = nullptr;
+    }
+
+    return ESP_OK;
+}
\ No newline at end of file
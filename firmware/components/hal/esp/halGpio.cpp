@@ -0,0 +1,88 @@
+#include "esp_err.h"
+#include "driver/gpio.h"
+#include "soc/soc_caps.h"
+
+#include "halGpio.h"
+
+static_assert(HAL_GPIO_PIN_COUNT == SOC_GPIO_PIN_COUNT, "HAL_GPIO_PIN_COUNT does not match the target.");
+
+/**
+ * @brief If true, the pin can be driven as an output.
+ */
+bool halGpioIsValidOutput(int8_t pin) {
+    return GPIO_IS_VALID_OUTPUT_GPIO(pin);
+}
+
+/**
+ * @brief Installs the interrupt service shared by every pin interrupt.
+ * Already installed is not an error.
+ *
+ * @return esp_err_t Return code.
+ */
+esp_err_t halGpioInstallIsrService() {
+    esp_err_t err = gpio_install_isr_service(0);
+
+    return (err == ESP_ERR_INVALID_STATE) ? ESP_OK : err;
+}
+
+/**
+ * @brief Configures a pin as a push-pull output. The level is set low
+ * before the output is enabled, so valves never pulse open on boot.
+ *
+ * @param pin GPIO number.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halGpioConfigOutput(int8_t pin) {
+    esp_err_t err = ESP_OK;
+    gpio_config_t pinConfig = {};
+
+    gpio_hold_dis((gpio_num_t) pin);
+    err = gpio_set_level((gpio_num_t) pin, 0);
+    if (err != ESP_OK) return err;
+
+    pinConfig.pin_bit_mask = 1ULL << pin;
+    pinConfig.mode = GPIO_MODE_OUTPUT;
+    pinConfig.pull_up_en = GPIO_PULLUP_DISABLE;
+    pinConfig.pull_down_en = GPIO_PULLDOWN_DISABLE;
+    pinConfig.intr_type = GPIO_INTR_DISABLE;
+    return gpio_config(&pinConfig);
+}
+
+/**
+ * @brief Configures a pin as an input.
+ *
+ * @param pin GPIO number.
+ * @param pullUp If true, the internal pull-up is enabled.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halGpioConfigInput(int8_t pin, bool pullUp) {
+    gpio_config_t pinConfig = {};
+
+    pinConfig.pin_bit_mask = 1ULL << pin;
+    pinConfig.mode = GPIO_MODE_INPUT;
+    pinConfig.pull_up_en = pullUp ? GPIO_PULLUP_ENABLE : GPIO_PULLUP_DISABLE;
+    pinConfig.pull_down_en = GPIO_PULLDOWN_DISABLE;
+    pinConfig.intr_type = GPIO_INTR_DISABLE;
+    return gpio_config(&pinConfig);
+}
+
+/**
+ * @brief Resets a pin to its default state.
+ *
+ * @param pin GPIO number.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halGpioReset(int8_t pin) {
+    return gpio_reset_pin((gpio_num_t) pin);
+}
+
+/**
+ * @brief Sets the level of an output.
+ *
+ * @param pin GPIO number.
+ * @param level True for high.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halGpioSetLevel(int8_t pin, bool level) {
+    return gpio_set_level((gpio_num_t) pin, level ? 1 : 0);
+}
\ No newline at end of file
@@ -0,0 +1,215 @@
+#include "esp_err.h"
+#include "mqtt_client.h"
+
+#include "halMqtt.h"
+#include "halSystem.h"
+#include "halTime.h"
+#include "halTrace.h"
+
+/**
+ * @brief A registered callback, passed to the client as the handler argument.
+ */
+typedef struct HalMqttHandler_t {
+    HalMqttCallback_t callback;
+    void *arg;
+} HalMqttHandler_t;
+
+static HalMqttHandler_t handlers[HAL_MQTT_MAX_CALLBACKS] = {};
+static uint8_t handlerCount = 0;
+
+/**
+ * @brief Converts a client event and passes it to the registered callback.
+ */
+static void onEvent(void *arg, esp_event_base_t base, int32_t id, void *data) {
+    HalMqttHandler_t *handler = static_cast<HalMqttHandler_t*>(arg);
+    esp_mqtt_event_handle_t event = static_cast<esp_mqtt_event_handle_t>(data);
+    HalMqttEvent_t halEvent = {};
+
+    switch (id) {
+        case MQTT_EVENT_CONNECTED:
+            halEvent.id = HAL_MQTT_EVENT_CONNECTED;
+            halEvent.sessionPresent = event->session_present;
+            break;
+
+        case MQTT_EVENT_DISCONNECTED:
+            halEvent.id = HAL_MQTT_EVENT_DISCONNECTED;
+            break;
+
+        case MQTT_EVENT_DATA:
+            halEvent.id = HAL_MQTT_EVENT_DATA;
+            halEvent.topic = event->topic;
+            halEvent.topicLength = event->topic_len;
+            halEvent.data = event->data;
+            halEvent.dataLength = event->data_len;
+            halEvent.totalLength = event->total_data_len;
+            halEvent.offset = event->current_data_offset;
+            break;
+
+        default:
+            halEvent.id = HAL_MQTT_EVENT_OTHER;
+            break;
+    }
+
+    handler->callback(handler->arg, halEvent);
+}
+
+/**
+ * @brief Passes each received message to the trace callback, once whatever the number of registered callbacks.
+ * Fragments of a payload larger than the client buffer are not traced.
+ */
+static void onTraceEvent(void *arg, esp_event_base_t base, int32_t id, void *data) {
+    esp_mqtt_event_handle_t event = static_cast<esp_mqtt_event_handle_t>(data);
+    HalTraceInput_t input = {};
+
+    if ( (halTraceEnabled() == false) || (event->current_data_offset != 0) || (event->data_len != event->total_data_len) ) {
+        return;
+    }
+
+    input.id = HAL_TRACE_MQTT_DATA;
+    input.time = halTimeMicros();
+    input.topic = event->topic;
+    input.topicLength = event->topic_len;
+    input.data = event->data;
+    input.dataLength = event->data_len;
+    halTraceEmit(input);
+}
+
+/**
+ * @brief Fills the client config from the HAL config.
+ */
+static void buildConfig(HalMqttConfig_t &config, esp_mqtt_client_config_t &mqttConfig) {
+    mqttConfig = {};
+    mqttConfig.broker.address.uri = config.uri;
+    mqttConfig.network.disable_auto_reconnect = true;
+    mqttConfig.credentials.client_id = config.clientId;
+    mqttConfig.session.disable_clean_session = config.persistentSession;
+    if ( (config.username != nullptr) && (config.username[0] != '\0') ) {
+        mqttConfig.credentials.username = config.username;
+        mqttConfig.credentials.authentication.password = config.password;
+    }
+}
+
+/**
+ * @brief Creates a stopped client. The client never reconnects on its own.
+ *
+ * @param config Connection config.
+ * @param client Overwritten with the handle.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halMqttCreate(HalMqttConfig_t &config, HalMqttClient_t *client) {
+    esp_err_t err = ESP_OK;
+    esp_mqtt_client_config_t mqttConfig = {};
+    esp_mqtt_client_handle_t handle = nullptr;
+
+    buildConfig(config, mqttConfig);
+    handle = esp_mqtt_client_init(&mqttConfig);
+    if (handle == nullptr) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    /** Registered first, so inputs are traced before the callbacks handle them. */
+    err = esp_mqtt_client_register_event(handle, MQTT_EVENT_DATA, &onTraceEvent, nullptr);
+    if (err != ESP_OK) {
+        esp_mqtt_client_destroy(handle);
+        return err;
+    }
+
+    *client = reinterpret_cast<HalMqttClient_t>(handle);
+    return ESP_OK;
+}
+
+/**
+ * @brief Changes the connection config. Takes effect on the next connection.
+ *
+ * @param client Client handle.
+ * @param config Connection config.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halMqttSetConfig(HalMqttClient_t client, HalMqttConfig_t &config) {
+    esp_mqtt_client_config_t mqttConfig = {};
+
+    buildConfig(config, mqttConfig);
+    return esp_mqtt_set_config(reinterpret_cast<esp_mqtt_client_handle_t>(client), &mqttConfig);
+}
+
+/**
+ * @brief Registers a callback for every event of a client.
+ *
+ * @param client Client handle.
+ * @param callback Called on each event.
+ * @param arg Passed to the callback.
+ * @return esp_err_t Return code. ESP_ERR_NO_MEM if HAL_MQTT_MAX_CALLBACKS are registered.
+ */
+esp_err_t halMqttRegister(HalMqttClient_t client, HalMqttCallback_t callback, void *arg) {
+    HalMqttHandler_t *handler = nullptr;
+
+    if (handlerCount >= HAL_MQTT_MAX_CALLBACKS) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    handler = &handlers[handlerCount++];
+    handler->callback = callback;
+    handler->arg = arg;
+    return esp_mqtt_client_register_event(reinterpret_cast<esp_mqtt_client_handle_t>(client), (esp_mqtt_event_id_t) ESP_EVENT_ANY_ID, &onEvent, handler);
+}
+
+/**
+ * @brief Starts the client, which connects to the broker.
+ *
+ * @param client Client handle.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halMqttStart(HalMqttClient_t client) {
+    return esp_mqtt_client_start(reinterpret_cast<esp_mqtt_client_handle_t>(client));
+}
+
+/**
+ * @brief Reconnects a started client.
+ *
+ * @param client Client handle.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halMqttReconnect(HalMqttClient_t client) {
+    return esp_mqtt_client_reconnect(reinterpret_cast<esp_mqtt_client_handle_t>(client));
+}
+
+/**
+ * @brief Subscribes to a topic.
+ *
+ * @param client Client handle.
+ * @param topic Topic.
+ * @param qos Quality of service.
+ * @return int Message ID, or negative on failure.
+ */
+int halMqttSubscribe(HalMqttClient_t client, const char *topic, int qos) {
+    return esp_mqtt_client_subscribe(reinterpret_cast<esp_mqtt_client_handle_t>(client), topic, qos);
+}
+
+/**
+ * @brief Queues a message in the outbox of the client without blocking.
+ *
+ * @param client Client handle.
+ * @param topic Topic.
+ * @param data Null terminated payload.
+ * @param qos Quality of service.
+ * @param retain If true, the broker retains the message.
+ * @return int Message ID, or negative on failure.
+ */
+int halMqttEnqueue(HalMqttClient_t client, const char *topic, const char *data, int qos, bool retain) {
+    int messageId = 0;
+
+    /** The outbox of the client allocates each message until it is acknowledged, outside the guard of the caller. */
+    halHeapGuardSuspend();
+    messageId = esp_mqtt_client_enqueue(reinterpret_cast<esp_mqtt_client_handle_t>(client), topic, data, 0, qos, retain, true);
+    halHeapGuardResume();
+    return messageId;
+}
+
+/**
+ * @brief Returns true if the client holds messages not yet sent, or QoS 1 messages not yet acknowledged.
+ *
+ * @param client Client handle.
+ */
+bool halMqttHasPending(HalMqttClient_t client) {
+    return esp_mqtt_client_get_outbox_size(reinterpret_cast<esp_mqtt_client_handle_t>(client)) > 0;
+}
\ No newline at end of file
@@ -0,0 +1,151 @@
+#include "esp_err.h"
+#include "esp_log.h"
+#include "nvs_flash.h"
+#include "nvs.h"
+
+#include "halNvs.h"
+#include "halSystem.h"
+
+static const char* TAG = "HalNvs";
+
+/**
+ * NVS allocates its handles and the index of its items on the heap, so the heap
+ * guard is suspended while it is called. Writes only follow a config change.
+ */
+
+/**
+ * @brief Maps the NVS errors shared with the host backend onto generic codes.
+ */
+static esp_err_t mapError(esp_err_t err) {
+    switch (err) {
+        case ESP_ERR_NVS_NOT_FOUND:
+            return ESP_ERR_NOT_FOUND;
+        case ESP_ERR_NVS_INVALID_LENGTH:
+            return ESP_ERR_INVALID_SIZE;
+        default:
+            return err;
+    }
+}
+
+/**
+ * @brief Initializes non-volatile storage, erasing it if it is full or of an older layout.
+ *
+ * @return esp_err_t Return code.
+ */
+esp_err_t halNvsInitialize() {
+    esp_err_t err = nvs_flash_init();
+
+    if ( (err == ESP_ERR_NVS_NO_FREE_PAGES) || (err == ESP_ERR_NVS_NEW_VERSION_FOUND) ) {
+        ESP_LOGW(TAG, "NVS partition is full or outdated, erasing.");
+        err = nvs_flash_erase();
+        if (err != ESP_OK) return err;
+        err = nvs_flash_init();
+    }
+
+    return err;
+}
+
+/**
+ * @brief Opens a namespace.
+ *
+ * @param name Namespace.
+ * @param writable If true, the namespace is opened for writing and created if missing.
+ * @param handle Overwritten with the handle.
+ * @return esp_err_t Return code. ESP_ERR_NOT_FOUND if opened read only and nothing was written to it.
+ */
+esp_err_t halNvsOpen(const char *name, bool writable, HalNvs_t &handle) {
+    nvs_handle_t nvsHandle = 0;
+    esp_err_t err = ESP_OK;
+
+    halHeapGuardSuspend();
+    err = nvs_open(name, writable ? NVS_READWRITE : NVS_READONLY, &nvsHandle);
+    halHeapGuardResume();
+
+    handle = nvsHandle;
+    return mapError(err);
+}
+
+/**
+ * @brief Reads a blob.
+ *
+ * @param handle Namespace handle.
+ * @param key Key.
+ * @param value Overwritten with the blob.
+ * @param length Size of the buffer in bytes. Overwritten with the size of the blob.
+ * @return esp_err_t Return code. ESP_ERR_NOT_FOUND if the key is missing,
+ * ESP_ERR_INVALID_SIZE if the buffer is too small.
+ */
+esp_err_t halNvsGetBlob(HalNvs_t handle, const char *key, void *value, size_t &length) {
+    return mapError(nvs_get_blob(handle, key, value, &length));
+}
+
+/**
+ * @brief Writes a blob. Takes effect on halNvsCommit().
+ *
+ * @param handle Namespace handle.
+ * @param key Key.
+ * @param value Blob.
+ * @param length Size of the blob in bytes.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halNvsSetBlob(HalNvs_t handle, const char *key, const void *value, size_t length) {
+    esp_err_t err = ESP_OK;
+
+    halHeapGuardSuspend();
+    err = nvs_set_blob(handle, key, value, length);
+    halHeapGuardResume();
+    return mapError(err);
+}
+
+/**
+ * @brief Reads an integer.
+ *
+ * @param handle Namespace handle.
+ * @param key Key.
+ * @param value Overwritten with the integer.
+ * @return esp_err_t Return code. ESP_ERR_NOT_FOUND if the key is missing.
+ */
+esp_err_t halNvsGetU32(HalNvs_t handle, const char *key, uint32_t &value) {
+    return mapError(nvs_get_u32(handle, key, &value));
+}
+
+/**
+ * @brief Writes an integer. Takes effect on halNvsCommit().
+ *
+ * @param handle Namespace handle.
+ * @param key Key.
+ * @param value Integer.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halNvsSetU32(HalNvs_t handle, const char *key, uint32_t value) {
+    esp_err_t err = ESP_OK;
+
+    halHeapGuardSuspend();
+    err = nvs_set_u32(handle, key, value);
+    halHeapGuardResume();
+    return mapError(err);
+}
+
+/**
+ * @brief Commits the writes to a namespace.
+ *
+ * @param handle Namespace handle.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halNvsCommit(HalNvs_t handle) {
+    esp_err_t err = ESP_OK;
+
+    halHeapGuardSuspend();
+    err = nvs_commit(handle);
+    halHeapGuardResume();
+    return mapError(err);
+}
+
+/**
+ * @brief Closes a namespace.
+ *
+ * @param handle Namespace handle.
+ */
+void halNvsClose(HalNvs_t handle) {
+    nvs_close(handle);
+}
\ No newline at end of file
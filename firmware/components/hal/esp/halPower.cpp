@@ -0,0 +1,124 @@
+#include "esp_err.h"
+#include "esp_attr.h"
+#include "esp_pm.h"
+#include "esp_sleep.h"
+#include "driver/gpio.h"
+
+#include "halPower.h"
+
+static HalLightSleepCallback_t lightSleepCallback = nullptr;
+
+/**
+ * @brief Called by the power management driver on exit from light sleep.
+ */
+static IRAM_ATTR esp_err_t onLightSleepExit(int64_t sleepTimeUs, void *arg) {
+    if (lightSleepCallback != nullptr) {
+        lightSleepCallback(sleepTimeUs);
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Configures frequency scaling and automatic light sleep.
+ *
+ * @param maxFrequency Maximum CPU frequency in megahertz.
+ * @param minFrequency Minimum CPU frequency in megahertz.
+ * @param lightSleep If true, the chip enters light sleep when idle.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halPowerConfigure(uint32_t maxFrequency, uint32_t minFrequency, bool lightSleep) {
+    esp_pm_config_t pmConfig = {
+        .max_freq_mhz = (int) maxFrequency,
+        .min_freq_mhz = (int) minFrequency,
+        .light_sleep_enable = lightSleep
+    };
+
+    return esp_pm_configure(&pmConfig);
+}
+
+/**
+ * @brief Creates a released lock.
+ *
+ * @param type Lock type.
+ * @param name Name of the lock, for debugging.
+ * @param lock Overwritten with the handle.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halPowerLockCreate(HalPowerLocks_e type, const char *name, HalPowerLock_t *lock) {
+    esp_pm_lock_type_t lockType = (type == HAL_POWER_LOCK_CPU_FREQ_MAX) ? ESP_PM_CPU_FREQ_MAX : ESP_PM_NO_LIGHT_SLEEP;
+
+    return esp_pm_lock_create(lockType, 0, name, reinterpret_cast<esp_pm_lock_handle_t*>(lock));
+}
+
+/**
+ * @brief Acquires a lock.
+ */
+esp_err_t halPowerLockAcquire(HalPowerLock_t lock) {
+    return esp_pm_lock_acquire(reinterpret_cast<esp_pm_lock_handle_t>(lock));
+}
+
+/**
+ * @brief Releases a lock.
+ */
+esp_err_t halPowerLockRelease(HalPowerLock_t lock) {
+    return esp_pm_lock_release(reinterpret_cast<esp_pm_lock_handle_t>(lock));
+}
+
+/**
+ * @brief Registers the callback called on exit from light sleep.
+ *
+ * @param callback Callback. Must be in IRAM.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halPowerOnLightSleepExit(HalLightSleepCallback_t callback) {
+    esp_pm_sleep_cbs_register_config_t sleepCallbacks = {};
+
+    lightSleepCallback = callback;
+    sleepCallbacks.exit_cb = onLightSleepExit;
+    return esp_pm_light_sleep_register_cbs(&sleepCallbacks);
+}
+
+/**
+ * @brief Returns the cause of the last wake from deep sleep, as an esp_sleep_wakeup_cause_t.
+ */
+uint8_t halSleepGetWakeCause() {
+    return esp_sleep_get_wakeup_cause();
+}
+
+/**
+ * @brief If true, the last wake from deep sleep was by the timer.
+ */
+bool halSleepWokeByTimer() {
+    return esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER;
+}
+
+/**
+ * @brief Wakes from deep sleep after a duration.
+ *
+ * @param duration Duration in microseconds.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halSleepEnableTimerWakeup(uint64_t duration) {
+    return esp_sleep_enable_timer_wakeup(duration);
+}
+
+/**
+ * @brief Wakes from deep sleep when a pin is pulled low.
+ *
+ * @param pin GPIO number.
+ * @return esp_err_t Return code. ESP_ERR_INVALID_ARG if the pin cannot wake from deep sleep.
+ */
+esp_err_t halSleepEnableGpioWakeup(int8_t pin) {
+    if (!esp_sleep_is_valid_wakeup_gpio((gpio_num_t) pin)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return esp_deep_sleep_enable_gpio_wakeup(1ULL << pin, ESP_GPIO_WAKEUP_GPIO_LOW);
+}
+
+/**
+ * @brief Enters deep sleep. Does not return.
+ */
+void halSleepStart() {
+    esp_deep_sleep_start();
+}
\ No newline at end of file
@@ -0,0 +1,81 @@
+#include "esp_err.h"
+#include "esp_attr.h"
+#include "driver/gpio.h"
+
+#include "halPulse.h"
+#include "halGpio.h"
+#include "halTime.h"
+#include "halTrace.h"
+
+/**
+ * @brief The pulse callback of a pin, passed to the interrupt service as the handler argument.
+ */
+typedef struct PulseHandler_t {
+    int8_t pin;
+    HalPulseCallback_t callback;
+    void *arg;
+} PulseHandler_t;
+
+static DRAM_ATTR PulseHandler_t handlers[HAL_GPIO_PIN_COUNT] = {};
+
+/**
+ * @brief Passes a rising edge to the trace callback, then to the pulse callback of the pin.
+ */
+static IRAM_ATTR void onEdge(void *arg) {
+    PulseHandler_t *handler = static_cast<PulseHandler_t*>(arg);
+    HalTraceInput_t input = {};
+
+    if (halTraceEnabled()) {
+        input.id = HAL_TRACE_PULSE;
+        input.time = halTimeMicros();
+        input.pin = handler->pin;
+        halTraceEmit(input);
+    }
+
+    handler->callback(handler->arg);
+}
+
+/**
+ * @brief Calls a callback on each rising edge of an input pin.
+ * The pin must be configured as an input and the interrupt service installed.
+ *
+ * @param pin GPIO number.
+ * @param callback Called on each rising edge. Must be in IRAM.
+ * @param arg Passed to the callback.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halPulseAttach(int8_t pin, HalPulseCallback_t callback, void *arg) {
+    esp_err_t err = ESP_OK;
+
+    if ( (pin < 0) || (pin >= HAL_GPIO_PIN_COUNT) || (callback == nullptr) ) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    handlers[pin].pin = pin;
+    handlers[pin].callback = callback;
+    handlers[pin].arg = arg;
+
+    err = gpio_set_intr_type((gpio_num_t) pin, GPIO_INTR_POSEDGE);
+    if (err != ESP_OK) return err;
+
+    err = gpio_isr_handler_add((gpio_num_t) pin, &onEdge, &handlers[pin]);
+    if (err != ESP_OK) return err;
+
+    err = gpio_intr_enable((gpio_num_t) pin);
+    if (err != ESP_OK) {
+        gpio_isr_handler_remove((gpio_num_t) pin);
+    }
+
+    return err;
+}
+
+/**
+ * @brief Stops calling the callback of a pin. Has no effect if none is attached.
+ *
+ * @param pin GPIO number.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halPulseDetach(int8_t pin) {
+    gpio_intr_disable((gpio_num_t) pin);
+    return gpio_isr_handler_remove((gpio_num_t) pin);
+}
\ No newline at end of file
@@ -0,0 +1,69 @@
+#include "esp_err.h"
+#include "driver/ledc.h"
+
+#include "halPwm.h"
+
+/**
+ * @brief Configures the LEDC timer shared by every PWM channel.
+ * The esp32c3 only has low speed channels.
+ *
+ * @param frequency PWM frequency in hertz.
+ * @param resolution Duty resolution in bits.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halPwmInitialize(uint32_t frequency, uint8_t resolution) {
+    ledc_timer_config_t timerConfig = {};
+
+    timerConfig.speed_mode = LEDC_LOW_SPEED_MODE;
+    timerConfig.duty_resolution = (ledc_timer_bit_t) resolution;
+    timerConfig.timer_num = LEDC_TIMER_0;
+    timerConfig.freq_hz = frequency;
+    timerConfig.clk_cfg = LEDC_AUTO_CLK;
+    return ledc_timer_config(&timerConfig);
+}
+
+/**
+ * @brief Routes a pin to a LEDC channel with zero duty.
+ *
+ * @param channel Channel number.
+ * @param pin GPIO number.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halPwmAttach(uint8_t channel, int8_t pin) {
+    ledc_channel_config_t channelConfig = {};
+
+    channelConfig.gpio_num = pin;
+    channelConfig.speed_mode = LEDC_LOW_SPEED_MODE;
+    channelConfig.channel = (ledc_channel_t) channel;
+    channelConfig.intr_type = LEDC_INTR_DISABLE;
+    channelConfig.timer_sel = LEDC_TIMER_0;
+    channelConfig.duty = 0;
+    channelConfig.hpoint = 0;
+    return ledc_channel_config(&channelConfig);
+}
+
+/**
+ * @brief Sets the duty of a channel.
+ *
+ * @param channel Channel number.
+ * @param duty Duty in steps of the resolution.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halPwmSetDuty(uint8_t channel, uint32_t duty) {
+    esp_err_t err = ESP_OK;
+
+    err = ledc_set_duty(LEDC_LOW_SPEED_MODE, (ledc_channel_t) channel, duty);
+    if (err != ESP_OK) return err;
+
+    return ledc_update_duty(LEDC_LOW_SPEED_MODE, (ledc_channel_t) channel);
+}
+
+/**
+ * @brief Stops a channel with its output low.
+ *
+ * @param channel Channel number.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halPwmStop(uint8_t channel) {
+    return ledc_stop(LEDC_LOW_SPEED_MODE, (ledc_channel_t) channel, 0);
+}
\ No newline at end of file
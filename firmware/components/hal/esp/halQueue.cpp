@@ -0,0 +1,81 @@
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#include "halQueue.h"
+
+/** Control blocks and items of the queues, handed out in order of creation. */
+static StaticQueue_t queueBuffers[HAL_QUEUE_MAX_QUEUES];
+static uint8_t queueCount = 0;
+alignas(4) static uint8_t pool[HAL_QUEUE_POOL_BYTES];
+static size_t poolUsed = 0;
+
+/**
+ * @brief Creates a queue from static memory.
+ *
+ * @param length Maximum number of items.
+ * @param itemSize Size of an item in bytes.
+ * @param queue Overwritten with the handle.
+ * @return esp_err_t Return code. ESP_ERR_NO_MEM if HAL_QUEUE_MAX_QUEUES queues
+ * were created or HAL_QUEUE_POOL_BYTES would be exceeded.
+ */
+esp_err_t halQueueCreate(uint8_t length, size_t itemSize, HalQueue_t *queue) {
+    QueueHandle_t handle = nullptr;
+    /** Keep each queue word aligned. */
+    size_t size = ((length * itemSize) + 3) & ~((size_t) 3);
+
+    if ( (queueCount >= HAL_QUEUE_MAX_QUEUES) || (size > HAL_QUEUE_POOL_BYTES - poolUsed) ) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    handle = xQueueCreateStatic(length, itemSize, &pool[poolUsed], &queueBuffers[queueCount]);
+    if (handle == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    queueCount++;
+    poolUsed += size;
+    *queue = reinterpret_cast<HalQueue_t>(handle);
+    return ESP_OK;
+}
+
+/**
+ * @brief Copies an item to the back of a queue without blocking.
+ *
+ * @param queue Queue handle.
+ * @param item Item.
+ * @return bool False if the queue is full.
+ */
+bool halQueueSend(HalQueue_t queue, const void *item) {
+    return xQueueSend(reinterpret_cast<QueueHandle_t>(queue), item, 0) == pdTRUE;
+}
+
+/**
+ * @brief Copies the front item of a queue without removing it, blocking until one arrives.
+ *
+ * @param queue Queue handle.
+ * @param item Overwritten with the item.
+ * @param timeout Maximum wait in miliseconds.
+ * @return bool False if the timeout elapsed first.
+ */
+bool halQueuePeek(HalQueue_t queue, void *item, uint32_t timeout) {
+    return xQueuePeek(reinterpret_cast<QueueHandle_t>(queue), item, pdMS_TO_TICKS(timeout)) == pdTRUE;
+}
+
+/**
+ * @brief Removes the front item of a queue without blocking.
+ *
+ * @param queue Queue handle.
+ * @param item Overwritten with the item.
+ * @return bool False if the queue is empty.
+ */
+bool halQueueReceive(HalQueue_t queue, void *item) {
+    return xQueueReceive(reinterpret_cast<QueueHandle_t>(queue), item, 0) == pdTRUE;
+}
+
+/**
+ * @brief Returns the number of items in a queue.
+ */
+uint8_t halQueueCount(HalQueue_t queue) {
+    return uxQueueMessagesWaiting(reinterpret_cast<QueueHandle_t>(queue));
+}
\ No newline at end of file
@@ -0,0 +1,166 @@
+#include <stdlib.h>
+
+#include "sdkconfig.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_mac.h"
+#include "esp_random.h"
+#include "esp_netif_sntp.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "halSystem.h"
+
+static const char* TAG = "HalSystem";
+
+/** The task guarded against heap allocations, or null. */
+static TaskHandle_t guardedTask = nullptr;
+/** Only changed by the guarded task. */
+static uint32_t guardSuspended = 0;
+static volatile uint32_t guardCount = 0;
+
+/**
+ * @brief Restarts the chip. Does not return.
+ */
+void halRestart() {
+    esp_restart();
+}
+
+/**
+ * @brief If true, the last reset was a wake from deep sleep, so RTC memory was retained.
+ */
+bool halResetWasDeepSleep() {
+    return esp_reset_reason() == ESP_RST_DEEPSLEEP;
+}
+
+/**
+ * @brief Returns a random number from the hardware generator.
+ */
+uint32_t halRandom() {
+    return esp_random();
+}
+
+/**
+ * @brief Reads the MAC address of the WiFi station.
+ *
+ * @param mac Overwritten with the 6 bytes of the address.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halReadMac(uint8_t *mac) {
+    return esp_read_mac(mac, ESP_MAC_WIFI_STA);
+}
+
+/**
+ * @brief Starts setting the clock from an SNTP server.
+ *
+ * @param server Host name of the server. Must outlive SNTP.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halSntpStart(const char *server) {
+    esp_sntp_config_t sntpConfig = ESP_NETIF_SNTP_DEFAULT_CONFIG(server);
+
+    return esp_netif_sntp_init(&sntpConfig);
+}
+
+/**
+ * @brief Stops SNTP.
+ */
+void halSntpStop() {
+    esp_netif_sntp_deinit();
+}
+
+/**
+ * @brief Reads the free memory of the heap.
+ *
+ * @param stats Overwritten with the heap statistics.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halHeapStats(HalHeapStats_t &stats) {
+    stats.freeBytes = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    stats.minimumFreeBytes = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    stats.largestFreeBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    return ESP_OK;
+}
+
+/**
+ * @brief Reads the least free stack of a task since it was created.
+ * Stacks are sized in bytes on ESP-IDF.
+ *
+ * @param name Name of the task.
+ * @param bytes Overwritten with the high-water mark, in bytes.
+ * @return esp_err_t Return code. ESP_ERR_NOT_FOUND if no task has the name.
+ */
+esp_err_t halTaskStackHighWater(const char *name, uint32_t &bytes) {
+    TaskHandle_t handle = xTaskGetHandle(name);
+
+    if (handle == nullptr) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    bytes = uxTaskGetStackHighWaterMark(handle);
+    return ESP_OK;
+}
+
+#if CONFIG_HEAP_USE_HOOKS
+/**
+ * @brief Called by the heap after each allocation, on the allocating task.
+ */
+extern "C" void esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps) {
+    if ( (guardedTask == nullptr) || (guardSuspended > 0) || (xTaskGetCurrentTaskHandle() != guardedTask) ) {
+        return;
+    }
+
+    guardCount = guardCount + 1;
+#if CONFIG_DRIP_HEAP_GUARD
+    ESP_DRAM_LOGE(TAG, "Heap allocation of %u bytes after boot.", (unsigned) size);
+    abort();
+#endif
+}
+#endif
+
+/**
+ * @brief Begins guarding the calling task against heap allocations, once it has booted.
+ * Allocations are observed through the allocation hook of the heap.
+ *
+ * @return esp_err_t Return code. ESP_ERR_NOT_SUPPORTED without CONFIG_HEAP_USE_HOOKS.
+ */
+esp_err_t halHeapGuardArm() {
+#if CONFIG_HEAP_USE_HOOKS
+    if (guardedTask == nullptr) {
+        guardCount = 0;
+        guardSuspended = 0;
+        guardedTask = xTaskGetCurrentTaskHandle();
+        ESP_LOGI(TAG, "Guarding task %s against heap allocations.", pcTaskGetName(guardedTask));
+    }
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+/**
+ * @brief Suspends the guard around a call which may allocate.
+ */
+void halHeapGuardSuspend() {
+    if (xTaskGetCurrentTaskHandle() == guardedTask) {
+        guardSuspended++;
+    }
+}
+
+/**
+ * @brief Ends a suspension of the guard.
+ */
+void halHeapGuardResume() {
+    if ( (xTaskGetCurrentTaskHandle() == guardedTask) && (guardSuspended > 0) ) {
+        guardSuspended--;
+    }
+}
+
+/**
+ * @brief Returns the number of allocations of the guarded task since it was guarded.
+ */
+uint32_t halHeapGuardCount() {
+    return guardCount;
+}
\ No newline at end of file
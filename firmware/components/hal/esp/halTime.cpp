@@ -0,0 +1,62 @@
+#include "esp_err.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "esp_cpu.h"
+
+#include "halTime.h"
+
+/**
+ * @brief Returns the time since boot in microseconds. Safe to call from interrupt context.
+ */
+IRAM_ATTR int64_t halTimeMicros() {
+    return esp_timer_get_time();
+}
+
+/**
+ * @brief Returns the CPU cycle counter, wrapping at 32 bits.
+ */
+IRAM_ATTR uint32_t halCycleCount() {
+    return esp_cpu_get_cycle_count();
+}
+
+/**
+ * @brief Creates a stopped one-shot timer, dispatched from the esp_timer task.
+ *
+ * @param callback Called on expiry.
+ * @param arg Passed to the callback.
+ * @param name Name of the timer, for debugging.
+ * @param timer Overwritten with the handle.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halTimerCreate(HalTimerCallback_t callback, void *arg, const char *name, HalTimer_t *timer) {
+    esp_timer_create_args_t timerArgs = {};
+
+    timerArgs.callback = callback;
+    timerArgs.arg = arg;
+    timerArgs.dispatch_method = ESP_TIMER_TASK;
+    timerArgs.name = name;
+    return esp_timer_create(&timerArgs, reinterpret_cast<esp_timer_handle_t*>(timer));
+}
+
+/**
+ * @brief Starts a timer. The timer must be stopped.
+ *
+ * @param timer Timer handle.
+ * @param timeout Time until expiry in microseconds.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halTimerStartOnce(HalTimer_t timer, uint64_t timeout) {
+    return esp_timer_start_once(reinterpret_cast<esp_timer_handle_t>(timer), timeout);
+}
+
+/**
+ * @brief Stops a timer. Stopping a stopped timer is not an error.
+ *
+ * @param timer Timer handle.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halTimerStop(HalTimer_t timer) {
+    esp_err_t err = esp_timer_stop(reinterpret_cast<esp_timer_handle_t>(timer));
+
+    return (err == ESP_ERR_INVALID_STATE) ? ESP_OK : err;
+}
\ No newline at end of file
@@ -0,0 +1,41 @@
+#include "esp_err.h"
+#include "esp_attr.h"
+
+#include "halTrace.h"
+
+/** Read from interrupt context, so kept in DRAM. */
+static DRAM_ATTR HalTraceCallback_t traceCallback = nullptr;
+static DRAM_ATTR void *traceArg = nullptr;
+
+/**
+ * @brief Sets the callback called on each input of the firmware, or clears it.
+ *
+ * @param callback Called on each input, or nullptr to stop. Must be in IRAM.
+ * @param arg Passed to the callback.
+ */
+void halTraceSetCallback(HalTraceCallback_t callback, void *arg) {
+    /** Clear the callback first, so an interrupt never sees the new callback with the old argument. */
+    traceCallback = nullptr;
+    traceArg = arg;
+    traceCallback = callback;
+}
+
+/**
+ * @brief Passes an input to the trace callback. Called by the backends.
+ *
+ * @param input The input, timestamped by the caller.
+ */
+IRAM_ATTR void halTraceEmit(HalTraceInput_t &input) {
+    HalTraceCallback_t callback = traceCallback;
+
+    if (callback != nullptr) {
+        callback(traceArg, input);
+    }
+}
+
+/**
+ * @brief If true, a trace callback is set. Lets the backends skip building inputs.
+ */
+IRAM_ATTR bool halTraceEnabled() {
+    return traceCallback != nullptr;
+}
\ No newline at end of file
@@ -0,0 +1,48 @@
+#ifndef HAL_ADC_H
+#define HAL_ADC_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+/** Opaque handle of a calibrated ADC channel. */
+typedef struct HalAdc *HalAdc_t;
+
+/**
+ * @brief Opens the ADC channel of a pin with the full input range and calibration.
+ * Only ADC1 pins are accepted, as ADC2 is unusable while WiFi is active.
+ *
+ * @param pin GPIO number.
+ * @param adc Overwritten with the handle.
+ * @return esp_err_t Return code. ESP_ERR_INVALID_ARG if the pin is not an ADC1 pin.
+ */
+esp_err_t halAdcOpen(int8_t pin, HalAdc_t *adc);
+
+/**
+ * @brief Reads one raw conversion.
+ *
+ * @param adc Channel handle.
+ * @param raw Overwritten with the conversion.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halAdcReadRaw(HalAdc_t adc, int &raw);
+
+/**
+ * @brief Converts a raw conversion to millivolts with the calibration of the channel.
+ *
+ * @param adc Channel handle.
+ * @param raw Raw conversion.
+ * @param millivolts Overwritten with the voltage.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halAdcToMillivolts(HalAdc_t adc, int raw, int &millivolts);
+
+/**
+ * @brief Closes a channel. Has no effect on a null handle.
+ *
+ * @param adc Channel handle.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halAdcClose(HalAdc_t adc);
+
+#endif
\ No newline at end of file
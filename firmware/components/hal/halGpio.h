@@ -0,0 +1,59 @@
+#ifndef HAL_GPIO_H
+#define HAL_GPIO_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+/** Number of GPIOs of the esp32c3. */
+#define HAL_GPIO_PIN_COUNT 22
+
+/**
+ * @brief If true, the pin can be driven as an output.
+ */
+bool halGpioIsValidOutput(int8_t pin);
+
+/**
+ * @brief Installs the interrupt service shared by every pin interrupt.
+ * Already installed is not an error.
+ *
+ * @return esp_err_t Return code.
+ */
+esp_err_t halGpioInstallIsrService();
+
+/**
+ * @brief Configures a pin as a push-pull output. The level is set low
+ * before the output is enabled, so valves never pulse open on boot.
+ *
+ * @param pin GPIO number.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halGpioConfigOutput(int8_t pin);
+
+/**
+ * @brief Configures a pin as an input.
+ *
+ * @param pin GPIO number.
+ * @param pullUp If true, the internal pull-up is enabled.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halGpioConfigInput(int8_t pin, bool pullUp);
+
+/**
+ * @brief Resets a pin to its default state.
+ *
+ * @param pin GPIO number.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halGpioReset(int8_t pin);
+
+/**
+ * @brief Sets the level of an output.
+ *
+ * @param pin GPIO number.
+ * @param level True for high.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halGpioSetLevel(int8_t pin, bool level);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,132 @@
+#ifndef HAL_MQTT_H
+#define HAL_MQTT_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+/** Opaque handle of an MQTT client. */
+typedef struct HalMqttClient *HalMqttClient_t;
+
+/** Maximum number of callbacks registered across every client. */
+#define HAL_MQTT_MAX_CALLBACKS 4
+
+/**
+ * @brief Describes the MQTT client events passed to callbacks.
+ */
+typedef enum HalMqttEvents_e {
+    HAL_MQTT_EVENT_CONNECTED,
+    HAL_MQTT_EVENT_DISCONNECTED,
+    HAL_MQTT_EVENT_DATA,
+    HAL_MQTT_EVENT_OTHER
+} HalMqttEvents_e;
+
+/**
+ * @brief Describes an MQTT client event. Pointers are only valid during the callback.
+ */
+typedef struct HalMqttEvent_t {
+    HalMqttEvents_e id = HAL_MQTT_EVENT_OTHER;
+    /** If true, the broker resumed the previous session. Valid for HAL_MQTT_EVENT_CONNECTED. */
+    bool sessionPresent = false;
+    /** Topic and payload of HAL_MQTT_EVENT_DATA. Neither is null terminated. */
+    const char *topic = nullptr;
+    int topicLength = 0;
+    const char *data = nullptr;
+    int dataLength = 0;
+    /** A payload larger than the client buffer is passed in several events. */
+    int totalLength = 0;
+    int offset = 0;
+} HalMqttEvent_t;
+
+/**
+ * @brief Called on each client event, from the client task on the target.
+ */
+typedef void (*HalMqttCallback_t)(void *arg, HalMqttEvent_t &event);
+
+/**
+ * @brief Describes the connection of an MQTT client. Strings must outlive the client.
+ */
+typedef struct HalMqttConfig_t {
+    const char *uri = nullptr;
+    const char *clientId = nullptr;
+    /** Null or empty to connect without credentials. */
+    const char *username = nullptr;
+    const char *password = nullptr;
+    /** If true, the client connects without a clean session. */
+    bool persistentSession = false;
+} HalMqttConfig_t;
+
+/**
+ * @brief Creates a stopped client. The client never reconnects on its own.
+ *
+ * @param config Connection config.
+ * @param client Overwritten with the handle.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halMqttCreate(HalMqttConfig_t &config, HalMqttClient_t *client);
+
+/**
+ * @brief Changes the connection config. Takes effect on the next connection.
+ *
+ * @param client Client handle.
+ * @param config Connection config.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halMqttSetConfig(HalMqttClient_t client, HalMqttConfig_t &config);
+
+/**
+ * @brief Registers a callback for every event of a client.
+ *
+ * @param client Client handle.
+ * @param callback Called on each event.
+ * @param arg Passed to the callback.
+ * @return esp_err_t Return code. ESP_ERR_NO_MEM if HAL_MQTT_MAX_CALLBACKS are registered.
+ */
+esp_err_t halMqttRegister(HalMqttClient_t client, HalMqttCallback_t callback, void *arg);
+
+/**
+ * @brief Starts the client, which connects to the broker.
+ *
+ * @param client Client handle.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halMqttStart(HalMqttClient_t client);
+
+/**
+ * @brief Reconnects a started client.
+ *
+ * @param client Client handle.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halMqttReconnect(HalMqttClient_t client);
+
+/**
+ * @brief Subscribes to a topic.
+ *
+ * @param client Client handle.
+ * @param topic Topic.
+ * @param qos Quality of service.
+ * @return int Message ID, or negative on failure.
+ */
+int halMqttSubscribe(HalMqttClient_t client, const char *topic, int qos);
+
+/**
+ * @brief Queues a message for publishing without blocking.
+ *
+ * @param client Client handle.
+ * @param topic Topic.
+ * @param data Null terminated payload.
+ * @param qos Quality of service.
+ * @param retain If true, the broker retains the message.
+ * @return int Message ID, or negative on failure.
+ */
+int halMqttEnqueue(HalMqttClient_t client, const char *topic, const char *data, int qos, bool retain);
+
+/**
+ * @brief Returns true if the client holds messages not yet sent, or QoS 1 messages not yet acknowledged.
+ *
+ * @param client Client handle.
+ */
+bool halMqttHasPending(HalMqttClient_t client);
+
+#endif
\ No newline at end of file
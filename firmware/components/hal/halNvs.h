@@ -0,0 +1,87 @@
+#ifndef HAL_NVS_H
+#define HAL_NVS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+/** Handle of an open namespace. */
+typedef uint32_t HalNvs_t;
+
+/**
+ * @brief Initializes non-volatile storage, erasing it if it is full or of an older layout.
+ *
+ * @return esp_err_t Return code.
+ */
+esp_err_t halNvsInitialize();
+
+/**
+ * @brief Opens a namespace.
+ *
+ * @param name Namespace.
+ * @param writable If true, the namespace is opened for writing and created if missing.
+ * @param handle Overwritten with the handle.
+ * @return esp_err_t Return code. ESP_ERR_NOT_FOUND if opened read only and nothing was written to it.
+ */
+esp_err_t halNvsOpen(const char *name, bool writable, HalNvs_t &handle);
+
+/**
+ * @brief Reads a blob.
+ *
+ * @param handle Namespace handle.
+ * @param key Key.
+ * @param value Overwritten with the blob.
+ * @param length Size of the buffer in bytes. Overwritten with the size of the blob.
+ * @return esp_err_t Return code. ESP_ERR_NOT_FOUND if the key is missing,
+ * ESP_ERR_INVALID_SIZE if the buffer is too small.
+ */
+esp_err_t halNvsGetBlob(HalNvs_t handle, const char *key, void *value, size_t &length);
+
+/**
+ * @brief Writes a blob. Takes effect on halNvsCommit().
+ *
+ * @param handle Namespace handle.
+ * @param key Key.
+ * @param value Blob.
+ * @param length Size of the blob in bytes.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halNvsSetBlob(HalNvs_t handle, const char *key, const void *value, size_t length);
+
+/**
+ * @brief Reads an integer.
+ *
+ * @param handle Namespace handle.
+ * @param key Key.
+ * @param value Overwritten with the integer.
+ * @return esp_err_t Return code. ESP_ERR_NOT_FOUND if the key is missing.
+ */
+esp_err_t halNvsGetU32(HalNvs_t handle, const char *key, uint32_t &value);
+
+/**
+ * @brief Writes an integer. Takes effect on halNvsCommit().
+ *
+ * @param handle Namespace handle.
+ * @param key Key.
+ * @param value Integer.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halNvsSetU32(HalNvs_t handle, const char *key, uint32_t value);
+
+/**
+ * @brief Commits the writes to a namespace.
+ *
+ * @param handle Namespace handle.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halNvsCommit(HalNvs_t handle);
+
+/**
+ * @brief Closes a namespace.
+ *
+ * @param handle Namespace handle.
+ */
+void halNvsClose(HalNvs_t handle);
+
+#endif
\ No newline at end of file
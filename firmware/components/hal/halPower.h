@@ -0,0 +1,97 @@
+#ifndef HAL_POWER_H
+#define HAL_POWER_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+/** Opaque handle of a power management lock. */
+typedef struct HalPowerLock *HalPowerLock_t;
+
+/**
+ * @brief Describes the power management locks.
+ */
+typedef enum HalPowerLocks_e {
+    /** Holds the CPU at its maximum frequency. */
+    HAL_POWER_LOCK_CPU_FREQ_MAX,
+    /** Prevents automatic light sleep. */
+    HAL_POWER_LOCK_NO_LIGHT_SLEEP
+} HalPowerLocks_e;
+
+/**
+ * @brief Called on exit from light sleep, with interrupts disabled on the target.
+ *
+ * @param sleepTime Time spent in light sleep, in microseconds.
+ */
+typedef void (*HalLightSleepCallback_t)(int64_t sleepTime);
+
+/**
+ * @brief Configures frequency scaling and automatic light sleep.
+ *
+ * @param maxFrequency Maximum CPU frequency in megahertz.
+ * @param minFrequency Minimum CPU frequency in megahertz.
+ * @param lightSleep If true, the chip enters light sleep when idle.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halPowerConfigure(uint32_t maxFrequency, uint32_t minFrequency, bool lightSleep);
+
+/**
+ * @brief Creates a released lock.
+ *
+ * @param type Lock type.
+ * @param name Name of the lock, for debugging.
+ * @param lock Overwritten with the handle.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halPowerLockCreate(HalPowerLocks_e type, const char *name, HalPowerLock_t *lock);
+
+/**
+ * @brief Acquires a lock.
+ */
+esp_err_t halPowerLockAcquire(HalPowerLock_t lock);
+
+/**
+ * @brief Releases a lock.
+ */
+esp_err_t halPowerLockRelease(HalPowerLock_t lock);
+
+/**
+ * @brief Registers the callback called on exit from light sleep.
+ *
+ * @param callback Callback.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halPowerOnLightSleepExit(HalLightSleepCallback_t callback);
+
+/**
+ * @brief Returns the cause of the last wake from deep sleep, as an esp_sleep_wakeup_cause_t.
+ */
+uint8_t halSleepGetWakeCause();
+
+/**
+ * @brief If true, the last wake from deep sleep was by the timer.
+ */
+bool halSleepWokeByTimer();
+
+/**
+ * @brief Wakes from deep sleep after a duration.
+ *
+ * @param duration Duration in microseconds.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halSleepEnableTimerWakeup(uint64_t duration);
+
+/**
+ * @brief Wakes from deep sleep when a pin is pulled low.
+ *
+ * @param pin GPIO number.
+ * @return esp_err_t Return code. ESP_ERR_INVALID_ARG if the pin cannot wake from deep sleep.
+ */
+esp_err_t halSleepEnableGpioWakeup(int8_t pin);
+
+/**
+ * @brief Enters deep sleep. Only returns on the host, where the wake is not emulated.
+ */
+void halSleepStart();
+
+#endif
\ No newline at end of file
@@ -0,0 +1,32 @@
+#ifndef HAL_PULSE_H
+#define HAL_PULSE_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+/**
+ * @brief Called on each counted pulse. Runs in interrupt context on the target.
+ */
+typedef void (*HalPulseCallback_t)(void *arg);
+
+/**
+ * @brief Calls a callback on each rising edge of an input pin.
+ * The pin must be configured as an input and the interrupt service installed.
+ *
+ * @param pin GPIO number.
+ * @param callback Called on each rising edge.
+ * @param arg Passed to the callback.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halPulseAttach(int8_t pin, HalPulseCallback_t callback, void *arg);
+
+/**
+ * @brief Stops calling the callback of a pin. Has no effect if none is attached.
+ *
+ * @param pin GPIO number.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halPulseDetach(int8_t pin);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,43 @@
+#ifndef HAL_PWM_H
+#define HAL_PWM_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+/**
+ * @brief Configures the timer shared by every PWM channel.
+ *
+ * @param frequency PWM frequency in hertz.
+ * @param resolution Duty resolution in bits.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halPwmInitialize(uint32_t frequency, uint8_t resolution);
+
+/**
+ * @brief Routes a pin to a PWM channel with zero duty.
+ *
+ * @param channel Channel number.
+ * @param pin GPIO number.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halPwmAttach(uint8_t channel, int8_t pin);
+
+/**
+ * @brief Sets the duty of a channel.
+ *
+ * @param channel Channel number.
+ * @param duty Duty in steps of the resolution.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halPwmSetDuty(uint8_t channel, uint32_t duty);
+
+/**
+ * @brief Stops a channel with its output low.
+ *
+ * @param channel Channel number.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halPwmStop(uint8_t channel);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,61 @@
+#ifndef HAL_QUEUE_H
+#define HAL_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+/** Opaque handle of a fixed length queue of fixed size items, copied in and out. */
+typedef struct HalQueue *HalQueue_t;
+
+/** Maximum number of queues. Queues are never deleted. */
+#define HAL_QUEUE_MAX_QUEUES 4
+/** Bytes of items of every queue, allocated statically. */
+#define HAL_QUEUE_POOL_BYTES 6144
+
+/**
+ * @brief Creates a queue from static memory.
+ *
+ * @param length Maximum number of items.
+ * @param itemSize Size of an item in bytes.
+ * @param queue Overwritten with the handle.
+ * @return esp_err_t Return code. ESP_ERR_NO_MEM if HAL_QUEUE_MAX_QUEUES queues
+ * were created or HAL_QUEUE_POOL_BYTES would be exceeded.
+ */
+esp_err_t halQueueCreate(uint8_t length, size_t itemSize, HalQueue_t *queue);
+
+/**
+ * @brief Copies an item to the back of a queue without blocking.
+ *
+ * @param queue Queue handle.
+ * @param item Item.
+ * @return bool False if the queue is full.
+ */
+bool halQueueSend(HalQueue_t queue, const void *item);
+
+/**
+ * @brief Copies the front item of a queue without removing it, blocking until one arrives.
+ *
+ * @param queue Queue handle.
+ * @param item Overwritten with the item.
+ * @param timeout Maximum wait in miliseconds.
+ * @return bool False if the timeout elapsed first.
+ */
+bool halQueuePeek(HalQueue_t queue, void *item, uint32_t timeout);
+
+/**
+ * @brief Removes the front item of a queue without blocking.
+ *
+ * @param queue Queue handle.
+ * @param item Overwritten with the item.
+ * @return bool False if the queue is empty.
+ */
+bool halQueueReceive(HalQueue_t queue, void *item);
+
+/**
+ * @brief Returns the number of items in a queue.
+ */
+uint8_t halQueueCount(HalQueue_t queue);
+
+#endif
\ No newline at end of file
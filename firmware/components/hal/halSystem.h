@@ -0,0 +1,99 @@
+#ifndef HAL_SYSTEM_H
+#define HAL_SYSTEM_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+/**
+ * @brief Describes the free memory of the heap.
+ */
+typedef struct HalHeapStats_t {
+    /** Free bytes. */
+    uint32_t freeBytes = 0;
+    /** Least free bytes since boot. */
+    uint32_t minimumFreeBytes = 0;
+    /** Largest block which can be allocated, in bytes. */
+    uint32_t largestFreeBlock = 0;
+} HalHeapStats_t;
+
+/**
+ * @brief Restarts the chip. Does not return.
+ */
+void halRestart();
+
+/**
+ * @brief If true, the last reset was a wake from deep sleep, so RTC memory was retained.
+ */
+bool halResetWasDeepSleep();
+
+/**
+ * @brief Returns a random number from the hardware generator.
+ */
+uint32_t halRandom();
+
+/**
+ * @brief Reads the MAC address of the WiFi station.
+ *
+ * @param mac Overwritten with the 6 bytes of the address.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halReadMac(uint8_t *mac);
+
+/**
+ * @brief Starts setting the clock from an SNTP server.
+ *
+ * @param server Host name of the server. Must outlive SNTP.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halSntpStart(const char *server);
+
+/**
+ * @brief Stops SNTP.
+ */
+void halSntpStop();
+
+/**
+ * @brief Reads the free memory of the heap.
+ *
+ * @param stats Overwritten with the heap statistics.
+ * @return esp_err_t Return code. ESP_ERR_NOT_SUPPORTED if the heap cannot be inspected.
+ */
+esp_err_t halHeapStats(HalHeapStats_t &stats);
+
+/**
+ * @brief Reads the least free stack of a task since it was created.
+ *
+ * @param name Name of the task.
+ * @param bytes Overwritten with the high-water mark, in bytes.
+ * @return esp_err_t Return code. ESP_ERR_NOT_FOUND if no task has the name,
+ * ESP_ERR_NOT_SUPPORTED if stacks cannot be inspected.
+ */
+esp_err_t halTaskStackHighWater(const char *name, uint32_t &bytes);
+
+/**
+ * @brief Begins guarding the calling task against heap allocations, once it has booted.
+ * Each allocation of the task is counted, and aborts with a backtrace if CONFIG_DRIP_HEAP_GUARD is set.
+ * Has no effect if the task is already guarded.
+ *
+ * @return esp_err_t Return code. ESP_ERR_NOT_SUPPORTED if allocations cannot be observed.
+ */
+esp_err_t halHeapGuardArm();
+
+/**
+ * @brief Suspends the guard around a call which may allocate, such as a driver
+ * allocating internally. Calls nest, and each is ended by halHeapGuardResume().
+ */
+void halHeapGuardSuspend();
+
+/**
+ * @brief Ends a suspension of the guard.
+ */
+void halHeapGuardResume();
+
+/**
+ * @brief Returns the number of allocations of the guarded task since it was guarded.
+ */
+uint32_t halHeapGuardCount();
+
+#endif
\ No newline at end of file
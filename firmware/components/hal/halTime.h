@@ -0,0 +1,55 @@
+#ifndef HAL_TIME_H
+#define HAL_TIME_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+/** Opaque handle of a one-shot timer. */
+typedef struct HalTimer *HalTimer_t;
+
+/**
+ * @brief Called when a timer expires. Runs in a timer task on the target, not in interrupt context.
+ */
+typedef void (*HalTimerCallback_t)(void *arg);
+
+/**
+ * @brief Returns the time since boot in microseconds. Safe to call from interrupt context.
+ */
+int64_t halTimeMicros();
+
+/**
+ * @brief Returns a free-running counter for measuring short code paths, wrapping at 32 bits.
+ * CPU cycles on the target, nanoseconds of the monotonic clock on the host.
+ */
+uint32_t halCycleCount();
+
+/**
+ * @brief Creates a stopped one-shot timer.
+ *
+ * @param callback Called on expiry.
+ * @param arg Passed to the callback.
+ * @param name Name of the timer, for debugging.
+ * @param timer Overwritten with the handle.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halTimerCreate(HalTimerCallback_t callback, void *arg, const char *name, HalTimer_t *timer);
+
+/**
+ * @brief Starts a timer. The timer must be stopped.
+ *
+ * @param timer Timer handle.
+ * @param timeout Time until expiry in microseconds.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halTimerStartOnce(HalTimer_t timer, uint64_t timeout);
+
+/**
+ * @brief Stops a timer. Stopping a stopped timer is not an error.
+ *
+ * @param timer Timer handle.
+ * @return esp_err_t Return code.
+ */
+esp_err_t halTimerStop(HalTimer_t timer);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,64 @@
+#ifndef HAL_TRACE_H
+#define HAL_TRACE_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+/**
+ * @brief Describes the inputs of the firmware passed to the trace callback.
+ */
+typedef enum HalTraceInputs_e {
+    /** A rising edge on a pulse input. */
+    HAL_TRACE_PULSE,
+    /** A conversion of an ADC reading to millivolts. */
+    HAL_TRACE_ADC,
+    /** A message received by an MQTT client. */
+    HAL_TRACE_MQTT_DATA
+} HalTraceInputs_e;
+
+/**
+ * @brief Describes an input. Pointers are only valid during the callback.
+ */
+typedef struct HalTraceInput_t {
+    HalTraceInputs_e id = HAL_TRACE_PULSE;
+    /** Time of the input since boot, in microseconds. */
+    int64_t time = 0;
+    /** GPIO number of HAL_TRACE_PULSE and HAL_TRACE_ADC. */
+    int8_t pin = -1;
+    /** Converted voltage of HAL_TRACE_ADC. */
+    int millivolts = 0;
+    /** Topic and payload of HAL_TRACE_MQTT_DATA. Neither is null terminated. */
+    const char *topic = nullptr;
+    int topicLength = 0;
+    const char *data = nullptr;
+    int dataLength = 0;
+} HalTraceInput_t;
+
+/**
+ * @brief Called on each input. Runs in interrupt context for HAL_TRACE_PULSE on
+ * the target, and on the task of the MQTT client for HAL_TRACE_MQTT_DATA.
+ */
+typedef void (*HalTraceCallback_t)(void *arg, HalTraceInput_t &input);
+
+/**
+ * @brief Sets the callback called on each input of the firmware, or clears it.
+ *
+ * @param callback Called on each input, or nullptr to stop. Must be in IRAM.
+ * @param arg Passed to the callback.
+ */
+void halTraceSetCallback(HalTraceCallback_t callback, void *arg);
+
+/**
+ * @brief Passes an input to the trace callback. Called by the backends.
+ *
+ * @param input The input, timestamped by the caller.
+ */
+void halTraceEmit(HalTraceInput_t &input);
+
+/**
+ * @brief If true, a trace callback is set. Lets the backends skip building inputs.
+ */
+bool halTraceEnabled();
+
+#endif
\ No newline at end of file
@@ -0,0 +1,93 @@
+#include "esp_err.h"
+
+#include "halAdc.h"
+#include "halTime.h"
+#include "halTrace.h"
+#include "halPosix.h"
+
+/** ADC1 of the esp32c3 is on GPIO 0 to 4, one channel per pin. */
+#define HAL_ADC_MAX_CHANNELS 5
+
+/**
+ * @brief An ADC channel reading the voltage set by halPosixSetAdc().
+ */
+struct HalAdc {
+    bool open;
+    int8_t pin;
+    int millivolts;
+};
+
+static HalAdc channels[HAL_ADC_MAX_CHANNELS] = {};
+
+/**
+ * @brief Opens the ADC channel of a pin.
+ */
+esp_err_t halAdcOpen(int8_t pin, HalAdc_t *adc) {
+    if ( (pin < 0) || (pin >= HAL_ADC_MAX_CHANNELS) ) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (channels[pin].open) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    channels[pin].open = true;
+    channels[pin].pin = pin;
+    *adc = &channels[pin];
+    return ESP_OK;
+}
+
+/**
+ * @brief Reads the voltage set by the host. Raw conversions are in millivolts on the host.
+ */
+esp_err_t halAdcReadRaw(HalAdc_t adc, int &raw) {
+    if ( (adc == nullptr) || (adc->open == false) ) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    raw = adc->millivolts;
+    return ESP_OK;
+}
+
+/**
+ * @brief Raw conversions are already in millivolts on the host.
+ */
+esp_err_t halAdcToMillivolts(HalAdc_t adc, int raw, int &millivolts) {
+    HalTraceInput_t input = {};
+
+    if ( (adc == nullptr) || (adc->open == false) ) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    millivolts = raw;
+    if (halTraceEnabled()) {
+        input.id = HAL_TRACE_ADC;
+        input.time = halTimeMicros();
+        input.pin = adc->pin;
+        input.millivolts = millivolts;
+        halTraceEmit(input);
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Closes a channel. Has no effect on a null handle.
+ */
+esp_err_t halAdcClose(HalAdc_t adc) {
+    if (adc != nullptr) {
+        adc->open = false;
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Sets the voltage read by the ADC channel of a pin.
+ */
+void halPosixSetAdc(int8_t pin, int millivolts) {
+    if ( (pin < 0) || (pin >= HAL_ADC_MAX_CHANNELS) ) {
+        return;
+    }
+
+    channels[pin].millivolts = millivolts;
+}
\ No newline at end of file
@@ -0,0 +1,79 @@
+#include "esp_err.h"
+
+#include "halGpio.h"
+#include "halPosix.h"
+
+static bool levels[HAL_GPIO_PIN_COUNT] = {};
+
+/**
+ * @brief If true, the pin can be driven as an output. Every esp32c3 pin can.
+ */
+bool halGpioIsValidOutput(int8_t pin) {
+    return (pin >= 0) && (pin < HAL_GPIO_PIN_COUNT);
+}
+
+/**
+ * @brief Pulse callbacks are called directly on the host, so there is no service to install.
+ */
+esp_err_t halGpioInstallIsrService() {
+    return ESP_OK;
+}
+
+/**
+ * @brief Configures a pin as an output, driven low.
+ */
+esp_err_t halGpioConfigOutput(int8_t pin) {
+    if (halGpioIsValidOutput(pin) == false) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    levels[pin] = false;
+    return ESP_OK;
+}
+
+/**
+ * @brief Configures a pin as an input.
+ */
+esp_err_t halGpioConfigInput(int8_t pin, bool pullUp) {
+    if ( (pin < 0) || (pin >= HAL_GPIO_PIN_COUNT) ) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    levels[pin] = pullUp;
+    return ESP_OK;
+}
+
+/**
+ * @brief Resets a pin to its default state.
+ */
+esp_err_t halGpioReset(int8_t pin) {
+    if ( (pin < 0) || (pin >= HAL_GPIO_PIN_COUNT) ) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    levels[pin] = false;
+    return ESP_OK;
+}
+
+/**
+ * @brief Sets the level of an output.
+ */
+esp_err_t halGpioSetLevel(int8_t pin, bool level) {
+    if (halGpioIsValidOutput(pin) == false) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    levels[pin] = level;
+    return ESP_OK;
+}
+
+/**
+ * @brief Returns the level of an output, or of the PWM output attached to it.
+ */
+bool halPosixGetLevel(int8_t pin) {
+    if ( (pin < 0) || (pin >= HAL_GPIO_PIN_COUNT) ) {
+        return false;
+    }
+
+    return levels[pin] || (halPosixGetPwmDuty(pin) > 0);
+}
\ No newline at end of file
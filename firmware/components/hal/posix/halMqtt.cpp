@@ -0,0 +1,557 @@
+#include <cstdio>
+#include <cstring>
+
+#include "esp_err.h"
+
+#include "halMqtt.h"
+#include "halTime.h"
+#include "halTrace.h"
+#include "halPosix.h"
+
+/** Maximum number of clients and subscriptions per client of the loopback broker. */
+#define HAL_POSIX_MAX_CLIENTS 2
+#define HAL_POSIX_MAX_SUBSCRIPTIONS 16
+#define HAL_POSIX_TOPIC_MAX_BYTES 96
+/** Maximum number of messages in flight on the link, in both directions. */
+#define HAL_POSIX_MAX_IN_FLIGHT 64
+#define HAL_POSIX_PAYLOAD_MAX_BYTES 1024
+/** Maximum number of times a transmission is lost in a row. */
+#define HAL_POSIX_MAX_RETRANSMITS 6
+
+/**
+ * @brief A client of the loopback broker. Messages are exchanged with the host
+ * through halPosixMqttDeliver() and the publish hook.
+ */
+struct HalMqttClient {
+    bool used;
+    HalMqttConfig_t config;
+    bool started;
+    bool connected;
+    /** The broker keeps the session of a persistent client through a disconnect. */
+    bool hasSession;
+    char subscriptions[HAL_POSIX_MAX_SUBSCRIPTIONS][HAL_POSIX_TOPIC_MAX_BYTES];
+    uint8_t subscriptionCount;
+    int nextMessageId;
+};
+
+/**
+ * @brief A message in flight on the link.
+ */
+typedef struct InFlight_t {
+    bool used;
+    /** True if published by the firmware, false if delivered by the broker. */
+    bool uplink;
+    /** Waiting for the client to reconnect. */
+    bool held;
+    HalMqttClient *client;
+    int64_t arrival;
+    /** Order of the message, so messages arriving at the same time keep their order. */
+    uint32_t sequence;
+    int qos;
+    bool retain;
+    char topic[HAL_POSIX_TOPIC_MAX_BYTES];
+    char data[HAL_POSIX_PAYLOAD_MAX_BYTES];
+    int length;
+} InFlight_t;
+
+/**
+ * @brief A registered callback.
+ */
+typedef struct MqttHandler_t {
+    HalMqttClient *client;
+    HalMqttCallback_t callback;
+    void *arg;
+} MqttHandler_t;
+
+static HalMqttClient clients[HAL_POSIX_MAX_CLIENTS] = {};
+static MqttHandler_t handlers[HAL_MQTT_MAX_CALLBACKS] = {};
+static uint8_t handlerCount = 0;
+static HalPosixPublishHook_t publishHook = nullptr;
+static void *publishArg = nullptr;
+static bool online = true;
+static HalPosixLink_t link = {};
+static uint32_t linkRandom = 1;
+static HalTimer_t linkTimer = nullptr;
+static InFlight_t inFlight[HAL_POSIX_MAX_IN_FLIGHT] = {};
+static uint32_t sequence = 0;
+/** Arrival of the last message in each direction, as TCP delivers in order. */
+static int64_t lastArrival[2] = {};
+
+static void deliver(HalMqttClient *client, const char *topic, const char *data, int length);
+static void send(bool uplink, HalMqttClient *client, const char *topic, const char *data, int length, int qos, bool retain);
+
+/**
+ * @brief Passes an event to every callback of a client.
+ */
+static void dispatch(HalMqttClient *client, HalMqttEvent_t &event) {
+    for (int i = 0; i < handlerCount; i++) {
+        if (handlers[i].client == client) {
+            handlers[i].callback(handlers[i].arg, event);
+        }
+    }
+}
+
+/**
+ * @brief Returns a uniformly distributed random number of the link.
+ */
+static uint32_t nextRandom() {
+    linkRandom ^= linkRandom << 13;
+    linkRandom ^= linkRandom >> 17;
+    linkRandom ^= linkRandom << 5;
+    return linkRandom;
+}
+
+/**
+ * @brief If true, the link delays messages, so they travel through the in-flight buffer.
+ */
+static bool impaired() {
+    return (link.latency > 0) || (link.jitter > 0) || (link.loss > 0);
+}
+
+/**
+ * @brief Returns the time a message sent now arrives at, after the latency,
+ * jitter and retransmissions of the link, and after the previous message of its direction.
+ */
+static int64_t arrivalTime(bool uplink) {
+    int64_t arrival = halTimeMicros() + link.latency;
+    uint32_t timeout = link.retransmitTimeout;
+
+    if (link.jitter > 0) {
+        arrival += nextRandom() % (link.jitter + 1);
+    }
+
+    /** A lost segment is resent after the retransmission timeout, which doubles each time. */
+    for (int i = 0; (i < HAL_POSIX_MAX_RETRANSMITS) && (nextRandom() < link.loss * UINT32_MAX); i++) {
+        arrival += timeout;
+        timeout *= 2;
+    }
+
+    if (arrival < lastArrival[uplink]) {
+        arrival = lastArrival[uplink];
+    }
+    lastArrival[uplink] = arrival;
+    return arrival;
+}
+
+/**
+ * @brief Arms the link timer at the earliest arrival of the messages in flight.
+ */
+static void armLink() {
+    int64_t earliest = INT64_MAX;
+
+    for (int i = 0; i < HAL_POSIX_MAX_IN_FLIGHT; i++) {
+        if (inFlight[i].used && (inFlight[i].held == false) && (inFlight[i].arrival < earliest)) {
+            earliest = inFlight[i].arrival;
+        }
+    }
+
+    halTimerStop(linkTimer);
+    if (earliest != INT64_MAX) {
+        halTimerStartOnce(linkTimer, (earliest > halTimeMicros()) ? earliest - halTimeMicros() : 0);
+    }
+}
+
+/**
+ * @brief Hands a message to its receiver.
+ */
+static void receive(InFlight_t &message) {
+    if (message.uplink) {
+        if (publishHook != nullptr) {
+            publishHook(message.topic, message.data, message.qos, message.retain, publishArg);
+        } else {
+            printf("%s %s\n", message.topic, message.data);
+        }
+    } else {
+        deliver(message.client, message.topic, message.data, message.length);
+    }
+}
+
+/**
+ * @brief Hands the messages which arrived to their receivers, in order.
+ */
+static void onLinkTimer(void *arg) {
+    InFlight_t *next = nullptr;
+    InFlight_t arrived;
+
+    while (true) {
+        next = nullptr;
+        for (int i = 0; i < HAL_POSIX_MAX_IN_FLIGHT; i++) {
+            if ( inFlight[i].used && (inFlight[i].held == false) && (inFlight[i].arrival <= halTimeMicros()) &&
+                ((next == nullptr) || (inFlight[i].sequence < next->sequence)) ) {
+                next = &inFlight[i];
+            }
+        }
+        if (next == nullptr) {
+            break;
+        }
+
+        /** Copied out first, as the receiver may send the next message into the freed entry. */
+        arrived = *next;
+        next->used = false;
+        receive(arrived);
+    }
+
+    armLink();
+}
+
+/**
+ * @brief Copies a message into an entry of the in-flight buffer.
+ *
+ * @returns False if the message is too long.
+ */
+static bool fill(InFlight_t &message, bool uplink, HalMqttClient *client, const char *topic, const char *data, int length, int qos, bool retain) {
+    if ( (strlen(topic) >= HAL_POSIX_TOPIC_MAX_BYTES) || (length >= HAL_POSIX_PAYLOAD_MAX_BYTES) ) {
+        return false;
+    }
+
+    message = {};
+    message.used = true;
+    message.uplink = uplink;
+    message.client = client;
+    message.sequence = sequence++;
+    message.qos = qos;
+    message.retain = retain;
+    strcpy(message.topic, topic);
+    memcpy(message.data, data, length);
+    message.data[length] = '\0';
+    message.length = length;
+    return true;
+}
+
+/**
+ * @brief Copies a message into a free entry of the in-flight buffer.
+ *
+ * @returns The entry, or nullptr if the buffer is full or the message too long.
+ */
+static InFlight_t* store(bool uplink, HalMqttClient *client, const char *topic, const char *data, int length, int qos, bool retain) {
+    for (int i = 0; i < HAL_POSIX_MAX_IN_FLIGHT; i++) {
+        if (inFlight[i].used == false) {
+            return fill(inFlight[i], uplink, client, topic, data, length, qos, retain) ? &inFlight[i] : nullptr;
+        }
+    }
+
+    return nullptr;
+}
+
+/**
+ * @brief Sends a message over the link. Without impairments it is received immediately.
+ */
+static void send(bool uplink, HalMqttClient *client, const char *topic, const char *data, int length, int qos, bool retain) {
+    InFlight_t immediate;
+    InFlight_t *message = nullptr;
+
+    if ( (impaired() == false) || (linkTimer == nullptr) ) {
+        if (fill(immediate, uplink, client, topic, data, length, qos, retain)) {
+            receive(immediate);
+        }
+        return;
+    }
+
+    message = store(uplink, client, topic, data, length, qos, retain);
+    if (message != nullptr) {
+        message->arrival = arrivalTime(uplink);
+        armLink();
+    }
+}
+
+/**
+ * @brief Holds the messages in flight of a client that lost its connection.
+ * QoS 1 messages of the client are resent from its outbox after reconnecting.
+ * Messages from the broker are only redelivered if it keeps a session for the client.
+ */
+static void holdInFlight(HalMqttClient *client) {
+    for (int i = 0; i < HAL_POSIX_MAX_IN_FLIGHT; i++) {
+        if ( (inFlight[i].used == false) || (inFlight[i].client != client) ) {
+            continue;
+        }
+        if ( (inFlight[i].qos == 0) || ((inFlight[i].uplink == false) && (client->hasSession == false)) ) {
+            inFlight[i].used = false;
+        } else {
+            inFlight[i].held = true;
+        }
+    }
+    armLink();
+}
+
+/**
+ * @brief Resends the held messages of a reconnected client. Messages from
+ * the broker are dropped if it did not resume the session.
+ */
+static void resendHeld(HalMqttClient *client, bool sessionPresent) {
+    for (int i = 0; i < HAL_POSIX_MAX_IN_FLIGHT; i++) {
+        if ( (inFlight[i].used == false) || (inFlight[i].held == false) || (inFlight[i].client != client) ) {
+            continue;
+        }
+        if ( (inFlight[i].uplink == false) && (sessionPresent == false) ) {
+            inFlight[i].used = false;
+            continue;
+        }
+        inFlight[i].held = false;
+        inFlight[i].arrival = arrivalTime(inFlight[i].uplink);
+        inFlight[i].sequence = sequence++;
+    }
+    armLink();
+}
+
+/**
+ * @brief Connects a client, resuming its session if it has one.
+ * While the broker is offline, the attempt fails with a disconnect.
+ */
+static void connect(HalMqttClient *client) {
+    HalMqttEvent_t event = {};
+    bool sessionPresent = false;
+
+    if (online == false) {
+        event.id = HAL_MQTT_EVENT_DISCONNECTED;
+        dispatch(client, event);
+        return;
+    }
+
+    if (client->hasSession == false) {
+        client->subscriptionCount = 0;
+    }
+
+    client->connected = true;
+    sessionPresent = client->hasSession;
+    event.id = HAL_MQTT_EVENT_CONNECTED;
+    event.sessionPresent = sessionPresent;
+    client->hasSession = client->config.persistentSession;
+    dispatch(client, event);
+    resendHeld(client, sessionPresent);
+}
+
+/**
+ * @brief Drops the connection of a client.
+ */
+static void disconnect(HalMqttClient *client) {
+    HalMqttEvent_t event = {};
+
+    event.id = HAL_MQTT_EVENT_DISCONNECTED;
+    client->connected = false;
+    holdInFlight(client);
+    dispatch(client, event);
+}
+
+/**
+ * @brief If true, a subscription matches a topic. Only the multi-level wildcard is supported.
+ */
+static bool matches(const char *subscription, const char *topic) {
+    size_t length = strlen(subscription);
+
+    if ( (length > 0) && (subscription[length - 1] == '#') ) {
+        return strncmp(subscription, topic, length - 1) == 0;
+    }
+    return strcmp(subscription, topic) == 0;
+}
+
+/**
+ * @brief Creates a stopped client of the loopback broker.
+ */
+esp_err_t halMqttCreate(HalMqttConfig_t &config, HalMqttClient_t *client) {
+    for (int i = 0; i < HAL_POSIX_MAX_CLIENTS; i++) {
+        if (clients[i].used == false) {
+            clients[i] = {};
+            clients[i].used = true;
+            clients[i].config = config;
+            clients[i].nextMessageId = 1;
+            *client = &clients[i];
+            if (linkTimer == nullptr) {
+                halTimerCreate(&onLinkTimer, nullptr, "mqttLink", &linkTimer);
+            }
+            return ESP_OK;
+        }
+    }
+
+    return ESP_ERR_NO_MEM;
+}
+
+/**
+ * @brief Changes the connection config. Takes effect on the next connection.
+ */
+esp_err_t halMqttSetConfig(HalMqttClient_t client, HalMqttConfig_t &config) {
+    if (client == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    client->config = config;
+    return ESP_OK;
+}
+
+/**
+ * @brief Registers a callback for every event of a client.
+ */
+esp_err_t halMqttRegister(HalMqttClient_t client, HalMqttCallback_t callback, void *arg) {
+    if (handlerCount >= HAL_MQTT_MAX_CALLBACKS) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    handlers[handlerCount].client = client;
+    handlers[handlerCount].callback = callback;
+    handlers[handlerCount].arg = arg;
+    handlerCount++;
+    return ESP_OK;
+}
+
+/**
+ * @brief Starts the client. The loopback broker accepts the connection immediately.
+ */
+esp_err_t halMqttStart(HalMqttClient_t client) {
+    if ( (client == nullptr) || client->started ) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    client->started = true;
+    connect(client);
+    return ESP_OK;
+}
+
+/**
+ * @brief Reconnects a started client.
+ */
+esp_err_t halMqttReconnect(HalMqttClient_t client) {
+    if ( (client == nullptr) || (client->started == false) ) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (client->connected == false) {
+        connect(client);
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Subscribes to a topic.
+ */
+int halMqttSubscribe(HalMqttClient_t client, const char *topic, int qos) {
+    if ( (client == nullptr) || (client->connected == false) ) {
+        return -1;
+    }
+
+    for (int i = 0; i < client->subscriptionCount; i++) {
+        if (strcmp(client->subscriptions[i], topic) == 0) {
+            return client->nextMessageId++;
+        }
+    }
+    if ( (client->subscriptionCount >= HAL_POSIX_MAX_SUBSCRIPTIONS) || (strlen(topic) >= HAL_POSIX_TOPIC_MAX_BYTES) ) {
+        return -1;
+    }
+
+    strcpy(client->subscriptions[client->subscriptionCount++], topic);
+    return client->nextMessageId++;
+}
+
+/**
+ * @brief Publishes a message to the host. Fails while disconnected.
+ */
+int halMqttEnqueue(HalMqttClient_t client, const char *topic, const char *data, int qos, bool retain) {
+    if ( (client == nullptr) || (client->connected == false) ) {
+        return -1;
+    }
+
+    send(true, client, topic, data, strlen(data), qos, retain);
+    return client->nextMessageId++;
+}
+
+/**
+ * @brief Returns true if a message of the client is still on its way to the broker.
+ */
+bool halMqttHasPending(HalMqttClient_t client) {
+    for (int i = 0; i < HAL_POSIX_MAX_IN_FLIGHT; i++) {
+        if (inFlight[i].used && inFlight[i].uplink && (inFlight[i].client == client)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Sets the hook called for each message published by the firmware.
+ * Without a hook, messages are printed to stdout.
+ */
+void halPosixSetPublishHook(HalPosixPublishHook_t hook, void *arg) {
+    publishHook = hook;
+    publishArg = arg;
+}
+
+/**
+ * @brief Passes a message arriving from the broker to a client, if it is still
+ * connected, or holds it for the session of the client.
+ */
+static void deliver(HalMqttClient *client, const char *topic, const char *data, int length) {
+    HalMqttEvent_t event = {};
+    HalTraceInput_t input = {};
+    InFlight_t *message = nullptr;
+
+    if (client->connected == false) {
+        message = client->hasSession ? store(false, client, topic, data, length, 1, false) : nullptr;
+        if (message != nullptr) {
+            message->held = true;
+        }
+        return;
+    }
+
+    event.id = HAL_MQTT_EVENT_DATA;
+    event.topic = topic;
+    event.topicLength = strlen(topic);
+    event.data = data;
+    event.dataLength = length;
+    event.totalLength = length;
+    if (halTraceEnabled()) {
+        input.id = HAL_TRACE_MQTT_DATA;
+        input.time = halTimeMicros();
+        input.topic = event.topic;
+        input.topicLength = event.topicLength;
+        input.data = event.data;
+        input.dataLength = event.dataLength;
+        halTraceEmit(input);
+    }
+    dispatch(client, event);
+}
+
+/**
+ * @brief Delivers a message from the broker to every client subscribed to the topic,
+ * over the link. The broker queues the message for a disconnected client with a session.
+ */
+void halPosixMqttDeliver(const char *topic, const char *data, int length) {
+    for (int i = 0; i < HAL_POSIX_MAX_CLIENTS; i++) {
+        if ( (clients[i].used == false) || ((clients[i].connected == false) && (clients[i].hasSession == false)) ) {
+            continue;
+        }
+        for (int j = 0; j < clients[i].subscriptionCount; j++) {
+            if (matches(clients[i].subscriptions[j], topic)) {
+                send(false, &clients[i], topic, data, length, 1, false);
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Drops the connection of every client, as a broker or network outage would.
+ */
+void halPosixMqttDisconnect() {
+    for (int i = 0; i < HAL_POSIX_MAX_CLIENTS; i++) {
+        if (clients[i].used && clients[i].connected) {
+            disconnect(&clients[i]);
+        }
+    }
+}
+
+/**
+ * @brief Takes the broker offline, dropping every connection and failing
+ * connection attempts, or brings it back online.
+ */
+void halPosixMqttSetOnline(bool isOnline) {
+    online = isOnline;
+    if (online == false) {
+        halPosixMqttDisconnect();
+    }
+}
+
+/**
+ * @brief Sets the impairments of the link between the firmware and the broker.
+ */
+void halPosixSetLink(HalPosixLink_t &config) {
+    link = config;
+    linkRandom = (link.seed == 0) ? 1 : link.seed;
+}
\ No newline at end of file
@@ -0,0 +1,143 @@
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "esp_err.h"
+
+#include "halNvs.h"
+#include "halSystem.h"
+#include "halPosix.h"
+
+/**
+ * Non-volatile storage is kept in memory for the lifetime of the process.
+ * Handles index the namespaces opened so far. The containers allocate, as NVS does
+ * on the target, so the heap guard is suspended while they are used.
+ */
+static std::vector<std::string> namespaces;
+static std::map<std::string, std::vector<uint8_t>> entries;
+/** Set if the WiFi driver has credentials stored, kept apart from the namespaces as on the target. */
+static bool wifiCredentials = true;
+
+/**
+ * @brief Returns the entry key of a key in a namespace, or an empty string for an invalid handle.
+ */
+static std::string entryKey(HalNvs_t handle, const char *key) {
+    if (handle >= namespaces.size()) {
+        return std::string();
+    }
+
+    return namespaces[handle] + "/" + key;
+}
+
+/**
+ * @brief Nothing to initialize on the host.
+ */
+esp_err_t halNvsInitialize() {
+    return ESP_OK;
+}
+
+/**
+ * @brief Opens a namespace. A namespace exists once it was opened for writing.
+ */
+esp_err_t halNvsOpen(const char *name, bool writable, HalNvs_t &handle) {
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+
+    halHeapGuardSuspend();
+    for (size_t i = 0; i < namespaces.size(); i++) {
+        if (namespaces[i] == name) {
+            handle = i;
+            err = ESP_OK;
+            break;
+        }
+    }
+    if ( (err != ESP_OK) && writable ) {
+        namespaces.push_back(name);
+        handle = namespaces.size() - 1;
+        err = ESP_OK;
+    }
+    halHeapGuardResume();
+    return err;
+}
+
+/**
+ * @brief Reads a blob.
+ */
+esp_err_t halNvsGetBlob(HalNvs_t handle, const char *key, void *value, size_t &length) {
+    esp_err_t err = ESP_OK;
+
+    halHeapGuardSuspend();
+    auto entry = entries.find(entryKey(handle, key));
+
+    if (entry == entries.end()) {
+        err = ESP_ERR_NOT_FOUND;
+    } else if (entry->second.size() > length) {
+        length = entry->second.size();
+        err = ESP_ERR_INVALID_SIZE;
+    } else {
+        length = entry->second.size();
+        memcpy(value, entry->second.data(), length);
+    }
+    halHeapGuardResume();
+    return err;
+}
+
+/**
+ * @brief Writes a blob. Writes take effect immediately on the host.
+ */
+esp_err_t halNvsSetBlob(HalNvs_t handle, const char *key, const void *value, size_t length) {
+    const uint8_t *bytes = static_cast<const uint8_t*>(value);
+
+    if (handle >= namespaces.size()) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    halHeapGuardSuspend();
+    entries[entryKey(handle, key)].assign(bytes, bytes + length);
+    halHeapGuardResume();
+    return ESP_OK;
+}
+
+/**
+ * @brief Reads an integer.
+ */
+esp_err_t halNvsGetU32(HalNvs_t handle, const char *key, uint32_t &value) {
+    size_t length = sizeof(value);
+
+    return halNvsGetBlob(handle, key, &value, length);
+}
+
+/**
+ * @brief Writes an integer.
+ */
+esp_err_t halNvsSetU32(HalNvs_t handle, const char *key, uint32_t value) {
+    return halNvsSetBlob(handle, key, &value, sizeof(value));
+}
+
+/**
+ * @brief Writes already took effect on the host.
+ */
+esp_err_t halNvsCommit(HalNvs_t handle) {
+    return (handle < namespaces.size()) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+/**
+ * @brief Handles stay valid on the host, so there is nothing to close.
+ */
+void halNvsClose(HalNvs_t handle) {
+}
+
+/**
+ * @brief Stores or erases the WiFi credentials, which the WiFi driver keeps in NVS on the target.
+ * Stored by default. Storing them while the firmware provisions stands in for the provisioning app.
+ */
+void halPosixSetWifiCredentials(bool stored) {
+    wifiCredentials = stored;
+}
+
+/**
+ * @brief Returns true if WiFi credentials are stored.
+ */
+bool halPosixHasWifiCredentials() {
+    return wifiCredentials;
+}
\ No newline at end of file
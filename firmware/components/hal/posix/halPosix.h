@@ -0,0 +1,141 @@
+#ifndef HAL_POSIX_H
+#define HAL_POSIX_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+/**
+ * Host side of the POSIX backend of the HAL. The backend is single threaded and
+ * runs on virtual time: time only advances while the firmware blocks on a queue,
+ * or when the host advances it. Timer callbacks and pulse callbacks run on the
+ * calling thread, so a run is deterministic and faster than real time.
+ */
+
+/** Virtual time at boot, in microseconds. Zero is reserved for missing timestamps. */
+#define HAL_POSIX_BOOT_TIME 100000
+
+/**
+ * @brief Called when the firmware blocks on an empty queue, before time advances.
+ * May inject messages or advance time, but not beyond the deadline.
+ *
+ * @param deadline Time the wait ends at, in microseconds.
+ * @param arg Argument given to halPosixSetIdleHook().
+ */
+typedef void (*HalPosixIdleHook_t)(int64_t deadline, void *arg);
+
+/**
+ * @brief Called for each message published by the firmware.
+ */
+typedef void (*HalPosixPublishHook_t)(const char *topic, const char *data, int qos, bool retain, void *arg);
+
+/**
+ * @brief Advances the virtual time, running the callback of each timer expiring on the way in order.
+ *
+ * @param duration Duration in microseconds.
+ */
+void halPosixAdvance(int64_t duration);
+
+/**
+ * @brief Returns the expiry of the next running timer in microseconds, or INT64_MAX if none is running.
+ */
+int64_t halPosixNextTimer();
+
+/**
+ * @brief Sets the hook called when the firmware blocks on an empty queue.
+ */
+void halPosixSetIdleHook(HalPosixIdleHook_t hook, void *arg);
+
+/**
+ * @brief Returns the level of an output, or of the PWM output attached to it.
+ */
+bool halPosixGetLevel(int8_t pin);
+
+/**
+ * @brief Returns the PWM duty of a pin in steps of the resolution, or zero if not attached.
+ */
+uint32_t halPosixGetPwmDuty(int8_t pin);
+
+/**
+ * @brief Emits a rising edge on an input pin, calling its pulse callback if attached.
+ */
+void halPosixPulse(int8_t pin);
+
+/**
+ * @brief Sets the voltage read by the ADC channel of a pin.
+ */
+void halPosixSetAdc(int8_t pin, int millivolts);
+
+/**
+ * @brief Sets the hook called for each message published by the firmware.
+ * Without a hook, messages are printed to stdout.
+ */
+void halPosixSetPublishHook(HalPosixPublishHook_t hook, void *arg);
+
+/**
+ * @brief Delivers a message from the broker to every client subscribed to the topic,
+ * over the link. The broker queues the message for a disconnected client with a session.
+ *
+ * @param topic Full topic.
+ * @param data Payload.
+ * @param length Length of the payload in bytes.
+ */
+void halPosixMqttDeliver(const char *topic, const char *data, int length);
+
+/**
+ * @brief Drops the connection of every client, as a broker or network outage would.
+ */
+void halPosixMqttDisconnect();
+
+/**
+ * @brief Takes the broker offline, dropping every connection and failing
+ * connection attempts, or brings it back online.
+ */
+void halPosixMqttSetOnline(bool online);
+
+/**
+ * @brief Impairments of the link between the firmware and the loopback broker,
+ * applied to each message in both directions. Messages keep their order within
+ * a direction, as over TCP. Without impairments, messages are received immediately.
+ */
+typedef struct HalPosixLink_t {
+    /** One-way delay of each message, in microseconds. */
+    uint32_t latency = 0;
+    /** Maximum random delay added to the latency, in microseconds. */
+    uint32_t jitter = 0;
+    /** Probability of losing a transmission, from 0 to 1. A lost transmission is resent, as over TCP. */
+    float loss = 0;
+    /** Delay of resending a lost transmission in microseconds, doubling for each further loss. */
+    uint32_t retransmitTimeout = 200000;
+    /** Seed of the jitter and losses, so runs are repeatable. */
+    uint32_t seed = 1;
+} HalPosixLink_t;
+
+/**
+ * @brief Sets the impairments of the link between the firmware and the broker.
+ */
+void halPosixSetLink(HalPosixLink_t &link);
+
+/**
+ * @brief Stores or erases the WiFi credentials, which the WiFi driver keeps in NVS on the target.
+ * Stored by default. Storing them while the firmware provisions stands in for the provisioning app.
+ */
+void halPosixSetWifiCredentials(bool stored);
+
+/**
+ * @brief Returns true if WiFi credentials are stored.
+ */
+bool halPosixHasWifiCredentials();
+
+/**
+ * @brief Reports a heap allocation to the guard of halHeapGuardArm(). Called by a host
+ * which interposes the allocator, as the backend cannot observe allocations itself.
+ */
+void halPosixCountAllocation();
+
+/**
+ * @brief Sets the highest level printed by the log macros.
+ */
+void halPosixSetLogLevel(int level);
+
+#endif
\ No newline at end of file
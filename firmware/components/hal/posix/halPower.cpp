@@ -0,0 +1,93 @@
+#include "esp_err.h"
+#include "esp_log.h"
+
+#include "halPower.h"
+
+static const char* TAG = "HalPower";
+
+/** Maximum number of locks. */
+#define HAL_POSIX_MAX_LOCKS 4
+
+/**
+ * @brief A power management lock. The host has no frequency scaling or light sleep,
+ * so locks only count their holders.
+ */
+struct HalPowerLock {
+    bool used;
+    HalPowerLocks_e type;
+    uint32_t count;
+};
+
+static HalPowerLock locks[HAL_POSIX_MAX_LOCKS] = {};
+
+esp_err_t halPowerConfigure(uint32_t maxFrequency, uint32_t minFrequency, bool lightSleep) {
+    return ESP_OK;
+}
+
+esp_err_t halPowerLockCreate(HalPowerLocks_e type, const char *name, HalPowerLock_t *lock) {
+    for (int i = 0; i < HAL_POSIX_MAX_LOCKS; i++) {
+        if (locks[i].used == false) {
+            locks[i] = {};
+            locks[i].used = true;
+            locks[i].type = type;
+            *lock = &locks[i];
+            return ESP_OK;
+        }
+    }
+
+    return ESP_ERR_NO_MEM;
+}
+
+esp_err_t halPowerLockAcquire(HalPowerLock_t lock) {
+    if (lock == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    lock->count++;
+    return ESP_OK;
+}
+
+esp_err_t halPowerLockRelease(HalPowerLock_t lock) {
+    if ( (lock == nullptr) || (lock->count == 0) ) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    lock->count--;
+    return ESP_OK;
+}
+
+/**
+ * @brief The host never enters light sleep, so the callback is never called.
+ */
+esp_err_t halPowerOnLightSleepExit(HalLightSleepCallback_t callback) {
+    return ESP_OK;
+}
+
+/**
+ * @brief The host always boots cold, so there is no wake cause.
+ */
+uint8_t halSleepGetWakeCause() {
+    return 0;
+}
+
+bool halSleepWokeByTimer() {
+    return false;
+}
+
+esp_err_t halSleepEnableTimerWakeup(uint64_t duration) {
+    return ESP_OK;
+}
+
+/**
+ * @brief Only GPIO 0 to 5 can wake the esp32c3 from deep sleep.
+ */
+esp_err_t halSleepEnableGpioWakeup(int8_t pin) {
+    return ( (pin >= 0) && (pin <= 5) ) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+/**
+ * @brief The wake is not emulated, so this returns and the caller handles the failure.
+ */
+void halSleepStart() {
+    ESP_LOGW(TAG, "Deep sleep is not emulated on the host.");
+}
\ No newline at end of file
@@ -0,0 +1,65 @@
+#include "esp_err.h"
+
+#include "halGpio.h"
+#include "halPulse.h"
+#include "halTime.h"
+#include "halTrace.h"
+#include "halPosix.h"
+
+/**
+ * @brief The pulse callback of a pin.
+ */
+typedef struct PulseHandler_t {
+    HalPulseCallback_t callback;
+    void *arg;
+} PulseHandler_t;
+
+static PulseHandler_t handlers[HAL_GPIO_PIN_COUNT] = {};
+
+/**
+ * @brief Calls a callback on each pulse emitted on a pin by halPosixPulse().
+ */
+esp_err_t halPulseAttach(int8_t pin, HalPulseCallback_t callback, void *arg) {
+    if ( (pin < 0) || (pin >= HAL_GPIO_PIN_COUNT) || (callback == nullptr) ) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (handlers[pin].callback != nullptr) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    handlers[pin].callback = callback;
+    handlers[pin].arg = arg;
+    return ESP_OK;
+}
+
+/**
+ * @brief Stops calling the callback of a pin. Has no effect if none is attached.
+ */
+esp_err_t halPulseDetach(int8_t pin) {
+    if ( (pin < 0) || (pin >= HAL_GPIO_PIN_COUNT) ) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    handlers[pin] = {};
+    return ESP_OK;
+}
+
+/**
+ * @brief Emits a rising edge on an input pin, calling its pulse callback if attached.
+ */
+void halPosixPulse(int8_t pin) {
+    HalTraceInput_t input = {};
+
+    if ( (pin < 0) || (pin >= HAL_GPIO_PIN_COUNT) || (handlers[pin].callback == nullptr) ) {
+        return;
+    }
+
+    if (halTraceEnabled()) {
+        input.id = HAL_TRACE_PULSE;
+        input.time = halTimeMicros();
+        input.pin = pin;
+        halTraceEmit(input);
+    }
+
+    handlers[pin].callback(handlers[pin].arg);
+}
\ No newline at end of file
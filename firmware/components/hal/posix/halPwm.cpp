@@ -0,0 +1,82 @@
+#include "esp_err.h"
+
+#include "halPwm.h"
+#include "halPosix.h"
+
+/** Number of LEDC channels of the esp32c3. */
+#define HAL_PWM_MAX_CHANNELS 6
+
+/**
+ * @brief The pin and duty of a channel.
+ */
+typedef struct PwmChannel_t {
+    int8_t pin;
+    uint32_t duty;
+} PwmChannel_t;
+
+static PwmChannel_t channels[HAL_PWM_MAX_CHANNELS] = {};
+static bool initialized = false;
+
+/**
+ * @brief Resets every channel.
+ */
+esp_err_t halPwmInitialize(uint32_t frequency, uint8_t resolution) {
+    for (int i = 0; i < HAL_PWM_MAX_CHANNELS; i++) {
+        channels[i].pin = -1;
+        channels[i].duty = 0;
+    }
+
+    initialized = true;
+    return ESP_OK;
+}
+
+/**
+ * @brief Routes a pin to a channel with zero duty.
+ */
+esp_err_t halPwmAttach(uint8_t channel, int8_t pin) {
+    if ( (initialized == false) || (channel >= HAL_PWM_MAX_CHANNELS) ) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    channels[channel].pin = pin;
+    channels[channel].duty = 0;
+    return ESP_OK;
+}
+
+/**
+ * @brief Sets the duty of a channel.
+ */
+esp_err_t halPwmSetDuty(uint8_t channel, uint32_t duty) {
+    if ( (initialized == false) || (channel >= HAL_PWM_MAX_CHANNELS) ) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    channels[channel].duty = duty;
+    return ESP_OK;
+}
+
+/**
+ * @brief Stops a channel with its output low.
+ */
+esp_err_t halPwmStop(uint8_t channel) {
+    if ( (initialized == false) || (channel >= HAL_PWM_MAX_CHANNELS) ) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    channels[channel].pin = -1;
+    channels[channel].duty = 0;
+    return ESP_OK;
+}
+
+/**
+ * @brief Returns the PWM duty of a pin in steps of the resolution, or zero if not attached.
+ */
+uint32_t halPosixGetPwmDuty(int8_t pin) {
+    for (int i = 0; i < HAL_PWM_MAX_CHANNELS; i++) {
+        if ( initialized && (pin >= 0) && (channels[i].pin == pin) ) {
+            return channels[i].duty;
+        }
+    }
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,124 @@
+#include <cstring>
+
+#include "esp_err.h"
+
+#include "halQueue.h"
+#include "halTime.h"
+#include "halPosix.h"
+
+/**
+ * @brief A ring buffer of fixed size items.
+ */
+struct HalQueue {
+    uint8_t length;
+    size_t itemSize;
+    uint8_t head;
+    uint8_t count;
+    uint8_t *items;
+};
+
+static HalQueue queues[HAL_QUEUE_MAX_QUEUES] = {};
+static uint8_t queueCount = 0;
+alignas(8) static uint8_t pool[HAL_QUEUE_POOL_BYTES];
+static size_t poolUsed = 0;
+
+static HalPosixIdleHook_t idleHook = nullptr;
+static void *idleArg = nullptr;
+
+/**
+ * @brief Creates a queue from static memory, as on the target.
+ */
+esp_err_t halQueueCreate(uint8_t length, size_t itemSize, HalQueue_t *queue) {
+    HalQueue *created = nullptr;
+    size_t size = ((length * itemSize) + 7) & ~((size_t) 7);
+
+    if ( (queueCount >= HAL_QUEUE_MAX_QUEUES) || (size > HAL_QUEUE_POOL_BYTES - poolUsed) ) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    created = &queues[queueCount++];
+    *created = {};
+    created->items = &pool[poolUsed];
+    created->length = length;
+    created->itemSize = itemSize;
+    poolUsed += size;
+    *queue = created;
+    return ESP_OK;
+}
+
+/**
+ * @brief Copies an item to the back of a queue.
+ */
+bool halQueueSend(HalQueue_t queue, const void *item) {
+    if ( (queue == nullptr) || (queue->count >= queue->length) ) {
+        return false;
+    }
+
+    memcpy(queue->items + ((queue->head + queue->count) % queue->length) * queue->itemSize, item, queue->itemSize);
+    queue->count++;
+    return true;
+}
+
+/**
+ * @brief Copies the front item of a queue without removing it. While the queue is
+ * empty, the idle hook is called and the virtual time advances to the next timer
+ * expiry, until an item arrives or the timeout elapses.
+ */
+bool halQueuePeek(HalQueue_t queue, void *item, uint32_t timeout) {
+    int64_t deadline = halTimeMicros() + (int64_t) timeout * 1000;
+    int64_t next = 0;
+
+    if (queue == nullptr) {
+        return false;
+    }
+
+    while (queue->count == 0) {
+        if (idleHook != nullptr) {
+            idleHook(deadline, idleArg);
+            if (queue->count > 0) {
+                break;
+            }
+        }
+        if (halTimeMicros() >= deadline) {
+            return false;
+        }
+
+        next = halPosixNextTimer();
+        if (next > deadline) {
+            next = deadline;
+        }
+        halPosixAdvance(next - halTimeMicros());
+    }
+
+    memcpy(item, queue->items + queue->head * queue->itemSize, queue->itemSize);
+    return true;
+}
+
+/**
+ * @brief Removes the front item of a queue.
+ */
+bool halQueueReceive(HalQueue_t queue, void *item) {
+    if ( (queue == nullptr) || (queue->count == 0) ) {
+        return false;
+    }
+
+    memcpy(item, queue->items + queue->head * queue->itemSize, queue->itemSize);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    return true;
+}
+
+/**
+ * @brief Returns the number of items in a queue.
+ */
+uint8_t halQueueCount(HalQueue_t queue) {
+    return (queue == nullptr) ? 0 : queue->count;
+}
+
+/**
+ * @brief Sets the hook called when the firmware blocks on an empty queue.
+ */
+void halPosixSetIdleHook(HalPosixIdleHook_t hook, void *arg) {
+    idleHook = hook;
+    idleArg = arg;
+}
\ No newline at end of file
@@ -0,0 +1,160 @@
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+
+#include "esp_err.h"
+#include "esp_log.h"
+
+#include "halSystem.h"
+#include "halTime.h"
+#include "halPosix.h"
+
+static const char* TAG = "HalSystem";
+
+static int logLevel = ESP_LOG_INFO;
+static uint32_t randomState = 0x2545F491;
+
+/** The backend is single threaded, so the guard covers every allocation once armed. */
+static bool guardArmed = false;
+static uint32_t guardSuspended = 0;
+static uint32_t guardCount = 0;
+
+/**
+ * @brief Exits the process, as the host cannot restart the firmware in place.
+ */
+void halRestart() {
+    ESP_LOGI(TAG, "Restart requested, exiting.");
+    exit(0);
+}
+
+/**
+ * @brief The host always boots cold.
+ */
+bool halResetWasDeepSleep() {
+    return false;
+}
+
+/**
+ * @brief Returns a number from a fixed seed xorshift generator, so runs are repeatable.
+ */
+uint32_t halRandom() {
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState;
+}
+
+/**
+ * @brief Reads a fixed, locally administered MAC address.
+ */
+esp_err_t halReadMac(uint8_t *mac) {
+    const uint8_t hostMac[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+
+    for (int i = 0; i < 6; i++) {
+        mac[i] = hostMac[i];
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief The host clock is set by the operating system.
+ */
+esp_err_t halSntpStart(const char *server) {
+    return ESP_OK;
+}
+
+void halSntpStop() {
+}
+
+/**
+ * @brief The host heap belongs to the operating system.
+ */
+esp_err_t halHeapStats(HalHeapStats_t &stats) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+/**
+ * @brief Host threads have no stack high-water marks.
+ */
+esp_err_t halTaskStackHighWater(const char *name, uint32_t &bytes) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+/**
+ * @brief Begins counting the allocations reported by halPosixCountAllocation().
+ */
+esp_err_t halHeapGuardArm() {
+    if (guardArmed == false) {
+        guardArmed = true;
+        guardSuspended = 0;
+        guardCount = 0;
+    }
+    return ESP_OK;
+}
+
+void halHeapGuardSuspend() {
+    guardSuspended++;
+}
+
+void halHeapGuardResume() {
+    if (guardSuspended > 0) {
+        guardSuspended--;
+    }
+}
+
+uint32_t halHeapGuardCount() {
+    return guardCount;
+}
+
+/**
+ * @brief Counts an allocation if the guard is armed and not suspended.
+ */
+void halPosixCountAllocation() {
+    if ( guardArmed && (guardSuspended == 0) ) {
+        guardCount++;
+    }
+}
+
+/**
+ * @brief Sets the highest level printed by the log macros.
+ */
+void halPosixSetLogLevel(int level) {
+    logLevel = level;
+}
+
+/**
+ * @brief Prints a log line stamped with the virtual time if its level is enabled.
+ */
+void halPosixLog(int level, const char *tag, const char *format, ...) {
+    const char levels[] = "NEWIDV";
+    va_list args;
+
+    if ( (level > logLevel) || (level <= ESP_LOG_NONE) || (level > ESP_LOG_VERBOSE) ) {
+        return;
+    }
+
+    fprintf(stderr, "%c (%lld) %s: ", levels[level], (long long) (halTimeMicros() / 1000), tag);
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fputc('\n', stderr);
+}
+
+/**
+ * @brief Returns the name of an error code.
+ */
+const char *esp_err_to_name(esp_err_t code) {
+    switch (code) {
+        case ESP_OK: return "ESP_OK";
+        case ESP_FAIL: return "ESP_FAIL";
+        case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_INVALID_VERSION: return "ESP_ERR_INVALID_VERSION";
+        default: return "UNKNOWN ERROR";
+    }
+}
\ No newline at end of file
@@ -0,0 +1,133 @@
+#include <stdint.h>
+#include <time.h>
+
+#include "esp_err.h"
+
+#include "halTime.h"
+#include "halPosix.h"
+
+/** Maximum number of timers. */
+#define HAL_POSIX_MAX_TIMERS 16
+
+/**
+ * @brief A one-shot timer on the virtual clock.
+ */
+struct HalTimer {
+    bool used;
+    bool running;
+    int64_t expiry;
+    HalTimerCallback_t callback;
+    void *arg;
+};
+
+static HalTimer timers[HAL_POSIX_MAX_TIMERS] = {};
+static int64_t now = HAL_POSIX_BOOT_TIME;
+
+/**
+ * @brief Returns the virtual time since boot in microseconds.
+ */
+int64_t halTimeMicros() {
+    return now;
+}
+
+/**
+ * @brief Returns the real monotonic time in nanoseconds, wrapping at 32 bits.
+ * Unlike halTimeMicros(), it advances while the host runs code.
+ */
+uint32_t halCycleCount() {
+    struct timespec time = {};
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint32_t) ((uint64_t) time.tv_sec * 1000000000 + time.tv_nsec);
+}
+
+/**
+ * @brief Creates a stopped one-shot timer on the virtual clock.
+ */
+esp_err_t halTimerCreate(HalTimerCallback_t callback, void *arg, const char *name, HalTimer_t *timer) {
+    for (int i = 0; i < HAL_POSIX_MAX_TIMERS; i++) {
+        if (timers[i].used == false) {
+            timers[i] = {};
+            timers[i].used = true;
+            timers[i].callback = callback;
+            timers[i].arg = arg;
+            *timer = &timers[i];
+            return ESP_OK;
+        }
+    }
+
+    return ESP_ERR_NO_MEM;
+}
+
+/**
+ * @brief Starts a timer. The timer must be stopped.
+ */
+esp_err_t halTimerStartOnce(HalTimer_t timer, uint64_t timeout) {
+    if ( (timer == nullptr) || timer->running ) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    timer->running = true;
+    timer->expiry = now + (int64_t) timeout;
+    return ESP_OK;
+}
+
+/**
+ * @brief Stops a timer. Stopping a stopped timer is not an error.
+ */
+esp_err_t halTimerStop(HalTimer_t timer) {
+    if (timer == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    timer->running = false;
+    return ESP_OK;
+}
+
+/**
+ * @brief Returns the expiry of the next running timer in microseconds, or INT64_MAX if none is running.
+ */
+int64_t halPosixNextTimer() {
+    int64_t next = INT64_MAX;
+
+    for (int i = 0; i < HAL_POSIX_MAX_TIMERS; i++) {
+        if ( timers[i].running && (timers[i].expiry < next) ) {
+            next = timers[i].expiry;
+        }
+    }
+
+    return next;
+}
+
+/**
+ * @brief Advances the virtual time, running the callback of each timer expiring on the way in order.
+ *
+ * @param duration Duration in microseconds.
+ */
+void halPosixAdvance(int64_t duration) {
+    int64_t target = now + duration;
+    HalTimer *next = nullptr;
+
+    while (true) {
+        next = nullptr;
+        for (int i = 0; i < HAL_POSIX_MAX_TIMERS; i++) {
+            if ( timers[i].running && (timers[i].expiry <= target) && ((next == nullptr) || (timers[i].expiry < next->expiry)) ) {
+                next = &timers[i];
+            }
+        }
+        if (next == nullptr) {
+            break;
+        }
+
+        /** A callback may restart its own timer, so it is stopped first. */
+        if (next->expiry > now) {
+            now = next->expiry;
+        }
+        next->running = false;
+        next->callback(next->arg);
+    }
+
+    if (target > now) {
+        now = target;
+    }
+}
\ No newline at end of file
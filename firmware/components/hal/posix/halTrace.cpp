@@ -0,0 +1,30 @@
+#include "esp_err.h"
+
+#include "halTrace.h"
+
+static HalTraceCallback_t traceCallback = nullptr;
+static void *traceArg = nullptr;
+
+/**
+ * @brief Sets the callback called on each input of the firmware, or clears it.
+ */
+void halTraceSetCallback(HalTraceCallback_t callback, void *arg) {
+    traceCallback = callback;
+    traceArg = arg;
+}
+
+/**
+ * @brief Passes an input to the trace callback. Called by the backends.
+ */
+void halTraceEmit(HalTraceInput_t &input) {
+    if (traceCallback != nullptr) {
+        traceCallback(traceArg, input);
+    }
+}
+
+/**
+ * @brief If true, a trace callback is set. Lets the backends skip building inputs.
+ */
+bool halTraceEnabled() {
+    return traceCallback != nullptr;
+}
\ No newline at end of file
@@ -0,0 +1,23 @@
+#ifndef ESP_LOG_H
+#define ESP_LOG_H
+
+/** Host replacement of the ESP-IDF log macros, printed to stderr by halPosixLog(). */
+#define ESP_LOG_NONE 0
+#define ESP_LOG_ERROR 1
+#define ESP_LOG_WARN 2
+#define ESP_LOG_INFO 3
+#define ESP_LOG_DEBUG 4
+#define ESP_LOG_VERBOSE 5
+
+/**
+ * @brief Prints a log line if its level is enabled by halPosixSetLogLevel().
+ */
+void halPosixLog(int level, const char *tag, const char *format, ...) __attribute__((format(printf, 3, 4)));
+
+#define ESP_LOGE(tag, format, ...) halPosixLog(ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) halPosixLog(ESP_LOG_WARN, tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) halPosixLog(ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) halPosixLog(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) halPosixLog(ESP_LOG_VERBOSE, tag, format, ##__VA_ARGS__)
+
+#endif
\ No newline at end of file
@@ -0,0 +1,9 @@
+#ifndef SDKCONFIG_H
+#define SDKCONFIG_H
+
+/**
+ * Host replacement of the generated ESP-IDF config. The options of the firmware,
+ * e.g. CONFIG_DRIP_MODE_SOURCE, are passed by the host build as compile definitions.
+ */
+
+#endif
\ No newline at end of file
@@ -0,0 +1,21 @@
+#ifndef HAL_POSIX_STRLCPY_H
+#define HAL_POSIX_STRLCPY_H
+
+#include <string.h>
+
+/**
+ * strlcpy() of newlib, missing from glibc before 2.38.
+ * Force included by the host build where the C library lacks it.
+ */
+static inline size_t strlcpy(char *dst, const char *src, size_t size) {
+    size_t length = strlen(src);
+
+    if (size > 0) {
+        size_t count = (length < size - 1) ? length : size - 1;
+        memcpy(dst, src, count);
+        dst[count] = '\0';
+    }
+    return length;
+}
+
+#endif
\ No newline at end of file
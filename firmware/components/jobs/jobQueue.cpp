@@ -0,0 +1,162 @@
+#include "esp_err.h"
+#include "esp_attr.h"
+
+#include "jobQueue.h"
+
+/** Marks the check word of the retained ID counter. */
+#define JOB_ID_MAGIC 0x10B1D5A5
+
+/**
+ * @brief Counter of the assigned IDs retained in RTC memory through resets.
+ */
+typedef struct JobIdRtc_t {
+    uint32_t nextId;
+    /** The counter xor JOB_ID_MAGIC. Noise after a power loss does not match. */
+    uint32_t check;
+} JobIdRtc_t;
+
+static RTC_NOINIT_ATTR JobIdRtc_t rtcJobIds;
+
+/**
+ * @brief Constructor.
+ */
+JobQueue::JobQueue() {
+    head = 0;
+    length = 0;
+
+    if ( (rtcJobIds.check != (rtcJobIds.nextId ^ JOB_ID_MAGIC)) || (rtcJobIds.nextId < JOB_AUTO_ID_MIN) ) {
+        rtcJobIds.nextId = JOB_AUTO_ID_MIN;
+        rtcJobIds.check = JOB_AUTO_ID_MIN ^ JOB_ID_MAGIC;
+    }
+}
+
+/**
+ * @brief Assigns the next ID to a job without one. The counter is retained
+ * in RTC memory through resets, so a resumed job never reuses an earlier ID.
+ * 
+ * @param job The job.
+ */
+void JobQueue::assignId(Job_t &job) {
+    uint32_t id = 0;
+
+    if (job.id != 0) {
+        return;
+    }
+
+    /** Skip an ID still waiting from before the counter wrapped. */
+    do {
+        id = rtcJobIds.nextId;
+        rtcJobIds.nextId = (id == UINT32_MAX) ? JOB_AUTO_ID_MIN : id + 1;
+    } while (contains(id));
+    rtcJobIds.check = rtcJobIds.nextId ^ JOB_ID_MAGIC;
+    job.id = id;
+}
+
+/**
+ * @brief Returns true if a waiting job has the ID.
+ * 
+ * @param id ID of the job.
+ */
+bool JobQueue::contains(uint32_t id) {
+    for (uint8_t i = 0; i < length; i++) {
+        if (jobs[(head + i) % JOB_QUEUE_LENGTH].id == id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Adds a job to the back of the queue.
+ * 
+ * @param job The job.
+ * @return esp_err_t Return code. ESP_ERR_NO_MEM if the queue is full,
+ * ESP_ERR_INVALID_STATE if a waiting job has the same ID.
+ */
+esp_err_t JobQueue::push(Job_t &job) {
+    if (length == JOB_QUEUE_LENGTH) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (job.type == JOB_NONE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    assignId(job);
+    if (contains(job.id)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    jobs[(head + length) % JOB_QUEUE_LENGTH] = job;
+    length++;
+    return ESP_OK;
+}
+
+/**
+ * @brief Removes the job at the front of the queue.
+ * 
+ * @param job Overwritten with the job.
+ * @return esp_err_t Return code. ESP_ERR_NOT_FOUND if the queue is empty.
+ */
+esp_err_t JobQueue::pop(Job_t &job) {
+    if (length == 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    job = jobs[head];
+    head = (head + 1) % JOB_QUEUE_LENGTH;
+    length--;
+    return ESP_OK;
+}
+
+/**
+ * @brief Removes a waiting job, keeping the order of the others.
+ * 
+ * @param id ID of the job.
+ * @return esp_err_t Return code. ESP_ERR_NOT_FOUND if no job has the ID.
+ */
+esp_err_t JobQueue::remove(uint32_t id) {
+    uint8_t found = length;
+
+    for (uint8_t i = 0; i < length; i++) {
+        if (jobs[(head + i) % JOB_QUEUE_LENGTH].id == id) {
+            found = i;
+            break;
+        }
+    }
+    if (found == length) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    /** Close the gap by moving the later jobs forward. */
+    for (uint8_t i = found; i + 1 < length; i++) {
+        jobs[(head + i) % JOB_QUEUE_LENGTH] = jobs[(head + i + 1) % JOB_QUEUE_LENGTH];
+    }
+    length--;
+    return ESP_OK;
+}
+
+/**
+ * @brief Removes every waiting job.
+ */
+void JobQueue::clear() {
+    head = 0;
+    length = 0;
+}
+
+/**
+ * @brief Returns the number of waiting jobs.
+ */
+uint8_t JobQueue::count() {
+    return length;
+}
+
+/**
+ * @brief Fills in the IDs of the waiting jobs. The active ID is left unchanged.
+ * 
+ * @param status Overwritten with the waiting jobs.
+ */
+void JobQueue::getStatus(JobQueueStatus_t &status) {
+    status.count = length;
+    for (uint8_t i = 0; i < length; i++) {
+        status.ids[i] = jobs[(head + i) % JOB_QUEUE_LENGTH].id;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,123 @@
+#ifndef JOB_QUEUE_H
+#define JOB_QUEUE_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#include "valveManager.h"
+
+/** Maximum number of jobs waiting behind the active one. */
+#define JOB_QUEUE_LENGTH 4
+/** First ID assigned by the device. IDs from commands stay below, so the two never collide. */
+#define JOB_AUTO_ID_MIN 0x80000000
+
+/**
+ * @brief Describes the types of queued jobs.
+ */
+typedef enum JobTypes_e {
+    JOB_NONE,
+    JOB_DISPENSE,
+    JOB_DRAIN
+} JobTypes_e;
+
+/**
+ * @brief Describes a process waiting to be run.
+ */
+typedef struct Job_t {
+    /** Identifies the job in queue status reports. Never zero once queued. */
+    uint32_t id = 0;
+    JobTypes_e type = JOB_NONE;
+    /** Valid if type is JOB_DISPENSE. */
+    RunPlan_t plan;
+    /** Valid if type is JOB_DRAIN. */
+    DrainTarget_t drain;
+} Job_t;
+
+/**
+ * @brief Describes the active job and the jobs waiting behind it.
+ */
+typedef struct JobQueueStatus_t {
+    /** ID of the active job, or zero if idle. */
+    uint32_t activeId = 0;
+    /** Number of waiting jobs. */
+    uint8_t count = 0;
+    /** IDs of the waiting jobs, next first. */
+    uint32_t ids[JOB_QUEUE_LENGTH] = {};
+} JobQueueStatus_t;
+
+/**
+ * @brief Bounded queue of jobs received while a process is active,
+ * started in order as each process ends.
+ */
+class JobQueue {
+public:
+    /**
+     * @brief Constructor.
+     */
+    JobQueue();
+
+    /**
+     * @brief Assigns the next ID to a job without one. The counter is retained
+     * in RTC memory through resets, so a resumed job never reuses an earlier ID.
+     * 
+     * @param job The job.
+     */
+    void assignId(Job_t &job);
+
+    /**
+     * @brief Returns true if a waiting job has the ID.
+     * 
+     * @param id ID of the job.
+     */
+    bool contains(uint32_t id);
+
+    /**
+     * @brief Adds a job to the back of the queue.
+     * 
+     * @param job The job.
+     * @return esp_err_t Return code. ESP_ERR_NO_MEM if the queue is full,
+     * ESP_ERR_INVALID_STATE if a waiting job has the same ID.
+     */
+    esp_err_t push(Job_t &job);
+
+    /**
+     * @brief Removes the job at the front of the queue.
+     * 
+     * @param job Overwritten with the job.
+     * @return esp_err_t Return code. ESP_ERR_NOT_FOUND if the queue is empty.
+     */
+    esp_err_t pop(Job_t &job);
+
+    /**
+     * @brief Removes a waiting job, keeping the order of the others.
+     * 
+     * @param id ID of the job.
+     * @return esp_err_t Return code. ESP_ERR_NOT_FOUND if no job has the ID.
+     */
+    esp_err_t remove(uint32_t id);
+
+    /**
+     * @brief Removes every waiting job.
+     */
+    void clear();
+
+    /**
+     * @brief Returns the number of waiting jobs.
+     */
+    uint8_t count();
+
+    /**
+     * @brief Fills in the IDs of the waiting jobs. The active ID is left unchanged.
+     * 
+     * @param status Overwritten with the waiting jobs.
+     */
+    void getStatus(JobQueueStatus_t &status);
+
+private:
+    Job_t jobs[JOB_QUEUE_LENGTH];
+    uint8_t head;
+    uint8_t length;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,256 @@
+#include <cstring>
+#include <stddef.h>
+
+#include "esp_err.h"
+#include "esp_attr.h"
+
+#include "processJournal.h"
+
+/** Marks the RTC journal as holding an active dispense process. */
+#define PROCESS_JOURNAL_MAGIC 0xD15E4A11
+/** Offset basis and prime of the FNV-1a checksum, applied to whole words. */
+#define PROCESS_JOURNAL_CHECKSUM_BASIS 0x811C9DC5
+#define PROCESS_JOURNAL_CHECKSUM_PRIME 0x01000193
+
+/**
+ * @brief Snapshot of the active process, written at every slice.
+ */
+typedef struct ProcessSnapshot_t {
+    /** Number of the snapshot within its process. Zero if never written. */
+    uint32_t sequence;
+    uint8_t step;
+    uint8_t zone;
+    uint8_t valveState;
+    uint8_t switchedOver;
+    /** Time into the step in miliseconds, and the volume it delivered in liters. */
+    uint32_t time;
+    float outputVolume;
+    /** Volume of the steps before in liters. */
+    float completedVolume;
+    /** Checksum of the words above, seeded with the checksum of the run plan. */
+    uint32_t check;
+} ProcessSnapshot_t;
+
+/** Number of words of a snapshot covered by its checksum. */
+#define PROCESS_SNAPSHOT_WORDS (offsetof(ProcessSnapshot_t, check) / sizeof(uint32_t))
+
+/**
+ * @brief Journal of the active process retained in RTC memory through resets.
+ */
+typedef struct ProcessJournalRtc_t {
+    uint32_t magic;
+    uint32_t jobId;
+    RunPlan_t plan;
+    /** Checksum of the job ID and the run plan. */
+    uint32_t planCheck;
+    ProcessSnapshot_t slots[2];
+} ProcessJournalRtc_t;
+
+static RTC_NOINIT_ATTR ProcessJournalRtc_t rtcJournal;
+
+/**
+ * @brief Returns the checksum of a range of words.
+ *
+ * @param seed Checksum the range is added to.
+ * @param words First word.
+ * @param count Number of words.
+ */
+static uint32_t checksum(uint32_t seed, const uint32_t *words, uint32_t count) {
+    uint32_t hash = seed;
+
+    for (uint32_t i = 0; i < count; i++) {
+        hash = (hash ^ words[i]) * PROCESS_JOURNAL_CHECKSUM_PRIME;
+    }
+    return hash;
+}
+
+/**
+ * @brief Returns the checksum of the job ID and run plan in the journal.
+ */
+static uint32_t planChecksum() {
+    uint32_t words[(sizeof(uint32_t) + sizeof(RunPlan_t)) / sizeof(uint32_t)];
+
+    memcpy(words, &rtcJournal.jobId, sizeof(uint32_t));
+    memcpy(words + 1, &rtcJournal.plan, sizeof(RunPlan_t));
+    return checksum(PROCESS_JOURNAL_CHECKSUM_BASIS, words, sizeof(words) / sizeof(uint32_t));
+}
+
+/**
+ * @brief Returns the checksum of a snapshot.
+ */
+static uint32_t snapshotChecksum(const ProcessSnapshot_t &snapshot) {
+    uint32_t words[PROCESS_SNAPSHOT_WORDS];
+
+    memcpy(words, &snapshot, sizeof(words));
+    return checksum(rtcJournal.planCheck, words, PROCESS_SNAPSHOT_WORDS);
+}
+
+/**
+ * @brief Constructor.
+ */
+ProcessJournal::ProcessJournal() {
+    sequence = 0;
+    completedVolume = 0;
+    beganOnTank = false;
+    switchedOver = false;
+}
+
+/**
+ * @brief Journals the beginning of a dispense process.
+ *
+ * @param jobId ID of the job.
+ * @param plan Run plan of the process.
+ * @param state Initial state of the valves.
+ * @param process Initial process variables.
+ */
+void ProcessJournal::begin(uint32_t jobId, RunPlan_t &plan, ValveStates_e state, DispenseProcess_t &process) {
+    /** The plan is checksummed as stored, so a reset while it is written leaves the journal invalid. */
+    rtcJournal.magic = PROCESS_JOURNAL_MAGIC;
+    rtcJournal.jobId = jobId;
+    memcpy(&rtcJournal.plan, &plan, sizeof(RunPlan_t));
+    rtcJournal.planCheck = planChecksum();
+    memset(rtcJournal.slots, 0, sizeof(rtcJournal.slots));
+
+    sequence = 0;
+    completedVolume = 0;
+    beganOnTank = (state == VALVES_TANK_DISPENSE);
+    switchedOver = false;
+    record(state, process);
+}
+
+/**
+ * @brief Writes a snapshot of the active process. Called at every slice.
+ *
+ * @param state Current state of the valves.
+ * @param process Current process variables.
+ */
+void ProcessJournal::record(ValveStates_e state, DispenseProcess_t &process) {
+    ProcessSnapshot_t snapshot = {};
+
+    /** The switchover carries across steps, as in the ValveManager. */
+    switchedOver = switchedOver || ( beganOnTank && ((state == VALVES_SOURCE_DISPENSE) || (state == VALVES_BLENDED_DISPENSE)) );
+
+    snapshot.sequence = ++sequence;
+    snapshot.step = process.step;
+    snapshot.zone = process.zone;
+    snapshot.valveState = state;
+    snapshot.switchedOver = switchedOver;
+    snapshot.time = process.time;
+    snapshot.outputVolume = process.outputVolume;
+    snapshot.completedVolume = completedVolume;
+    snapshot.check = snapshotChecksum(snapshot);
+
+    /** Overwrite the older slot, so the newer one survives a torn write. */
+    rtcJournal.slots[sequence & 1] = snapshot;
+}
+
+/**
+ * @brief Adds the volume of a completed step to the run, and writes a snapshot at the start of the next.
+ *
+ * @param state Current state of the valves.
+ * @param summary Summary of the completed step.
+ */
+void ProcessJournal::recordStep(ValveStates_e state, DispenseSummary_t &summary) {
+    DispenseProcess_t process = {};
+
+    completedVolume += summary.outputVolume;
+    process.step = summary.step + 1;
+    process.zone = (process.step < rtcJournal.plan.stepCount) ? rtcJournal.plan.steps[process.step].zone : summary.zone;
+    record(state, process);
+}
+
+/**
+ * @brief Marks the process as ended, so it is not recovered.
+ */
+void ProcessJournal::end() {
+    rtcJournal.magic = 0;
+}
+
+/**
+ * @brief Reads a process interrupted before the last boot, and clears the journal.
+ *
+ * @param recovery Overwritten with the interrupted process.
+ * @return esp_err_t Return code. ESP_ERR_NOT_FOUND if no process was interrupted.
+ */
+esp_err_t ProcessJournal::recover(ProcessRecovery_t &recovery) {
+    ProcessSnapshot_t *snapshot = nullptr;
+    DispenseTarget_t target = {};
+    bool valid[2] = {};
+    bool done = false;
+
+    /** Memory which was never written reads as noise after a power loss, so only a matching checksum counts. */
+    if ( (rtcJournal.magic != PROCESS_JOURNAL_MAGIC) || (rtcJournal.planCheck != planChecksum()) ) {
+        goto none;
+    }
+    if ( (rtcJournal.plan.stepCount == 0) || (rtcJournal.plan.stepCount > MAX_RUN_STEPS) ) {
+        goto none;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        valid[i] = (rtcJournal.slots[i].sequence != 0) && (rtcJournal.slots[i].check == snapshotChecksum(rtcJournal.slots[i]));
+    }
+    if ( valid[0] && ((valid[1] == false) || (rtcJournal.slots[0].sequence > rtcJournal.slots[1].sequence)) ) {
+        snapshot = &rtcJournal.slots[0];
+    } else if (valid[1]) {
+        snapshot = &rtcJournal.slots[1];
+    } else {
+        goto none;
+    }
+    if (snapshot->step > rtcJournal.plan.stepCount) {
+        goto none;
+    }
+
+    recovery = {};
+    recovery.jobId = rtcJournal.jobId;
+    recovery.stepCount = rtcJournal.plan.stepCount;
+    recovery.step = snapshot->step;
+    recovery.zone = snapshot->zone;
+    recovery.valveState = (ValveStates_e) snapshot->valveState;
+    recovery.switchedOver = snapshot->switchedOver;
+    recovery.time = snapshot->time;
+    recovery.deliveredVolume = snapshot->completedVolume + snapshot->outputVolume;
+
+    /** Every valve was closed on the last step, so only the overshoot was still being metered. */
+    if (recovery.valveState == VALVES_CLOSING) {
+        goto exit;
+    }
+
+    for (uint8_t i = snapshot->step; i < rtcJournal.plan.stepCount; i++) {
+        target = rtcJournal.plan.steps[i];
+
+        /** The interrupted step is shortened by what it delivered, and skipped if too little is left. */
+        if (i == snapshot->step) {
+            if (target.targetVolume > 0) {
+                target.targetVolume -= snapshot->outputVolume;
+                done = (target.targetVolume < PROCESS_RESUME_MIN_VOLUME);
+            } else {
+                done = (target.targetTime < snapshot->time + PROCESS_RESUME_MIN_TIME_MS);
+            }
+            if (target.targetTime > 0) {
+                target.targetTime = (target.targetTime > snapshot->time + PROCESS_RESUME_MIN_TIME_MS) ? target.targetTime - snapshot->time : PROCESS_RESUME_MIN_TIME_MS;
+            }
+            if (target.timeout > 0) {
+                done = done || (target.timeout < snapshot->time + PROCESS_RESUME_MIN_TIME_MS);
+                if (done == false) {
+                    target.timeout -= snapshot->time;
+                }
+            }
+            if (done) {
+                continue;
+            }
+        }
+
+        if (target.targetVolume > 0) {
+            recovery.remainingVolume += target.targetVolume;
+        }
+        recovery.remaining.steps[recovery.remaining.stepCount++] = target;
+    }
+
+exit:
+    rtcJournal.magic = 0;
+    return ESP_OK;
+
+none:
+    rtcJournal.magic = 0;
+    return ESP_ERR_NOT_FOUND;
+}
\ No newline at end of file
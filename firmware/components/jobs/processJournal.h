@@ -0,0 +1,106 @@
+#ifndef PROCESS_JOURNAL_H
+#define PROCESS_JOURNAL_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#include "valveManager.h"
+
+/** A step of an interrupted run with less than this volume left in liters is not resumed. */
+#define PROCESS_RESUME_MIN_VOLUME 0.05f
+/** A step of an interrupted run with less than this time left in miliseconds is not resumed. */
+#define PROCESS_RESUME_MIN_TIME_MS 1000
+
+/**
+ * @brief Describes a dispense process found interrupted on boot, and what is left of its run plan.
+ */
+typedef struct ProcessRecovery_t {
+    /** ID of the interrupted job in the previous boot. */
+    uint32_t jobId = 0;
+    /** ID of the job resuming the rest of the run plan, or zero if not resumed. */
+    uint32_t resumeId = 0;
+    /** Number of steps of the interrupted run plan, and the step it was interrupted at. */
+    uint8_t stepCount = 0;
+    uint8_t step = 0;
+    uint8_t zone = 0;
+    /** State of the valves at the last snapshot. */
+    ValveStates_e valveState = VALVES_UNKNOWN;
+    /** Set if the tank had switched over to the source. */
+    bool switchedOver = false;
+    /** Time into the interrupted step at the last snapshot, in miliseconds. */
+    uint32_t time = 0;
+    /** Volume delivered by the whole run plan up to the last snapshot, in liters. */
+    float deliveredVolume = 0;
+    /** Volume the volume targets of the steps left still ask for, in liters. */
+    float remainingVolume = 0;
+    /** Steps left of the run plan, the interrupted one shortened by what it delivered. No steps if it was done. */
+    RunPlan_t remaining;
+} ProcessRecovery_t;
+
+/**
+ * @brief Journals the active dispense process into RTC memory, which is not initialized
+ * on boot, so a process cut short by a brownout, watchdog or panic reset can be recovered.
+ * The contents are lost on a power loss, and are rejected by their checksum on a cold boot.
+ *
+ * The run plan is written once as the process begins. Each slice then writes a snapshot of a
+ * few words into one of two slots in turn, stamped with a sequence number and a checksum,
+ * so a reset in the middle of a write leaves the snapshot of the slice before intact.
+ */
+class ProcessJournal {
+public:
+    /**
+     * @brief Constructor.
+     */
+    ProcessJournal();
+
+    /**
+     * @brief Journals the beginning of a dispense process.
+     *
+     * @param jobId ID of the job.
+     * @param plan Run plan of the process.
+     * @param state Initial state of the valves.
+     * @param process Initial process variables.
+     */
+    void begin(uint32_t jobId, RunPlan_t &plan, ValveStates_e state, DispenseProcess_t &process);
+
+    /**
+     * @brief Writes a snapshot of the active process. Called at every slice.
+     *
+     * @param state Current state of the valves.
+     * @param process Current process variables.
+     */
+    void record(ValveStates_e state, DispenseProcess_t &process);
+
+    /**
+     * @brief Adds the volume of a completed step to the run, and writes a snapshot at the start of the next.
+     *
+     * @param state Current state of the valves.
+     * @param summary Summary of the completed step.
+     */
+    void recordStep(ValveStates_e state, DispenseSummary_t &summary);
+
+    /**
+     * @brief Marks the process as ended, so it is not recovered.
+     */
+    void end();
+
+    /**
+     * @brief Reads a process interrupted before the last boot, and clears the journal.
+     *
+     * @param recovery Overwritten with the interrupted process.
+     * @return esp_err_t Return code. ESP_ERR_NOT_FOUND if no process was interrupted.
+     */
+    esp_err_t recover(ProcessRecovery_t &recovery);
+
+private:
+    /** Number of snapshots written by this process. Selects the slot of the next. */
+    uint32_t sequence;
+    /** Volume of the completed steps of the run plan, in liters. */
+    float completedVolume;
+    /** Set if the process began on the tank, so a source state means the tank switched over. */
+    bool beganOnTank;
+    bool switchedOver;
+};
+
+#endif
\ No newline at end of file
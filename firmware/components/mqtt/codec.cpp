@@ -0,0 +1,758 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include "esp_err.h"
+
+#include "codec.h"
+#include "topics.h"
+#include "valveManager.h"
+
+/** Maximum length of a field name, including the quotes. */
+#define CODEC_MAX_KEY_BYTES 16
+
+/** Maximum length of a single object in an array. */
+#define CODEC_MAX_OBJECT_BYTES 96
+
+/**
+ * @brief Finds the value of a field of a flat JSON object.
+ *
+ * @param json Null-terminated JSON object.
+ * @param key Field name.
+ * @returns Pointer to the first character of the value, or null if the field is missing.
+ */
+static const char* findValue(const char *json, const char *key) {
+    char quoted[CODEC_MAX_KEY_BYTES];
+    const char *position = json;
+    const char *value = nullptr;
+    int length = snprintf(quoted, sizeof(quoted), "\"%s\"", key);
+
+    if ( (length < 0) || (length >= (int) sizeof(quoted)) ) {
+        return nullptr;
+    }
+
+    /** A string value equal to the key is skipped, as it is not followed by a colon. */
+    while ( (position = strstr(position, quoted)) != nullptr ) {
+        value = position + length;
+        while ( (*value == ' ') || (*value == '\t') || (*value == '\r') || (*value == '\n') ) value++;
+        if (*value == ':') {
+            value++;
+            while ( (*value == ' ') || (*value == '\t') || (*value == '\r') || (*value == '\n') ) value++;
+            return value;
+        }
+        position += length;
+    }
+
+    return nullptr;
+}
+
+/**
+ * @brief Reads a number field of a flat JSON object.
+ *
+ * @param json Null-terminated JSON object.
+ * @param key Field name.
+ * @param value Overwritten with the field value.
+ * @return esp_err_t Return code. ESP_ERR_NOT_FOUND if the field is missing.
+ */
+esp_err_t codecGetFloat(const char *json, const char *key, float &value) {
+    const char *start = findValue(json, key);
+    char *end = nullptr;
+    float parsed = 0;
+
+    if (start == nullptr) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    parsed = strtof(start, &end);
+    if (end == start) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    value = parsed;
+    return ESP_OK;
+}
+
+/**
+ * @brief Reads a non-negative integer field of a flat JSON object.
+ *
+ * @param json Null-terminated JSON object.
+ * @param key Field name.
+ * @param value Overwritten with the field value.
+ * @return esp_err_t Return code. ESP_ERR_NOT_FOUND if the field is missing,
+ * ESP_ERR_INVALID_ARG if it is not a number or does not fit 32 bits.
+ */
+esp_err_t codecGetUint(const char *json, const char *key, uint32_t &value) {
+    const char *start = findValue(json, key);
+    char *end = nullptr;
+    unsigned long parsed = 0;
+
+    if (start == nullptr) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (*start == '-') {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    /** unsigned long is wider than 32 bits on the host, and saturates on overflow on the target. */
+    errno = 0;
+    parsed = strtoul(start, &end, 10);
+    if ( (end == start) || (errno == ERANGE) || (parsed > UINT32_MAX) ) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    value = parsed;
+    return ESP_OK;
+}
+
+/**
+ * @brief Reads a boolean field of a flat JSON object.
+ *
+ * @param json Null-terminated JSON object.
+ * @param key Field name.
+ * @param value Overwritten with the field value.
+ * @return esp_err_t Return code. ESP_ERR_NOT_FOUND if the field is missing.
+ */
+esp_err_t codecGetBool(const char *json, const char *key, bool &value) {
+    const char *start = findValue(json, key);
+
+    if (start == nullptr) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    if (strncmp(start, "true", 4) == 0) {
+        value = true;
+    } else if (strncmp(start, "false", 5) == 0) {
+        value = false;
+    } else {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Reads a string field of a flat JSON object. Escape sequences are not supported.
+ *
+ * @param json Null-terminated JSON object.
+ * @param key Field name.
+ * @param value Overwritten with the null-terminated field value.
+ * @param size Size of the value buffer in bytes.
+ * @return esp_err_t Return code. ESP_ERR_NOT_FOUND if the field is missing.
+ */
+esp_err_t codecGetString(const char *json, const char *key, char *value, size_t size) {
+    const char *start = findValue(json, key);
+    const char *end = nullptr;
+
+    if (start == nullptr) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (*start != '"') {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    start++;
+    end = strchr(start, '"');
+    if (end == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if ((size_t) (end - start) >= size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    memcpy(value, start, end - start);
+    value[end - start] = '\0';
+    return ESP_OK;
+}
+
+/**
+ * @brief Finds an array field of a JSON object.
+ *
+ * @param json Null-terminated JSON object.
+ * @param key Field name.
+ * @param position Set to the opening bracket of the array, to be passed to codecNextObject().
+ * @return esp_err_t Return code. ESP_ERR_NOT_FOUND if the field is missing.
+ */
+esp_err_t codecGetArray(const char *json, const char *key, const char* &position) {
+    position = findValue(json, key);
+
+    if (position == nullptr) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (*position != '[') {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Copies the next object of an array of flat objects.
+ *
+ * @param position The opening bracket of the array, or the end of the last object.
+ * Advanced to the end of the copied object.
+ * @param object Overwritten with the null-terminated object.
+ * @param size Size of the object buffer in bytes.
+ * @return esp_err_t Return code. ESP_ERR_NOT_FOUND at the end of the array.
+ */
+esp_err_t codecNextObject(const char* &position, char *object, size_t size) {
+    const char *start = strpbrk(position + 1, "{]");
+    const char *end = nullptr;
+
+    if ( (start == nullptr) || (*start == ']') ) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    /** Objects are flat, so each ends at the first closing brace. */
+    end = strchr(start, '}');
+    if ( (end == nullptr) || ((size_t) (end - start + 1) >= size) ) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    memcpy(object, start, end - start + 1);
+    object[end - start + 1] = '\0';
+    position = end;
+    return ESP_OK;
+}
+
+/**
+ * @brief Reads the fields of a dispense target from a flat JSON object.
+ *
+ * @param json Null-terminated JSON object.
+ * @param target Overwritten with the target.
+ * @return esp_err_t Return code.
+ */
+static esp_err_t decodeDispenseTarget(const char *json, DispenseTarget_t &target) {
+    uint32_t zone = 0;
+
+    target = {};
+    codecGetFloat(json, "tv", target.targetVolume);
+    codecGetUint(json, "tt", target.targetTime);
+    codecGetUint(json, "to", target.timeout);
+    codecGetUint(json, "z", zone);
+    if (zone >= MAX_ZONES) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    target.zone = zone;
+
+    if ( (target.targetVolume <= 0) && (target.targetTime == 0) ) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Decodes a dispense command, either a single target or a run plan
+ * of targets in the "p" array.
+ *
+ * @param json Null-terminated JSON object.
+ * @param plan Overwritten with the plan.
+ * @return esp_err_t Return code.
+ */
+static esp_err_t decodeRunPlan(const char *json, RunPlan_t &plan) {
+    esp_err_t err = ESP_OK;
+    char object[CODEC_MAX_OBJECT_BYTES];
+    const char *position = nullptr;
+
+    /** A single target without a plan, as sent by the legacy scheduler. */
+    err = codecGetArray(json, "p", position);
+    if (err == ESP_ERR_NOT_FOUND) {
+        plan.stepCount = 1;
+        return decodeDispenseTarget(json, plan.steps[0]);
+    }
+    if (err != ESP_OK) return err;
+
+    while ( (err = codecNextObject(position, object, sizeof(object))) == ESP_OK ) {
+        if (plan.stepCount == MAX_RUN_STEPS) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+
+        err = decodeDispenseTarget(object, plan.steps[plan.stepCount]);
+        if (err != ESP_OK) return err;
+        plan.stepCount++;
+    }
+    if (err != ESP_ERR_NOT_FOUND) return err;
+
+    if (plan.stepCount == 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Decodes the schedule fields of a config change. The entry table
+ * is replaced if the "sch" array is present.
+ *
+ * @param json Null-terminated JSON object.
+ * @param schedule Schedule config, updated with the fields present.
+ * @return esp_err_t Return code. ESP_ERR_NOT_FOUND if no schedule field is present.
+ */
+esp_err_t codecDecodeSchedule(const char *json, ScheduleConfig_t &schedule) {
+    esp_err_t err = ESP_OK;
+    char object[CODEC_MAX_OBJECT_BYTES];
+    const char *position = nullptr;
+    ScheduleConfig_t decoded = schedule;
+    ScheduleEntry_t *entry = nullptr;
+    DispenseTarget_t target = {};
+    uint32_t days = 0;
+    uint32_t minute = 0;
+    bool found = false;
+
+    err = codecGetString(json, "tz", decoded.timezone, sizeof(decoded.timezone));
+    if (err == ESP_OK) found = true;
+    else if (err != ESP_ERR_NOT_FOUND) return err;
+
+    err = codecGetString(json, "ntp", decoded.ntpServer, sizeof(decoded.ntpServer));
+    if (err == ESP_OK) found = true;
+    else if (err != ESP_ERR_NOT_FOUND) return err;
+
+    err = codecGetArray(json, "sch", position);
+    if (err == ESP_OK) {
+        found = true;
+        decoded.entryCount = 0;
+
+        while ( (err = codecNextObject(position, object, sizeof(object))) == ESP_OK ) {
+            if (decoded.entryCount == MAX_SCHEDULE_ENTRIES) {
+                return ESP_ERR_INVALID_SIZE;
+            }
+
+            /** Entries carry a dispense target plus the days and minute of the day they fire at. */
+            err = decodeDispenseTarget(object, target);
+            if (err != ESP_OK) return err;
+            days = 0;
+            minute = 0;
+            err = codecGetUint(object, "d", days);
+            if (err != ESP_OK) return err;
+            err = codecGetUint(object, "m", minute);
+            if (err != ESP_OK) return err;
+            if ( (days > 0x7F) || (minute >= 24 * 60) ) {
+                return ESP_ERR_INVALID_ARG;
+            }
+
+            entry = &decoded.entries[decoded.entryCount];
+            entry->days = days;
+            entry->minute = minute;
+            entry->zone = target.zone;
+            entry->targetVolume = target.targetVolume;
+            entry->targetTime = target.targetTime;
+            entry->timeout = target.timeout;
+            decoded.entryCount++;
+        }
+        if (err != ESP_ERR_NOT_FOUND) return err;
+
+    } else if (err != ESP_ERR_NOT_FOUND) {
+        return err;
+    }
+
+    if (found == false) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    schedule = decoded;
+    return ESP_OK;
+}
+
+/**
+ * @brief Decodes the dispense fields of a config change.
+ *
+ * @param json Null-terminated JSON object.
+ * @param dispense Dispense config, updated with the fields present.
+ * @return esp_err_t Return code. ESP_ERR_NOT_FOUND if no dispense field is present.
+ */
+esp_err_t codecDecodeDispense(const char *json, DispenseConfig_t &dispense) {
+    return codecGetBool(json, "rsm", dispense.resumeInterrupted);
+}
+
+/**
+ * @brief Decodes the system fields of a config change.
+ *
+ * @param json Null-terminated JSON object.
+ * @param system System config, updated with the fields present.
+ * @return esp_err_t Return code. ESP_ERR_NOT_FOUND if no system field is present,
+ * ESP_ERR_INVALID_ARG if the sleep interval is out of bounds.
+ */
+esp_err_t codecDecodeSystem(const char *json, SystemConfig_t &system) {
+    esp_err_t err = ESP_OK;
+    uint32_t sleepInterval = 0;
+
+    err = codecGetUint(json, "si", sleepInterval);
+    if (err != ESP_OK) return err;
+    if ( (sleepInterval < SYSTEM_SLEEP_INTERVAL_MIN) || (sleepInterval > SYSTEM_SLEEP_INTERVAL_MAX) ) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    system.sleepInterval = sleepInterval;
+    return ESP_OK;
+}
+
+/**
+ * @brief Decodes the flow sensor fields of a config change.
+ *
+ * @param json Null-terminated JSON object.
+ * @param flowSensor Flow sensor config, updated with the fields present.
+ * @return esp_err_t Return code. ESP_ERR_NOT_FOUND if no flow sensor field is present.
+ */
+esp_err_t codecDecodeFlowSensor(const char *json, FlowSensorConfig_t &flowSensor) {
+    esp_err_t err = ESP_OK;
+    uint32_t recalibration = 0;
+
+    err = codecGetUint(json, "rcal", recalibration);
+    if (err != ESP_OK) return err;
+    if (recalibration > FLOW_RECALIBRATION_APPLY) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    flowSensor.recalibration = (FlowRecalibration_e) recalibration;
+    return ESP_OK;
+}
+
+/**
+ * @brief Decodes the tank geometry fields of a config change. The strapping table
+ * is replaced if the "strap" array is present.
+ *
+ * @param json Null-terminated JSON object.
+ * @param tank Tank config, updated with the fields present.
+ * @return esp_err_t Return code. ESP_ERR_NOT_FOUND if no tank geometry field is present.
+ */
+esp_err_t codecDecodeTank(const char *json, TankConfig_t &tank) {
+    esp_err_t err = ESP_OK;
+    char object[CODEC_MAX_OBJECT_BYTES];
+    const char *position = nullptr;
+    TankConfig_t decoded = tank;
+    uint32_t shape = 0;
+    uint32_t height = 0;
+    float volume = 0;
+    bool found = false;
+
+    err = codecGetUint(json, "shape", shape);
+    if (err == ESP_OK) {
+        if (shape > TANK_TABLE) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        decoded.shape = (TankShapes_e) shape;
+        found = true;
+    } else if (err != ESP_ERR_NOT_FOUND) {
+        return err;
+    }
+
+    err = codecGetFloat(json, "dim1", decoded.dimension1);
+    if (err == ESP_OK) found = true;
+    else if (err != ESP_ERR_NOT_FOUND) return err;
+
+    err = codecGetFloat(json, "dim2", decoded.dimension2);
+    if (err == ESP_OK) found = true;
+    else if (err != ESP_ERR_NOT_FOUND) return err;
+
+    err = codecGetFloat(json, "dim3", decoded.dimension3);
+    if (err == ESP_OK) found = true;
+    else if (err != ESP_ERR_NOT_FOUND) return err;
+
+    err = codecGetArray(json, "strap", position);
+    if (err == ESP_OK) {
+        found = true;
+        decoded.strappingPointCount = 0;
+        memset(decoded.strapping, 0, sizeof(decoded.strapping));
+
+        /** Points carry the height in millimeters and the volume in liters, stored in milliliters. */
+        while ( (err = codecNextObject(position, object, sizeof(object))) == ESP_OK ) {
+            if (decoded.strappingPointCount == MAX_TANK_STRAPPING_POINTS) {
+                return ESP_ERR_INVALID_SIZE;
+            }
+
+            err = codecGetUint(object, "h", height);
+            if (err != ESP_OK) return err;
+            err = codecGetFloat(object, "v", volume);
+            if (err != ESP_OK) return err;
+            if ( (height > UINT16_MAX) || (volume < 0) || (volume * 1000 >= UINT32_MAX) ) {
+                return ESP_ERR_INVALID_ARG;
+            }
+
+            decoded.strapping[decoded.strappingPointCount].height = height;
+            decoded.strapping[decoded.strappingPointCount].volume = (uint32_t) (volume * 1000 + 0.5f);
+            decoded.strappingPointCount++;
+        }
+        if (err != ESP_ERR_NOT_FOUND) return err;
+
+    } else if (err != ESP_ERR_NOT_FOUND) {
+        return err;
+    }
+
+    if (found == false) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    tank = decoded;
+    return ESP_OK;
+}
+
+/**
+ * @brief Decodes the pressure sensor scale fields of a config change.
+ *
+ * @param json Null-terminated JSON object.
+ * @param pressureSensor Pressure sensor config, updated with the fields present.
+ * @return esp_err_t Return code. ESP_ERR_NOT_FOUND if no pressure sensor field is present.
+ */
+esp_err_t codecDecodePressureSensor(const char *json, PressureSensorConfig_t &pressureSensor) {
+    esp_err_t err = ESP_OK;
+    PressureSensorConfig_t decoded = pressureSensor;
+    bool found = false;
+
+    err = codecGetFloat(json, "off", decoded.offset);
+    if (err == ESP_OK) found = true;
+    else if (err != ESP_ERR_NOT_FOUND) return err;
+
+    err = codecGetFloat(json, "gain", decoded.gain);
+    if (err == ESP_OK) found = true;
+    else if (err != ESP_ERR_NOT_FOUND) return err;
+
+    if (decoded.gain < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (found == false) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    pressureSensor = decoded;
+    return ESP_OK;
+}
+
+/**
+ * @brief Returns the message type of a received topic.
+ *
+ * @param baseTopic Null-terminated base topic of the device.
+ * @param topic Received topic, not null-terminated.
+ * @param length Length of the topic in bytes.
+ * @returns The message type, or MQTT_RX_MIN if the topic is not a command of the device.
+ */
+MqttRxMessages_e codecMatchTopic(const char *baseTopic, const char *topic, int length) {
+    size_t baseLength = strlen(baseTopic);
+    const char *suffix = nullptr;
+    int suffixLength = 0;
+
+    if ( (length <= (int) baseLength) || (strncmp(topic, baseTopic, baseLength) != 0) ) {
+        return MQTT_RX_MIN;
+    }
+    suffix = topic + baseLength;
+    suffixLength = length - baseLength;
+
+    for (int i = MQTT_RX_MIN + 1; i < MQTT_RX_MAX; i++) {
+        if ( (MQTT_RX_TOPICS[i] != nullptr) && ((int) strlen(MQTT_RX_TOPICS[i]) == suffixLength) && (strncmp(MQTT_RX_TOPICS[i], suffix, suffixLength) == 0) ) {
+            return (MqttRxMessages_e) i;
+        }
+    }
+
+    return MQTT_RX_MIN;
+}
+
+/**
+ * @brief Encodes a time slice of the dispense process. The tank level is left out without a pressure sensor.
+ *
+ * @tparam Mode OperatingMode of the build.
+ * @param slice The process variables.
+ * @param json Overwritten with the null-terminated JSON payload.
+ * @param size Size of the payload buffer in bytes.
+ * @return esp_err_t Return code. ESP_ERR_INVALID_SIZE if the buffer is too small.
+ */
+template <typename Mode>
+esp_err_t codecEncodeSlice(DispenseProcess_t &slice, char *json, size_t size) {
+    int length = 0;
+
+    if (Mode::PRESSURE) {
+        length = snprintf(json,
+            size,
+            "{\"z\":%u,\"s\":%u,\"t\":%.3f,\"v\":%.3f,\"q\":%.3f,\"tv\":%.3f}",
+            slice.zone,
+            slice.step,
+            slice.time / 1000.0,
+            slice.outputVolume,
+            slice.flowRate,
+            slice.tankLevel
+        );
+    } else {
+        length = snprintf(json,
+            size,
+            "{\"z\":%u,\"s\":%u,\"t\":%.3f,\"v\":%.3f,\"q\":%.3f}",
+            slice.zone,
+            slice.step,
+            slice.time / 1000.0,
+            slice.outputVolume,
+            slice.flowRate
+        );
+    }
+
+    return ( (length < 0) || (length >= (int) size) ) ? ESP_ERR_INVALID_SIZE : ESP_OK;
+}
+
+/**
+ * @brief Encodes the summary of a dispense step. The fields of a supply the mode leaves out are left out.
+ *
+ * @tparam Mode OperatingMode of the build.
+ * @param summary The step summary.
+ * @param json Overwritten with the null-terminated JSON payload.
+ * @param size Size of the payload buffer in bytes.
+ * @return esp_err_t Return code. ESP_ERR_INVALID_SIZE if the buffer is too small.
+ */
+template <typename Mode>
+esp_err_t codecEncodeSummary(DispenseSummary_t &summary, char *json, size_t size) {
+    int length = 0;
+    int fused = 0;
+
+    /** The switchover, its saving and the blend time need both supplies. */
+    if (Mode::BLEND) {
+        length = snprintf(json,
+            size,
+            "{\"z\":%u,\"s\":%u,\"tt\":%.3f,\"vt\":%.3f,\"tv\":%.3f,\"vs\":%.3f,\"tts\":%.3f,\"tb\":%.3f,\"tss\":%.3f,\"ov\":%.3f}",
+            summary.zone,
+            summary.step,
+            summary.duration / 1000.0,
+            summary.outputVolume,
+            summary.outputTankVolume,
+            summary.outputSourceVolume,
+            summary.tankSwitchoverTime / 1000.0,
+            summary.blendTime / 1000.0,
+            summary.switchoverSaving / 1000.0,
+            summary.overshoot
+        );
+    } else if (Mode::TANK) {
+        length = snprintf(json,
+            size,
+            "{\"z\":%u,\"s\":%u,\"tt\":%.3f,\"vt\":%.3f,\"tv\":%.3f,\"ov\":%.3f}",
+            summary.zone,
+            summary.step,
+            summary.duration / 1000.0,
+            summary.outputVolume,
+            summary.outputTankVolume,
+            summary.overshoot
+        );
+    } else {
+        length = snprintf(json,
+            size,
+            "{\"z\":%u,\"s\":%u,\"tt\":%.3f,\"vt\":%.3f,\"vs\":%.3f,\"ov\":%.3f}",
+            summary.zone,
+            summary.step,
+            summary.duration / 1000.0,
+            summary.outputVolume,
+            summary.outputSourceVolume,
+            summary.overshoot
+        );
+    }
+
+    /** The fused volume and the correction factor need the tank level. They replace the closing brace. */
+    if ( Mode::PRESSURE && (length > 0) && (length < (int) size) ) {
+        fused = snprintf(json + length - 1,
+            size - length + 1,
+            ",\"vf\":%.3f,\"kf\":%.4f}",
+            summary.fusedVolume,
+            summary.correction
+        );
+        length = (fused < 0) ? fused : length - 1 + fused;
+    }
+
+    return ( (length < 0) || (length >= (int) size) ) ? ESP_ERR_INVALID_SIZE : ESP_OK;
+}
+
+/** Only the mode of the build is compiled. */
+template esp_err_t codecEncodeSlice<DripMode>(DispenseProcess_t &slice, char *json, size_t size);
+template esp_err_t codecEncodeSummary<DripMode>(DispenseSummary_t &summary, char *json, size_t size);
+
+/**
+ * @brief Encodes a chunk of a captured trace, with its sequence number and its bytes in base64.
+ *
+ * @param sequence Sequence number of the chunk.
+ * @param data Bytes of the chunk.
+ * @param length Length of the chunk in bytes.
+ * @param json Overwritten with the null-terminated JSON payload.
+ * @param size Size of the payload buffer in bytes.
+ * @return esp_err_t Return code. ESP_ERR_INVALID_SIZE if the buffer is too small.
+ */
+esp_err_t codecEncodeTraceChunk(uint32_t sequence, const uint8_t *data, size_t length, char *json, size_t size) {
+    static const char ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    uint32_t triple = 0;
+    size_t position = 0;
+    int header = snprintf(json, size, "{\"n\":%lu,\"d\":\"", (unsigned long) sequence);
+
+    /** Four characters per three bytes, then the closing quote, brace and terminator. */
+    if ( (header < 0) || (header + ((length + 2) / 3) * 4 + 3 > size) ) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    position = header;
+    for (size_t i = 0; i < length; i += 3) {
+        triple = (uint32_t) data[i] << 16;
+        if (i + 1 < length) triple |= (uint32_t) data[i + 1] << 8;
+        if (i + 2 < length) triple |= data[i + 2];
+
+        json[position++] = ALPHABET[(triple >> 18) & 0x3F];
+        json[position++] = ALPHABET[(triple >> 12) & 0x3F];
+        json[position++] = (i + 1 < length) ? ALPHABET[(triple >> 6) & 0x3F] : '=';
+        json[position++] = (i + 2 < length) ? ALPHABET[triple & 0x3F] : '=';
+    }
+    json[position++] = '"';
+    json[position++] = '}';
+    json[position] = '\0';
+    return ESP_OK;
+}
+
+/**
+ * @brief Decodes the JSON payload of a received message into its
+ * message struct. Payloads without a struct are copied as is.
+ *
+ * @param messageCode The message type.
+ * @param json Null-terminated JSON payload.
+ * @param payload Overwritten with the decoded payload.
+ * @param size Size of the payload buffer in bytes.
+ * @return esp_err_t Return code.
+ */
+esp_err_t codecDecode(MqttRxMessages_e messageCode, const char *json, void *payload, size_t size) {
+    esp_err_t err = ESP_OK;
+    RunPlan_t *plan = nullptr;
+    MqttRxFlowCalibrate_t *calibrate = nullptr;
+    MqttRxPressureCalibrate_t *pressureCalibrate = nullptr;
+    DrainTarget_t *drain = nullptr;
+
+    /** Field names follow the short names of the legacy firmware. Times are in miliseconds. */
+    switch (messageCode) {
+        case MQTT_RX_DISPENSE_ACTIVATE:
+            if (size < sizeof(RunPlan_t)) return ESP_ERR_INVALID_SIZE;
+            plan = new (payload) RunPlan_t();
+            return decodeRunPlan(json, *plan);
+
+        case MQTT_RX_FLOW_CALIBRATE:
+            if (size < sizeof(MqttRxFlowCalibrate_t)) return ESP_ERR_INVALID_SIZE;
+            calibrate = new (payload) MqttRxFlowCalibrate_t();
+            codecGetBool(json, "c", calibrate->conclude);
+            codecGetFloat(json, "mv", calibrate->measuredVolume);
+            if (calibrate->conclude) return ESP_OK;
+            err = codecGetFloat(json, "tv", calibrate->targetVolume);
+            if (err != ESP_OK) return err;
+            codecGetUint(json, "to", calibrate->timeout);
+            return ESP_OK;
+
+        case MQTT_RX_PRESSURE_CALIBRATE:
+            if (size < sizeof(MqttRxPressureCalibrate_t)) return ESP_ERR_INVALID_SIZE;
+            pressureCalibrate = new (payload) MqttRxPressureCalibrate_t();
+            codecGetBool(json, "c", pressureCalibrate->conclude);
+            codecGetFloat(json, "v", pressureCalibrate->tankVolume);
+            codecGetFloat(json, "dv", pressureCalibrate->stepVolume);
+            codecGetUint(json, "n", pressureCalibrate->stepCount);
+            codecGetUint(json, "to", pressureCalibrate->timeout);
+            return ESP_OK;
+
+        case MQTT_RX_DRAIN:
+            if (size < sizeof(DrainTarget_t)) return ESP_ERR_INVALID_SIZE;
+            drain = new (payload) DrainTarget_t();
+            err = codecGetUint(json, "tt", drain->targetTime);
+            if (err != ESP_OK) return err;
+            codecGetUint(json, "to", drain->timeout);
+            return ESP_OK;
+
+        /** Config changes are partial, so they are applied field by field by the receiver. */
+        default:
+            if (strlen(json) >= size) return ESP_ERR_INVALID_SIZE;
+            strcpy(static_cast<char*>(payload), json);
+            return ESP_OK;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,190 @@
+#ifndef MQTT_CODEC_H
+#define MQTT_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#include "messages.h"
+#include "operatingMode.h"
+
+/**
+ * @brief Reads a number field of a flat JSON object.
+ *
+ * @param json Null-terminated JSON object.
+ * @param key Field name.
+ * @param value Overwritten with the field value.
+ * @return esp_err_t Return code. ESP_ERR_NOT_FOUND if the field is missing.
+ */
+esp_err_t codecGetFloat(const char *json, const char *key, float &value);
+
+/**
+ * @brief Reads a non-negative integer field of a flat JSON object.
+ *
+ * @param json Null-terminated JSON object.
+ * @param key Field name.
+ * @param value Overwritten with the field value.
+ * @return esp_err_t Return code. ESP_ERR_NOT_FOUND if the field is missing,
+ * ESP_ERR_INVALID_ARG if it is not a number or does not fit 32 bits.
+ */
+esp_err_t codecGetUint(const char *json, const char *key, uint32_t &value);
+
+/**
+ * @brief Reads a boolean field of a flat JSON object.
+ *
+ * @param json Null-terminated JSON object.
+ * @param key Field name.
+ * @param value Overwritten with the field value.
+ * @return esp_err_t Return code. ESP_ERR_NOT_FOUND if the field is missing.
+ */
+esp_err_t codecGetBool(const char *json, const char *key, bool &value);
+
+/**
+ * @brief Reads a string field of a flat JSON object. Escape sequences are not supported.
+ *
+ * @param json Null-terminated JSON object.
+ * @param key Field name.
+ * @param value Overwritten with the null-terminated field value.
+ * @param size Size of the value buffer in bytes.
+ * @return esp_err_t Return code. ESP_ERR_NOT_FOUND if the field is missing.
+ */
+esp_err_t codecGetString(const char *json, const char *key, char *value, size_t size);
+
+/**
+ * @brief Finds an array field of a JSON object.
+ *
+ * @param json Null-terminated JSON object.
+ * @param key Field name.
+ * @param position Set to the opening bracket of the array, to be passed to codecNextObject().
+ * @return esp_err_t Return code. ESP_ERR_NOT_FOUND if the field is missing.
+ */
+esp_err_t codecGetArray(const char *json, const char *key, const char* &position);
+
+/**
+ * @brief Copies the next object of an array of flat objects.
+ *
+ * @param position The opening bracket of the array, or the end of the last object.
+ * Advanced to the end of the copied object.
+ * @param object Overwritten with the null-terminated object.
+ * @param size Size of the object buffer in bytes.
+ * @return esp_err_t Return code. ESP_ERR_NOT_FOUND at the end of the array.
+ */
+esp_err_t codecNextObject(const char* &position, char *object, size_t size);
+
+/**
+ * @brief Decodes the schedule fields of a config change. The entry table
+ * is replaced if the "sch" array is present.
+ *
+ * @param json Null-terminated JSON object.
+ * @param schedule Schedule config, updated with the fields present.
+ * @return esp_err_t Return code. ESP_ERR_NOT_FOUND if no schedule field is present.
+ */
+esp_err_t codecDecodeSchedule(const char *json, ScheduleConfig_t &schedule);
+
+/**
+ * @brief Decodes the system fields of a config change.
+ *
+ * @param json Null-terminated JSON object.
+ * @param system System config, updated with the fields present.
+ * @return esp_err_t Return code. ESP_ERR_NOT_FOUND if no system field is present,
+ * ESP_ERR_INVALID_ARG if the sleep interval is out of bounds.
+ */
+esp_err_t codecDecodeSystem(const char *json, SystemConfig_t &system);
+
+/**
+ * @brief Decodes the dispense fields of a config change.
+ *
+ * @param json Null-terminated JSON object.
+ * @param dispense Dispense config, updated with the fields present.
+ * @return esp_err_t Return code. ESP_ERR_NOT_FOUND if no dispense field is present.
+ */
+esp_err_t codecDecodeDispense(const char *json, DispenseConfig_t &dispense);
+
+/**
+ * @brief Decodes the flow sensor fields of a config change.
+ *
+ * @param json Null-terminated JSON object.
+ * @param flowSensor Flow sensor config, updated with the fields present.
+ * @return esp_err_t Return code. ESP_ERR_NOT_FOUND if no flow sensor field is present.
+ */
+esp_err_t codecDecodeFlowSensor(const char *json, FlowSensorConfig_t &flowSensor);
+
+/**
+ * @brief Decodes the tank geometry fields of a config change. The strapping table
+ * is replaced if the "strap" array is present.
+ *
+ * @param json Null-terminated JSON object.
+ * @param tank Tank config, updated with the fields present.
+ * @return esp_err_t Return code. ESP_ERR_NOT_FOUND if no tank geometry field is present.
+ */
+esp_err_t codecDecodeTank(const char *json, TankConfig_t &tank);
+
+/**
+ * @brief Decodes the pressure sensor scale fields of a config change.
+ *
+ * @param json Null-terminated JSON object.
+ * @param pressureSensor Pressure sensor config, updated with the fields present.
+ * @return esp_err_t Return code. ESP_ERR_NOT_FOUND if no pressure sensor field is present.
+ */
+esp_err_t codecDecodePressureSensor(const char *json, PressureSensorConfig_t &pressureSensor);
+
+/**
+ * @brief Returns the message type of a received topic.
+ *
+ * @param baseTopic Null-terminated base topic of the device.
+ * @param topic Received topic, not null-terminated.
+ * @param length Length of the topic in bytes.
+ * @returns The message type, or MQTT_RX_MIN if the topic is not a command of the device.
+ */
+MqttRxMessages_e codecMatchTopic(const char *baseTopic, const char *topic, int length);
+
+/**
+ * @brief Encodes a time slice of the dispense process. The tank level is left out without a pressure sensor.
+ *
+ * @tparam Mode OperatingMode of the build.
+ * @param slice The process variables.
+ * @param json Overwritten with the null-terminated JSON payload.
+ * @param size Size of the payload buffer in bytes.
+ * @return esp_err_t Return code. ESP_ERR_INVALID_SIZE if the buffer is too small.
+ */
+template <typename Mode = DripMode>
+esp_err_t codecEncodeSlice(DispenseProcess_t &slice, char *json, size_t size);
+
+/**
+ * @brief Encodes the summary of a dispense step. The fields of a supply the mode leaves out are left out.
+ *
+ * @tparam Mode OperatingMode of the build.
+ * @param summary The step summary.
+ * @param json Overwritten with the null-terminated JSON payload.
+ * @param size Size of the payload buffer in bytes.
+ * @return esp_err_t Return code. ESP_ERR_INVALID_SIZE if the buffer is too small.
+ */
+template <typename Mode = DripMode>
+esp_err_t codecEncodeSummary(DispenseSummary_t &summary, char *json, size_t size);
+
+/**
+ * @brief Encodes a chunk of a captured trace, with its sequence number and its bytes in base64.
+ *
+ * @param sequence Sequence number of the chunk.
+ * @param data Bytes of the chunk.
+ * @param length Length of the chunk in bytes.
+ * @param json Overwritten with the null-terminated JSON payload.
+ * @param size Size of the payload buffer in bytes.
+ * @return esp_err_t Return code. ESP_ERR_INVALID_SIZE if the buffer is too small.
+ */
+esp_err_t codecEncodeTraceChunk(uint32_t sequence, const uint8_t *data, size_t length, char *json, size_t size);
+
+/**
+ * @brief Decodes the JSON payload of a received message into its
+ * message struct. Payloads without a struct are copied as is.
+ *
+ * @param messageCode The message type.
+ * @param json Null-terminated JSON payload.
+ * @param payload Overwritten with the decoded payload.
+ * @param size Size of the payload buffer in bytes.
+ * @return esp_err_t Return code.
+ */
+esp_err_t codecDecode(MqttRxMessages_e messageCode, const char *json, void *payload, size_t size);
+
+#endif
\ No newline at end of file
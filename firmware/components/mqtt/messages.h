@@ -21,6 +21,11 @@ typedef enum MqttRxMessages_e {
     MQTT_RX_PRESSURE_CALIBRATE,
     MQTT_RX_DRAIN,
     MQTT_RX_PRESSURE_POLL,
+    MQTT_RX_VALVE_CHARACTERISE,
+    MQTT_RX_TRACE_CAPTURE,
+    MQTT_RX_RESOURCE_REQUEST,
+    /** Internal. The broker accepted the connection. */
+    MQTT_RX_CONNECTED,
 
     MQTT_RX_MAX
 } MqttRxMessages_e;
@@ -39,6 +44,14 @@ typedef enum MqttTxMessages_e {
     MQTT_TX_READ_CONFIG,
     MQTT_TX_DRAIN_SUMMARY,
     MQTT_TX_PRESSURE,
+    MQTT_TX_POWER_REPORT,
+    MQTT_TX_WAKE_REPORT,
+    MQTT_TX_CONNECTION_REPORT,
+    MQTT_TX_QUEUE_STATUS,
+    MQTT_TX_VALVE_LATENCY,
+    MQTT_TX_TRACE_CHUNK,
+    MQTT_TX_RESOURCE_REPORT,
+    MQTT_TX_RECOVERY,
     
     MQTT_TX_MAX
 } MqttTxMessages_e;
@@ -50,6 +63,8 @@ typedef enum MqttTxMessages_e {
  */
 typedef struct MqttRxMessage_t {
     MqttRxMessages_e messageCode;
+    /** The optional "id" field of the payload. Zero if missing. */
+    uint32_t jobId;
     char* payload;
 } MqttRxMessage_t;
 
@@ -61,9 +76,9 @@ typedef struct MqttRxConfigMessage_t {
 } MqttRxConfigMessage_t;
 
 /** 
- * @brief Dispense activate command.
+ * @brief Dispense activate command. A single target is a plan of one step.
  */
-typedef DispenseTarget_t MqttRxDispenseActivateMessage_t;
+typedef RunPlan_t MqttRxDispenseActivateMessage_t;
 
 /**
  * @brief Flow calibration dispense and measure command.
@@ -85,6 +100,28 @@ typedef struct MqttRxFlowCalibrate_t {
     bool conclude = false;
 } MqttRxFlowCalibrate_t;
 
+/**
+ * @brief Pressure calibration point command.
+ */
+typedef struct MqttRxPressureCalibrate_t {
+    /** 
+     * The tank volume measured by the user in liters, or negative if not given.
+     * Required unless conclude is true.
+     */
+    float tankVolume = -1;
+    /** 
+     * The volume drained through the flow sensor between points in liters.
+     * Zero to wait for the next measured tank volume instead.
+     */
+    float stepVolume = 0;
+    /** The number of drain steps, or zero to drain until the tank is empty. */
+    uint32_t stepCount = 0;
+    /** The timeout of each drain step in seconds. */
+    uint32_t timeout = 0;
+    /** If true the calibration process is concluded. */
+    bool conclude = false;
+} MqttRxPressureCalibrate_t;
+
 /** Outgoing messages. */
 
 /**
@@ -1,23 +1,77 @@
+#include <cstdio>
+#include <cstring>
+
 #include "esp_err.h"
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "halMqtt.h"
+#include "halQueue.h"
 
 #include "mqttManager.h"
+#include "topics.h"
+#include "codec.h"
 
 static const char* TAG = "MqttManager";
 
+/** Marks the retained session state as valid. */
+#define MQTT_SESSION_MAGIC 0x5E5510E1
+
+/**
+ * @brief Describes the session held by the broker, retained through deep sleep.
+ */
+typedef struct MqttSessionState_t {
+    uint32_t magic;
+    /** Config generation the subscriptions and retained config were last synchronized to. */
+    uint32_t configGeneration;
+} MqttSessionState_t;
+
+static RTC_DATA_ATTR MqttSessionState_t rtcSession;
+
 /**
  * @brief Constructor.
  */
 MqttManager::MqttManager() {
-    return;
+    _checkedForMessages = false;
+    client = nullptr;
+    baseTopic[0] = '\0';
+    connected = false;
+    sessionResumed = false;
+    configGeneration = 0;
+    rxQueue = nullptr;
+    rxMessage = {};
+    connectedQueued = false;
+    rxRejectHead = 0;
+    rxRejectTail = 0;
+    txBufferHead = 0;
+    txBufferCount = 0;
+    txDropped = 0;
+    rxPeak = 0;
+    rxDropped = 0;
+    txPeak = 0;
+    txDroppedTotal = 0;
 }
 
 /**
- * @brief Begin the MqttManager.s
+ * @brief Begin the MqttManager. Received messages are queued from
+ * the events of the client.
  * 
+ * @param client MQTT client, owned by the ConnectionManager.
+ * @param baseTopic Prefix of every topic.
  * @return esp_err_t Return code. 
  */
-esp_err_t MqttManager::initialize() {
-    return ESP_OK;
+esp_err_t MqttManager::initialize(HalMqttClient_t client, const char *baseTopic) {
+    esp_err_t err = ESP_OK;
+
+    if ( (client == nullptr) || (baseTopic == nullptr) ) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    this->client = client;
+    strlcpy(this->baseTopic, baseTopic, sizeof(this->baseTopic));
+
+    err = halQueueCreate(RX_QUEUE_LENGTH, sizeof(MqttRxQueueItem_t), &rxQueue);
+    if (err != ESP_OK) return err;
+
+    return halMqttRegister(client, &onEvent, this);
 }
 
 /**
@@ -34,16 +88,124 @@ bool MqttManager::checkedForMessages() {
  * the queue.
  */
 uint8_t MqttManager::numMessagesInQueue() {
-    return 0;
+    if (rxQueue == nullptr) {
+        return 0;
+    }
+
+    return halQueueCount(rxQueue);
 }
 
 /**
- * @brief Pull the next incoming MQTT message from the queue.
+ * @brief Blocks the calling task until a message is received
+ * or the timeout elapses. While blocked, the chip may enter
+ * automatic light sleep.
  * 
- * @param Pointer to the message object.
+ * @param timeout Maximum time to wait in miliseconds.
+ * @returns True if a message is waiting in the queue.
+ */
+bool MqttManager::waitForMessage(uint32_t timeout) {
+    if (rxQueue == nullptr) {
+        return false;
+    }
+
+    /** Wait on the queue without removing the item. It is received by getNextMessage(). */
+    return halQueuePeek(rxQueue, &rxItem, timeout);
+}
+
+/**
+ * @brief Pull the next incoming MQTT message from the queue
+ * and decode its payload.
+ * 
+ * @param message Set to the decoded message, valid until the next call.
  * @return esp_err_t Return code.
  */
-esp_err_t MqttManager::getNextMessage(MqttRxMessage_t* message) {
+esp_err_t MqttManager::getNextMessage(MqttRxMessage_t* &message) {
+    esp_err_t err = ESP_OK;
+
+    message = nullptr;
+    rejectDropped();
+    if ( (rxQueue == nullptr) || (halQueueReceive(rxQueue, &rxItem) == false) ) {
+        return ESP_OK;
+    }
+    if (rxItem.messageCode == MQTT_RX_CONNECTED) {
+        connectedQueued = false;
+    }
+
+    err = codecDecode(rxItem.messageCode, rxItem.data, rxPayload, sizeof(rxPayload));
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to decode message %d: %s", rxItem.messageCode, esp_err_to_name(err));
+        return err;
+    }
+
+    rxMessage.messageCode = rxItem.messageCode;
+    /** An ID which does not fit is rejected rather than replaced by an assigned one. */
+    rxMessage.jobId = 0;
+    err = codecGetUint(rxItem.data, "id", rxMessage.jobId);
+    if ( (err != ESP_OK) && (err != ESP_ERR_NOT_FOUND) ) {
+        ESP_LOGW(TAG, "Invalid ID of message %d: %s", rxItem.messageCode, esp_err_to_name(err));
+        return err;
+    }
+    rxMessage.payload = rxPayload;
+    message = &rxMessage;
+    return ESP_OK;
+}
+
+/**
+ * @brief Sets the config generation the subscriptions and the retained
+ * config are synchronized to on the next connection.
+ * 
+ * @param generation Current config generation.
+ */
+void MqttManager::setConfigGeneration(uint32_t generation) {
+    configGeneration = generation;
+}
+
+/**
+ * @brief If true, the last connection resumed a persistent session
+ * of the current config generation, so the subscriptions were kept and
+ * the retained config is up to date.
+ */
+bool MqttManager::isSessionResumed() {
+    return sessionResumed;
+}
+
+/**
+ * @brief If true, a transmitted message has not yet reached the broker while connected.
+ * Messages buffered while disconnected are not counted, as they wait for the next connection.
+ */
+bool MqttManager::isPublishPending() {
+    return connected && (client != nullptr) && halMqttHasPending(client);
+}
+
+/**
+ * @brief Publishes the messages buffered while disconnected, oldest first.
+ * 
+ * @return esp_err_t Return code.
+ */
+esp_err_t MqttManager::flush() {
+    esp_err_t err = ESP_OK;
+    MqttTxBufferItem_t *item = nullptr;
+    uint32_t dropped = txDropped;
+
+    while ( connected && (txBufferCount > 0) ) {
+        item = &txBuffer[txBufferHead];
+        err = buildTopic(MQTT_TX_TOPICS[item->messageCode]);
+        if (err != ESP_OK) return err;
+
+        if (halMqttEnqueue(client, topic, item->data, 1, item->messageCode == MQTT_TX_READ_CONFIG) < 0) {
+            return ESP_FAIL;
+        }
+        txBufferHead = (txBufferHead + 1) % TX_BUFFER_LENGTH;
+        txBufferCount--;
+    }
+
+    /** Report any telemetry lost while disconnected. */
+    if ( connected && (dropped > 0) ) {
+        txDropped = 0;
+        snprintf(txPayload, sizeof(txPayload), "Dropped %lu messages while disconnected.", (unsigned long) dropped);
+        return txWarning(TAG, txPayload);
+    }
+
     return ESP_OK;
 }
 
@@ -53,17 +215,20 @@ esp_err_t MqttManager::getNextMessage(MqttRxMessage_t* message) {
  * @param Log message.
  * @return esp_err_t Return code.
  */
-esp_err_t txInfo(const char* tag, const char *message) {
-    return ESP_OK;
+esp_err_t MqttManager::txInfo(const char* tag, const char *message) {
+    ESP_LOGI(tag, "%s", message);
+    return txLog(MQTT_TX_INFO_LOG, tag, message);
 }
+
 /**
  * @brief Transmit a warning log.
  * 
  * @param Log message.
  * @return esp_err_t Return code.
  */
-esp_err_t txWarning(const char* tag, const char *message) {
-    return ESP_OK;
+esp_err_t MqttManager::txWarning(const char* tag, const char *message) {
+    ESP_LOGW(tag, "%s", message);
+    return txLog(MQTT_TX_WARNING_LOG, tag, message);
 }
 
 /**
@@ -72,8 +237,9 @@ esp_err_t txWarning(const char* tag, const char *message) {
  * @param Log message.
  * @return esp_err_t Return code.
  */
-esp_err_t txError(const char* tag, const char *message) {
-    return ESP_OK;
+esp_err_t MqttManager::txError(const char* tag, const char *message) {
+    ESP_LOGE(tag, "%s", message);
+    return txLog(MQTT_TX_ERROR_LOG, tag, message);
 }
 
 /**
@@ -82,16 +248,604 @@ esp_err_t txError(const char* tag, const char *message) {
  * @param slice The variables.
  * @return esp_err_t Return code.
  */
-esp_err_t txDispenseSlice(DispenseProcess_t &slice) {
-    return ESP_OK;
+esp_err_t MqttManager::txDispenseSlice(DispenseProcess_t &slice) {
+    esp_err_t err = codecEncodeSlice(slice, txPayload, sizeof(txPayload));
+    if (err != ESP_OK) return err;
+
+    return publish(MQTT_TX_DISPENSE_SLICE, txPayload);
 }
 
 /**
- * @brief Transmits a summary of the dispense process variables.
+ * @brief Transmits a summary of the dispense process variables of one zone.
  * 
  * @param summary The variables.
  * @return esp_err_t Return code. 
  */
-esp_err_t txDispenseSummary(DispenseSummary_t &summary) {
+esp_err_t MqttManager::txDispenseSummary(DispenseSummary_t &summary) {
+    esp_err_t err = codecEncodeSummary(summary, txPayload, sizeof(txPayload));
+    if (err != ESP_OK) return err;
+
+    return publish(MQTT_TX_DISPENSE_SUMMARY, txPayload);
+}
+
+/**
+ * @brief Transmits a summary of the drain process variables.
+ * 
+ * @param summary The variables.
+ * @return esp_err_t Return code.
+ */
+esp_err_t MqttManager::txDrainSummary(DrainSummary_t &summary) {
+    int length = snprintf(txPayload, 
+        sizeof(txPayload), 
+        "{\"tt\":%.3f}",
+        summary.duration / 1000.0
+    );
+    if ( (length < 0) || (length >= (int) sizeof(txPayload)) ) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    return publish(MQTT_TX_DRAIN_SUMMARY, txPayload);
+}
+
+/**
+ * @brief Transmits the active job and the jobs waiting behind it.
+ * 
+ * @param status The queue status.
+ * @return esp_err_t Return code.
+ */
+esp_err_t MqttManager::txQueueStatus(JobQueueStatus_t &status) {
+    int length = snprintf(txPayload, sizeof(txPayload), "{\"a\":%lu,\"q\":[", (unsigned long) status.activeId);
+
+    for (uint8_t i = 0; (i < status.count) && (length > 0) && (length < (int) sizeof(txPayload)); i++) {
+        length += snprintf(txPayload + length, sizeof(txPayload) - length, "%s%lu", (i > 0) ? "," : "", (unsigned long) status.ids[i]);
+    }
+    if ( (length > 0) && (length < (int) sizeof(txPayload)) ) {
+        length += snprintf(txPayload + length, sizeof(txPayload) - length, "]}");
+    }
+    if ( (length < 0) || (length >= (int) sizeof(txPayload)) ) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    return publish(MQTT_TX_QUEUE_STATUS, txPayload);
+}
+
+/**
+ * @brief Transmits the summary of a dispense process interrupted before the last boot.
+ * 
+ * @param recovery The interrupted process.
+ * @return esp_err_t Return code.
+ */
+esp_err_t MqttManager::txRecovery(ProcessRecovery_t &recovery) {
+    int length = snprintf(txPayload, 
+        sizeof(txPayload), 
+        "{\"job\":%lu,\"rsm\":%lu,\"n\":%u,\"s\":%u,\"z\":%u,\"st\":%d,\"sw\":%s,\"tt\":%.3f,\"vt\":%.3f,\"vr\":%.3f,\"ns\":%u}",
+        (unsigned long) recovery.jobId,
+        (unsigned long) recovery.resumeId,
+        recovery.stepCount,
+        recovery.step,
+        recovery.zone,
+        recovery.valveState,
+        recovery.switchedOver ? "true" : "false",
+        recovery.time / 1000.0,
+        recovery.deliveredVolume,
+        recovery.remainingVolume,
+        recovery.remaining.stepCount
+    );
+    if ( (length < 0) || (length >= (int) sizeof(txPayload)) ) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    return publish(MQTT_TX_RECOVERY, txPayload);
+}
+
+/**
+ * @brief Transmits the latency of the supply valves measured by the characterisation process.
+ * 
+ * @param summary The measurements.
+ * @return esp_err_t Return code.
+ */
+esp_err_t MqttManager::txValveLatency(CharacteriseSummary_t &summary) {
+    int length = snprintf(txPayload, 
+        sizeof(txPayload), 
+        "{\"src\":{\"m\":%s,\"o\":%u,\"c\":%u,\"v\":%.3f},\"tnk\":{\"m\":%s,\"o\":%u,\"c\":%u,\"v\":%.3f}}",
+        summary.source.measured ? "true" : "false",
+        summary.source.latency.openDelay,
+        summary.source.latency.closeDelay,
+        summary.source.closeVolume,
+        summary.tank.measured ? "true" : "false",
+        summary.tank.latency.openDelay,
+        summary.tank.latency.closeDelay,
+        summary.tank.closeVolume
+    );
+    if ( (length < 0) || (length >= (int) sizeof(txPayload)) ) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    return publish(MQTT_TX_VALVE_LATENCY, txPayload);
+}
+
+/**
+ * @brief Transmits a reading of the pressure sensor.
+ * 
+ * @param millivolts Sensor voltage.
+ * @param volume Tank volume in liters.
+ * @param calibrated If false, the volume is unknown and left out.
+ * @return esp_err_t Return code.
+ */
+esp_err_t MqttManager::txPressureReport(uint16_t millivolts, float volume, bool calibrated) {
+    int length = 0;
+
+    if (calibrated) {
+        length = snprintf(txPayload, sizeof(txPayload), "{\"mv\":%u,\"v\":%.3f}", millivolts, volume);
+    } else {
+        length = snprintf(txPayload, sizeof(txPayload), "{\"mv\":%u}", millivolts);
+    }
+    if ( (length < 0) || (length >= (int) sizeof(txPayload)) ) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    return publish(MQTT_TX_PRESSURE, txPayload);
+}
+
+/**
+ * @brief Transmits the config as a retained message.
+ * 
+ * @param config The config.
+ * @return esp_err_t Return code.
+ */
+esp_err_t MqttManager::txConfig(Config_t &config) {
+    /** Field names follow the config report of the legacy firmware. */
+    int length = snprintf(txPayload, 
+        sizeof(txPayload), 
+        "{\"gen\":%lu,\"srvc\":{\"res\":%.3f,\"rsm\":%d},\"src\":{\"rate\":%.3f},"
+        "\"tnk\":{\"time\":%u,\"shape\":%d,\"dim1\":%.3f,\"dim2\":%.3f,\"dim3\":%.3f,\"pts\":%u},"
+        "\"flow\":{\"ppl\":%.3f,\"min\":%.3f,\"ctime\":%.0f,\"cmax\":%.3f,\"rcal\":%d},"
+        "\"prssr\":{\"mode\":%.0f,\"off\":%.0f,\"gain\":%.0f}}",
+        (unsigned long) configGeneration,
+        config.dispense.dataResolutionLiters,
+        config.dispense.resumeInterrupted,
+        config.source.staticFlowRate,
+        config.tank.tank_timeout,
+        config.tank.shape,
+        config.tank.dimension1,
+        config.tank.dimension2,
+        config.tank.dimension3,
+        config.tank.strappingPointCount,
+        config.flowSensor.defaultPulsesPerLiter,
+        config.flowSensor.minFlowRate,
+        config.flowSensor.calibrationTimeout,
+        config.flowSensor.calibrateMaxVolume,
+        config.flowSensor.recalibration,
+        config.pressureSensor.reportMode,
+        config.pressureSensor.offset,
+        config.pressureSensor.gain
+    );
+    if ( (length < 0) || (length >= (int) sizeof(txPayload)) ) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    return publish(MQTT_TX_READ_CONFIG, txPayload);
+}
+
+/**
+ * @brief Transmits the time spent in each power state.
+ * 
+ * @param stats The power statistics.
+ * @return esp_err_t Return code.
+ */
+esp_err_t MqttManager::txPowerReport(PowerStats_t &stats) {
+    int length = snprintf(txPayload, 
+        sizeof(txPayload), 
+        "{\"uptime\":%lu,\"active\":%lu,\"idle\":%lu,\"lightSleep\":%lu,\"lightSleepCount\":%lu}",
+        (unsigned long) stats.uptime,
+        (unsigned long) stats.activeTime,
+        (unsigned long) stats.idleTime,
+        (unsigned long) stats.lightSleepTime,
+        (unsigned long) stats.lightSleepCount
+    );
+    if ( (length < 0) || (length >= (int) sizeof(txPayload)) ) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    return publish(MQTT_TX_POWER_REPORT, txPayload);
+}
+
+/**
+ * @brief Transmits the wake to command readiness latency.
+ * 
+ * @param report The wake report.
+ * @return esp_err_t Return code.
+ */
+esp_err_t MqttManager::txWakeReport(WakeReport_t &report) {
+    int length = snprintf(txPayload, 
+        sizeof(txPayload), 
+        "{\"cause\":%u,\"count\":%lu,\"configRestored\":%s,\"wakeToReady\":%lu,"
+        "\"bootloader\":%lu,\"config\":%lu,\"network\":%lu,\"ready\":%lu}",
+        report.wakeCause,
+        (unsigned long) report.wakeCount,
+        report.configRestored ? "true" : "false",
+        (unsigned long) report.wakeToReady,
+        (unsigned long) report.bootloaderTime,
+        (unsigned long) report.configTime,
+        (unsigned long) report.networkTime,
+        (unsigned long) report.readyTime
+    );
+    if ( (length < 0) || (length >= (int) sizeof(txPayload)) ) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    return publish(MQTT_TX_WAKE_REPORT, txPayload);
+}
+
+/**
+ * @brief Transmits the duration of each phase of the last connection.
+ * 
+ * @param timing The connection timing.
+ * @return esp_err_t Return code.
+ */
+esp_err_t MqttManager::txConnectionReport(ConnectionTiming_t &timing) {
+    int length = snprintf(txPayload, 
+        sizeof(txPayload), 
+        "{\"fastPath\":%s,\"sessionResumed\":%s,\"failures\":%lu,\"scan\":%lu,\"auth\":%lu,\"dhcp\":%lu,\"mqtt\":%lu,\"total\":%lu}",
+        timing.fastPath ? "true" : "false",
+        sessionResumed ? "true" : "false",
+        (unsigned long) timing.failures,
+        (unsigned long) timing.scan,
+        (unsigned long) timing.auth,
+        (unsigned long) timing.dhcp,
+        (unsigned long) timing.mqtt,
+        (unsigned long) timing.total
+    );
+    if ( (length < 0) || (length >= (int) sizeof(txPayload)) ) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    return publish(MQTT_TX_CONNECTION_REPORT, txPayload);
+}
+
+/**
+ * @brief Transmits a chunk of a captured trace.
+ * 
+ * @param sequence Sequence number of the chunk, so the receiver can detect gaps.
+ * @param data Bytes of the chunk.
+ * @param length Length of the chunk in bytes.
+ * @return esp_err_t Return code.
+ */
+esp_err_t MqttManager::txTraceChunk(uint32_t sequence, const uint8_t *data, uint16_t length) {
+    esp_err_t err = codecEncodeTraceChunk(sequence, data, length, txPayload, sizeof(txPayload));
+    if (err != ESP_OK) return err;
+
+    return publish(MQTT_TX_TRACE_CHUNK, txPayload);
+}
+
+/**
+ * @brief Transmits the margins of the memory and the peak depths of the message queues.
+ * Unavailable margins are left out.
+ * 
+ * @param report The memory margins.
+ * @return esp_err_t Return code.
+ */
+esp_err_t MqttManager::txResourceReport(ResourceReport_t &report) {
+    MqttQueueStats_t queues = {};
+    size_t length = 0;
+    int written = 0;
+    bool first = true;
+
+    getQueueStats(queues);
+    written = snprintf(txPayload, 
+        sizeof(txPayload), 
+        "{\"rxPeak\":%u,\"rxDropped\":%lu,\"txPeak\":%u,\"txDropped\":%lu",
+        queues.rxPeak,
+        (unsigned long) queues.rxDropped,
+        queues.txPeak,
+        (unsigned long) queues.txDropped
+    );
+    if ( (written < 0) || (written >= (int) sizeof(txPayload)) ) goto err;
+    length = written;
+
+    if (report.heapAvailable) {
+        written = snprintf(txPayload + length, 
+            sizeof(txPayload) - length, 
+            ",\"free\":%lu,\"minFree\":%lu,\"largest\":%lu,\"minLargest\":%lu",
+            (unsigned long) report.heapFree,
+            (unsigned long) report.heapMinimumFree,
+            (unsigned long) report.heapLargestBlock,
+            (unsigned long) report.heapMinimumLargestBlock
+        );
+        if ( (written < 0) || (written >= (int) (sizeof(txPayload) - length)) ) goto err;
+        length += written;
+    }
+
+    /** Least free stack of each task, in bytes. */
+    for (int i = 0; i < RESOURCE_TASK_COUNT; i++) {
+        if (report.stackHighWater[i] < 0) {
+            continue;
+        }
+        written = snprintf(txPayload + length, 
+            sizeof(txPayload) - length, 
+            "%s\"%s\":%ld",
+            first ? ",\"stack\":{" : ",",
+            RESOURCE_TASKS[i],
+            (long) report.stackHighWater[i]
+        );
+        if ( (written < 0) || (written >= (int) (sizeof(txPayload) - length)) ) goto err;
+        length += written;
+        first = false;
+    }
+
+    written = snprintf(txPayload + length, sizeof(txPayload) - length, "%s}", first ? "" : "}");
+    if ( (written < 0) || (written >= (int) (sizeof(txPayload) - length)) ) goto err;
+
+    return publish(MQTT_TX_RESOURCE_REPORT, txPayload);
+
+err:
+    return ESP_ERR_INVALID_SIZE;
+}
+
+/**
+ * @brief Reads the peak depths of the message queues since boot.
+ * 
+ * @param stats Overwritten with the queue statistics.
+ */
+void MqttManager::getQueueStats(MqttQueueStats_t &stats) {
+    stats.rxPeak = rxPeak;
+    stats.rxDropped = rxDropped;
+    stats.txPeak = txPeak;
+    stats.txDropped = txDroppedTotal;
+}
+
+/**
+ * @brief Handles events of the MQTT client. Runs on the task of the client.
+ */
+void MqttManager::onEvent(void *arg, HalMqttEvent_t &event) {
+    MqttManager *self = static_cast<MqttManager*>(arg);
+    MqttRxQueueItem_t item = {};
+    bool queued = false;
+
+    switch (event.id) {
+        case HAL_MQTT_EVENT_CONNECTED:
+            self->onConnected(event.sessionPresent);
+
+            /** Let the FSM task flush the buffer, so publishing stays on a single task. The event
+             * has a slot of its own, and one waiting covers any reconnection before it is handled. */
+            if (self->connectedQueued == false) {
+                item.messageCode = MQTT_RX_CONNECTED;
+                self->connectedQueued = true;
+                self->countReceived(halQueueSend(self->rxQueue, &item));
+            }
+            break;
+
+        case HAL_MQTT_EVENT_DISCONNECTED:
+            /** Only a flag, so it is never lost to a full queue. */
+            self->connected = false;
+            break;
+
+        case HAL_MQTT_EVENT_DATA:
+            /** Fragmented and oversized payloads are not supported. */
+            if ( (event.offset != 0) || (event.dataLength != event.totalLength) || (event.dataLength >= RX_PAYLOAD_MAX_BYTES) ) {
+                ESP_LOGW(TAG, "Dropped oversized message of %d bytes.", event.totalLength);
+                break;
+            }
+            item.messageCode = codecMatchTopic(self->baseTopic, event.topic, event.topicLength);
+            if (item.messageCode == MQTT_RX_MIN) {
+                break;
+            }
+            item.length = event.dataLength;
+            memcpy(item.data, event.data, event.dataLength);
+            item.data[event.dataLength] = '\0';
+            if (halQueueCount(self->rxQueue) < RX_QUEUE_LENGTH - RX_CONTROL_SLOTS) {
+                queued = halQueueSend(self->rxQueue, &item);
+            }
+            self->countReceived(queued);
+            if (queued == false) {
+                ESP_LOGW(TAG, "Receive queue full, dropped message %d.", item.messageCode);
+                self->dropReceived(item);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Updates the statistics of the receive queue after queueing a message.
+ * Runs on the task of the client.
+ * 
+ * @param queued If false, the queue was full and the message was dropped.
+ */
+void MqttManager::countReceived(bool queued) {
+    uint8_t depth = halQueueCount(rxQueue);
+
+    if (queued == false) {
+        rxDropped = rxDropped + 1;
+    }
+    if (depth > rxPeak) {
+        rxPeak = depth;
+    }
+}
+
+/**
+ * @brief Records a command dropped by the full receive queue, so the FSM task rejects it.
+ * Runs on the task of the client.
+ * 
+ * @param item The dropped message.
+ */
+void MqttManager::dropReceived(MqttRxQueueItem_t &item) {
+    uint8_t next = (rxRejectHead + 1) % RX_REJECT_LENGTH;
+    MqttRxReject_t &reject = rxRejects[rxRejectHead];
+
+    /** With the ring full too, the command is only counted. */
+    if (next == rxRejectTail) {
+        return;
+    }
+    reject.messageCode = item.messageCode;
+    reject.jobId = 0;
+    codecGetUint(item.data, "id", reject.jobId);
+    rxRejectHead = next;
+}
+
+/**
+ * @brief Publishes a rejection of each command dropped by the full receive queue.
+ * Runs on the FSM task.
+ */
+void MqttManager::rejectDropped() {
+    char message[64];
+    MqttRxReject_t *reject = nullptr;
+
+    while (rxRejectTail != rxRejectHead) {
+        reject = &rxRejects[rxRejectTail];
+        if (reject->jobId != 0) {
+            snprintf(message, sizeof(message), "Receive queue full, rejected job %lu.", (unsigned long) reject->jobId);
+        } else {
+            snprintf(message, sizeof(message), "Receive queue full, rejected message %d.", reject->messageCode);
+        }
+        txWarning(TAG, message);
+        rxRejectTail = (rxRejectTail + 1) % RX_REJECT_LENGTH;
+    }
+}
+
+/**
+ * @brief Handles the broker accepting the connection. Subscriptions are
+ * only renewed if the broker did not keep the session of this config generation.
+ * 
+ * @param sessionPresent If true, the broker resumed the previous session.
+ */
+void MqttManager::onConnected(bool sessionPresent) {
+    bool resumed = sessionPresent && (rtcSession.magic == MQTT_SESSION_MAGIC) && (rtcSession.configGeneration == configGeneration);
+
+    if (resumed == false) {
+        if (subscribe() == ESP_OK) {
+            rtcSession.configGeneration = configGeneration;
+            rtcSession.magic = MQTT_SESSION_MAGIC;
+        } else {
+            rtcSession.magic = 0;
+        }
+    }
+
+    ESP_LOGI(TAG, "Connected, session %s.", resumed ? "resumed" : "renewed");
+    sessionResumed = resumed;
+    connected = true;
+}
+
+/**
+ * @brief Subscribes to the topics of every received message.
+ * 
+ * @return esp_err_t Return code.
+ */
+esp_err_t MqttManager::subscribe() {
+    esp_err_t err = ESP_OK;
+    /** Runs on the client task, so the topic buffer of the FSM task is not used. */
+    char rxTopic[MQTT_TOPIC_MAX_BYTES];
+
+    for (int i = MQTT_RX_MIN + 1; i < MQTT_RX_MAX; i++) {
+        if (MQTT_RX_TOPICS[i] == nullptr) {
+            continue;
+        }
+
+        snprintf(rxTopic, sizeof(rxTopic), "%s%s", baseTopic, MQTT_RX_TOPICS[i]);
+        if (halMqttSubscribe(client, rxTopic, 1) < 0) {
+            ESP_LOGW(TAG, "Failed to subscribe to %s.", rxTopic);
+            err = ESP_FAIL;
+        }
+    }
+
+    return err;
+}
+
+/**
+ * @brief Writes the full topic of a message into the topic buffer.
+ * 
+ * @param suffix Topic suffix of the message.
+ * @return esp_err_t Return code.
+ */
+esp_err_t MqttManager::buildTopic(const char *suffix) {
+    int length = 0;
+
+    if (suffix == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    length = snprintf(topic, sizeof(topic), "%s%s", baseTopic, suffix);
+    if ( (length < 0) || (length >= (int) sizeof(topic)) ) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
     return ESP_OK;
 }
+
+/**
+ * @brief Transmits a log message.
+ * 
+ * @param messageCode The log type.
+ * @param tag Tag of the sender.
+ * @param message Log message.
+ * @return esp_err_t Return code.
+ */
+esp_err_t MqttManager::txLog(MqttTxMessages_e messageCode, const char *tag, const char *message) {
+    char log[TX_PAYLOAD_MAX_BYTES];
+    int length = 0;
+
+    length = snprintf(log, sizeof(log), "{\"m\":\"%s: %s\"}", tag, message);
+    if (length < 0) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (length >= (int) sizeof(log)) {
+        /** Truncate long messages but keep the payload valid. */
+        length = sizeof(log) - 1;
+        log[length - 2] = '"';
+        log[length - 1] = '}';
+    }
+    /** Quotes in the message are replaced, as the payload is not escaped. */
+    for (int i = 6; i < length - 2; i++) {
+        if ( (log[i] == '"') || (log[i] == '\\') ) {
+            log[i] = '\'';
+        }
+    }
+
+    return publish(messageCode, log);
+}
+
+/**
+ * @brief Publishes a payload to the topic of the message, or buffers it
+ * while disconnected.
+ * 
+ * @param messageCode The message type.
+ * @param payload Null-terminated payload.
+ * @return esp_err_t Return code.
+ */
+esp_err_t MqttManager::publish(MqttTxMessages_e messageCode, const char *payload) {
+    esp_err_t err = ESP_OK;
+    MqttTxBufferItem_t *item = nullptr;
+
+    if ( (messageCode <= MQTT_TX_MIN) || (messageCode >= MQTT_TX_MAX) ) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    /** The client outbox holds QoS 1 messages until acknowledged. Only the config is retained. */
+    if (connected && (txBufferCount == 0)) {
+        err = buildTopic(MQTT_TX_TOPICS[messageCode]);
+        if (err != ESP_OK) return err;
+
+        if (halMqttEnqueue(client, topic, payload, 1, messageCode == MQTT_TX_READ_CONFIG) >= 0) {
+            return ESP_OK;
+        }
+    }
+
+    /** Buffer while disconnected, dropping the oldest message when full. */
+    if (txBufferCount == TX_BUFFER_LENGTH) {
+        txBufferHead = (txBufferHead + 1) % TX_BUFFER_LENGTH;
+        txBufferCount--;
+        txDropped++;
+        txDroppedTotal++;
+    }
+    item = &txBuffer[(txBufferHead + txBufferCount) % TX_BUFFER_LENGTH];
+    item->messageCode = messageCode;
+    strlcpy(item->data, payload, sizeof(item->data));
+    txBufferCount++;
+    if (txBufferCount > txPeak) {
+        txPeak = txBufferCount;
+    }
+
+    return ESP_OK;
+}
\ No newline at end of file
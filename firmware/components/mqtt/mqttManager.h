@@ -1,13 +1,76 @@
 #ifndef MQTT_MANAGER_H
 #define MQTT_MANAGER_H
 
+#include "halMqtt.h"
+#include "halQueue.h"
+
 #include "messages.h"
+#include "topics.h"
 #include "valveManager.h"
+#include "powerManager.h"
+#include "connectionManager.h"
+#include "jobQueue.h"
+#include "processJournal.h"
+#include "resourceManager.h"
 
 #define RX_PAYLOAD_MAX_BYTES 512
+/** Slots of the receive queue kept free of commands, for the connection event. */
+#define RX_CONTROL_SLOTS 1
+/** A full job queue, a few requests and the connection event fit the receive queue. */
+#define RX_QUEUE_LENGTH (JOB_QUEUE_LENGTH + 3 + RX_CONTROL_SLOTS)
+/** Number of commands dropped by a full receive queue which are still to be rejected. */
+#define RX_REJECT_LENGTH 8
+#define TX_PAYLOAD_MAX_BYTES 256
+/** Number of transmitted messages buffered while disconnected. The oldest is dropped when full. */
+#define TX_BUFFER_LENGTH 8
+
+/**
+ * @brief Describes a received message waiting in the queue
+ * before its payload has been decoded.
+ */
+typedef struct MqttRxQueueItem_t {
+    MqttRxMessages_e messageCode;
+    uint16_t length;
+    char data[RX_PAYLOAD_MAX_BYTES];
+} MqttRxQueueItem_t;
+
+/**
+ * @brief Describes a command dropped by the full receive queue, to be rejected by the FSM task.
+ */
+typedef struct MqttRxReject_t {
+    MqttRxMessages_e messageCode;
+    /** ID of the job the command carried, or zero. */
+    uint32_t jobId;
+} MqttRxReject_t;
+
+/**
+ * @brief Describes a transmitted message buffered while disconnected.
+ */
+typedef struct MqttTxBufferItem_t {
+    MqttTxMessages_e messageCode;
+    char data[TX_PAYLOAD_MAX_BYTES];
+} MqttTxBufferItem_t;
+
+/**
+ * @brief Describes the peak depths of the message queues since boot.
+ */
+typedef struct MqttQueueStats_t {
+    /** Most received messages waiting for the FSM, of RX_QUEUE_LENGTH. */
+    uint8_t rxPeak = 0;
+    /** Received messages dropped as the queue was full. */
+    uint32_t rxDropped = 0;
+    /** Most transmitted messages buffered while disconnected, of TX_BUFFER_LENGTH. */
+    uint8_t txPeak = 0;
+    /** Transmitted messages dropped as the buffer was full. */
+    uint32_t txDropped = 0;
+} MqttQueueStats_t;
 
 /**
  * @brief Handles transmitting and receiving MQTT messages.
+ *
+ * The connection event is queued once however often the client reconnects before it is handled,
+ * and a disconnection is only a flag, so the receive queue holds commands and requests. A command
+ * dropped by the full queue is remembered and rejected once the FSM task next reads the queue.
  */
 class MqttManager {
 public:
@@ -17,11 +80,14 @@ public:
     MqttManager();
 
     /**
-     * @brief Begin the MqttManager.s
+     * @brief Begin the MqttManager. Received messages are queued from
+     * the events of the client.
      * 
+     * @param client MQTT client, owned by the ConnectionManager.
+     * @param baseTopic Prefix of every topic.
      * @return esp_err_t Return code. 
      */
-    esp_err_t initialize();
+    esp_err_t initialize(HalMqttClient_t client, const char *baseTopic);
 
     /**
      * @brief Get the checkedForMessages flagged.
@@ -35,14 +101,53 @@ public:
      * the queue.
      */
     uint8_t numMessagesInQueue();
+
+    /**
+     * @brief Blocks the calling task until a message is received
+     * or the timeout elapses. While blocked, the chip may enter
+     * automatic light sleep.
+     * 
+     * @param timeout Maximum time to wait in miliseconds.
+     * @returns True if a message is waiting in the queue.
+     */
+    bool waitForMessage(uint32_t timeout);
     
     /**
-     * @brief Pull the next incoming MQTT message from the queue.
+     * @brief Pull the next incoming MQTT message from the queue
+     * and decode its payload.
      * 
-     * @param Pointer to the message object.
+     * @param message Set to the decoded message, valid until the next call.
      * @return esp_err_t Return code.
      */
-    esp_err_t getNextMessage(MqttRxMessage_t* message);
+    esp_err_t getNextMessage(MqttRxMessage_t* &message);
+
+    /**
+     * @brief Sets the config generation the subscriptions and the retained
+     * config are synchronized to on the next connection.
+     * 
+     * @param generation Current config generation.
+     */
+    void setConfigGeneration(uint32_t generation);
+
+    /**
+     * @brief If true, the last connection resumed a persistent session
+     * of the current config generation, so the subscriptions were kept and
+     * the retained config is up to date.
+     */
+    bool isSessionResumed();
+
+    /**
+     * @brief If true, a transmitted message has not yet reached the broker while connected.
+     * Messages buffered while disconnected are not counted, as they wait for the next connection.
+     */
+    bool isPublishPending();
+
+    /**
+     * @brief Publishes the messages buffered while disconnected, oldest first.
+     * 
+     * @return esp_err_t Return code.
+     */
+    esp_err_t flush();
 
     /**
      * @brief Transmit an info log.
@@ -77,19 +182,215 @@ public:
     esp_err_t txDispenseSlice(DispenseProcess_t &slice);
 
     /**
-     * @brief Transmits a summary of the dispense process variables.
+     * @brief Transmits a summary of the dispense process variables of one zone.
      * 
      * @param summary The variables.
      * @return esp_err_t Return code. 
      */
     esp_err_t txDispenseSummary(DispenseSummary_t &summary);
 
+    /**
+     * @brief Transmits a summary of the drain process variables.
+     * 
+     * @param summary The variables.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t txDrainSummary(DrainSummary_t &summary);
+
+    /**
+     * @brief Transmits the active job and the jobs waiting behind it.
+     * 
+     * @param status The queue status.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t txQueueStatus(JobQueueStatus_t &status);
+
+    /**
+     * @brief Transmits the summary of a dispense process interrupted before the last boot.
+     * 
+     * @param recovery The interrupted process.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t txRecovery(ProcessRecovery_t &recovery);
+
+    /**
+     * @brief Transmits the latency of the supply valves measured by the characterisation process.
+     * 
+     * @param summary The measurements.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t txValveLatency(CharacteriseSummary_t &summary);
+
+    /**
+     * @brief Transmits a reading of the pressure sensor.
+     * 
+     * @param millivolts Sensor voltage.
+     * @param volume Tank volume in liters.
+     * @param calibrated If false, the volume is unknown and left out.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t txPressureReport(uint16_t millivolts, float volume, bool calibrated);
+
+    /**
+     * @brief Transmits the config as a retained message.
+     * 
+     * @param config The config.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t txConfig(Config_t &config);
+
+    /**
+     * @brief Transmits the time spent in each power state.
+     * 
+     * @param stats The power statistics.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t txPowerReport(PowerStats_t &stats);
+
+    /**
+     * @brief Transmits the wake to command readiness latency.
+     * 
+     * @param report The wake report.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t txWakeReport(WakeReport_t &report);
+
+    /**
+     * @brief Transmits the duration of each phase of the last connection.
+     * 
+     * @param timing The connection timing.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t txConnectionReport(ConnectionTiming_t &timing);
+
+    /**
+     * @brief Transmits a chunk of a captured trace.
+     * 
+     * @param sequence Sequence number of the chunk, so the receiver can detect gaps.
+     * @param data Bytes of the chunk.
+     * @param length Length of the chunk in bytes.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t txTraceChunk(uint32_t sequence, const uint8_t *data, uint16_t length);
+
+    /**
+     * @brief Transmits the margins of the memory and the peak depths of the message queues.
+     * 
+     * @param report The memory margins.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t txResourceReport(ResourceReport_t &report);
+
+    /**
+     * @brief Reads the peak depths of the message queues since boot.
+     * 
+     * @param stats Overwritten with the queue statistics.
+     */
+    void getQueueStats(MqttQueueStats_t &stats);
+
     
 private:
     /** If true, the manager has checked for messages at least once. */
     bool _checkedForMessages;
+    HalMqttClient_t client;
+    char baseTopic[MQTT_TOPIC_MAX_BYTES];
+    volatile bool connected;
+    volatile bool sessionResumed;
+    uint32_t configGeneration;
+    HalQueue_t rxQueue;
+    MqttRxQueueItem_t rxItem;
     MqttRxMessage_t rxMessage;
-    char rxPayload[RX_PAYLOAD_MAX_BYTES]; 
+    /** Set while the connection event waits in the receive queue, so it is queued once. */
+    volatile bool connectedQueued;
+    /** Ring of dropped commands, written by the client task and read by the FSM task. */
+    MqttRxReject_t rxRejects[RX_REJECT_LENGTH];
+    volatile uint8_t rxRejectHead;
+    volatile uint8_t rxRejectTail;
+    alignas(4) char rxPayload[RX_PAYLOAD_MAX_BYTES]; 
+    char txPayload[TX_PAYLOAD_MAX_BYTES];
+    char topic[MQTT_TOPIC_MAX_BYTES];
+
+    /** Ring buffer of messages transmitted while disconnected. */
+    MqttTxBufferItem_t txBuffer[TX_BUFFER_LENGTH];
+    uint8_t txBufferHead;
+    uint8_t txBufferCount;
+    uint32_t txDropped;
+
+    /** Queue statistics. The receive queue is filled from the client task. */
+    volatile uint8_t rxPeak;
+    volatile uint32_t rxDropped;
+    uint8_t txPeak;
+    uint32_t txDroppedTotal;
+
+    /**
+     * @brief Handles events of the MQTT client. Runs on the task of the client.
+     */
+    static void onEvent(void *arg, HalMqttEvent_t &event);
+
+    /**
+     * @brief Updates the statistics of the receive queue after queueing a message.
+     * Runs on the task of the client.
+     * 
+     * @param queued If false, the queue was full and the message was dropped.
+     */
+    void countReceived(bool queued);
+
+    /**
+     * @brief Records a command dropped by the full receive queue, so the FSM task rejects it.
+     * Runs on the task of the client.
+     * 
+     * @param item The dropped message.
+     */
+    void dropReceived(MqttRxQueueItem_t &item);
+
+    /**
+     * @brief Publishes a rejection of each command dropped by the full receive queue.
+     * Runs on the FSM task.
+     */
+    void rejectDropped();
+
+    /**
+     * @brief Handles the broker accepting the connection. Subscriptions are
+     * only renewed if the broker did not keep the session of this config generation.
+     * 
+     * @param sessionPresent If true, the broker resumed the previous session.
+     */
+    void onConnected(bool sessionPresent);
+
+    /**
+     * @brief Subscribes to the topics of every received message.
+     * 
+     * @return esp_err_t Return code.
+     */
+    esp_err_t subscribe();
+
+    /**
+     * @brief Writes the full topic of a message into the topic buffer.
+     * 
+     * @param suffix Topic suffix of the message.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t buildTopic(const char *suffix);
+
+    /**
+     * @brief Transmits a log message.
+     * 
+     * @param messageCode The log type.
+     * @param tag Tag of the sender.
+     * @param message Log message.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t txLog(MqttTxMessages_e messageCode, const char *tag, const char *message);
+
+    /**
+     * @brief Publishes a payload to the topic of the message, or buffers it
+     * while disconnected.
+     * 
+     * @param messageCode The message type.
+     * @param payload Null-terminated payload.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t publish(MqttTxMessages_e messageCode, const char *payload);
 
 };
 
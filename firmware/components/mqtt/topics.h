@@ -0,0 +1,55 @@
+#ifndef MQTT_TOPICS_H
+#define MQTT_TOPICS_H
+
+#include "messages.h"
+#include "operatingMode.h"
+
+/** Maximum length of a full topic, including the base topic. */
+#define MQTT_TOPIC_MAX_BYTES 64
+
+/**
+ * @brief Topic suffixes of received messages, in the order of MqttRxMessages_e.
+ * Appended to the base topic. Null for messages without a topic, and for the
+ * commands of a drain or sensor the operating mode leaves out, so they are not subscribed to.
+ */
+static const char* const MQTT_RX_TOPICS[MQTT_RX_MAX] = {
+    nullptr,
+    "out/on",
+    "off",
+    "restart",
+    "config/change",
+    "flow/calibrate",
+    DripMode::PRESSURE ? "pressure/calibrate" : nullptr,
+    DripMode::DRAIN ? "drain/on" : nullptr,
+    DripMode::PRESSURE ? "pressure/request" : nullptr,
+    "valves/characterise",
+    "trace/capture",
+    "resources/request",
+    nullptr
+};
+
+/**
+ * @brief Topic suffixes of transmitted messages, in the order of MqttTxMessages_e.
+ * Appended to the base topic.
+ */
+static const char* const MQTT_TX_TOPICS[MQTT_TX_MAX] = {
+    nullptr,
+    "out/log/sl",
+    "out/log/sm",
+    "log/info",
+    "log/warning",
+    "log/error",
+    "config",
+    "drain/log",
+    "pressure/report",
+    "diagnostics/power",
+    "diagnostics/wake",
+    "diagnostics/connection",
+    "queue/status",
+    "valves/latency",
+    "trace/data",
+    "diagnostics/resources",
+    "out/log/rcv"
+};
+
+#endif
\ No newline at end of file
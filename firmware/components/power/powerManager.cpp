@@ -0,0 +1,350 @@
+#include <sys/time.h>
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "halPower.h"
+#include "halSystem.h"
+#include "halTime.h"
+
+#include "powerManager.h"
+
+static const char* TAG = "PowerManager";
+
+/** Marks the retained state as valid. */
+#define POWER_RTC_MAGIC 0x51EE9A7E
+
+/**
+ * @brief State retained in RTC memory through deep sleep.
+ */
+typedef struct PowerRtcState_t {
+    uint32_t magic;
+    uint32_t wakeCount;
+    uint32_t configGeneration;
+    /** Wall clock time of the scheduled timer wake, in microseconds. */
+    int64_t scheduledWakeTime;
+} PowerRtcState_t;
+
+static RTC_DATA_ATTR PowerRtcState_t rtcState;
+
+/** Light sleep accounting, updated from the sleep exit callback. */
+static volatile int64_t lightSleepTimeUs = 0;
+static volatile uint32_t lightSleepCount = 0;
+
+/**
+ * @brief Called by the power management driver on exit from light sleep.
+ * Runs with interrupts disabled, so only accumulates counters.
+ *
+ * @param sleepTimeUs Time spent in light sleep, in microseconds.
+ */
+static IRAM_ATTR void onLightSleepExit(int64_t sleepTimeUs) {
+    lightSleepTimeUs += sleepTimeUs;
+    lightSleepCount++;
+}
+
+/**
+ * @brief Returns the wall clock time in microseconds. The wall clock is
+ * driven by the RTC timer, so it keeps counting through deep sleep.
+ */
+static int64_t wallTimeUs() {
+    struct timeval now = {};
+    gettimeofday(&now, nullptr);
+    return ((int64_t) now.tv_sec * 1000000) + now.tv_usec;
+}
+
+/**
+ * @brief Returns the difference between two timestamps in miliseconds,
+ * or zero if either timestamp is missing or the difference is negative.
+ */
+static uint32_t elapsedMs(int64_t start, int64_t end) {
+    if ( (start <= 0) || (end <= start) ) {
+        return 0;
+    }
+    return (end - start) / 1000;
+}
+
+/**
+ * @brief Constructor.
+ */
+PowerManager::PowerManager() {
+    active = false;
+    lightSleepEnabled = true;
+    cpuFreqLock = nullptr;
+    noSleepLock = nullptr;
+    statsStartTime = 0;
+    stateStartTime = 0;
+    activeTime = 0;
+    awakeTime = 0;
+    for (int i = 0; i < BOOT_PHASES_MAX; i++) {
+        bootPhaseTimes[i] = 0;
+    }
+    bootPhaseTimes[BOOT_PHASE_APP_START] = halTimeMicros();
+    appStartWallTime = wallTimeUs();
+    _wokeFromDeepSleep = false;
+}
+
+/**
+ * @brief Begin the PowerManager. Configures the power management
+ * driver and creates the locks held while a process is active.
+ *
+ * @return esp_err_t Return code.
+ */
+esp_err_t PowerManager::initialize() {
+    esp_err_t err = ESP_OK;
+
+    /** Create the locks held while a process is active. */
+    err = halPowerLockCreate(HAL_POWER_LOCK_CPU_FREQ_MAX, "process", &cpuFreqLock);
+    if (err != ESP_OK) return err;
+
+    err = halPowerLockCreate(HAL_POWER_LOCK_NO_LIGHT_SLEEP, "process", &noSleepLock);
+    if (err != ESP_OK) return err;
+
+    /** Track time spent in light sleep. */
+    err = halPowerOnLightSleepExit(&onLightSleepExit);
+    if (err != ESP_OK) return err;
+
+    statsStartTime = halTimeMicros();
+    stateStartTime = statsStartTime;
+
+    /** RTC_DATA_ATTR memory is zeroed on cold boot and retained through deep sleep. */
+    _wokeFromDeepSleep = halResetWasDeepSleep() && (rtcState.magic == POWER_RTC_MAGIC);
+    if (_wokeFromDeepSleep) {
+        rtcState.wakeCount++;
+    } else {
+        rtcState = {};
+    }
+
+    /** Start idle. The FSM acquires the locks once a process begins. */
+    active = false;
+    return applyPmConfig();
+}
+
+/**
+ * @brief Applies the system config. Automatic light sleep is
+ * only allowed if enabled in the config.
+ *
+ * @param config System config.
+ * @return esp_err_t Return code.
+ */
+esp_err_t PowerManager::configure(SystemConfig_t &config) {
+    if (config.lightSleepEnabled == lightSleepEnabled) {
+        return ESP_OK;
+    }
+
+    lightSleepEnabled = config.lightSleepEnabled;
+    return applyPmConfig();
+}
+
+/**
+ * @brief Acquires the power locks for an active process.
+ * Has no effect if the locks are already held.
+ *
+ * @return esp_err_t Return code.
+ */
+esp_err_t PowerManager::beginActive() {
+    esp_err_t err = ESP_OK;
+    int64_t now = 0;
+
+    if (active) {
+        return ESP_OK;
+    }
+
+    err = halPowerLockAcquire(cpuFreqLock);
+    if (err != ESP_OK) return err;
+
+    err = halPowerLockAcquire(noSleepLock);
+    if (err != ESP_OK) {
+        halPowerLockRelease(cpuFreqLock);
+        return err;
+    }
+
+    now = halTimeMicros();
+    awakeTime += now - stateStartTime;
+    stateStartTime = now;
+    active = true;
+    return ESP_OK;
+}
+
+/**
+ * @brief Releases the power locks, allowing frequency scaling
+ * and automatic light sleep. Has no effect if the locks are not held.
+ *
+ * @return esp_err_t Return code.
+ */
+esp_err_t PowerManager::endActive() {
+    esp_err_t err = ESP_OK;
+    int64_t now = 0;
+
+    if (!active) {
+        return ESP_OK;
+    }
+
+    now = halTimeMicros();
+    activeTime += now - stateStartTime;
+    stateStartTime = now;
+    active = false;
+
+    err = halPowerLockRelease(noSleepLock);
+    if (err != ESP_OK) return err;
+
+    return halPowerLockRelease(cpuFreqLock);
+}
+
+/**
+ * @brief Retrieves the time spent in each power state.
+ *
+ * @param stats Overwritten with the accumulated stats.
+ * @param reset If true, the accumulated stats are reset after retrieval.
+ * @return esp_err_t Return code.
+ */
+esp_err_t PowerManager::getStats(PowerStats_t &stats, bool reset) {
+    int64_t now = halTimeMicros();
+    int64_t currentActive = activeTime;
+    int64_t currentAwake = awakeTime;
+    int64_t sleepTime = lightSleepTimeUs;
+
+    /** Include the time spent in the current state. */
+    if (active) {
+        currentActive += now - stateStartTime;
+    } else {
+        currentAwake += now - stateStartTime;
+    }
+
+    /** Light sleep only happens while not active, so it is a subset of the awake time. */
+    stats.uptime = (now - statsStartTime) / 1000;
+    stats.activeTime = currentActive / 1000;
+    stats.lightSleepTime = sleepTime / 1000;
+    stats.idleTime = (currentAwake > sleepTime) ? (currentAwake - sleepTime) / 1000 : 0;
+    stats.lightSleepCount = lightSleepCount;
+
+    if (reset) {
+        statsStartTime = now;
+        stateStartTime = now;
+        activeTime = 0;
+        awakeTime = 0;
+        lightSleepTimeUs = 0;
+        lightSleepCount = 0;
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief If true, the device booted from deep sleep with valid retained state.
+ */
+bool PowerManager::wokeFromDeepSleep() {
+    return _wokeFromDeepSleep;
+}
+
+/**
+ * @brief Returns the config generation retained through deep sleep.
+ * Only valid if wokeFromDeepSleep() is true.
+ */
+uint32_t PowerManager::getRetainedConfigGeneration() {
+    return rtcState.configGeneration;
+}
+
+/**
+ * @brief Records the time at which a boot phase completed.
+ * 
+ * @param phase The completed phase.
+ */
+void PowerManager::markBootPhase(BootPhases_e phase) {
+    if ( (phase >= BOOT_PHASES_MAX) || (bootPhaseTimes[phase] != 0) ) {
+        return;
+    }
+    bootPhaseTimes[phase] = halTimeMicros();
+}
+
+/**
+ * @brief Retrieves the wake latency and its breakdown by boot phase.
+ * 
+ * @param report Overwritten with the report.
+ * @param configRestored If true, the config was restored from RTC memory.
+ * @return esp_err_t Return code.
+ */
+esp_err_t PowerManager::getWakeReport(WakeReport_t &report, bool configRestored) {
+    int64_t appStart = bootPhaseTimes[BOOT_PHASE_APP_START];
+    int64_t timerStartWallTime = appStartWallTime - appStart;
+    int64_t readyWallTime = 0;
+
+    report = {};
+    report.wakeCause = halSleepGetWakeCause();
+    report.wakeCount = rtcState.wakeCount;
+    report.configRestored = configRestored;
+    report.configTime = elapsedMs(appStart, bootPhaseTimes[BOOT_PHASE_CONFIG]);
+    report.networkTime = elapsedMs(bootPhaseTimes[BOOT_PHASE_CONFIG], bootPhaseTimes[BOOT_PHASE_NETWORK]);
+    report.readyTime = elapsedMs(bootPhaseTimes[BOOT_PHASE_NETWORK], bootPhaseTimes[BOOT_PHASE_READY]);
+
+    /** The absolute wake time is only known for timer wakes. */
+    if (_wokeFromDeepSleep && halSleepWokeByTimer() && (bootPhaseTimes[BOOT_PHASE_READY] != 0)) {
+        readyWallTime = appStartWallTime + (bootPhaseTimes[BOOT_PHASE_READY] - appStart);
+        report.bootloaderTime = elapsedMs(rtcState.scheduledWakeTime, timerStartWallTime);
+        report.wakeToReady = elapsedMs(rtcState.scheduledWakeTime, readyWallTime);
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Retains the config generation in RTC memory, 
+ * configures the timer and GPIO wake sources, and enters deep sleep.
+ * Does not return on success.
+ * 
+ * @param config System config.
+ * @param maxDuration Upper bound of the sleep in miliseconds, e.g. until the next
+ * scheduled job. Zero to sleep for the full sleep interval.
+ * @param configGeneration Current config generation.
+ * @return esp_err_t Return code.
+ */
+esp_err_t PowerManager::enterDeepSleep(SystemConfig_t &config, uint32_t maxDuration, uint32_t configGeneration) {
+    esp_err_t err = ESP_OK;
+    uint64_t duration = (uint64_t) config.sleepInterval * 1000000;
+
+    if ( (maxDuration > 0) && (duration > (uint64_t) maxDuration * 1000) ) {
+        duration = (uint64_t) maxDuration * 1000;
+    }
+    if (duration == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    err = halSleepEnableTimerWakeup(duration);
+    if (err != ESP_OK) return err;
+
+    if (config.wakeGpio >= 0) {
+        err = halSleepEnableGpioWakeup(config.wakeGpio);
+        if (err == ESP_ERR_INVALID_ARG) {
+            ESP_LOGE(TAG, "GPIO %d cannot wake from deep sleep.", config.wakeGpio);
+        }
+        if (err != ESP_OK) return err;
+    }
+
+    rtcState.configGeneration = configGeneration;
+    rtcState.scheduledWakeTime = wallTimeUs() + duration;
+    rtcState.magic = POWER_RTC_MAGIC;
+
+    ESP_LOGI(TAG, "Entering deep sleep for %lu ms.", (unsigned long) (duration / 1000));
+    endActive();
+    halSleepStart();
+
+    /** Only reached on the host. */
+    return ESP_FAIL;
+}
+
+/**
+ * @brief Configures the power management driver with the current settings.
+ *
+ * @return esp_err_t Return code.
+ */
+esp_err_t PowerManager::applyPmConfig() {
+    esp_err_t err = ESP_OK;
+
+    err = halPowerConfigure(POWER_MAX_CPU_FREQ_MHZ, POWER_MIN_CPU_FREQ_MHZ, lightSleepEnabled);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to configure power management: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    ESP_LOGI(TAG, "Power management configured, light sleep %s.", lightSleepEnabled ? "enabled" : "disabled");
+    return ESP_OK;
+}
@@ -0,0 +1,209 @@
+#ifndef POWER_MANAGER_H
+#define POWER_MANAGER_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "halPower.h"
+
+#include "config.h"
+
+/** Maximum CPU frequency while a process is active, in MHz. */
+#define POWER_MAX_CPU_FREQ_MHZ 160
+/** Minimum CPU frequency while idle, in MHz. Must be the XTAL frequency or a divisor of it. */
+#define POWER_MIN_CPU_FREQ_MHZ 40
+
+/**
+ * @brief Describes the power states the device is accounted in.
+ */
+typedef enum PowerStates_e {
+    /** A process is active. CPU locked at maximum frequency, light sleep inhibited. */
+    POWER_ACTIVE,
+    /** No process is active. CPU frequency is scaled down, light sleep is allowed. */
+    POWER_IDLE,
+    /** The chip is in automatic light sleep. Subset of time not spent in POWER_ACTIVE. */
+    POWER_LIGHT_SLEEP,
+
+    POWER_STATES_MAX
+} PowerStates_e;
+
+/**
+ * @brief Describes the accumulated time spent in each power state.
+ */
+typedef struct PowerStats_t {
+    /** Time since the stats were last reset, in miliseconds. */
+    uint32_t uptime = 0;
+    /** Time with a process active, in miliseconds. */
+    uint32_t activeTime = 0;
+    /** Time awake without a process active, in miliseconds. */
+    uint32_t idleTime = 0;
+    /** Time in automatic light sleep, in miliseconds. */
+    uint32_t lightSleepTime = 0;
+    /** Number of times the chip entered light sleep. */
+    uint32_t lightSleepCount = 0;
+} PowerStats_t;
+
+/**
+ * @brief Describes the phases of boot timed towards command readiness.
+ */
+typedef enum BootPhases_e {
+    /** The application started. */
+    BOOT_PHASE_APP_START,
+    /** The config is loaded or restored. */
+    BOOT_PHASE_CONFIG,
+    /** WiFi and MQTT are connected. */
+    BOOT_PHASE_NETWORK,
+    /** The FSM is listening for commands. */
+    BOOT_PHASE_READY,
+
+    BOOT_PHASES_MAX
+} BootPhases_e;
+
+/**
+ * @brief Describes the latency from wake to command readiness.
+ */
+typedef struct WakeReport_t {
+    /** The wake cause, as esp_sleep_wakeup_cause_t. */
+    uint8_t wakeCause = 0;
+    /** Number of wakes from deep sleep since the last cold boot. */
+    uint32_t wakeCount = 0;
+    /** If true, the config was restored from RTC memory. */
+    bool configRestored = false;
+    /** 
+     * Time from the scheduled timer wake to command readiness, in miliseconds.
+     * Zero if the device was not woken by the timer.
+     */
+    uint32_t wakeToReady = 0;
+    /** Time from the scheduled timer wake to app start, spent in ROM and the bootloader, in miliseconds. */
+    uint32_t bootloaderTime = 0;
+    /** Time from app start to the config being available, in miliseconds. */
+    uint32_t configTime = 0;
+    /** Time from the config being available to the connection being established, in miliseconds. */
+    uint32_t networkTime = 0;
+    /** Time from the connection being established to the FSM listening, in miliseconds. */
+    uint32_t readyTime = 0;
+} WakeReport_t;
+
+/**
+ * @brief Handles dynamic frequency scaling, automatic light sleep,
+ * deep sleep, and accounting of the time spent in each power state.
+ *
+ * A maximum CPU frequency lock and a no-light-sleep lock are held in every state except
+ * STATE_LISTEN. While listening the FSM task blocks on the MQTT receive queue, so the chip
+ * scales down and sleeps between messages while WiFi stays associated through DTIM-aligned modem sleep.
+ */
+class PowerManager {
+public:
+    /**
+     * @brief Constructor.
+     */
+    PowerManager();
+
+    /**
+     * @brief Begin the PowerManager. Configures the power management
+     * driver and creates the locks held while a process is active.
+     *
+     * @return esp_err_t Return code.
+     */
+    esp_err_t initialize();
+
+    /**
+     * @brief Applies the system config. Automatic light sleep is
+     * only allowed if enabled in the config.
+     *
+     * @param config System config.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t configure(SystemConfig_t &config);
+
+    /**
+     * @brief Acquires the power locks for an active process.
+     * Has no effect if the locks are already held.
+     *
+     * @return esp_err_t Return code.
+     */
+    esp_err_t beginActive();
+
+    /**
+     * @brief Releases the power locks, allowing frequency scaling
+     * and automatic light sleep. Has no effect if the locks are not held.
+     *
+     * @return esp_err_t Return code.
+     */
+    esp_err_t endActive();
+
+    /**
+     * @brief Retrieves the time spent in each power state.
+     *
+     * @param stats Overwritten with the accumulated stats.
+     * @param reset If true, the accumulated stats are reset after retrieval.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t getStats(PowerStats_t &stats, bool reset);
+
+    /**
+     * @brief If true, the device booted from deep sleep with valid retained state.
+     */
+    bool wokeFromDeepSleep();
+
+    /**
+     * @brief Returns the config generation retained through deep sleep.
+     * Only valid if wokeFromDeepSleep() is true.
+     */
+    uint32_t getRetainedConfigGeneration();
+
+    /**
+     * @brief Records the time at which a boot phase completed.
+     * 
+     * @param phase The completed phase.
+     */
+    void markBootPhase(BootPhases_e phase);
+
+    /**
+     * @brief Retrieves the wake latency and its breakdown by boot phase.
+     * 
+     * @param report Overwritten with the report.
+     * @param configRestored If true, the config was restored from RTC memory.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t getWakeReport(WakeReport_t &report, bool configRestored);
+
+    /**
+     * @brief Retains the config generation in RTC memory, 
+     * configures the timer and GPIO wake sources, and enters deep sleep.
+     * Does not return on success.
+     * 
+     * @param config System config.
+     * @param maxDuration Upper bound of the sleep in miliseconds, e.g. until the next
+     * scheduled job. Zero to sleep for the full sleep interval.
+     * @param configGeneration Current config generation.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t enterDeepSleep(SystemConfig_t &config, uint32_t maxDuration, uint32_t configGeneration);
+
+private:
+    bool active;
+    bool lightSleepEnabled;
+    HalPowerLock_t cpuFreqLock;
+    HalPowerLock_t noSleepLock;
+
+    /** Timestamps in microseconds. */
+    int64_t statsStartTime;
+    int64_t stateStartTime;
+    /** Accumulated times in microseconds. */
+    int64_t activeTime;
+    int64_t awakeTime;
+    int64_t bootPhaseTimes[BOOT_PHASES_MAX];
+    /** Wall clock time of app start, in microseconds. */
+    int64_t appStartWallTime;
+    bool _wokeFromDeepSleep;
+
+    /**
+     * @brief Configures the power management driver with the current settings.
+     *
+     * @return esp_err_t Return code.
+     */
+    esp_err_t applyPmConfig();
+};
+
+#endif
@@ -0,0 +1,385 @@
+#include "esp_err.h"
+#include "esp_log.h"
+#include "halTime.h"
+
+#include "pressureCalibrator.h"
+#include "valveManager.h"
+
+static const char* TAG = "PressureCalibrator";
+
+/**
+ * @brief Constructor.
+ *
+ * @param valveManager Drains each calibration step.
+ * @param pressureManager Reads the sensor voltage.
+ */
+template <typename Mode>
+PressureCalibratorT<Mode>::PressureCalibratorT(ValveManagerT<Mode> *valveManager, PressureManager *pressureManager) {
+    this->valveManager = valveManager;
+    this->pressureManager = pressureManager;
+    tankPin = -1;
+    flowSensorPin = -1;
+    minFlowRate = 0;
+    state = PRESSURE_SENSOR_IDLE;
+    calibrationTarget = {};
+    calibrationProcess = {};
+    calibrationSummary = {};
+    measureStartTime = 0;
+    voltageSum = 0;
+    voltageCount = 0;
+    lastPoint = false;
+}
+
+/**
+ * @brief Begin the PressureCalibrator.
+ *
+ * @return esp_err_t Return code.
+ */
+template <typename Mode>
+esp_err_t PressureCalibratorT<Mode>::initialize() {
+    if ( (valveManager == nullptr) || (pressureManager == nullptr) ) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Applies the config. Only allowed while idle.
+ *
+ * @param config Device config.
+ * @return esp_err_t Return code.
+ */
+template <typename Mode>
+esp_err_t PressureCalibratorT<Mode>::configure(Config_t &config) {
+    if (state != PRESSURE_SENSOR_IDLE) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    tankPin = config.valves.tankPin;
+    flowSensorPin = config.valves.flowSensorPin;
+    minFlowRate = config.flowSensor.minFlowRate;
+    return ESP_OK;
+}
+
+/**
+ * @brief Begins a calibration process by measuring the first point.
+ *
+ * @param target Tank volume of the first point, and the drain steps.
+ * @param state Overwritten with the initial state of the process.
+ * @param process Overwritten with the initial process variables.
+ * @return esp_err_t Return code. ESP_ERR_NOT_SUPPORTED if no pressure sensor is installed,
+ * or drain steps are asked for without a tank valve and flow sensor.
+ */
+template <typename Mode>
+esp_err_t PressureCalibratorT<Mode>::beginCalibration(PressureCalibrateTarget_t &target, PressureSensorStates_e &state, PressureCalibrateProcess_t &process) {
+    esp_err_t err = ESP_OK;
+    uint16_t millivolts = 0;
+
+    state = this->state;
+    if (this->state != PRESSURE_SENSOR_IDLE) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (Mode::PRESSURE == false) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    err = pressureManager->readVoltage(millivolts);
+    if (err != ESP_OK) return err;
+
+    err = checkTarget(target);
+    if (err != ESP_OK) return err;
+
+    fit.reset();
+    calibrationTarget = target;
+    calibrationProcess = {};
+    calibrationProcess.tankVolume = target.tankVolume;
+    calibrationSummary = {};
+    lastPoint = target.conclude;
+    beginMeasure();
+
+    state = this->state;
+    process = calibrationProcess;
+    return ESP_OK;
+}
+
+/**
+ * @brief Updates the calibration process.
+ *
+ * @param state Overwritten with the current state. PRESSURE_SENSOR_IDLE once concluded.
+ * @param process Overwritten with the current process variables.
+ * @param summary Overwritten with the process summary once concluded.
+ * @param pointMeasured Set to true if a point was measured during this update.
+ * @return esp_err_t Return code.
+ */
+template <typename Mode>
+esp_err_t PressureCalibratorT<Mode>::loopCalibration(PressureSensorStates_e &state, PressureCalibrateProcess_t &process, PressureCalibrateSummary_t &summary, bool &pointMeasured) {
+    esp_err_t err = ESP_OK;
+    ValveStates_e valveState = VALVES_UNKNOWN;
+    DispenseProcess_t dispenseProcess = {};
+    DispenseSummary_t dispenseSummary = {};
+    bool stepComplete = false;
+    uint16_t millivolts = 0;
+    uint32_t elapsed = 0;
+
+    pointMeasured = false;
+
+    if (this->state == PRESSURE_SENSOR_CALIBRATION_DRAINING) {
+        err = valveManager->loopDispense(valveState, dispenseProcess, dispenseSummary, stepComplete);
+        if (err != ESP_OK) goto exit;
+
+        /** The step ends once the line has settled, so the volume after the close is counted too. */
+        if (stepComplete) {
+            endStep(dispenseSummary.outputTankVolume, dispenseSummary.outputSourceVolume);
+        }
+        goto exit;
+    }
+
+    if (this->state != PRESSURE_SENSOR_CALIBRATION_MEASURING) {
+        goto exit;
+    }
+
+    /** Let the surface settle before averaging the voltage. */
+    elapsed = (halTimeMicros() - measureStartTime) / 1000;
+    if (elapsed < PRESSURE_CALIBRATION_SETTLE_MS) {
+        goto exit;
+    }
+
+    err = pressureManager->readVoltage(millivolts);
+    if (err != ESP_OK) goto exit;
+    voltageSum += millivolts;
+    voltageCount++;
+    if (elapsed < PRESSURE_CALIBRATION_SETTLE_MS + PRESSURE_CALIBRATION_SAMPLE_MS) {
+        goto exit;
+    }
+
+    calibrationProcess.millivolts = (voltageSum + voltageCount / 2) / voltageCount;
+    fit.add(calibrationProcess.millivolts, calibrationProcess.tankVolume);
+    calibrationProcess.pointCount++;
+    pointMeasured = true;
+    ESP_LOGI(TAG, "Point %u: %u mV at %.2f liters.", calibrationProcess.pointCount, calibrationProcess.millivolts, calibrationProcess.tankVolume);
+
+    if ( lastPoint || ((calibrationTarget.stepCount > 0) && (calibrationProcess.stepCount >= calibrationTarget.stepCount)) ) {
+        summarize();
+        this->state = PRESSURE_SENSOR_IDLE;
+    } else if (calibrationTarget.stepVolume > 0) {
+        err = beginStep();
+    } else {
+        this->state = PRESSURE_SENSOR_CALIBRATION_WAITING_FOR_VOLUME;
+    }
+
+exit:
+    state = this->state;
+    process = calibrationProcess;
+    summary = calibrationSummary;
+    return err;
+}
+
+/**
+ * @brief Accepts the next tank volume, or the conclusion, into the calibration process.
+ * A conclusion during a drain step ends the step early and measures its point first.
+ *
+ * @param state Overwritten with the current state.
+ * @param target Tank volume of the next point, and the drain steps after it.
+ * @param process Overwritten with the current process variables.
+ * @return esp_err_t Return code. ESP_ERR_INVALID_STATE if a tank volume arrives
+ * before the current point is measured.
+ */
+template <typename Mode>
+esp_err_t PressureCalibratorT<Mode>::inputCalibration(PressureSensorStates_e &state, PressureCalibrateTarget_t &target, PressureCalibrateProcess_t &process) {
+    esp_err_t err = ESP_OK;
+    ValveStates_e valveState = VALVES_UNKNOWN;
+    DispenseProcess_t dispenseProcess = {};
+    DispenseSummary_t dispenseSummary = {};
+
+    if (target.conclude) {
+        switch (this->state) {
+            case PRESSURE_SENSOR_CALIBRATION_DRAINING:
+                err = valveManager->endDispense(valveState, dispenseProcess, dispenseSummary);
+                if (err != ESP_OK) goto exit;
+                lastPoint = true;
+                endStep(dispenseSummary.outputTankVolume, dispenseSummary.outputSourceVolume);
+                break;
+
+            case PRESSURE_SENSOR_CALIBRATION_MEASURING:
+                lastPoint = true;
+                break;
+
+            case PRESSURE_SENSOR_CALIBRATION_WAITING_FOR_VOLUME:
+                summarize();
+                this->state = PRESSURE_SENSOR_IDLE;
+                break;
+
+            default:
+                err = ESP_ERR_INVALID_STATE;
+                break;
+        }
+        goto exit;
+    }
+
+    if (this->state != PRESSURE_SENSOR_CALIBRATION_WAITING_FOR_VOLUME) {
+        err = ESP_ERR_INVALID_STATE;
+        goto exit;
+    }
+
+    err = checkTarget(target);
+    if (err != ESP_OK) goto exit;
+
+    /** The steps count again from the new volume. */
+    calibrationTarget = target;
+    calibrationProcess.stepCount = 0;
+    calibrationProcess.tankVolume = target.tankVolume;
+    beginMeasure();
+
+exit:
+    state = this->state;
+    process = calibrationProcess;
+    return err;
+}
+
+/**
+ * @brief Ends the calibration process without a fit.
+ *
+ * @param state Overwritten with the state.
+ * @param process Overwritten with the final process variables.
+ * @return esp_err_t Return code.
+ */
+template <typename Mode>
+esp_err_t PressureCalibratorT<Mode>::endCalibration(PressureSensorStates_e &state, PressureCalibrateProcess_t &process) {
+    esp_err_t err = ESP_OK;
+    ValveStates_e valveState = VALVES_UNKNOWN;
+    DispenseProcess_t dispenseProcess = {};
+    DispenseSummary_t dispenseSummary = {};
+
+    if (this->state == PRESSURE_SENSOR_CALIBRATION_DRAINING) {
+        err = valveManager->endDispense(valveState, dispenseProcess, dispenseSummary);
+    }
+
+    this->state = PRESSURE_SENSOR_IDLE;
+    state = this->state;
+    process = calibrationProcess;
+    return err;
+}
+
+/**
+ * @brief Validates the drain steps of a target.
+ *
+ * @param target Target of the next points.
+ * @return esp_err_t Return code. ESP_ERR_NOT_SUPPORTED if the steps cannot be drained.
+ */
+template <typename Mode>
+esp_err_t PressureCalibratorT<Mode>::checkTarget(PressureCalibrateTarget_t &target) {
+    if ( (target.tankVolume < 0) || (target.stepVolume < 0) ) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (target.stepVolume == 0) {
+        return ESP_OK;
+    }
+
+    /** The drained volume is only known from the flow sensor. */
+    if ( (Mode::TANK == false) || (tankPin < 0) || (flowSensorPin < 0) ) {
+        ESP_LOGW(TAG, "Drain steps need the tank valve and the flow sensor.");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (getStepTimeout(target) == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Returns the timeout of the drain steps of a target in seconds, or zero if it has none.
+ *
+ * @param target Target of the next points.
+ */
+template <typename Mode>
+uint32_t PressureCalibratorT<Mode>::getStepTimeout(PressureCalibrateTarget_t &target) {
+    if (target.timeout > 0) {
+        return target.timeout;
+    }
+    if (minFlowRate <= 0) {
+        return 0;
+    }
+
+    return (uint32_t) (target.stepVolume / minFlowRate * 60);
+}
+
+/**
+ * @brief Dispenses a step volume from the tank through the first zone.
+ *
+ * @return esp_err_t Return code.
+ */
+template <typename Mode>
+esp_err_t PressureCalibratorT<Mode>::beginStep() {
+    esp_err_t err = ESP_OK;
+    RunPlan_t plan = {};
+    ValveStates_e valveState = VALVES_UNKNOWN;
+    DispenseProcess_t dispenseProcess = {};
+
+    plan.stepCount = 1;
+    plan.steps[0].targetVolume = calibrationTarget.stepVolume;
+    plan.steps[0].timeout = getStepTimeout(calibrationTarget) * 1000;
+    plan.steps[0].zone = 0;
+
+    err = valveManager->beginDispense(plan, valveState, dispenseProcess);
+    if (err != ESP_OK) return err;
+
+    state = PRESSURE_SENSOR_CALIBRATION_DRAINING;
+    return ESP_OK;
+}
+
+/**
+ * @brief Subtracts the volume the tank delivered in a drain step, and begins measuring its point.
+ *
+ * @param tankVolume Volume metered from the tank in liters.
+ * @param sourceVolume Volume metered from the source in liters, once the tank ran empty.
+ */
+template <typename Mode>
+void PressureCalibratorT<Mode>::endStep(float tankVolume, float sourceVolume) {
+    calibrationProcess.stepCount++;
+    calibrationProcess.tankVolume -= tankVolume;
+
+    /** A short step or a switchover means the tank ran empty, so its point is the last. */
+    if ( (sourceVolume > 0) || (tankVolume < PRESSURE_CALIBRATION_EMPTY_FRACTION * calibrationTarget.stepVolume) ) {
+        ESP_LOGI(TAG, "Tank empty after %.2f liters of the step.", tankVolume);
+        lastPoint = true;
+    }
+    if (calibrationProcess.tankVolume < 0) {
+        ESP_LOGW(TAG, "Drained %.2f liters beyond the measured tank volume.", -calibrationProcess.tankVolume);
+        calibrationProcess.tankVolume = 0;
+        lastPoint = true;
+    }
+
+    beginMeasure();
+}
+
+/**
+ * @brief Begins measuring a point at the current tank volume.
+ */
+template <typename Mode>
+void PressureCalibratorT<Mode>::beginMeasure() {
+    measureStartTime = halTimeMicros();
+    voltageSum = 0;
+    voltageCount = 0;
+    state = PRESSURE_SENSOR_CALIBRATION_MEASURING;
+}
+
+/**
+ * @brief Writes the fit of the measured points into the summary.
+ */
+template <typename Mode>
+void PressureCalibratorT<Mode>::summarize() {
+    esp_err_t err = ESP_OK;
+
+    calibrationSummary = {};
+    calibrationSummary.measuredCount = fit.getCount();
+    err = fit.fillTable(calibrationSummary.points, calibrationSummary.pointCount, calibrationSummary.degree, calibrationSummary.residual);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "No rising fit of %u points.", calibrationSummary.measuredCount);
+        calibrationSummary.pointCount = 0;
+    }
+}
+
+/** Only the mode of the build is compiled. */
+template class PressureCalibratorT<DripMode>;
\ No newline at end of file
@@ -0,0 +1,229 @@
+#ifndef PRESSURE_CALIBRATOR_H
+#define PRESSURE_CALIBRATOR_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#include "config.h"
+#include "operatingMode.h"
+#include "pressureManager.h"
+#include "pressureFit.h"
+
+template <typename Mode>
+class ValveManagerT;
+
+/** Time the tank settles for after a drain step before its voltage is measured, in miliseconds. */
+#define PRESSURE_CALIBRATION_SETTLE_MS 3000
+/** Time the voltage of a point is averaged over, in miliseconds. */
+#define PRESSURE_CALIBRATION_SAMPLE_MS 2000
+/** A drain step delivering less than this fraction of its volume from the tank has emptied it. */
+#define PRESSURE_CALIBRATION_EMPTY_FRACTION 0.5f
+
+/**
+ * @brief Describes the possible states of the pressure sensor.
+ */
+typedef enum PressureSensorStates_e {
+    /** Default state. */
+    PRESSURE_SENSOR_UNKNOWN,
+    PRESSURE_SENSOR_IDLE,
+    PRESSURE_SENSOR_CALIBRATION_DRAINING,
+    PRESSURE_SENSOR_CALIBRATION_MEASURING,
+    PRESSURE_SENSOR_CALIBRATION_WAITING_FOR_VOLUME
+} PressureSensorStates_e;
+
+/**
+ * @brief Describes the input by the user for a pressure sensor calibration process.
+ */
+typedef struct PressureCalibrateTarget_t {
+    /** Tank volume measured by the user in liters, or negative if not measured. Required unless concluding. */
+    float tankVolume = -1;
+    /**
+     * Volume drained from the tank through the flow sensor between points, in liters.
+     * Zero to wait for the next tank volume measured by the user instead.
+     */
+    float stepVolume = 0;
+    /** Number of drain steps, or zero to drain until the tank is empty. */
+    uint32_t stepCount = 0;
+    /**
+     * Timeout of each drain step in seconds. Zero for the time the step takes at the minFlowRate
+     * of the flow sensor config, so a step only ends short once the tank stops flowing.
+     */
+    uint32_t timeout = 0;
+    /** If true the calibration process is concluded once the current point is measured. */
+    bool conclude = false;
+} PressureCalibrateTarget_t;
+
+/**
+ * @brief Describes the realtime variables of a pressure sensor calibration process.
+ */
+typedef struct PressureCalibrateProcess_t {
+    /** Number of points measured, and drain steps completed. */
+    uint16_t pointCount = 0;
+    uint32_t stepCount = 0;
+    /** Tank volume of the current point in liters, as measured by the user less the volume drained since. */
+    float tankVolume = 0;
+    /** Averaged voltage of the last point in millivolts. */
+    uint16_t millivolts = 0;
+} PressureCalibrateProcess_t;
+
+/**
+ * @brief Describes a summary of a whole pressure sensor calibration process.
+ */
+typedef struct PressureCalibrateSummary_t {
+    /** Number of points measured. */
+    uint16_t measuredCount = 0;
+    /** Calibration table of the fit, or no points if the measured points gave none. */
+    uint8_t pointCount = 0;
+    PressureSensorCalibrationPoint_t points[MAX_PRESSURE_CALIBRATION_POINTS] = {};
+    /** Degree of the polynomial fitted, and its root mean square residual in liters. */
+    uint8_t degree = 0;
+    float residual = 0;
+} PressureCalibrateSummary_t;
+
+/**
+ * @brief Handles the pressure sensor calibration process. Each point averages the sensor
+ * voltage at a known tank volume. The first volume is measured by the user, then either
+ * the tank is drained through the first zone by a step volume metered by the flow sensor,
+ * or the user fills or drains the tank by hand and sends its next volume. Each point is added
+ * to a running least squares fit, and the process concludes by writing the fit into the calibration table.
+ *
+ * The process lives in this class rather than in the connection, so it carries on while
+ * the device reconnects, and a point measured meanwhile is reported once connected.
+ *
+ * @tparam Mode OperatingMode of the build, as of the ValveManager.
+ */
+template <typename Mode>
+class PressureCalibratorT {
+public:
+    /**
+     * @brief Constructor.
+     *
+     * @param valveManager Drains each calibration step.
+     * @param pressureManager Reads the sensor voltage.
+     */
+    PressureCalibratorT(ValveManagerT<Mode> *valveManager, PressureManager *pressureManager);
+
+    /**
+     * @brief Begin the PressureCalibrator.
+     *
+     * @return esp_err_t Return code.
+     */
+    esp_err_t initialize();
+
+    /**
+     * @brief Applies the config. Only allowed while idle.
+     *
+     * @param config Device config.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t configure(Config_t &config);
+
+    /**
+     * @brief Begins a calibration process by measuring the first point.
+     *
+     * @param target Tank volume of the first point, and the drain steps.
+     * @param state Overwritten with the initial state of the process.
+     * @param process Overwritten with the initial process variables.
+     * @return esp_err_t Return code. ESP_ERR_NOT_SUPPORTED if no pressure sensor is installed,
+     * or drain steps are asked for without a tank valve and flow sensor.
+     */
+    esp_err_t beginCalibration(PressureCalibrateTarget_t &target, PressureSensorStates_e &state, PressureCalibrateProcess_t &process);
+
+    /**
+     * @brief Updates the calibration process.
+     *
+     * @param state Overwritten with the current state. PRESSURE_SENSOR_IDLE once concluded.
+     * @param process Overwritten with the current process variables.
+     * @param summary Overwritten with the process summary once concluded.
+     * @param pointMeasured Set to true if a point was measured during this update.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t loopCalibration(PressureSensorStates_e &state, PressureCalibrateProcess_t &process, PressureCalibrateSummary_t &summary, bool &pointMeasured);
+
+    /**
+     * @brief Accepts the next tank volume, or the conclusion, into the calibration process.
+     * A conclusion during a drain step ends the step early and measures its point first.
+     *
+     * @param state Overwritten with the current state.
+     * @param target Tank volume of the next point, and the drain steps after it.
+     * @param process Overwritten with the current process variables.
+     * @return esp_err_t Return code. ESP_ERR_INVALID_STATE if a tank volume arrives
+     * before the current point is measured.
+     */
+    esp_err_t inputCalibration(PressureSensorStates_e &state, PressureCalibrateTarget_t &target, PressureCalibrateProcess_t &process);
+
+    /**
+     * @brief Ends the calibration process without a fit.
+     *
+     * @param state Overwritten with the state.
+     * @param process Overwritten with the final process variables.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t endCalibration(PressureSensorStates_e &state, PressureCalibrateProcess_t &process);
+
+private:
+    ValveManagerT<Mode> *valveManager;
+    PressureManager *pressureManager;
+    int8_t tankPin;
+    int8_t flowSensorPin;
+    /** Flow rate in liters per minute the default timeout of a drain step is set by. */
+    float minFlowRate;
+    PressureSensorStates_e state;
+    PressureCalibrateTarget_t calibrationTarget;
+    PressureCalibrateProcess_t calibrationProcess;
+    PressureCalibrateSummary_t calibrationSummary;
+    PressureFit fit;
+    /** Time the current point began settling, in microseconds. */
+    int64_t measureStartTime;
+    /** Voltages summed over the current point, in millivolts. */
+    uint32_t voltageSum;
+    uint16_t voltageCount;
+    /** Set once a drain step found the tank empty, or the user concluded, so the current point is the last. */
+    bool lastPoint;
+
+    /**
+     * @brief Validates the drain steps of a target.
+     *
+     * @param target Target of the next points.
+     * @return esp_err_t Return code. ESP_ERR_NOT_SUPPORTED if the steps cannot be drained.
+     */
+    esp_err_t checkTarget(PressureCalibrateTarget_t &target);
+
+    /**
+     * @brief Returns the timeout of the drain steps of a target in seconds, or zero if it has none.
+     *
+     * @param target Target of the next points.
+     */
+    uint32_t getStepTimeout(PressureCalibrateTarget_t &target);
+
+    /**
+     * @brief Dispenses a step volume from the tank through the first zone.
+     *
+     * @return esp_err_t Return code.
+     */
+    esp_err_t beginStep();
+
+    /**
+     * @brief Subtracts the volume the tank delivered in a drain step, and begins measuring its point.
+     *
+     * @param tankVolume Volume metered from the tank in liters.
+     * @param sourceVolume Volume metered from the source in liters, once the tank ran empty.
+     */
+    void endStep(float tankVolume, float sourceVolume);
+
+    /**
+     * @brief Begins measuring a point at the current tank volume.
+     */
+    void beginMeasure();
+
+    /**
+     * @brief Writes the fit of the measured points into the summary.
+     */
+    void summarize();
+};
+
+/** The PressureCalibrator of the operating mode of the build. */
+typedef PressureCalibratorT<DripMode> PressureCalibrator;
+
+#endif
\ No newline at end of file
@@ -1,5 +1,105 @@
-#ifndef DDA89F47_551F_4953_AC21_84BF58F3DED7
-#define DDA89F47_551F_4953_AC21_84BF58F3DED7
+#include "esp_err.h"
+#include "esp_log.h"
+#include "halAdc.h"
 
+#include "pressureDriver.h"
 
-#endif /* DDA89F47_551F_4953_AC21_84BF58F3DED7 */
+static const char* TAG = "PressureDriver";
+
+/**
+ * @brief Constructor.
+ */
+PressureDriver::PressureDriver() {
+    gpioManager = nullptr;
+    pin = -1;
+    adc = nullptr;
+}
+
+/**
+ * @brief Claims the sensor pin and configures its ADC channel.
+ * 
+ * @param gpioManager Allocates the pin.
+ * @param pin GPIO of the sensor output. Must be an ADC1 pin.
+ * @return esp_err_t Return code.
+ */
+esp_err_t PressureDriver::initialize(GpioManager *gpioManager, int8_t pin) {
+    esp_err_t err = ESP_OK;
+
+    if (gpioManager == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (this->pin >= 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    err = gpioManager->claimInput(pin, false, "PressureDriver");
+    if (err != ESP_OK) return err;
+
+    /** ADC2 is unusable while WiFi is active, so only ADC1 pins are accepted. */
+    err = halAdcOpen(pin, &adc);
+    if (err != ESP_OK) {
+        if (err == ESP_ERR_INVALID_ARG) {
+            ESP_LOGE(TAG, "GPIO %d is not an ADC1 pin.", pin);
+        }
+        gpioManager->release(pin);
+        return err;
+    }
+
+    this->gpioManager = gpioManager;
+    this->pin = pin;
+    return ESP_OK;
+}
+
+/**
+ * @brief Releases the ADC channel and the sensor pin.
+ * Has no effect if not initialized.
+ * 
+ * @return esp_err_t Return code.
+ */
+esp_err_t PressureDriver::deinitialize() {
+    if (pin < 0) {
+        return ESP_OK;
+    }
+
+    halAdcClose(adc);
+    adc = nullptr;
+    gpioManager->release(pin);
+    pin = -1;
+    return ESP_OK;
+}
+
+/**
+ * @brief If true, the sensor is installed.
+ */
+bool PressureDriver::isInstalled() {
+    return pin >= 0;
+}
+
+/**
+ * @brief Reads the calibrated sensor voltage, averaged over PRESSURE_SAMPLE_COUNT conversions.
+ * 
+ * @param millivolts Overwritten with the voltage.
+ * @return esp_err_t Return code.
+ */
+esp_err_t PressureDriver::read(uint16_t &millivolts) {
+    esp_err_t err = ESP_OK;
+    int raw = 0;
+    int voltage = 0;
+    int32_t sum = 0;
+
+    if (pin < 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    for (int i = 0; i < PRESSURE_SAMPLE_COUNT; i++) {
+        err = halAdcReadRaw(adc, raw);
+        if (err != ESP_OK) return err;
+        sum += raw;
+    }
+
+    err = halAdcToMillivolts(adc, sum / PRESSURE_SAMPLE_COUNT, voltage);
+    if (err != ESP_OK) return err;
+
+    millivolts = voltage;
+    return ESP_OK;
+}
\ No newline at end of file
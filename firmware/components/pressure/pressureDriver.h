@@ -0,0 +1,60 @@
+#ifndef PRESSURE_DRIVER_H
+#define PRESSURE_DRIVER_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "halAdc.h"
+
+#include "gpioManager.h"
+
+/** Number of ADC conversions averaged per reading. */
+#define PRESSURE_SAMPLE_COUNT 8
+
+/**
+ * @brief Reads the analog output of the pressure sensor in millivolts.
+ */
+class PressureDriver {
+public:
+    /**
+     * @brief Constructor.
+     */
+    PressureDriver();
+
+    /**
+     * @brief Claims the sensor pin and configures its ADC channel.
+     * 
+     * @param gpioManager Allocates the pin.
+     * @param pin GPIO of the sensor output. Must be an ADC1 pin.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t initialize(GpioManager *gpioManager, int8_t pin);
+
+    /**
+     * @brief Releases the ADC channel and the sensor pin.
+     * Has no effect if not initialized.
+     * 
+     * @return esp_err_t Return code.
+     */
+    esp_err_t deinitialize();
+
+    /**
+     * @brief If true, the sensor is installed.
+     */
+    bool isInstalled();
+
+    /**
+     * @brief Reads the calibrated sensor voltage, averaged over PRESSURE_SAMPLE_COUNT conversions.
+     * 
+     * @param millivolts Overwritten with the voltage.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t read(uint16_t &millivolts);
+
+private:
+    GpioManager *gpioManager;
+    int8_t pin;
+    HalAdc_t adc;
+};
+
+#endif
\ No newline at end of file
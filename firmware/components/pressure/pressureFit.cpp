@@ -0,0 +1,212 @@
+#include <cstring>
+#include <math.h>
+
+#include "esp_err.h"
+
+#include "pressureFit.h"
+
+/**
+ * @brief Constructor.
+ */
+PressureFit::PressureFit() {
+    memset(factor, 0, sizeof(factor));
+    memset(rotated, 0, sizeof(rotated));
+    residualSum = 0;
+    count = 0;
+    minVoltage = 0;
+    maxVoltage = 0;
+}
+
+/**
+ * @brief Forgets every point.
+ */
+void PressureFit::reset() {
+    memset(factor, 0, sizeof(factor));
+    memset(rotated, 0, sizeof(rotated));
+    residualSum = 0;
+    count = 0;
+    minVoltage = 0;
+    maxVoltage = 0;
+}
+
+/**
+ * @brief Adds a point to the fit.
+ *
+ * @param millivolts Sensor voltage.
+ * @param volume Tank volume in liters.
+ */
+void PressureFit::add(uint16_t millivolts, float volume) {
+    float row[PRESSURE_FIT_MAX_DEGREE + 1];
+    float x = (millivolts - PRESSURE_FIT_CENTRE_MV) / PRESSURE_FIT_SCALE_MV;
+    float y = volume;
+    float radius = 0;
+    float c = 0;
+    float s = 0;
+    float next = 0;
+
+    row[0] = 1;
+    for (uint8_t i = 1; i <= PRESSURE_FIT_MAX_DEGREE; i++) {
+        row[i] = row[i - 1] * x;
+    }
+
+    /** Each rotation zeroes one entry of the row against the diagonal of the factor. */
+    for (uint8_t k = 0; k <= PRESSURE_FIT_MAX_DEGREE; k++) {
+        if (row[k] == 0) {
+            continue;
+        }
+        if (factor[k][k] == 0) {
+            for (uint8_t j = k; j <= PRESSURE_FIT_MAX_DEGREE; j++) {
+                factor[k][j] = row[j];
+            }
+            rotated[k] = y;
+            y = 0;
+            break;
+        }
+
+        radius = sqrtf(factor[k][k] * factor[k][k] + row[k] * row[k]);
+        c = factor[k][k] / radius;
+        s = row[k] / radius;
+        for (uint8_t j = k; j <= PRESSURE_FIT_MAX_DEGREE; j++) {
+            next = c * factor[k][j] + s * row[j];
+            row[j] = c * row[j] - s * factor[k][j];
+            factor[k][j] = next;
+        }
+        next = c * rotated[k] + s * y;
+        y = c * y - s * rotated[k];
+        rotated[k] = next;
+    }
+
+    /** What is left of the volume is the residual of the highest degree. */
+    residualSum += y * y;
+
+    if ( (count == 0) || (millivolts < minVoltage) ) {
+        minVoltage = millivolts;
+    }
+    if ( (count == 0) || (millivolts > maxVoltage) ) {
+        maxVoltage = millivolts;
+    }
+    count++;
+}
+
+/**
+ * @brief Returns the number of points added.
+ */
+uint16_t PressureFit::getCount() {
+    return count;
+}
+
+/**
+ * @brief Fills a calibration table with the fit, at evenly spaced voltages over the range of the points.
+ * The highest degree the points support is used whose volume rises over the whole range.
+ *
+ * @param points Overwritten with the table, room for MAX_PRESSURE_CALIBRATION_POINTS points.
+ * @param pointCount Overwritten with the number of points of the table.
+ * @param degree Overwritten with the degree of the polynomial.
+ * @param residual Overwritten with the root mean square residual of the fit, in liters.
+ * @return esp_err_t Return code. ESP_ERR_INVALID_STATE if the points span no voltage
+ * or no degree gives a rising volume.
+ */
+esp_err_t PressureFit::fillTable(PressureSensorCalibrationPoint_t *points, uint8_t &pointCount, uint8_t &degree, float &residual) {
+    float coefficients[PRESSURE_FIT_MAX_DEGREE + 1];
+    uint16_t step = 0;
+    uint8_t tableCount = 0;
+    uint8_t candidate = PRESSURE_FIT_MAX_DEGREE;
+    uint16_t millivolts = 0;
+    float volume = 0;
+    float previous = 0;
+    float first = 0;
+    float sum = 0;
+    bool rising = false;
+
+    if ( (count < 2) || (maxVoltage <= minVoltage) ) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    /** An even spacing in whole millivolts, so the table is looked up without a search. */
+    step = (maxVoltage - minVoltage + MAX_PRESSURE_CALIBRATION_POINTS - 2) / (MAX_PRESSURE_CALIBRATION_POINTS - 1);
+    tableCount = (maxVoltage - minVoltage + step - 1) / step + 1;
+
+    while (candidate * PRESSURE_FIT_POINTS_PER_DEGREE > count) {
+        candidate--;
+    }
+
+    /** A polynomial which turns within the range would give two voltages the same volume. */
+    for (; candidate >= 1; candidate--) {
+        if (solve(candidate, coefficients) != ESP_OK) {
+            continue;
+        }
+
+        rising = true;
+        first = evaluate(coefficients, candidate, minVoltage);
+        previous = first;
+        for (uint8_t i = 1; i < tableCount; i++) {
+            volume = evaluate(coefficients, candidate, minVoltage + i * step);
+            if (volume < previous) {
+                rising = false;
+                break;
+            }
+            previous = volume;
+        }
+        if ( rising && (previous > first) ) {
+            break;
+        }
+    }
+    if (candidate == 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    for (uint8_t i = 0; i < tableCount; i++) {
+        millivolts = minVoltage + i * step;
+        volume = evaluate(coefficients, candidate, millivolts) + 0.5f;
+        points[i].analogVoltage = millivolts;
+        points[i].volume = (volume < 0) ? 0 : ((volume > UINT16_MAX) ? UINT16_MAX : (uint16_t) volume);
+    }
+
+    /** The rotated volumes beyond the degree are the residual it leaves over the highest degree. */
+    sum = residualSum;
+    for (uint8_t k = candidate + 1; k <= PRESSURE_FIT_MAX_DEGREE; k++) {
+        sum += rotated[k] * rotated[k];
+    }
+
+    pointCount = tableCount;
+    degree = candidate;
+    residual = sqrtf(sum / count);
+    return ESP_OK;
+}
+
+/**
+ * @brief Solves for the coefficients of a degree by back substitution.
+ *
+ * @param degree Degree of the polynomial.
+ * @param coefficients Overwritten with the coefficients in rising order.
+ * @return esp_err_t Return code. ESP_ERR_INVALID_STATE if the points do not determine the degree.
+ */
+esp_err_t PressureFit::solve(uint8_t degree, float *coefficients) {
+    float value = 0;
+
+    for (int8_t i = degree; i >= 0; i--) {
+        if (fabsf(factor[i][i]) <= PRESSURE_FIT_MIN_PIVOT * fabsf(factor[0][0])) {
+            return ESP_ERR_INVALID_STATE;
+        }
+
+        value = rotated[i];
+        for (uint8_t j = i + 1; j <= degree; j++) {
+            value -= factor[i][j] * coefficients[j];
+        }
+        coefficients[i] = value / factor[i][i];
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Evaluates a polynomial at a voltage.
+ */
+float PressureFit::evaluate(const float *coefficients, uint8_t degree, uint16_t millivolts) {
+    float x = (millivolts - PRESSURE_FIT_CENTRE_MV) / PRESSURE_FIT_SCALE_MV;
+    float value = coefficients[degree];
+
+    for (int8_t i = degree - 1; i >= 0; i--) {
+        value = value * x + coefficients[i];
+    }
+    return value;
+}
\ No newline at end of file
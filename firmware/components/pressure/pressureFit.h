@@ -0,0 +1,90 @@
+#ifndef PRESSURE_FIT_H
+#define PRESSURE_FIT_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#include "config.h"
+
+/** Highest degree of the polynomial fitted. */
+#define PRESSURE_FIT_MAX_DEGREE 3
+/** Number of points needed per degree of the polynomial, so a fit never just passes through its points. */
+#define PRESSURE_FIT_POINTS_PER_DEGREE 2
+/** Voltage the polynomial is centred at and scaled by, in millivolts, so its powers stay near one. */
+#define PRESSURE_FIT_CENTRE_MV 1650.0f
+#define PRESSURE_FIT_SCALE_MV 1650.0f
+/** A degree is left out if a diagonal of its triangular factor falls below this fraction of the first. */
+#define PRESSURE_FIT_MIN_PIVOT 0.0001f
+
+/**
+ * @brief Fits the tank volume as a polynomial of the pressure sensor voltage by least squares,
+ * updated one point at a time, so the points need not be stored. Each point is rotated into the
+ * triangular factor of the QR decomposition with Givens rotations, which keeps the fit well
+ * conditioned in single precision. As the powers are in rising order, every lower degree can be
+ * solved from the same factor. Has no hardware dependencies.
+ */
+class PressureFit {
+public:
+    /**
+     * @brief Constructor.
+     */
+    PressureFit();
+
+    /**
+     * @brief Forgets every point.
+     */
+    void reset();
+
+    /**
+     * @brief Adds a point to the fit.
+     *
+     * @param millivolts Sensor voltage.
+     * @param volume Tank volume in liters.
+     */
+    void add(uint16_t millivolts, float volume);
+
+    /**
+     * @brief Returns the number of points added.
+     */
+    uint16_t getCount();
+
+    /**
+     * @brief Fills a calibration table with the fit, at evenly spaced voltages over the range of the points.
+     * The highest degree the points support is used whose volume rises over the whole range.
+     *
+     * @param points Overwritten with the table, room for MAX_PRESSURE_CALIBRATION_POINTS points.
+     * @param pointCount Overwritten with the number of points of the table.
+     * @param degree Overwritten with the degree of the polynomial.
+     * @param residual Overwritten with the root mean square residual of the fit, in liters.
+     * @return esp_err_t Return code. ESP_ERR_INVALID_STATE if the points span no voltage
+     * or no degree gives a rising volume.
+     */
+    esp_err_t fillTable(PressureSensorCalibrationPoint_t *points, uint8_t &pointCount, uint8_t &degree, float &residual);
+
+private:
+    /** Upper triangular factor, and the rotated volumes. */
+    float factor[PRESSURE_FIT_MAX_DEGREE + 1][PRESSURE_FIT_MAX_DEGREE + 1];
+    float rotated[PRESSURE_FIT_MAX_DEGREE + 1];
+    /** Residual sum of squares of the highest degree, in liters squared. */
+    float residualSum;
+    uint16_t count;
+    uint16_t minVoltage;
+    uint16_t maxVoltage;
+
+    /**
+     * @brief Solves for the coefficients of a degree by back substitution.
+     *
+     * @param degree Degree of the polynomial.
+     * @param coefficients Overwritten with the coefficients in rising order.
+     * @return esp_err_t Return code. ESP_ERR_INVALID_STATE if the points do not determine the degree.
+     */
+    esp_err_t solve(uint8_t degree, float *coefficients);
+
+    /**
+     * @brief Evaluates a polynomial at a voltage.
+     */
+    static float evaluate(const float *coefficients, uint8_t degree, uint16_t millivolts);
+};
+
+#endif
\ No newline at end of file
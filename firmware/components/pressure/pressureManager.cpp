@@ -1,5 +1,187 @@
-#ifndef DF1628CA_D2CE_4853_9561_8116F6A96180
-#define DF1628CA_D2CE_4853_9561_8116F6A96180
+#include <cstring>
 
+#include "esp_err.h"
+#include "esp_log.h"
 
-#endif /* DF1628CA_D2CE_4853_9561_8116F6A96180 */
+#include "pressureManager.h"
+
+static const char* TAG = "PressureManager";
+
+/**
+ * @brief Constructor.
+ * 
+ * @param gpioManager Allocates the sensor pin.
+ */
+PressureManager::PressureManager(GpioManager *gpioManager) {
+    this->gpioManager = gpioManager;
+    pointCount = 0;
+    spacing = 0;
+    memset(points, 0, sizeof(points));
+}
+
+/**
+ * @brief Begin the PressureManager.
+ * 
+ * @return esp_err_t Return code.
+ */
+esp_err_t PressureManager::initialize() {
+    if (gpioManager == nullptr) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Applies the config, claiming the sensor pin if installed.
+ * 
+ * @param config Device config.
+ * @return esp_err_t Return code.
+ */
+esp_err_t PressureManager::configure(Config_t &config) {
+    esp_err_t err = ESP_OK;
+
+    pressureDriver.deinitialize();
+    pointCount = 0;
+    spacing = 0;
+
+    if (config.pressureSensor.pin >= 0) {
+        err = pressureDriver.initialize(gpioManager, config.pressureSensor.pin);
+        if (err != ESP_OK) return err;
+    }
+
+    /** Points must rise in voltage, so the table can be interpolated in order. */
+    if ( (config.pressureCalibrationTable != nullptr) && (config.pressureSensor.calibrationPointCount <= MAX_PRESSURE_CALIBRATION_POINTS) ) {
+        for (uint8_t i = 1; i < config.pressureSensor.calibrationPointCount; i++) {
+            if (config.pressureCalibrationTable[i].analogVoltage <= config.pressureCalibrationTable[i - 1].analogVoltage) {
+                ESP_LOGE(TAG, "Calibration points are not in rising voltage order.");
+                return ESP_ERR_INVALID_ARG;
+            }
+        }
+        pointCount = config.pressureSensor.calibrationPointCount;
+        memcpy(points, config.pressureCalibrationTable, pointCount * sizeof(points[0]));
+    }
+
+    if (pointCount >= 2) {
+        spacing = points[1].analogVoltage - points[0].analogVoltage;
+        for (uint8_t i = 2; i < pointCount; i++) {
+            if (points[i].analogVoltage - points[i - 1].analogVoltage != spacing) {
+                spacing = 0;
+                break;
+            }
+        }
+    }
+
+    /** The calibration table, being measured in the tank itself, takes precedence over its geometry. */
+    geometry = TankGeometry();
+    if ( (pointCount < 2) && (config.pressureSensor.gain > 0) ) {
+        err = geometry.configure(config.tank, config.pressureSensor.offset, config.pressureSensor.gain);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Invalid tank geometry.");
+            return err;
+        }
+        ESP_LOGI(TAG, "Configured by tank geometry of %.1f liters.", geometry.getCapacity());
+        return ESP_OK;
+    }
+
+    ESP_LOGI(TAG, "Configured with %d calibration points.", pointCount);
+    return ESP_OK;
+}
+
+/**
+ * @brief If true, the sensor is installed and calibrated, or its gain and the tank geometry
+ * are known, so the tank volume can be read.
+ */
+bool PressureManager::isCalibrated() {
+    return pressureDriver.isInstalled() && ( (pointCount >= 2) || geometry.isConfigured() );
+}
+
+/**
+ * @brief Reads the sensor voltage.
+ * 
+ * @param millivolts Overwritten with the voltage.
+ * @return esp_err_t Return code. ESP_ERR_NOT_SUPPORTED if no sensor is installed.
+ */
+esp_err_t PressureManager::readVoltage(uint16_t &millivolts) {
+    if (pressureDriver.isInstalled() == false) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    return pressureDriver.read(millivolts);
+}
+
+/**
+ * @brief Reads the tank volume, interpolated linearly between calibration points.
+ * A table of evenly spaced voltages, as written by the calibration process, is looked up without a search.
+ * Without calibration points, the volume is that of the tank geometry at the height the sensor reads.
+ * 
+ * @param volume Overwritten with the volume in liters.
+ * @return esp_err_t Return code. ESP_ERR_INVALID_STATE if not calibrated.
+ */
+esp_err_t PressureManager::getTankVolume(float &volume) {
+    esp_err_t err = ESP_OK;
+    uint16_t millivolts = 0;
+
+    if (isCalibrated() == false) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    err = pressureDriver.read(millivolts);
+    if (err != ESP_OK) return err;
+
+    if (pointCount < 2) {
+        volume = geometry.getVolume(millivolts);
+    } else {
+        volume = (spacing > 0) ? lookup(points, pointCount, spacing, millivolts) : interpolate(points, pointCount, millivolts);
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Interpolates the volume of a voltage linearly between calibration points.
+ * Voltages outside the table are extrapolated from the nearest segment.
+ * 
+ * @param points Calibration points in rising voltage order.
+ * @param pointCount Number of points, at least two.
+ * @param millivolts Sensor voltage.
+ * @returns Volume in liters, not below zero.
+ */
+float PressureManager::interpolate(const PressureSensorCalibrationPoint_t *points, uint8_t pointCount, uint16_t millivolts) {
+    uint8_t i = 1;
+    float fraction = 0;
+    float volume = 0;
+
+    while ( (i < pointCount - 1) && (millivolts > points[i].analogVoltage) ) {
+        i++;
+    }
+    fraction = (float) (millivolts - points[i - 1].analogVoltage) / (points[i].analogVoltage - points[i - 1].analogVoltage);
+    volume = points[i - 1].volume + fraction * (points[i].volume - points[i - 1].volume);
+    return (volume < 0) ? 0 : volume;
+}
+
+/**
+ * @brief Interpolates the volume of a voltage like interpolate(), in a table of evenly spaced voltages,
+ * so the segment is found by a division instead of a search.
+ * 
+ * @param points Calibration points in rising voltage order.
+ * @param pointCount Number of points, at least two.
+ * @param spacing Voltage between consecutive points in millivolts.
+ * @param millivolts Sensor voltage.
+ * @returns Volume in liters, not below zero.
+ */
+float PressureManager::lookup(const PressureSensorCalibrationPoint_t *points, uint8_t pointCount, uint16_t spacing, uint16_t millivolts) {
+    int32_t offset = (int32_t) millivolts - points[0].analogVoltage;
+    int32_t i = 0;
+    float volume = 0;
+
+    /** Voltages outside the table fall in the first or last segment. */
+    if (offset > 0) {
+        i = offset / spacing;
+        if (i > pointCount - 2) {
+            i = pointCount - 2;
+        }
+    }
+    offset -= i * spacing;
+    volume = points[i].volume + (float) offset * (points[i + 1].volume - points[i].volume) / spacing;
+    return (volume < 0) ? 0 : volume;
+}
\ No newline at end of file
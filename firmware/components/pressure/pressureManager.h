@@ -0,0 +1,100 @@
+#ifndef PRESSURE_MANAGER_H
+#define PRESSURE_MANAGER_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#include "config.h"
+#include "gpioManager.h"
+#include "pressureDriver.h"
+#include "tankGeometry.h"
+
+/**
+ * @brief Converts the pressure sensor reading into the tank volume
+ * using the calibration table of the config. Without a calibration table,
+ * a known sensor gain converts it by the tank geometry instead.
+ */
+class PressureManager {
+public:
+    /**
+     * @brief Constructor.
+     * 
+     * @param gpioManager Allocates the sensor pin.
+     */
+    PressureManager(GpioManager *gpioManager);
+
+    /**
+     * @brief Begin the PressureManager.
+     * 
+     * @return esp_err_t Return code.
+     */
+    esp_err_t initialize();
+
+    /**
+     * @brief Applies the config, claiming the sensor pin if installed.
+     * 
+     * @param config Device config.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t configure(Config_t &config);
+
+    /**
+     * @brief If true, the sensor is installed and calibrated, or its gain and the tank geometry
+     * are known, so the tank volume can be read.
+     */
+    bool isCalibrated();
+
+    /**
+     * @brief Reads the sensor voltage.
+     * 
+     * @param millivolts Overwritten with the voltage.
+     * @return esp_err_t Return code. ESP_ERR_NOT_SUPPORTED if no sensor is installed.
+     */
+    esp_err_t readVoltage(uint16_t &millivolts);
+
+    /**
+     * @brief Reads the tank volume, interpolated linearly between calibration points.
+     * A table of evenly spaced voltages, as written by the calibration process, is looked up without a search.
+     * Without calibration points, the volume is that of the tank geometry at the height the sensor reads.
+     * 
+     * @param volume Overwritten with the volume in liters.
+     * @return esp_err_t Return code. ESP_ERR_INVALID_STATE if not calibrated.
+     */
+    esp_err_t getTankVolume(float &volume);
+
+    /**
+     * @brief Interpolates the volume of a voltage linearly between calibration points.
+     * Voltages outside the table are extrapolated from the nearest segment.
+     * 
+     * @param points Calibration points in rising voltage order.
+     * @param pointCount Number of points, at least two.
+     * @param millivolts Sensor voltage.
+     * @returns Volume in liters, not below zero.
+     */
+    static float interpolate(const PressureSensorCalibrationPoint_t *points, uint8_t pointCount, uint16_t millivolts);
+
+    /**
+     * @brief Interpolates the volume of a voltage like interpolate(), in a table of evenly spaced voltages,
+     * so the segment is found by a division instead of a search.
+     * 
+     * @param points Calibration points in rising voltage order.
+     * @param pointCount Number of points, at least two.
+     * @param spacing Voltage between consecutive points in millivolts.
+     * @param millivolts Sensor voltage.
+     * @returns Volume in liters, not below zero.
+     */
+    static float lookup(const PressureSensorCalibrationPoint_t *points, uint8_t pointCount, uint16_t spacing, uint16_t millivolts);
+
+private:
+    GpioManager *gpioManager;
+    PressureDriver pressureDriver;
+    uint8_t pointCount;
+    /** Voltage between consecutive points in millivolts if evenly spaced, otherwise zero. */
+    uint16_t spacing;
+    PressureSensorCalibrationPoint_t points[MAX_PRESSURE_CALIBRATION_POINTS];
+    /** Tank geometry on the voltage scale of the sensor, used without calibration points. */
+    TankGeometry geometry;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,241 @@
+#include <cstring>
+#include <math.h>
+
+#include "esp_err.h"
+
+#include "tankGeometry.h"
+
+/**
+ * @brief Constructor.
+ */
+TankGeometry::TankGeometry() {
+    knotCount = 0;
+    slope = 0;
+    intercept = 0;
+    memset(knots, 0, sizeof(knots));
+    memset(coefficients, 0, sizeof(coefficients));
+    fullReading = 0;
+    capacity = 0;
+}
+
+/**
+ * @brief Compiles the conversion of a tank config. The height is read on the scale
+ * offset + gain * meters, so a gain of one and an offset of zero read it in meters.
+ *
+ * @param tank Tank config.
+ * @param offset Reading at zero height.
+ * @param gain Reading per meter of height. Must be positive.
+ * @return esp_err_t Return code. ESP_ERR_INVALID_ARG if the tank has no volume,
+ * or its strapping table has fewer than two points or does not rise in height.
+ */
+esp_err_t TankGeometry::configure(TankConfig_t &tank, float offset, float gain) {
+    float area = 0;
+    float height = 0;
+
+    knotCount = 0;
+    slope = 0;
+    intercept = 0;
+    fullReading = 0;
+    capacity = 0;
+
+    if (gain <= 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    switch (tank.shape) {
+        case TANK_RECTANGLE:
+            area = tank.dimension1 * tank.dimension2;
+            height = tank.dimension3;
+            break;
+        case TANK_CYLINDER:
+            area = (float) M_PI * tank.dimension1 * tank.dimension1 / 4;
+            height = tank.dimension2;
+            break;
+        case TANK_TABLE:
+            return compileTable(tank, offset, gain);
+        default:
+            return ESP_ERR_INVALID_ARG;
+    }
+
+    if ( (area <= 0) || (height <= 0) ) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    /** Liters per cubic meter and meters per unit of reading are folded into the slope. */
+    slope = area * 1000 / gain;
+    intercept = -slope * offset;
+    fullReading = offset + gain * height;
+    capacity = area * height * 1000;
+    return ESP_OK;
+}
+
+/**
+ * @brief If true, a tank config has been compiled.
+ */
+bool TankGeometry::isConfigured() {
+    return capacity > 0;
+}
+
+/**
+ * @brief Returns the tank volume at a height.
+ *
+ * @param reading Height on the scale of the config.
+ * @returns Volume in liters, not below zero. Heights beyond the tank are extrapolated
+ * from its nearest end.
+ */
+float TankGeometry::getVolume(float reading) {
+    uint8_t low = 0;
+    uint8_t high = 0;
+    uint8_t middle = 0;
+    float *segment = nullptr;
+    float width = 0;
+    float volume = 0;
+
+    if (knotCount == 0) {
+        volume = slope * reading + intercept;
+        return (volume < 0) ? 0 : volume;
+    }
+
+    /** The knots need not be evenly spaced, so the segment is found by bisection. */
+    high = knotCount - 1;
+    while (low < high) {
+        middle = (low + high + 1) / 2;
+        if (reading >= knots[middle]) {
+            low = middle;
+        } else {
+            high = middle - 1;
+        }
+    }
+
+    segment = coefficients[low];
+    width = reading - knots[low];
+    if (width < 0) {
+        /** Below the table, the volume follows the slope at its first point. */
+        volume = segment[0] + segment[1] * width;
+    } else {
+        volume = segment[0] + width * (segment[1] + width * (segment[2] + width * segment[3]));
+    }
+    return (volume < 0) ? 0 : volume;
+}
+
+/**
+ * @brief Returns the height of the full tank on the scale of the config.
+ */
+float TankGeometry::getFullReading() {
+    return fullReading;
+}
+
+/**
+ * @brief Returns the volume of the full tank in liters.
+ */
+float TankGeometry::getCapacity() {
+    return capacity;
+}
+
+/**
+ * @brief Compiles a strapping table into monotone cubic segments.
+ *
+ * @param tank Tank config with the strapping table.
+ * @param offset Reading at zero height.
+ * @param gain Reading per meter of height.
+ * @return esp_err_t Return code.
+ */
+esp_err_t TankGeometry::compileTable(TankConfig_t &tank, float offset, float gain) {
+    TankStrappingPoint_t *points = tank.strapping;
+    uint8_t count = tank.strappingPointCount;
+    float secants[MAX_TANK_STRAPPING_POINTS - 1];
+    float slopes[MAX_TANK_STRAPPING_POINTS];
+    float width = 0;
+    float alpha = 0;
+    float beta = 0;
+    float norm = 0;
+    float scale = 0;
+
+    if ( (count < 2) || (count > MAX_TANK_STRAPPING_POINTS) ) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    /** A tank only holds more water higher up, so both columns must rise. */
+    for (uint8_t i = 1; i < count; i++) {
+        if ( (points[i].height <= points[i - 1].height) || (points[i].volume < points[i - 1].volume) ) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    for (uint8_t i = 0; i < count; i++) {
+        knots[i] = offset + gain * points[i].height / 1000.0f;
+    }
+    for (uint8_t i = 0; i < count - 1; i++) {
+        secants[i] = (points[i + 1].volume - points[i].volume) / 1000.0f / (knots[i + 1] - knots[i]);
+    }
+
+    /** Each inner point takes the mean of the secants around it, or none if either is flat. */
+    slopes[0] = secants[0];
+    slopes[count - 1] = secants[count - 2];
+    if (count > 2) {
+        slopes[0] = endSlope(knots[1] - knots[0], knots[2] - knots[1], secants[0], secants[1]);
+        slopes[count - 1] = endSlope(knots[count - 1] - knots[count - 2], knots[count - 2] - knots[count - 3], secants[count - 2], secants[count - 3]);
+    }
+    for (uint8_t i = 1; i < count - 1; i++) {
+        slopes[i] = ( (secants[i - 1] == 0) || (secants[i] == 0) ) ? 0 : (secants[i - 1] + secants[i]) / 2;
+    }
+
+    /** Slopes steep against the secant of their segment are scaled back, so it cannot overshoot. */
+    for (uint8_t i = 0; i < count - 1; i++) {
+        if (secants[i] == 0) {
+            slopes[i] = 0;
+            slopes[i + 1] = 0;
+            continue;
+        }
+
+        alpha = slopes[i] / secants[i];
+        beta = slopes[i + 1] / secants[i];
+        norm = alpha * alpha + beta * beta;
+        if (norm > 9) {
+            scale = 3 / sqrtf(norm);
+            slopes[i] = scale * alpha * secants[i];
+            slopes[i + 1] = scale * beta * secants[i];
+        }
+    }
+
+    /** Hermite segments, expanded into powers of the reading past each knot. */
+    for (uint8_t i = 0; i < count - 1; i++) {
+        width = knots[i + 1] - knots[i];
+        coefficients[i][0] = points[i].volume / 1000.0f;
+        coefficients[i][1] = slopes[i];
+        coefficients[i][2] = (3 * secants[i] - 2 * slopes[i] - slopes[i + 1]) / width;
+        coefficients[i][3] = (slopes[i] + slopes[i + 1] - 2 * secants[i]) / (width * width);
+    }
+
+    /** Above the table, the volume follows the slope at its last point. */
+    coefficients[count - 1][0] = points[count - 1].volume / 1000.0f;
+    coefficients[count - 1][1] = slopes[count - 1];
+    coefficients[count - 1][2] = 0;
+    coefficients[count - 1][3] = 0;
+
+    knotCount = count;
+    fullReading = knots[count - 1];
+    capacity = points[count - 1].volume / 1000.0f;
+    return ESP_OK;
+}
+
+/**
+ * @brief Returns the slope at an end of the table, from the parabola through its three end points.
+ * The slope is kept from turning against the end secant or overshooting it, so the end segment stays monotone.
+ *
+ * @param width Width of the end segment.
+ * @param nextWidth Width of the segment next to it.
+ * @param secant Secant of the end segment.
+ * @param nextSecant Secant of the segment next to it.
+ */
+float TankGeometry::endSlope(float width, float nextWidth, float secant, float nextSecant) {
+    float slope = ((2 * width + nextWidth) * secant - width * nextSecant) / (width + nextWidth);
+
+    if (slope * secant <= 0) {
+        return 0;
+    }
+    if ( (secant * nextSecant <= 0) && (fabsf(slope) > fabsf(3 * secant)) ) {
+        return 3 * secant;
+    }
+    return slope;
+}
\ No newline at end of file
@@ -0,0 +1,97 @@
+#ifndef TANK_GEOMETRY_H
+#define TANK_GEOMETRY_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#include "config.h"
+
+/**
+ * @brief Converts the water height into the tank volume by the shape of the tank config.
+ * The conversion is compiled into coefficients whenever the config changes, so reading
+ * the volume of an upright tank takes one multiply-add, and the height is read on any
+ * linear scale, such as the pressure sensor voltage, at no extra cost.
+ *
+ * The strapping table of a TANK_TABLE shape is interpolated by monotone cubic segments
+ * with the slopes of Fritsch and Carlson, so the volume rises smoothly with the height
+ * without overshooting between points. Has no hardware dependencies.
+ */
+class TankGeometry {
+public:
+    /**
+     * @brief Constructor.
+     */
+    TankGeometry();
+
+    /**
+     * @brief Compiles the conversion of a tank config. The height is read on the scale
+     * offset + gain * meters, so a gain of one and an offset of zero read it in meters.
+     *
+     * @param tank Tank config.
+     * @param offset Reading at zero height.
+     * @param gain Reading per meter of height. Must be positive.
+     * @return esp_err_t Return code. ESP_ERR_INVALID_ARG if the tank has no volume,
+     * or its strapping table has fewer than two points or does not rise in height.
+     */
+    esp_err_t configure(TankConfig_t &tank, float offset, float gain);
+
+    /**
+     * @brief If true, a tank config has been compiled.
+     */
+    bool isConfigured();
+
+    /**
+     * @brief Returns the tank volume at a height.
+     *
+     * @param reading Height on the scale of the config.
+     * @returns Volume in liters, not below zero. Heights beyond the tank are extrapolated
+     * from its nearest end.
+     */
+    float getVolume(float reading);
+
+    /**
+     * @brief Returns the height of the full tank on the scale of the config.
+     */
+    float getFullReading();
+
+    /**
+     * @brief Returns the volume of the full tank in liters.
+     */
+    float getCapacity();
+
+private:
+    /** Number of segment knots, zero for an upright tank. */
+    uint8_t knotCount;
+    /** Volume per unit of reading, and the volume at a zero reading, of an upright tank. */
+    float slope;
+    float intercept;
+    /** Reading at the start of each segment, and the coefficients of its cubic in the reading past the start, in rising power order. */
+    float knots[MAX_TANK_STRAPPING_POINTS];
+    float coefficients[MAX_TANK_STRAPPING_POINTS][4];
+    float fullReading;
+    float capacity;
+
+    /**
+     * @brief Compiles a strapping table into monotone cubic segments.
+     *
+     * @param tank Tank config with the strapping table.
+     * @param offset Reading at zero height.
+     * @param gain Reading per meter of height.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t compileTable(TankConfig_t &tank, float offset, float gain);
+
+    /**
+     * @brief Returns the slope at an end of the table, from the parabola through its three end points.
+     * The slope is kept from turning against the end secant or overshooting it, so the end segment stays monotone.
+     *
+     * @param width Width of the end segment.
+     * @param nextWidth Width of the segment next to it.
+     * @param secant Secant of the end segment.
+     * @param nextSecant Secant of the segment next to it.
+     */
+    static float endSlope(float width, float nextWidth, float secant, float nextSecant);
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,81 @@
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "halSystem.h"
+
+#include "resourceManager.h"
+
+static const char* TAG = "ResourceManager";
+
+/**
+ * @brief Constructor.
+ */
+ResourceManager::ResourceManager() {
+    minimumLargestBlock = UINT32_MAX;
+}
+
+/**
+ * @brief Samples the largest free block of the heap, which the heap does not track.
+ */
+void ResourceManager::sample() {
+    HalHeapStats_t heap = {};
+
+    if (halHeapStats(heap) != ESP_OK) {
+        return;
+    }
+    if (heap.largestFreeBlock < minimumLargestBlock) {
+        minimumLargestBlock = heap.largestFreeBlock;
+    }
+}
+
+/**
+ * @brief Reads the current margins.
+ *
+ * @param report Overwritten with the margins.
+ */
+void ResourceManager::getReport(ResourceReport_t &report) {
+    HalHeapStats_t heap = {};
+    uint32_t highWater = 0;
+
+    report = {};
+
+    /** Sample first, so the current block counts towards the least. */
+    sample();
+    if (halHeapStats(heap) == ESP_OK) {
+        report.heapAvailable = true;
+        report.heapFree = heap.freeBytes;
+        report.heapMinimumFree = heap.minimumFreeBytes;
+        report.heapLargestBlock = heap.largestFreeBlock;
+        report.heapMinimumLargestBlock = minimumLargestBlock;
+    }
+
+    for (int i = 0; i < RESOURCE_TASK_COUNT; i++) {
+        report.stackHighWater[i] = -1;
+        if (halTaskStackHighWater(RESOURCE_TASKS[i], highWater) == ESP_OK) {
+            report.stackHighWater[i] = highWater;
+        }
+    }
+}
+
+/**
+ * @brief Prints the margins to the serial log as errors.
+ *
+ * @param report The margins.
+ */
+void ResourceManager::log(ResourceReport_t &report) {
+    if (report.heapAvailable) {
+        ESP_LOGE(TAG, "Heap %lu bytes free, %lu least, largest block %lu, %lu least.",
+            (unsigned long) report.heapFree,
+            (unsigned long) report.heapMinimumFree,
+            (unsigned long) report.heapLargestBlock,
+            (unsigned long) report.heapMinimumLargestBlock
+        );
+    }
+
+    for (int i = 0; i < RESOURCE_TASK_COUNT; i++) {
+        if (report.stackHighWater[i] >= 0) {
+            ESP_LOGE(TAG, "Task %s least free stack %ld bytes.", RESOURCE_TASKS[i], (long) report.stackHighWater[i]);
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,77 @@
+#ifndef RESOURCE_MANAGER_H
+#define RESOURCE_MANAGER_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+/** Number of tasks whose stacks are reported. */
+#define RESOURCE_TASK_COUNT 6
+
+/**
+ * @brief Names of the tasks whose stacks are reported: the FSM task created by main,
+ * then the tasks of the MQTT client, the timers, the TCP/IP stack, the WiFi driver and the default event loop.
+ */
+static const char* const RESOURCE_TASKS[RESOURCE_TASK_COUNT] = {
+    "FSM",
+    "mqtt_task",
+    "esp_timer",
+    "tiT",
+    "wifi",
+    "sys_evt"
+};
+
+/**
+ * @brief Describes the margins of the memory of the firmware.
+ */
+typedef struct ResourceReport_t {
+    /** If false, the heap cannot be inspected and its fields are zero. */
+    bool heapAvailable = false;
+    /** Free heap, in bytes. */
+    uint32_t heapFree = 0;
+    /** Least free heap since boot, in bytes. */
+    uint32_t heapMinimumFree = 0;
+    /** Largest block which can be allocated, in bytes. */
+    uint32_t heapLargestBlock = 0;
+    /** Least largest block seen by the samples since boot, in bytes. */
+    uint32_t heapMinimumLargestBlock = 0;
+    /** Least free stack of each of RESOURCE_TASKS since it was created in bytes, or -1 if unavailable. */
+    int32_t stackHighWater[RESOURCE_TASK_COUNT] = {};
+} ResourceReport_t;
+
+/**
+ * @brief Monitors the heap and the stacks of the tasks, so their margins
+ * can be reported and the stacks sized from measurements.
+ */
+class ResourceManager {
+public:
+    /**
+     * @brief Constructor.
+     */
+    ResourceManager();
+
+    /**
+     * @brief Samples the largest free block of the heap, which the heap does not track.
+     * The free heap and the stack high-water marks are tracked by the heap and the kernel.
+     */
+    void sample();
+
+    /**
+     * @brief Reads the current margins.
+     *
+     * @param report Overwritten with the margins.
+     */
+    void getReport(ResourceReport_t &report);
+
+    /**
+     * @brief Prints the margins to the serial log as errors, so they are kept in the log of a fatal error.
+     *
+     * @param report The margins.
+     */
+    static void log(ResourceReport_t &report);
+
+private:
+    uint32_t minimumLargestBlock;
+};
+
+#endif
\ No newline at end of file
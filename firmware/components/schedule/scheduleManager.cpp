@@ -0,0 +1,237 @@
+#include <cstdlib>
+#include <cstring>
+#include <time.h>
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "halSystem.h"
+
+#include "scheduleManager.h"
+
+static const char* TAG = "ScheduleManager";
+
+/** Last deadline run, retained through deep sleep so it is not run again on wake. */
+static RTC_DATA_ATTR time_t rtcLastFireTime;
+
+/**
+ * @brief Constructor.
+ */
+ScheduleManager::ScheduleManager() {
+    schedule = {};
+    sntpStarted = false;
+    indexed = false;
+    nextFireTime = 0;
+    nextMask = 0;
+}
+
+/**
+ * @brief Applies the schedule config. Sets the local time zone, and
+ * starts SNTP synchronization once the network stack is initialized.
+ * 
+ * @param config Schedule config.
+ * @return esp_err_t Return code.
+ */
+esp_err_t ScheduleManager::configure(ScheduleConfig_t &config) {
+    esp_err_t err = ESP_OK;
+    bool serverChanged = (strncmp(schedule.ntpServer, config.ntpServer, sizeof(schedule.ntpServer)) != 0);
+
+    if (config.entryCount > MAX_SCHEDULE_ENTRIES) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    schedule = config;
+    setenv("TZ", schedule.timezone, 1);
+    tzset();
+    indexed = false;
+
+    /** The client keeps a pointer to the server name, so it is restarted if the name changes. */
+    if (sntpStarted && serverChanged) {
+        halSntpStop();
+        sntpStarted = false;
+    }
+    if ( (sntpStarted == false) && (schedule.ntpServer[0] != '\0') ) {
+        err = halSntpStart(schedule.ntpServer);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to start SNTP: %s", esp_err_to_name(err));
+            return err;
+        }
+        sntpStarted = true;
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief If true, the clock has been set by SNTP, possibly before deep sleep.
+ */
+bool ScheduleManager::isTimeValid() {
+    return time(nullptr) >= SCHEDULE_MIN_VALID_TIME;
+}
+
+/**
+ * @brief Returns the time until the next deadline in miliseconds, zero if
+ * it is due, or SCHEDULE_NO_DEADLINE if no entry is enabled.
+ */
+uint32_t ScheduleManager::getTimeUntilNext() {
+    time_t now = 0;
+
+    if (updateIndex() == false) {
+        return (schedule.entryCount > 0) ? SCHEDULE_CLOCK_POLL_MS : SCHEDULE_NO_DEADLINE;
+    }
+    if (nextFireTime == 0) {
+        return SCHEDULE_NO_DEADLINE;
+    }
+
+    now = time(nullptr);
+    if (now >= nextFireTime) {
+        return 0;
+    }
+    if (nextFireTime - now >= (time_t) (SCHEDULE_NO_DEADLINE / 1000)) {
+        return SCHEDULE_NO_DEADLINE - 1;
+    }
+
+    return (nextFireTime - now) * 1000;
+}
+
+/**
+ * @brief Checks whether the next deadline is due. If so, the entries firing at it
+ * are returned as a run plan and the following deadline is found.
+ * 
+ * @param plan Overwritten with the entries of the deadline if due is set.
+ * @param due Set to true if a deadline is due.
+ * @return esp_err_t Return code. ESP_ERR_TIMEOUT if the deadline was missed by
+ * more than SCHEDULE_LATE_LIMIT and skipped.
+ */
+esp_err_t ScheduleManager::getDueRun(RunPlan_t &plan, bool &due) {
+    time_t now = time(nullptr);
+    time_t fireTime = 0;
+    uint32_t fireMask = 0;
+    DispenseTarget_t *step = nullptr;
+
+    due = false;
+    if ( (updateIndex() == false) || (nextFireTime == 0) || (now < nextFireTime) ) {
+        return ESP_OK;
+    }
+
+    fireTime = nextFireTime;
+    fireMask = nextMask;
+    rtcLastFireTime = fireTime;
+    findNext(fireTime);
+
+    if (now - fireTime > SCHEDULE_LATE_LIMIT) {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    plan = {};
+    for (uint8_t i = 0; i < schedule.entryCount; i++) {
+        if ( (fireMask & (1UL << i)) == 0 ) {
+            continue;
+        }
+
+        step = &plan.steps[plan.stepCount++];
+        step->zone = schedule.entries[i].zone;
+        step->targetVolume = schedule.entries[i].targetVolume;
+        step->targetTime = schedule.entries[i].targetTime;
+        step->timeout = schedule.entries[i].timeout;
+    }
+
+    due = (plan.stepCount > 0);
+    return ESP_OK;
+}
+
+/**
+ * @brief Finds the next deadline once the clock is valid.
+ * 
+ * @returns True if the next deadline is known.
+ */
+bool ScheduleManager::updateIndex() {
+    time_t now = 0;
+    time_t after = 0;
+
+    if (indexed) {
+        return true;
+    }
+    if (isTimeValid() == false) {
+        return false;
+    }
+
+    /** 
+     * Start after the last deadline run, so a deadline passed while waking from
+     * deep sleep still runs, but never further back than the late limit.
+     */
+    now = time(nullptr);
+    after = now - SCHEDULE_LATE_LIMIT;
+    if (rtcLastFireTime > after) {
+        after = rtcLastFireTime;
+    }
+
+    findNext(after);
+    indexed = true;
+    return true;
+}
+
+/**
+ * @brief Finds the earliest deadline of all entries after a time.
+ * 
+ * @param after Time in seconds since the epoch.
+ */
+void ScheduleManager::findNext(time_t after) {
+    time_t fireTime = 0;
+
+    nextFireTime = 0;
+    nextMask = 0;
+
+    /** Entries at the same time are collected, so they run as a single plan. */
+    for (uint8_t i = 0; i < schedule.entryCount; i++) {
+        fireTime = nextEntryTime(schedule.entries[i], after);
+        if (fireTime == 0) {
+            continue;
+        }
+
+        if ( (nextFireTime == 0) || (fireTime < nextFireTime) ) {
+            nextFireTime = fireTime;
+            nextMask = 1UL << i;
+        } else if (fireTime == nextFireTime) {
+            nextMask |= 1UL << i;
+        }
+    }
+}
+
+/**
+ * @brief Returns the first time an entry fires after a time, or zero if it is disabled.
+ * 
+ * @param entry Schedule entry.
+ * @param after Time in seconds since the epoch.
+ */
+time_t ScheduleManager::nextEntryTime(ScheduleEntry_t &entry, time_t after) {
+    struct tm local = {};
+    struct tm candidate = {};
+    time_t fireTime = 0;
+
+    if ( ((entry.days & 0x7F) == 0) || (entry.minute >= 24 * 60) ) {
+        return 0;
+    }
+
+    localtime_r(&after, &local);
+
+    /** Today and the next seven days, so the same weekday a week later is also covered. */
+    for (uint8_t day = 0; day <= 7; day++) {
+        if ( (entry.days & (1 << ((local.tm_wday + day) % 7))) == 0 ) {
+            continue;
+        }
+
+        candidate = local;
+        candidate.tm_mday += day;
+        candidate.tm_hour = entry.minute / 60;
+        candidate.tm_min = entry.minute % 60;
+        candidate.tm_sec = 0;
+        candidate.tm_isdst = -1;
+        fireTime = mktime(&candidate);
+        if (fireTime > after) {
+            return fireTime;
+        }
+    }
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,97 @@
+#ifndef SCHEDULE_MANAGER_H
+#define SCHEDULE_MANAGER_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "esp_err.h"
+
+#include "config.h"
+#include "valveManager.h"
+
+/** Earliest valid time, 2024-01-01 UTC. The clock is unset until the first SNTP synchronization. */
+#define SCHEDULE_MIN_VALID_TIME 1704067200
+/** Deadlines missed by more than this many seconds are skipped instead of run late. */
+#define SCHEDULE_LATE_LIMIT 900
+/** Period at which the clock is checked while waiting for the first synchronization, in miliseconds. */
+#define SCHEDULE_CLOCK_POLL_MS 10000
+/** Returned by getTimeUntilNext() if no deadline is pending. */
+#define SCHEDULE_NO_DEADLINE UINT32_MAX
+
+/**
+ * @brief Runs the schedule table of the config without the broker. Only the
+ * next deadline is kept, so each check is a single comparison, and the
+ * FSM bounds its waits and deep sleeps by the time until that deadline.
+ */
+class ScheduleManager {
+public:
+    /**
+     * @brief Constructor.
+     */
+    ScheduleManager();
+
+    /**
+     * @brief Applies the schedule config. Sets the local time zone, and
+     * starts SNTP synchronization once the network stack is initialized.
+     * 
+     * @param config Schedule config.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t configure(ScheduleConfig_t &config);
+
+    /**
+     * @brief If true, the clock has been set by SNTP, possibly before deep sleep.
+     */
+    bool isTimeValid();
+
+    /**
+     * @brief Returns the time until the next deadline in miliseconds, zero if
+     * it is due, or SCHEDULE_NO_DEADLINE if no entry is enabled.
+     */
+    uint32_t getTimeUntilNext();
+
+    /**
+     * @brief Checks whether the next deadline is due. If so, the entries firing at it
+     * are returned as a run plan and the following deadline is found.
+     * 
+     * @param plan Overwritten with the entries of the deadline if due is set.
+     * @param due Set to true if a deadline is due.
+     * @return esp_err_t Return code. ESP_ERR_TIMEOUT if the deadline was missed by
+     * more than SCHEDULE_LATE_LIMIT and skipped.
+     */
+    esp_err_t getDueRun(RunPlan_t &plan, bool &due);
+
+private:
+    ScheduleConfig_t schedule;
+    bool sntpStarted;
+    /** If true, the next deadline has been found for the current config and clock. */
+    bool indexed;
+    /** Next deadline, or zero if none. */
+    time_t nextFireTime;
+    /** Entries firing at the next deadline, bit 0 is the first entry. */
+    uint32_t nextMask;
+
+    /**
+     * @brief Finds the next deadline once the clock is valid.
+     * 
+     * @returns True if the next deadline is known.
+     */
+    bool updateIndex();
+
+    /**
+     * @brief Finds the earliest deadline of all entries after a time.
+     * 
+     * @param after Time in seconds since the epoch.
+     */
+    void findNext(time_t after);
+
+    /**
+     * @brief Returns the first time an entry fires after a time, or zero if it is disabled.
+     * 
+     * @param entry Schedule entry.
+     * @param after Time in seconds since the epoch.
+     */
+    time_t nextEntryTime(ScheduleEntry_t &entry, time_t after);
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,393 @@
+#include <cstring>
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "halTime.h"
+#include "halTrace.h"
+
+#include "traceManager.h"
+
+static const char* TAG = "TraceManager";
+
+/** Largest varint of a 64 bit value, in bytes. */
+#define TRACE_VARINT_MAX_BYTES 10
+
+/**
+ * @brief Constructor.
+ */
+TraceManager::TraceManager() {
+    pulseHead.store(0);
+    pulseTail.store(0);
+    pulsesLost = 0;
+    adcHead.store(0);
+    adcTail.store(0);
+    adcsLost = 0;
+    messageHead.store(0);
+    messageTail.store(0);
+    messagesLost = 0;
+    capturing = false;
+    lostRecorded = 0;
+    lastTime = 0;
+    sequence = 0;
+    streamLength = 0;
+}
+
+/**
+ * @brief Begins capturing a new trace.
+ *
+ * @return esp_err_t Return code. ESP_ERR_INVALID_STATE if a trace is being captured or read.
+ */
+esp_err_t TraceManager::start() {
+    uint32_t magic = TRACE_MAGIC;
+
+    if (isActive()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    /** Nothing produces inputs while the callback is cleared, so the buffers can be reset. */
+    pulseHead.store(0);
+    pulseTail.store(0);
+    pulsesLost = 0;
+    adcHead.store(0);
+    adcTail.store(0);
+    adcsLost = 0;
+    messageHead.store(0);
+    messageTail.store(0);
+    messagesLost = 0;
+    lostRecorded = 0;
+    sequence = 0;
+    streamLength = 0;
+
+    lastTime = halTimeMicros();
+    encodeBytes(&magic, sizeof(magic));
+    encodeVarint(lastTime);
+
+    capturing = true;
+    halTraceSetCallback(&onInput, this);
+    ESP_LOGI(TAG, "Capture started.");
+    return ESP_OK;
+}
+
+/**
+ * @brief Stops capturing. The inputs captured so far remain to be read.
+ */
+void TraceManager::stop() {
+    if (capturing == false) {
+        return;
+    }
+
+    halTraceSetCallback(nullptr, nullptr);
+    capturing = false;
+    ESP_LOGI(TAG, "Capture stopped, %lu inputs lost.", (unsigned long) (pulsesLost + adcsLost + messagesLost));
+}
+
+/**
+ * @brief If true, a trace is being captured or has chunks left to read.
+ */
+bool TraceManager::isActive() {
+    return capturing
+        || (streamLength > 0)
+        || (pulseTail.load() != pulseHead.load())
+        || (adcTail.load() != adcHead.load())
+        || (messageTail.load() != messageHead.load());
+}
+
+/**
+ * @brief Encodes the inputs captured since the last call, and returns the next
+ * complete chunk of the trace. Once stopped, the last chunk may be shorter.
+ *
+ * @param chunk Overwritten with the chunk, of TRACE_CHUNK_BYTES bytes.
+ * @param length Overwritten with the length of the chunk in bytes.
+ * @param sequence Overwritten with the sequence number of the chunk, from zero.
+ * @returns True if a chunk was returned.
+ */
+bool TraceManager::read(uint8_t *chunk, uint16_t &length, uint32_t &sequence) {
+    bool pending = true;
+
+    length = 0;
+    while ( (streamLength < TRACE_CHUNK_BYTES) && pending ) {
+        pending = encodeNext();
+    }
+
+    /** Flush the remainder once stopped and every buffered input is encoded. */
+    if (streamLength >= TRACE_CHUNK_BYTES) {
+        length = TRACE_CHUNK_BYTES;
+    } else if ( (capturing == false) && (streamLength > 0) ) {
+        length = streamLength;
+    } else {
+        return false;
+    }
+
+    memcpy(chunk, stream, length);
+    memmove(stream, stream + length, streamLength - length);
+    streamLength -= length;
+    sequence = this->sequence++;
+    return true;
+}
+
+/**
+ * @brief Reads a varint of a trace.
+ *
+ * @return esp_err_t Return code. ESP_ERR_INVALID_SIZE if the varint is truncated.
+ */
+static esp_err_t decodeVarint(const uint8_t *data, size_t length, size_t &offset, uint64_t &value) {
+    int shift = 0;
+
+    value = 0;
+    do {
+        if ( (offset >= length) || (shift >= 64) ) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        value |= (uint64_t) (data[offset] & 0x7F) << shift;
+        shift += 7;
+    } while (data[offset++] & 0x80);
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Decodes the header of a trace.
+ *
+ * @param data The trace.
+ * @param length Length of the trace in bytes.
+ * @param offset Overwritten with the offset of the first record.
+ * @param startTime Overwritten with the capture start time, in microseconds since boot.
+ * @return esp_err_t Return code. ESP_ERR_INVALID_VERSION if the magic does not match.
+ */
+esp_err_t TraceManager::decodeHeader(const uint8_t *data, size_t length, size_t &offset, int64_t &startTime) {
+    esp_err_t err = ESP_OK;
+    uint32_t magic = 0;
+    uint64_t value = 0;
+
+    if (length < sizeof(magic)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(&magic, data, sizeof(magic));
+    if (magic != TRACE_MAGIC) {
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    offset = sizeof(magic);
+    err = decodeVarint(data, length, offset, value);
+    if (err != ESP_OK) return err;
+
+    startTime = value;
+    return ESP_OK;
+}
+
+/**
+ * @brief Decodes the next record of a trace.
+ *
+ * @param data The trace.
+ * @param length Length of the trace in bytes.
+ * @param offset Offset of the record. Advanced to the next record.
+ * @param record Overwritten with the record. Its time must be that of the previous record,
+ * or the capture start time for the first record.
+ * @return esp_err_t Return code. ESP_ERR_NOT_FOUND at the end of the trace,
+ * ESP_ERR_INVALID_SIZE if the record is truncated.
+ */
+esp_err_t TraceManager::decode(const uint8_t *data, size_t length, size_t &offset, TraceRecord_t &record) {
+    esp_err_t err = ESP_OK;
+    uint64_t value = 0;
+    int64_t time = record.time;
+
+    if (offset >= length) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    err = decodeVarint(data, length, offset, value);
+    if (err != ESP_OK) return err;
+
+    record = {};
+    record.type = (TraceRecords_e) (value & 0x03);
+    record.time = time + (int64_t) (value >> 2);
+
+    switch (record.type) {
+        case TRACE_RECORD_PULSE:
+            if (offset >= length) return ESP_ERR_INVALID_SIZE;
+            record.pin = data[offset++];
+            return ESP_OK;
+
+        case TRACE_RECORD_ADC:
+            if (offset >= length) return ESP_ERR_INVALID_SIZE;
+            record.pin = data[offset++];
+            err = decodeVarint(data, length, offset, value);
+            record.millivolts = value;
+            return err;
+
+        case TRACE_RECORD_MQTT:
+            err = decodeVarint(data, length, offset, value);
+            if (err != ESP_OK) return err;
+            if ( (value > TRACE_TOPIC_MAX_BYTES) || (offset + value > length) ) return ESP_ERR_INVALID_SIZE;
+            record.topic = reinterpret_cast<const char*>(data + offset);
+            record.topicLength = value;
+            offset += value;
+
+            err = decodeVarint(data, length, offset, value);
+            if (err != ESP_OK) return err;
+            if ( (value > TRACE_PAYLOAD_MAX_BYTES) || (offset + value > length) ) return ESP_ERR_INVALID_SIZE;
+            record.data = reinterpret_cast<const char*>(data + offset);
+            record.dataLength = value;
+            offset += value;
+            return ESP_OK;
+
+        case TRACE_RECORD_LOST:
+        default:
+            err = decodeVarint(data, length, offset, value);
+            record.lost = value;
+            return err;
+    }
+}
+
+/**
+ * @brief Buffers an input. Runs on the producer of the input.
+ */
+IRAM_ATTR void TraceManager::onInput(void *arg, HalTraceInput_t &input) {
+    TraceManager *self = static_cast<TraceManager*>(arg);
+    uint16_t head = 0;
+    TraceMqtt_t *message = nullptr;
+
+    switch (input.id) {
+        /** Runs in interrupt context on the target. */
+        case HAL_TRACE_PULSE:
+            head = self->pulseHead.load(std::memory_order_relaxed);
+            if ((uint16_t) (head - self->pulseTail.load(std::memory_order_acquire)) >= TRACE_PULSE_BUFFER_LENGTH) {
+                self->pulsesLost = self->pulsesLost + 1;
+                return;
+            }
+            self->pulses[head % TRACE_PULSE_BUFFER_LENGTH].time = input.time;
+            self->pulses[head % TRACE_PULSE_BUFFER_LENGTH].pin = input.pin;
+            self->pulseHead.store(head + 1, std::memory_order_release);
+            break;
+
+        case HAL_TRACE_ADC:
+            head = self->adcHead.load(std::memory_order_relaxed);
+            if ((uint16_t) (head - self->adcTail.load(std::memory_order_acquire)) >= TRACE_ADC_BUFFER_LENGTH) {
+                self->adcsLost = self->adcsLost + 1;
+                return;
+            }
+            self->adcs[head % TRACE_ADC_BUFFER_LENGTH].time = input.time;
+            self->adcs[head % TRACE_ADC_BUFFER_LENGTH].pin = input.pin;
+            self->adcs[head % TRACE_ADC_BUFFER_LENGTH].millivolts = input.millivolts;
+            self->adcHead.store(head + 1, std::memory_order_release);
+            break;
+
+        case HAL_TRACE_MQTT_DATA:
+            head = self->messageHead.load(std::memory_order_relaxed);
+            if ( ((uint16_t) (head - self->messageTail.load(std::memory_order_acquire)) >= TRACE_MQTT_BUFFER_LENGTH)
+                || (input.topicLength > TRACE_TOPIC_MAX_BYTES) || (input.dataLength > TRACE_PAYLOAD_MAX_BYTES) ) {
+                self->messagesLost = self->messagesLost + 1;
+                return;
+            }
+            message = &self->messages[head % TRACE_MQTT_BUFFER_LENGTH];
+            message->time = input.time;
+            message->topicLength = input.topicLength;
+            message->dataLength = input.dataLength;
+            memcpy(message->topic, input.topic, input.topicLength);
+            memcpy(message->data, input.data, input.dataLength);
+            self->messageHead.store(head + 1, std::memory_order_release);
+            break;
+
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Encodes the buffered input with the earliest time.
+ *
+ * @returns False if no input is buffered.
+ */
+bool TraceManager::encodeNext() {
+    uint16_t pulseTail = this->pulseTail.load(std::memory_order_relaxed);
+    uint16_t adcTail = this->adcTail.load(std::memory_order_relaxed);
+    uint16_t messageTail = this->messageTail.load(std::memory_order_relaxed);
+    TracePulse_t *pulse = nullptr;
+    TraceAdc_t *adc = nullptr;
+    TraceMqtt_t *message = nullptr;
+    uint32_t lost = pulsesLost + adcsLost + messagesLost;
+
+    /** Record losses as they are noticed, so the replay knows where the trace is incomplete. */
+    if (lost != lostRecorded) {
+        encodeTag(lastTime, TRACE_RECORD_LOST);
+        encodeVarint(lost - lostRecorded);
+        lostRecorded = lost;
+    }
+
+    if (pulseTail != pulseHead.load(std::memory_order_acquire)) {
+        pulse = &pulses[pulseTail % TRACE_PULSE_BUFFER_LENGTH];
+    }
+    if (adcTail != adcHead.load(std::memory_order_acquire)) {
+        adc = &adcs[adcTail % TRACE_ADC_BUFFER_LENGTH];
+    }
+    if (messageTail != messageHead.load(std::memory_order_acquire)) {
+        message = &messages[messageTail % TRACE_MQTT_BUFFER_LENGTH];
+    }
+
+    /** Each buffer is in time order, so the earliest head is the next input. */
+    if ( (pulse != nullptr) && ((adc == nullptr) || (pulse->time <= adc->time)) && ((message == nullptr) || (pulse->time <= message->time)) ) {
+        encodeTag(pulse->time, TRACE_RECORD_PULSE);
+        encodeBytes(&pulse->pin, 1);
+        this->pulseTail.store(pulseTail + 1, std::memory_order_release);
+        return true;
+    }
+
+    if ( (adc != nullptr) && ((message == nullptr) || (adc->time <= message->time)) ) {
+        encodeTag(adc->time, TRACE_RECORD_ADC);
+        encodeBytes(&adc->pin, 1);
+        encodeVarint((adc->millivolts > 0) ? adc->millivolts : 0);
+        this->adcTail.store(adcTail + 1, std::memory_order_release);
+        return true;
+    }
+
+    if (message != nullptr) {
+        encodeTag(message->time, TRACE_RECORD_MQTT);
+        encodeVarint(message->topicLength);
+        encodeBytes(message->topic, message->topicLength);
+        encodeVarint(message->dataLength);
+        encodeBytes(message->data, message->dataLength);
+        this->messageTail.store(messageTail + 1, std::memory_order_release);
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Appends the varint of the time since the last record and the record type.
+ */
+void TraceManager::encodeTag(int64_t time, TraceRecords_e type) {
+    /** An input buffered by a preempted producer may be older than the last record. */
+    int64_t delta = (time > lastTime) ? (time - lastTime) : 0;
+
+    lastTime += delta;
+    encodeVarint(((uint64_t) delta << 2) | type);
+}
+
+/**
+ * @brief Appends a varint to the stream.
+ */
+void TraceManager::encodeVarint(uint64_t value) {
+    uint8_t bytes[TRACE_VARINT_MAX_BYTES];
+    size_t length = 0;
+
+    do {
+        bytes[length] = value & 0x7F;
+        value >>= 7;
+        if (value != 0) {
+            bytes[length] |= 0x80;
+        }
+        length++;
+    } while (value != 0);
+
+    encodeBytes(bytes, length);
+}
+
+/**
+ * @brief Appends bytes to the stream.
+ */
+void TraceManager::encodeBytes(const void *data, size_t length) {
+    memcpy(stream + streamLength, data, length);
+    streamLength += length;
+}
\ No newline at end of file
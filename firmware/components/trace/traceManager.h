@@ -0,0 +1,205 @@
+#ifndef TRACE_MANAGER_H
+#define TRACE_MANAGER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+#include "esp_err.h"
+#include "halTrace.h"
+
+/** Number of inputs of each kind buffered between two reads of the trace. Further inputs are counted as lost. */
+#define TRACE_PULSE_BUFFER_LENGTH 64
+#define TRACE_ADC_BUFFER_LENGTH 16
+#define TRACE_MQTT_BUFFER_LENGTH 4
+/** Received messages with a longer topic or payload are counted as lost. */
+#define TRACE_TOPIC_MAX_BYTES 64
+#define TRACE_PAYLOAD_MAX_BYTES 512
+/** Bytes of each chunk of the trace. A chunk fits a transmitted payload once base64 encoded. */
+#define TRACE_CHUNK_BYTES 168
+/** Encoded bytes waiting to be read. Holds a chunk and the largest record. */
+#define TRACE_STREAM_BYTES 1024
+/** "DRT1" in little endian, the first bytes of a trace. */
+#define TRACE_MAGIC 0x31545244
+
+/**
+ * @brief Describes the records of a trace.
+ *
+ * A trace is the magic, the capture start time as a varint in microseconds since boot,
+ * then a sequence of records. Each record begins with a varint of the time since
+ * the previous record in microseconds, shifted left by two, or'ed with the record type.
+ * - TRACE_RECORD_PULSE: the pin as a byte.
+ * - TRACE_RECORD_ADC: the pin as a byte, then the millivolts as a varint.
+ * - TRACE_RECORD_MQTT: the topic length as a varint, the topic, the payload length as a varint, the payload.
+ * - TRACE_RECORD_LOST: the number of inputs lost since the previous record as a varint.
+ */
+typedef enum TraceRecords_e {
+    TRACE_RECORD_PULSE,
+    TRACE_RECORD_ADC,
+    TRACE_RECORD_MQTT,
+    TRACE_RECORD_LOST
+} TraceRecords_e;
+
+/**
+ * @brief Describes a decoded record. Pointers are into the decoded trace.
+ */
+typedef struct TraceRecord_t {
+    TraceRecords_e type = TRACE_RECORD_PULSE;
+    /** Time of the input in microseconds since boot of the captured device. */
+    int64_t time = 0;
+    int8_t pin = -1;
+    int millivolts = 0;
+    uint32_t lost = 0;
+    /** Topic and payload of TRACE_RECORD_MQTT. Neither is null terminated. */
+    const char *topic = nullptr;
+    uint16_t topicLength = 0;
+    const char *data = nullptr;
+    uint16_t dataLength = 0;
+} TraceRecord_t;
+
+/**
+ * @brief Captures the inputs of the firmware at the HAL into a compact binary trace:
+ * the flow sensor pulses, the pressure sensor readings and the received messages.
+ * The trace is read in chunks by the caller, to be transmitted, and replayed on the host.
+ *
+ * Inputs are buffered by their producer, the pulse interrupt, the FSM task or
+ * the task of the MQTT client, and encoded in time order by the reader.
+ * A pulse takes about 3 bytes, so a dispense at 15 L/min from a sensor of 1265 pulses
+ * per liter streams about 1 kB/s. There is no flash journal, so the trace is only streamed.
+ */
+class TraceManager {
+public:
+    /**
+     * @brief Constructor.
+     */
+    TraceManager();
+
+    /**
+     * @brief Begins capturing a new trace.
+     *
+     * @return esp_err_t Return code. ESP_ERR_INVALID_STATE if a trace is being captured or read.
+     */
+    esp_err_t start();
+
+    /**
+     * @brief Stops capturing. The inputs captured so far remain to be read.
+     */
+    void stop();
+
+    /**
+     * @brief If true, a trace is being captured or has chunks left to read.
+     */
+    bool isActive();
+
+    /**
+     * @brief Encodes the inputs captured since the last call, and returns the next
+     * complete chunk of the trace. Once stopped, the last chunk may be shorter.
+     *
+     * @param chunk Overwritten with the chunk, of TRACE_CHUNK_BYTES bytes.
+     * @param length Overwritten with the length of the chunk in bytes.
+     * @param sequence Overwritten with the sequence number of the chunk, from zero.
+     * @returns True if a chunk was returned.
+     */
+    bool read(uint8_t *chunk, uint16_t &length, uint32_t &sequence);
+
+    /**
+     * @brief Decodes the header of a trace.
+     *
+     * @param data The trace.
+     * @param length Length of the trace in bytes.
+     * @param offset Overwritten with the offset of the first record.
+     * @param startTime Overwritten with the capture start time, in microseconds since boot.
+     * @return esp_err_t Return code. ESP_ERR_INVALID_VERSION if the magic does not match.
+     */
+    static esp_err_t decodeHeader(const uint8_t *data, size_t length, size_t &offset, int64_t &startTime);
+
+    /**
+     * @brief Decodes the next record of a trace.
+     *
+     * @param data The trace.
+     * @param length Length of the trace in bytes.
+     * @param offset Offset of the record. Advanced to the next record.
+     * @param record Overwritten with the record. Its time must be that of the previous record,
+     * or the capture start time for the first record.
+     * @return esp_err_t Return code. ESP_ERR_NOT_FOUND at the end of the trace,
+     * ESP_ERR_INVALID_SIZE if the record is truncated.
+     */
+    static esp_err_t decode(const uint8_t *data, size_t length, size_t &offset, TraceRecord_t &record);
+
+private:
+    typedef struct TracePulse_t {
+        int64_t time;
+        int8_t pin;
+    } TracePulse_t;
+
+    typedef struct TraceAdc_t {
+        int64_t time;
+        int8_t pin;
+        int millivolts;
+    } TraceAdc_t;
+
+    typedef struct TraceMqtt_t {
+        int64_t time;
+        uint8_t topicLength;
+        uint16_t dataLength;
+        char topic[TRACE_TOPIC_MAX_BYTES];
+        char data[TRACE_PAYLOAD_MAX_BYTES];
+    } TraceMqtt_t;
+
+    /**
+     * Each buffer has a single producer, which writes its head and lost count,
+     * and a single consumer, the reader, which writes its tail.
+     */
+    TracePulse_t pulses[TRACE_PULSE_BUFFER_LENGTH];
+    std::atomic<uint16_t> pulseHead;
+    std::atomic<uint16_t> pulseTail;
+    volatile uint32_t pulsesLost;
+
+    TraceAdc_t adcs[TRACE_ADC_BUFFER_LENGTH];
+    std::atomic<uint16_t> adcHead;
+    std::atomic<uint16_t> adcTail;
+    volatile uint32_t adcsLost;
+
+    TraceMqtt_t messages[TRACE_MQTT_BUFFER_LENGTH];
+    std::atomic<uint16_t> messageHead;
+    std::atomic<uint16_t> messageTail;
+    volatile uint32_t messagesLost;
+
+    bool capturing;
+    /** Lost inputs already recorded. */
+    uint32_t lostRecorded;
+    /** Time of the last encoded record. */
+    int64_t lastTime;
+    uint32_t sequence;
+    uint8_t stream[TRACE_STREAM_BYTES];
+    size_t streamLength;
+
+    /**
+     * @brief Buffers an input. Runs on the producer of the input.
+     */
+    static void onInput(void *arg, HalTraceInput_t &input);
+
+    /**
+     * @brief Encodes the buffered input with the earliest time.
+     *
+     * @returns False if no input is buffered.
+     */
+    bool encodeNext();
+
+    /**
+     * @brief Appends the varint of the time since the last record and the record type.
+     */
+    void encodeTag(int64_t time, TraceRecords_e type);
+
+    /**
+     * @brief Appends a varint to the stream.
+     */
+    void encodeVarint(uint64_t value);
+
+    /**
+     * @brief Appends bytes to the stream.
+     */
+    void encodeBytes(const void *data, size_t length);
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,251 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "switchoverPredictor.h"
+
+/**
+ * @brief Returns the least squares slope of a set of points, and the mean of their abscissas.
+ *
+ * @param x Abscissas.
+ * @param y Ordinates.
+ * @param count Number of points, at least two.
+ * @param center Overwritten with the mean of the abscissas.
+ */
+static float fitSlope(const float *x, const float *y, uint8_t count, float &center) {
+    float meanX = 0;
+    float meanY = 0;
+    float sxx = 0;
+    float sxy = 0;
+
+    for (uint8_t i = 0; i < count; i++) {
+        meanX += x[i];
+        meanY += y[i];
+    }
+    meanX /= count;
+    meanY /= count;
+    for (uint8_t i = 0; i < count; i++) {
+        sxx += (x[i] - meanX) * (x[i] - meanX);
+        sxy += (x[i] - meanX) * (y[i] - meanY);
+    }
+
+    center = meanX;
+    return (sxx > 0) ? (sxy / sxx) : 0;
+}
+
+/**
+ * @brief Constructor.
+ */
+SwitchoverPredictor::SwitchoverPredictor() {
+    enabled = false;
+    threshold = 0;
+    armThreshold = 0;
+    emptyRate = 0;
+    horizon = 0;
+    reset();
+}
+
+/**
+ * @brief Sets the switchover threshold. A fraction of zero disables the predictor.
+ * 
+ * @param sourceFlowRate Flow rate of the source in liters per minute.
+ * @param fraction Fraction of the source flow rate below which the tank is switched over.
+ * @param hysteresis Added to the fraction to arm the predictor, so it only switches
+ * over once the tank has flowed clearly above the threshold.
+ * @param horizon Interval the tank output is projected over, in miliseconds.
+ * @param emptyRate Flow rate below which the tank counts as empty, in liters per minute.
+ */
+void SwitchoverPredictor::configure(float sourceFlowRate, float fraction, float hysteresis, uint32_t horizon, float emptyRate) {
+    enabled = (sourceFlowRate > 0) && (fraction > 0) && (horizon > 0);
+    threshold = sourceFlowRate * fraction;
+    armThreshold = sourceFlowRate * (fraction + hysteresis);
+    this->emptyRate = emptyRate;
+    this->horizon = horizon / 60000.0f;
+    reset();
+}
+
+/**
+ * @brief Clears the estimates at the start of a dispense process.
+ */
+void SwitchoverPredictor::reset() {
+    hasVolume = false;
+    hasRate = false;
+    armed = false;
+    below = false;
+    belowCount = 0;
+    emptyCount = 0;
+    volume = 0;
+    periodVolume = 0;
+    periodCount = 0;
+    periodStart = 0;
+    memset(sampleVolumes, 0, sizeof(sampleVolumes));
+    memset(sampleTimes, 0, sizeof(sampleTimes));
+    sampleCount = 0;
+    sampleNext = 0;
+    memset(rates, 0, sizeof(rates));
+    memset(rateTimes, 0, sizeof(rateTimes));
+    rateCount = 0;
+    rateNext = 0;
+    rate = 0;
+    rateTime = 0;
+    slope = 0;
+    lastTime = 0;
+}
+
+/**
+ * @brief Adds a tank volume reading.
+ * 
+ * @param time Time of the reading in miliseconds.
+ * @param tankVolume Tank volume in liters.
+ */
+void SwitchoverPredictor::update(uint32_t time, float tankVolume) {
+    float center = 0;
+    float projectedRate = 0;
+    float projectedOutput = 0;
+
+    if (enabled == false) {
+        return;
+    }
+    if (hasVolume == false) {
+        volume = tankVolume;
+        hasVolume = true;
+    }
+    volume += PREDICTOR_VOLUME_SMOOTHING * (tankVolume - volume);
+    lastTime = time / 60000.0f;
+
+    if (periodCount == 0) {
+        periodStart = time;
+    }
+    periodVolume += tankVolume;
+    periodCount++;
+    if (time - periodStart < PREDICTOR_SAMPLE_PERIOD_MS) {
+        return;
+    }
+
+    sampleVolumes[sampleNext] = periodVolume / periodCount;
+    sampleTimes[sampleNext] = (periodStart + time) / 2 / 60000.0f;
+    sampleNext = (sampleNext + 1) % PREDICTOR_WINDOW_SAMPLES;
+    if (sampleCount < PREDICTOR_WINDOW_SAMPLES) sampleCount++;
+    periodVolume = 0;
+    periodCount = 0;
+
+    /** A partial window fits the valve opening transient and too few readings to judge the tank by. */
+    if (sampleCount < PREDICTOR_WINDOW_SAMPLES) {
+        return;
+    }
+
+    rate = -fitSlope(sampleTimes, sampleVolumes, sampleCount, rateTime);
+    rates[rateNext] = rate;
+    rateTimes[rateNext] = rateTime;
+    rateNext = (rateNext + 1) % PREDICTOR_SLOPE_SAMPLES;
+    if (rateCount < PREDICTOR_SLOPE_SAMPLES) rateCount++;
+    hasRate = true;
+
+    /** The change of the rate is only trusted from a full set of estimates, and a tank only slows down. */
+    slope = 0;
+    if (rateCount >= PREDICTOR_SLOPE_SAMPLES) {
+        slope = fitSlope(rateTimes, rates, rateCount, center);
+        if (slope > 0) {
+            slope = 0;
+        }
+    }
+
+    if (rate >= armThreshold) {
+        armed = true;
+    }
+
+    /** Average rate over the horizon on the current trend, limited by what is left in the tank. */
+    projectedRate = rate + slope * (lastTime - rateTime + horizon / 2);
+    if (projectedRate < 0) {
+        projectedRate = 0;
+    }
+    projectedOutput = projectedRate * horizon;
+    if (projectedOutput > volume) {
+        projectedOutput = (volume > 0) ? volume : 0;
+    }
+
+    if ( armed && (projectedOutput < threshold * horizon) ) {
+        below = true;
+    } else if (projectedRate >= armThreshold) {
+        below = false;
+    }
+    if (below) {
+        if (belowCount < PREDICTOR_HOLD_SAMPLES) belowCount++;
+    } else {
+        belowCount = 0;
+    }
+
+    if ( (rate < emptyRate) || (volume <= 0) ) {
+        if (emptyCount < PREDICTOR_HOLD_SAMPLES) emptyCount++;
+    } else {
+        emptyCount = 0;
+    }
+}
+
+/**
+ * @brief If true, the projected tank output over the horizon has stayed
+ * below the threshold long enough to switch over to the source.
+ */
+bool SwitchoverPredictor::shouldSwitch() {
+    return enabled && (belowCount >= PREDICTOR_HOLD_SAMPLES);
+}
+
+/**
+ * @brief If true, the fitted tank flow has stayed below the empty rate, or the
+ * tank volume at or below zero, long enough to close the tank.
+ */
+bool SwitchoverPredictor::isEmpty() {
+    return enabled && (emptyCount >= PREDICTOR_HOLD_SAMPLES);
+}
+
+/**
+ * @brief Returns the fitted rate of decline of the tank volume in liters per minute,
+ * projected to the last reading.
+ */
+float SwitchoverPredictor::getRate() {
+    float current = rate + slope * (lastTime - rateTime);
+
+    return (current > 0) ? current : 0;
+}
+
+/**
+ * @brief Returns the smoothed tank volume in liters.
+ */
+float SwitchoverPredictor::getVolume() {
+    return volume;
+}
+
+/**
+ * @brief Estimates the time until the tank flow rate falls below a rate
+ * or the tank runs empty, whichever is first.
+ * 
+ * @param rate Flow rate in liters per minute.
+ * @returns Time in miliseconds, or UINT32_MAX if it cannot be estimated.
+ */
+uint32_t SwitchoverPredictor::estimateTimeUntilRate(float rate) {
+    float current = 0;
+    float minutes = -1;
+    float empty = -1;
+
+    if (hasRate == false) {
+        return UINT32_MAX;
+    }
+    current = getRate();
+    if (current <= rate) {
+        return 0;
+    }
+
+    if (slope < 0) {
+        minutes = (current - rate) / -slope;
+    }
+    if ( (current > 0) && (volume > 0) ) {
+        empty = volume / current;
+        if ( (minutes < 0) || (empty < minutes) ) {
+            minutes = empty;
+        }
+    }
+    if ( (minutes < 0) || (minutes * 60000.0f >= (float) UINT32_MAX) ) {
+        return UINT32_MAX;
+    }
+
+    return (uint32_t) (minutes * 60000.0f);
+}
\ No newline at end of file
@@ -0,0 +1,134 @@
+#ifndef SWITCHOVER_PREDICTOR_H
+#define SWITCHOVER_PREDICTOR_H
+
+#include <stdint.h>
+
+/** Period the tank volume readings are averaged over, in miliseconds. */
+#define PREDICTOR_SAMPLE_PERIOD_MS 1000
+/** Number of averaged readings the decline rate is fitted over, by least squares. */
+#define PREDICTOR_WINDOW_SAMPLES 60
+/** Number of rate estimates the change of the rate is fitted over, by least squares. */
+#define PREDICTOR_SLOPE_SAMPLES 60
+/** Smoothing factor of the tank volume, between 0 and 1. */
+#define PREDICTOR_VOLUME_SMOOTHING 0.3f
+/** Number of consecutive rate estimates below the threshold before switching over. */
+#define PREDICTOR_HOLD_SAMPLES 5
+
+/**
+ * @brief Predicts when the tank stops being worth dispensing from, using the
+ * rate at which the tank volume declines. Has no hardware dependencies.
+ *
+ * The tank volume readings are averaged over each sample period. The decline rate is the least
+ * squares slope of the averages of the last window, and its change the least squares slope of
+ * the last rate estimates, so the noise of the pressure sensor is not amplified by differencing.
+ * The predictor only arms once a full window shows the tank flowing above the arm threshold, and
+ * a rate below the threshold only counts towards a switchover until the rate recovers above the
+ * arm threshold again.
+ */
+class SwitchoverPredictor {
+public:
+    /**
+     * @brief Constructor.
+     */
+    SwitchoverPredictor();
+
+    /**
+     * @brief Sets the switchover threshold. A fraction of zero disables the predictor.
+     * 
+     * @param sourceFlowRate Flow rate of the source in liters per minute.
+     * @param fraction Fraction of the source flow rate below which the tank is switched over.
+     * @param hysteresis Added to the fraction to arm the predictor, so it only switches
+     * over once the tank has flowed clearly above the threshold.
+     * @param horizon Interval the tank output is projected over, in miliseconds.
+     * @param emptyRate Flow rate below which the tank counts as empty, in liters per minute.
+     */
+    void configure(float sourceFlowRate, float fraction, float hysteresis, uint32_t horizon, float emptyRate);
+
+    /**
+     * @brief Clears the estimates at the start of a dispense process.
+     */
+    void reset();
+
+    /**
+     * @brief Adds a tank volume reading.
+     * 
+     * @param time Time of the reading in miliseconds.
+     * @param tankVolume Tank volume in liters.
+     */
+    void update(uint32_t time, float tankVolume);
+
+    /**
+     * @brief If true, the projected tank output over the horizon has stayed
+     * below the threshold long enough to switch over to the source.
+     */
+    bool shouldSwitch();
+
+    /**
+     * @brief If true, the fitted tank flow has stayed below the empty rate, or the
+     * tank volume at or below zero, long enough to close the tank.
+     */
+    bool isEmpty();
+
+    /**
+     * @brief Returns the fitted rate of decline of the tank volume in liters per minute,
+     * projected to the last reading.
+     */
+    float getRate();
+
+    /**
+     * @brief Returns the smoothed tank volume in liters.
+     */
+    float getVolume();
+
+    /**
+     * @brief Estimates the time until the tank flow rate falls below a rate
+     * or the tank runs empty, whichever is first.
+     * 
+     * @param rate Flow rate in liters per minute.
+     * @returns Time in miliseconds, or UINT32_MAX if it cannot be estimated.
+     */
+    uint32_t estimateTimeUntilRate(float rate);
+
+private:
+    bool enabled;
+    /** Flow rates in liters per minute. */
+    float threshold;
+    float armThreshold;
+    float emptyRate;
+    /** Projection horizon in minutes. */
+    float horizon;
+
+    bool hasVolume;
+    bool hasRate;
+    bool armed;
+    /** Set while the projected output is below the threshold, until the rate recovers above the arm threshold. */
+    bool below;
+    uint8_t belowCount;
+    /** Number of consecutive rate estimates below the empty rate, or with the tank empty. */
+    uint8_t emptyCount;
+    float volume;
+
+    /** Sum and number of the readings of the current sample period, and its start in miliseconds. */
+    float periodVolume;
+    uint16_t periodCount;
+    uint32_t periodStart;
+    /** Averaged readings in liters and their times in minutes, oldest overwritten first. */
+    float sampleVolumes[PREDICTOR_WINDOW_SAMPLES];
+    float sampleTimes[PREDICTOR_WINDOW_SAMPLES];
+    uint8_t sampleCount;
+    uint8_t sampleNext;
+    /** Rate estimates and the times they are centered on, in minutes. */
+    float rates[PREDICTOR_SLOPE_SAMPLES];
+    float rateTimes[PREDICTOR_SLOPE_SAMPLES];
+    uint8_t rateCount;
+    uint8_t rateNext;
+
+    /** Decline rate in liters per minute at rateTime, and its change in liters per minute squared. */
+    float rate;
+    float rateTime;
+    float slope;
+    /** Time of the last reading in minutes. */
+    float lastTime;
+};
+
+#endif
\ No newline at end of file
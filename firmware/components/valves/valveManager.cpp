@@ -1,4 +1,6 @@
 #include "esp_err.h"
+#include "esp_log.h"
+#include "halTime.h"
 
 #include "valveManager.h"
 
@@ -6,94 +8,996 @@ static const char* TAG = "ValveManager";
 
 /**
  * @brief Constructor.
+ *
+ * @param gpioManager Allocates the valve and flow sensor pins.
+ * @param pressureManager Reads the tank volume.
  */
-ValveManager::ValveManager() {
+template <typename Mode>
+ValveManagerT<Mode>::ValveManagerT(GpioManager *gpioManager, PressureManager *pressureManager) {
+    this->gpioManager = gpioManager;
+    this->pressureManager = pressureManager;
+    configured = false;
+    valveConfig = {};
+    valveConfig.sourcePin = -1;
+    valveConfig.tankPin = -1;
+    valveConfig.drainPin = -1;
+    valveConfig.flowSensorPin = -1;
+    pulsesPerLiter = 0;
+    staticFlowRate = 0;
+    minFlowRate = 0;
+    tankTimeout = 0;
+    blendEnabled = false;
     state = VALVES_IDLE;
-    dispenseTarget = {};
+    plan = {};
     dispenseProcess = {};
     dispenseSummary = {};
     drainTarget = {};
     drainProcess = {};
     drainSummary = {};
+    dispenseStartTime = 0;
+    stepStartTime = 0;
+    lastLoopTime = 0;
+    switchoverTime = 0;
+    blendStartTime = 0;
+    stepBlendTime = 0;
+    lastPulses = 0;
+    stepVolume = 0;
+    stepTankVolume = 0;
+    stepInitialTankLevel = 0;
+    fusionVolume = 0;
+    lastTankVolume = 0;
+    switchoverSaving = 0;
+    smoothedFlowRate = 0;
+    closeTime = 0;
+    closeSupplyState = VALVES_IDLE;
+    characteriseSummary = {};
+    characterisePhase = CHARACTERISE_OPENING;
+    characteriseTank = false;
+    characteriseCycle = 0;
+    phaseStartTime = 0;
+    phasePulses = 0;
+    openDelaySum = 0;
+    closeDelaySum = 0;
+    closeVolumeSum = 0;
 }
 
 /**
  * @brief Begin the ValveManager.
- * 
- * @return esp_err_t Return code. 
+ *
+ * @return esp_err_t Return code.
  */
-esp_err_t ValveManager::initialize() {
+template <typename Mode>
+esp_err_t ValveManagerT<Mode>::initialize() {
+    if ( (gpioManager == nullptr) || (pressureManager == nullptr) ) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
     return ESP_OK;
 }
 
 /**
- * @brief Begins a dispensation process.
- * 
- * @param target Target for the process.
- * @param state Overwritten with the initial state of the dispensation process.
+ * @brief Applies the config and claims the pins of the installed
+ * valves and flow sensor. Only allowed while idle.
+ *
+ * @param config Device config.
+ * @return esp_err_t Return code. ESP_ERR_NOT_SUPPORTED if a specialised build
+ * is given other valves or sensors than those of its mode.
+ */
+template <typename Mode>
+esp_err_t ValveManagerT<Mode>::configure(Config_t &config) {
+    esp_err_t err = ESP_OK;
+
+    if (state != VALVES_IDLE) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (config.valves.zoneCount > MAX_ZONES) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if ( (config.valves.sourcePin < 0) && (config.valves.tankPin < 0) ) {
+        ESP_LOGE(TAG, "No supply valve installed.");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    /** A specialised build only handles the valves and sensors of its mode. */
+    if ( (Mode::RUNTIME == false) && (
+            ((config.valves.sourcePin >= 0) != Mode::SOURCE) ||
+            ((config.valves.tankPin >= 0) != Mode::TANK) ||
+            ((config.valves.drainPin >= 0) != Mode::DRAIN) ||
+            ((config.pressureSensor.pin >= 0) != Mode::PRESSURE)) ) {
+        ESP_LOGE(TAG, "The installed valves and sensors do not match the operating mode of the build.");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    /** The tank has no known flow rate, so the switchover to the source depends on the sensor. */
+    if ( (config.valves.tankPin >= 0) && (config.valves.flowSensorPin < 0) ) {
+        ESP_LOGE(TAG, "The tank valve requires a flow sensor.");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    /** The correction factor belongs to the calibration of the flow sensor it was estimated against. */
+    if (config.flowSensor.defaultPulsesPerLiter != pulsesPerLiter) {
+        estimator.reset();
+    }
+
+    releasePins();
+    valveConfig = config.valves;
+    pulsesPerLiter = config.flowSensor.defaultPulsesPerLiter;
+    staticFlowRate = config.source.staticFlowRate;
+    minFlowRate = config.flowSensor.minFlowRate;
+    tankTimeout = (uint32_t) config.tank.tank_timeout * 1000;
+    predictor.configure(staticFlowRate, config.tank.switchoverFraction, config.tank.switchoverHysteresis, (uint32_t) config.tank.switchoverHorizon * 1000, minFlowRate);
+
+    /** Blending needs both supplies. The tank must not backfeed, so a check valve is assumed on its outlet. */
+    blendEnabled = Mode::BLEND && config.tank.blendEnabled && hasSource() && hasTank();
+
+    /** Claim every pin through the GpioManager, so the budget is checked in one place. */
+    if (valveConfig.sourcePin >= 0) {
+        err = gpioManager->claimValve(valveConfig.sourcePin, valveConfig.sourceDrive, "source valve");
+        if (err != ESP_OK) goto err;
+    }
+    if (valveConfig.tankPin >= 0) {
+        err = gpioManager->claimValve(valveConfig.tankPin, valveConfig.tankDrive, "tank valve");
+        if (err != ESP_OK) goto err;
+    }
+    if (valveConfig.drainPin >= 0) {
+        err = gpioManager->claimValve(valveConfig.drainPin, valveConfig.drainDrive, "drain valve");
+        if (err != ESP_OK) goto err;
+    }
+    for (int i = 0; i < valveConfig.zoneCount; i++) {
+        err = gpioManager->claimValve(valveConfig.zonePins[i], valveConfig.zoneDrives[i], "zone valve");
+        if (err != ESP_OK) goto err;
+    }
+    if (valveConfig.flowSensorPin >= 0) {
+        err = flowDriver.initialize(gpioManager, valveConfig.flowSensorPin);
+        if (err != ESP_OK) goto err;
+    }
+
+    configured = true;
+    ESP_LOGI(TAG, "Configured %d zones, %d pins left.", getZoneCount(), gpioManager->getFreePinCount());
+    return ESP_OK;
+
+err:
+    ESP_LOGE(TAG, "GPIO budget exceeded: %s", esp_err_to_name(err));
+    releasePins();
+    return err;
+}
+
+/**
+ * @brief Returns the number of zones which can be dispensed to.
+ * One if no zone valves are installed.
+ */
+template <typename Mode>
+uint8_t ValveManagerT<Mode>::getZoneCount() {
+    return (valveConfig.zoneCount == 0) ? 1 : valveConfig.zoneCount;
+}
+
+/**
+ * @brief Returns the number of flow sensor pulses counted since it was claimed,
+ * or zero if no flow sensor is installed.
+ */
+template <typename Mode>
+uint32_t ValveManagerT<Mode>::getFlowPulses() {
+    if (valveConfig.flowSensorPin < 0) {
+        return 0;
+    }
+
+    return flowDriver.getPulses();
+}
+
+/**
+ * @brief Proposes the K-factor of the flow sensor which matches the tank level, once the
+ * correction factor of the tank dispenses is known well enough.
+ *
+ * The correction factor must be estimated over RECALIBRATION_MIN_VOLUME, and the change is
+ * limited to RECALIBRATION_MAX_STEP, so a biased estimate cannot move the K-factor far at once.
+ *
+ * @param pulsesPerLiter Overwritten with the proposed K-factor in pulses per liter.
+ * @return esp_err_t Return code. ESP_ERR_INVALID_STATE if the correction factor is not known
+ * well enough or too close to one to propose a change. ESP_ERR_INVALID_SIZE if the change is beyond
+ * RECALIBRATION_MAX_CHANGE, in which case the K-factor is still given.
+ */
+template <typename Mode>
+esp_err_t ValveManagerT<Mode>::proposeRecalibration(float &pulsesPerLiter) {
+    float change = 0;
+
+    if ( (Mode::PRESSURE == false) || (flowDriver.isInstalled() == false) ) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if ( (estimator.getDeviation() > RECALIBRATION_MAX_DEVIATION) || (estimator.getCoveredVolume() < RECALIBRATION_MIN_VOLUME) ) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    /** The true volume is the metered volume times the correction factor, so the K-factor scales by its inverse. */
+    change = estimator.getCorrection() - 1;
+    if ( (change < RECALIBRATION_MIN_CHANGE) && (change > -RECALIBRATION_MIN_CHANGE) ) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    pulsesPerLiter = this->pulsesPerLiter / estimator.getCorrection();
+    if ( (change > RECALIBRATION_MAX_CHANGE) || (change < -RECALIBRATION_MAX_CHANGE) ) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (change > RECALIBRATION_MAX_STEP) {
+        pulsesPerLiter = this->pulsesPerLiter / (1 + RECALIBRATION_MAX_STEP);
+    } else if (change < -RECALIBRATION_MAX_STEP) {
+        pulsesPerLiter = this->pulsesPerLiter / (1 - RECALIBRATION_MAX_STEP);
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Begins a dispensation process running each step of the plan in order.
+ *
+ * @param plan Steps of the process.
+ * @param state Overwritten with the initial state of the process.
  * @param process Overwritten with the initial process variables.
  * @return esp_err_t Return code.
  */
-esp_err_t ValveManager::beginDispenstation(DispenseTarget_t &target, ValveStates_e &state, DispenseProcess_t &process) {
+template <typename Mode>
+esp_err_t ValveManagerT<Mode>::beginDispense(RunPlan_t &plan, ValveStates_e &state, DispenseProcess_t &process) {
+    esp_err_t err = ESP_OK;
+    int64_t now = halTimeMicros();
+
+    state = this->state;
+    if ( (configured == false) || (this->state != VALVES_IDLE) ) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if ( (plan.stepCount == 0) || (plan.stepCount > MAX_RUN_STEPS) ) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (int i = 0; i < plan.stepCount; i++) {
+        if (plan.steps[i].zone >= getZoneCount()) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        if ( (plan.steps[i].targetVolume <= 0) && (plan.steps[i].targetTime == 0) ) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    this->plan = plan;
+    dispenseProcess = {};
+    dispenseSummary = {};
+    switchoverTime = 0;
+    switchoverSaving = 0;
+    blendStartTime = 0;
+    smoothedFlowRate = 0;
+    dispenseStartTime = now;
+    predictor.reset();
+    estimator.begin();
+    fusionVolume = 0;
+
+    /** Open the zone before the supply, so the supply never runs against a closed line. */
+    err = setValve(zonePin(plan.steps[0].zone), true);
+    if (err != ESP_OK) goto err;
+
+    /** Dispense from the tank first when installed, like the legacy firmware. */
+    if (hasTank()) {
+        err = setValve(valveConfig.tankPin, true);
+        if (err != ESP_OK) goto err;
+        this->state = VALVES_TANK_DISPENSE;
+    } else {
+        err = setValve(valveConfig.sourcePin, true);
+        if (err != ESP_OK) goto err;
+        this->state = VALVES_SOURCE_DISPENSE;
+    }
+
+    beginStep(now);
+    state = this->state;
+    process = dispenseProcess;
     return ESP_OK;
+
+err:
+    closeAll();
+    this->state = VALVES_IDLE;
+    state = this->state;
+    return err;
 }
 
 /**
- * @brief Updates the dispensation process.
- * 
- * @param state Overwritten with the current state.
+ * @brief Updates the dispense process. When a step completes, the next
+ * zone valve is opened before the last one is closed, without closing the supply.
+ *
+ * @param state Overwritten with the current state. VALVES_IDLE once the last step completes.
  * @param process Overwritten with the current process variables.
- * @param summary Overwritten with the current process summary.
+ * @param summary Overwritten with the summary of the completed step if stepComplete is set.
+ * @param stepComplete Set to true if a step completed during this update.
  * @return esp_err_t Return code.
  */
-esp_err_t ValveManager::loopDispense(ValveStates_e &state, DispenseProcess_t &process, DispenseSummary_t &summary) {
+template <typename Mode>
+esp_err_t ValveManagerT<Mode>::loopDispense(ValveStates_e &state, DispenseProcess_t &process, DispenseSummary_t &summary, bool &stepComplete) {
+    esp_err_t err = ESP_OK;
+    int64_t now = halTimeMicros();
+    float minutes = (now - lastLoopTime) / 60000000.0f;
+    uint32_t pulses = 0;
+    float volume = 0;
+    uint32_t elapsed = 0;
+    DispenseTarget_t *target = nullptr;
+    DispenseTarget_t *next = nullptr;
+    float tankVolume = 0;
+    float tankShare = 0;
+    uint32_t untilTimeoutRule = 0;
+    bool timeoutRule = false;
+    bool exhausted = false;
+    bool lastStep = false;
+    float inFlightVolume = 0;
+    int64_t lastPulseTime = 0;
+
+    stepComplete = false;
+    if ( (this->state != VALVES_TANK_DISPENSE) && (this->state != VALVES_SOURCE_DISPENSE) && (this->state != VALVES_BLENDED_DISPENSE) && (this->state != VALVES_CLOSING) ) {
+        state = this->state;
+        return ESP_ERR_INVALID_STATE;
+    }
+    target = &plan.steps[dispenseProcess.step];
+
+    /** Measure the volume since the last update. */
+    if (flowDriver.isInstalled()) {
+        pulses = flowDriver.getPulses();
+        volume = (pulses - lastPulses) / pulsesPerLiter;
+        lastPulses = pulses;
+    } else {
+        volume = staticFlowRate * minutes;
+    }
+    lastLoopTime = now;
+
+    stepVolume += volume;
+    if ( Mode::TANK && ((this->state == VALVES_TANK_DISPENSE) || ((this->state == VALVES_CLOSING) && (closeSupplyState == VALVES_TANK_DISPENSE))) ) {
+        stepTankVolume += volume;
+    }
+    if ( Mode::TANK && Mode::PRESSURE && (this->state == VALVES_TANK_DISPENSE) ) {
+        fusionVolume += volume;
+    }
+    elapsed = (now - stepStartTime) / 1000;
+
+    dispenseProcess.time = elapsed;
+    dispenseProcess.outputVolume = stepVolume;
+    dispenseProcess.flowRate = (minutes > 0) ? (volume / minutes) : 0;
+    smoothedFlowRate += VALVE_FLOW_RATE_SMOOTHING * (dispenseProcess.flowRate - smoothedFlowRate);
+
+    /** Only the tank part of the step is corrected by the tank level, the source part stays metered. */
+    dispenseProcess.fusedVolume = stepVolume;
+    if (Mode::TANK && Mode::PRESSURE) {
+        dispenseProcess.correction = estimator.getCorrection();
+        dispenseProcess.fusedVolume = estimator.getStepVolume(stepVolume);
+    }
+
+    /** After the last step, keep metering until the line settles so the summary includes the overshoot. */
+    if (this->state == VALVES_CLOSING) {
+        lastPulseTime = flowDriver.getLastPulseTime();
+        if (lastPulseTime < closeTime) {
+            lastPulseTime = closeTime;
+        }
+        if ( (now - lastPulseTime >= VALVE_QUIET_MS * 1000) || (now - closeTime >= VALVE_SETTLE_TIMEOUT_MS * 1000) ) {
+            summarizeStep(closeTime, true);
+            summary = dispenseSummary;
+            stepComplete = true;
+            this->state = VALVES_IDLE;
+            ESP_LOGI(TAG, "Line settled, %.3f liters beyond the target.", dispenseSummary.overshoot);
+        }
+        state = this->state;
+        process = dispenseProcess;
+        return ESP_OK;
+    }
+
+    /** Track the decline of the tank volume while dispensing from it. */
+    if ( Mode::PRESSURE && (pressureManager->getTankVolume(tankVolume) == ESP_OK) ) {
+        dispenseProcess.tankLevel = tankVolume;
+        if ( (this->state == VALVES_TANK_DISPENSE) || (this->state == VALVES_BLENDED_DISPENSE) ) {
+            predictor.update((now - dispenseStartTime) / 1000, tankVolume);
+        }
+
+        /** While only the tank flows, its decline and the meter measure the same volume. */
+        if ( Mode::TANK && (this->state == VALVES_TANK_DISPENSE) ) {
+            estimator.update((now - dispenseStartTime) / 1000, fusionVolume, tankVolume);
+        }
+    }
+
+    /** 
+     * While blending the meter measures both supplies, so the tank share is
+     * the decline of the smoothed tank volume. Only a new low of the volume is credited, so
+     * its noise does not add up over the blend. It is bounded by the step volume in the summary.
+     */
+    if ( Mode::BLEND && (this->state == VALVES_BLENDED_DISPENSE) ) {
+        tankShare = lastTankVolume - predictor.getVolume();
+        if (tankShare > 0) {
+            stepTankVolume += tankShare;
+            lastTankVolume = predictor.getVolume();
+        }
+        stepBlendTime += (now - blendStartTime) / 1000;
+        blendStartTime = now;
+
+        /** The tank is done once its own fitted flow has stayed below the minimum flow rate. */
+        if (predictor.isEmpty()) {
+            setValve(valveConfig.tankPin, false);
+            this->state = VALVES_SOURCE_DISPENSE;
+            ESP_LOGI(TAG, "Tank empty, closed after blending %.2f liters from it.", stepTankVolume);
+        }
+    } else if (Mode::TANK) {
+        lastTankVolume = predictor.getVolume();
+    }
+
+    /** 
+     * Switch over to the source once the tank stops flowing, or end the run if there is none.
+     * The predictor switches over earlier, once the projected tank flow is no longer worth the wait
+     * for the source. Without a source, the tank is always worth the wait.
+     */
+    timeoutRule = Mode::TANK && (dispenseProcess.flowRate < minFlowRate) && (elapsed > tankTimeout);
+    if ( Mode::TANK && (this->state == VALVES_TANK_DISPENSE) && (timeoutRule || (hasSource() && predictor.shouldSwitch())) ) {
+        if (timeoutRule == false) {
+            untilTimeoutRule = predictor.estimateTimeUntilRate(minFlowRate);
+            if ( (untilTimeoutRule != UINT32_MAX) && (elapsed < tankTimeout) && (untilTimeoutRule < tankTimeout - elapsed) ) {
+                untilTimeoutRule = tankTimeout - elapsed;
+            }
+            switchoverSaving = (untilTimeoutRule == UINT32_MAX) ? 0 : untilTimeoutRule;
+        }
+
+        if ( Mode::BLEND && blendEnabled && (timeoutRule == false) ) {
+            /** Keep the tank open on its low-head tail, the source makes up the rest of the flow. */
+            err = setValve(valveConfig.sourcePin, true);
+            if (err != ESP_OK) goto err;
+            this->state = VALVES_BLENDED_DISPENSE;
+            switchoverTime = now;
+            blendStartTime = now;
+            ESP_LOGI(TAG, "Tank flow declining, blending with the source after %.2f liters.", stepTankVolume);
+        } else if (hasSource()) {
+            err = setValve(valveConfig.sourcePin, true);
+            if (err != ESP_OK) goto err;
+            setValve(valveConfig.tankPin, false);
+            this->state = VALVES_SOURCE_DISPENSE;
+            switchoverTime = now;
+            ESP_LOGI(TAG, "Tank %s, switched over to the source after %.2f liters.", timeoutRule ? "empty" : "flow declining", stepTankVolume);
+        } else {
+            ESP_LOGW(TAG, "Tank empty, ending the run.");
+            exhausted = true;
+        }
+    }
+
+    /** 
+     * A volume target takes precedence over a time target. The supply only closes after
+     * the last step, so only then is the close command issued early by the volume in flight.
+     */
+    lastStep = exhausted || (dispenseProcess.step + 1 >= plan.stepCount);
+    if (target->targetVolume > 0) {
+        if (lastStep) {
+            inFlightVolume = smoothedFlowRate * getCloseDelay() / 60000.0f;
+        }
+        stepComplete = stepVolume + inFlightVolume >= target->targetVolume;
+    } else {
+        stepComplete = elapsed >= target->targetTime;
+    }
+    if ( (target->timeout > 0) && (elapsed >= target->timeout) ) {
+        ESP_LOGW(TAG, "Step %d timed out.", dispenseProcess.step);
+        stepComplete = true;
+    }
+    stepComplete = stepComplete || exhausted;
+
+    if (stepComplete) {
+
+        /** Move to the next step without closing the supply. */
+        if (lastStep == false) {
+            summarizeStep(now, true);
+            summary = dispenseSummary;
+            next = &plan.steps[dispenseProcess.step + 1];
+            if (next->zone != target->zone) {
+                err = setValve(zonePin(next->zone), true);
+                if (err != ESP_OK) goto err;
+                setValve(zonePin(target->zone), false);
+            }
+            dispenseProcess.step++;
+            beginStep(now);
+
+        /** The summary of the last step waits for the line to settle. */
+        } else if (flowDriver.isInstalled()) {
+            closeAll();
+            closeSupplyState = this->state;
+            closeTime = now;
+            this->state = VALVES_CLOSING;
+            stepComplete = false;
+        } else {
+            summarizeStep(now, true);
+            summary = dispenseSummary;
+            closeAll();
+            this->state = VALVES_IDLE;
+        }
+    }
+
+    state = this->state;
+    process = dispenseProcess;
     return ESP_OK;
+
+err:
+    closeAll();
+    this->state = VALVES_IDLE;
+    state = this->state;
+    return err;
 }
 
 /**
- * @brief Ends the dispensation process.
- * 
+ * @brief Ends the dispense process before the plan completes.
+ *
  * @param state Overwritten with the state.
  * @param process Overwritten with the current process variables.
- * @param summary Overwritten with the current process summary.
+ * @param summary Overwritten with the summary of the interrupted step.
  * @return esp_err_t Return code.
  */
-esp_err_t ValveManager::endDispense(ValveStates_e &state, DispenseProcess_t &process, DispenseSummary_t &summary) {
+template <typename Mode>
+esp_err_t ValveManagerT<Mode>::endDispense(ValveStates_e &state, DispenseProcess_t &process, DispenseSummary_t &summary) {
+    if ( (this->state == VALVES_TANK_DISPENSE) || (this->state == VALVES_SOURCE_DISPENSE) || (this->state == VALVES_BLENDED_DISPENSE) ) {
+        summarizeStep(halTimeMicros(), false);
+    } else if (this->state == VALVES_CLOSING) {
+        summarizeStep(closeTime, true);
+    }
+
+    closeAll();
+    this->state = VALVES_IDLE;
+    state = this->state;
+    process = dispenseProcess;
+    summary = dispenseSummary;
     return ESP_OK;
 }
 
 /**
  * @brief Begins a drain process.
- * 
+ *
  * @param target Target for the process.
  * @param state Overwritten with the initial state of the drain process.
  * @param process Overwritten with the initial process variables.
  * @return esp_err_t Return code.
  */
-esp_err_t ValveManager::beginDrain(DrainTarget_t &target, ValveStates_e &state, DrainProcess_t &process) {
+template <typename Mode>
+esp_err_t ValveManagerT<Mode>::beginDrain(DrainTarget_t &target, ValveStates_e &state, DrainProcess_t &process) {
+    esp_err_t err = ESP_OK;
+
+    state = this->state;
+    if ( (configured == false) || (this->state != VALVES_IDLE) ) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (hasDrain() == false) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (target.targetTime == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    err = setValve(valveConfig.drainPin, true);
+    if (err != ESP_OK) return err;
+
+    drainTarget = target;
+    drainProcess = {};
+    drainSummary = {};
+    stepStartTime = halTimeMicros();
+    this->state = VALVES_TANK_DRAIN;
+    state = this->state;
+    process = drainProcess;
     return ESP_OK;
 }
 
 /**
  * @brief Updates the drain process.
- * 
+ *
  * @param state Overwritten with the current state.
  * @param process Overwritten with the current process variables.
  * @param summary Overwritten with the current process summary.
  * @return esp_err_t Return code.
  */
-esp_err_t ValveManager::loopDrain(ValveStates_e &state, DrainProcess_t &process, DrainSummary_t &summary) {
+template <typename Mode>
+esp_err_t ValveManagerT<Mode>::loopDrain(ValveStates_e &state, DrainProcess_t &process, DrainSummary_t &summary) {
+    uint32_t elapsed = 0;
+
+    if (this->state != VALVES_TANK_DRAIN) {
+        state = this->state;
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    elapsed = (halTimeMicros() - stepStartTime) / 1000;
+    drainProcess.time = elapsed;
+    drainSummary.duration = elapsed;
+
+    if ( (elapsed >= drainTarget.targetTime) || ((drainTarget.timeout > 0) && (elapsed >= drainTarget.timeout)) ) {
+        closeAll();
+        this->state = VALVES_IDLE;
+    }
+
+    state = this->state;
+    process = drainProcess;
+    summary = drainSummary;
     return ESP_OK;
 }
 
 /**
  * @brief Ends the drain process.
- * 
+ *
  * @param state Overwritten with the state.
  * @param process Overwritten with the current process variables.
  * @param summary Overwritten with the current process summary.
  * @return esp_err_t Return code.
  */
-esp_err_t ValveManager::endDrain(ValveStates_e &state, DrainProcess_t &process, DrainSummary_t &summary) {
+template <typename Mode>
+esp_err_t ValveManagerT<Mode>::endDrain(ValveStates_e &state, DrainProcess_t &process, DrainSummary_t &summary) {
+    if (this->state == VALVES_TANK_DRAIN) {
+        drainSummary.duration = (halTimeMicros() - stepStartTime) / 1000;
+    }
+
+    closeAll();
+    this->state = VALVES_IDLE;
+    state = this->state;
+    process = drainProcess;
+    summary = drainSummary;
+    return ESP_OK;
+}
+
+/**
+ * @brief Begins the characterisation process, which opens and closes each
+ * installed supply valve into the first zone and measures its latency from the flow pulses.
+ *
+ * @param state Overwritten with the initial state of the process.
+ * @return esp_err_t Return code. ESP_ERR_NOT_SUPPORTED if no flow sensor is installed.
+ */
+template <typename Mode>
+esp_err_t ValveManagerT<Mode>::beginCharacterise(ValveStates_e &state) {
+    esp_err_t err = ESP_OK;
+
+    state = this->state;
+    if ( (configured == false) || (this->state != VALVES_IDLE) ) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (flowDriver.isInstalled() == false) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    characteriseSummary = {};
+    characteriseTank = (hasSource() == false);
+
+    /** Open the zone before the supply, as in a dispense process. */
+    err = setValve(zonePin(0), true);
+    if (err != ESP_OK) goto err;
+
+    this->state = VALVES_CHARACTERISE;
+    err = beginCharacteriseSupply(halTimeMicros());
+    if (err != ESP_OK) goto err;
+
+    state = this->state;
+    return ESP_OK;
+
+err:
+    closeAll();
+    this->state = VALVES_IDLE;
+    state = this->state;
+    return err;
+}
+
+/**
+ * @brief Updates the characterisation process.
+ *
+ * @param state Overwritten with the current state. VALVES_IDLE once every supply valve is measured.
+ * @param summary Overwritten with the latency of the supply valves measured so far.
+ * @return esp_err_t Return code.
+ */
+template <typename Mode>
+esp_err_t ValveManagerT<Mode>::loopCharacterise(ValveStates_e &state, CharacteriseSummary_t &summary) {
+    esp_err_t err = ESP_OK;
+    int64_t now = halTimeMicros();
+    int64_t lastPulseTime = flowDriver.getLastPulseTime();
+    uint32_t elapsed = (now - phaseStartTime) / 1000;
+    int8_t pin = characteriseTank ? valveConfig.tankPin : valveConfig.sourcePin;
+    ValveCharacterisation_t *result = characteriseTank ? &characteriseSummary.tank : &characteriseSummary.source;
+    bool nextSupply = false;
+
+    if (this->state != VALVES_CHARACTERISE) {
+        state = this->state;
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    switch (characterisePhase) {
+
+        /** The open delay ends at the first pulse after the open command. */
+        case CHARACTERISE_OPENING:
+            if (flowDriver.getOnsetTime() > phaseStartTime) {
+                openDelaySum += (flowDriver.getOnsetTime() - phaseStartTime) / 1000;
+                characterisePhase = CHARACTERISE_FLOWING;
+                phaseStartTime = now;
+            } else if (elapsed >= CHARACTERISE_ONSET_TIMEOUT_MS) {
+                ESP_LOGW(TAG, "No flow from the %s valve, skipped.", characteriseTank ? "tank" : "source");
+                nextSupply = true;
+            }
+            break;
+
+        /** Let the flow settle before closing. */
+        case CHARACTERISE_FLOWING:
+            if (elapsed >= CHARACTERISE_FLOW_MS) {
+                setValve(pin, false);
+                phasePulses = flowDriver.getPulses();
+                characterisePhase = CHARACTERISE_CLOSING;
+                phaseStartTime = now;
+            }
+            break;
+
+        /** The close delay ends at the last pulse, once no pulse arrived for VALVE_QUIET_MS. */
+        case CHARACTERISE_CLOSING:
+            if (lastPulseTime < phaseStartTime) {
+                lastPulseTime = phaseStartTime;
+            }
+            if (now - lastPulseTime >= VALVE_QUIET_MS * 1000) {
+                closeDelaySum += (lastPulseTime - phaseStartTime) / 1000;
+                closeVolumeSum += (flowDriver.getPulses() - phasePulses) / pulsesPerLiter;
+                characteriseCycle++;
+
+                if (characteriseCycle < CHARACTERISE_CYCLES) {
+                    flowDriver.resetOnset();
+                    err = setValve(pin, true);
+                    if (err != ESP_OK) goto err;
+                    characterisePhase = CHARACTERISE_OPENING;
+                    phaseStartTime = now;
+                    break;
+                }
+
+                result->measured = true;
+                result->latency.openDelay = openDelaySum / CHARACTERISE_CYCLES;
+                result->latency.closeDelay = closeDelaySum / CHARACTERISE_CYCLES;
+                result->closeVolume = closeVolumeSum / CHARACTERISE_CYCLES;
+                ESP_LOGI(TAG, "The %s valve opens in %u ms and closes in %u ms.", characteriseTank ? "tank" : "source", result->latency.openDelay, result->latency.closeDelay);
+                nextSupply = true;
+            } else if (elapsed >= VALVE_SETTLE_TIMEOUT_MS) {
+                ESP_LOGW(TAG, "The %s valve did not close, skipped.", characteriseTank ? "tank" : "source");
+                nextSupply = true;
+            }
+            break;
+    }
+
+    /** A supply without usable pulses is skipped and keeps its previous latency. */
+    if (nextSupply) {
+        setValve(pin, false);
+        if (characteriseTank == false) {
+            characteriseTank = true;
+            err = beginCharacteriseSupply(now);
+            if (err != ESP_OK) goto err;
+        } else {
+            closeAll();
+            this->state = VALVES_IDLE;
+        }
+    }
+
+    state = this->state;
+    summary = characteriseSummary;
+    return ESP_OK;
+
+err:
+    closeAll();
+    this->state = VALVES_IDLE;
+    state = this->state;
+    summary = characteriseSummary;
+    return err;
+}
+
+/**
+ * @brief Ends the characterisation process.
+ *
+ * @param state Overwritten with the final state.
+ * @return esp_err_t Return code.
+ */
+template <typename Mode>
+esp_err_t ValveManagerT<Mode>::endCharacterise(ValveStates_e &state) {
+    closeAll();
+    this->state = VALVES_IDLE;
+    state = this->state;
     return ESP_OK;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Opens or closes a valve. Has no effect if the valve is not installed.
+ *
+ * @param pin GPIO of the valve, or -1.
+ * @param open True to open.
+ * @return esp_err_t Return code.
+ */
+template <typename Mode>
+esp_err_t ValveManagerT<Mode>::setValve(int8_t pin, bool open) {
+    if (pin < 0) {
+        return ESP_OK;
+    }
+
+    return gpioManager->setLevel(pin, open);
+}
+
+/**
+ * @brief Returns the GPIO of a zone valve, or -1 if no zone valves are installed.
+ */
+template <typename Mode>
+int8_t ValveManagerT<Mode>::zonePin(uint8_t zone) {
+    if (zone >= valveConfig.zoneCount) {
+        return -1;
+    }
+
+    return valveConfig.zonePins[zone];
+}
+
+/**
+ * @brief Closes every valve.
+ */
+template <typename Mode>
+void ValveManagerT<Mode>::closeAll() {
+    /** Close the supply before the zones, so the line is never pressurized against a closed zone. */
+    if (hasSource()) {
+        setValve(valveConfig.sourcePin, false);
+    }
+    if (hasTank()) {
+        setValve(valveConfig.tankPin, false);
+    }
+    if (hasDrain()) {
+        setValve(valveConfig.drainPin, false);
+    }
+    for (int i = 0; i < valveConfig.zoneCount; i++) {
+        setValve(valveConfig.zonePins[i], false);
+    }
+}
+
+/**
+ * @brief Releases the pins claimed by configure().
+ */
+template <typename Mode>
+void ValveManagerT<Mode>::releasePins() {
+    /** A failed configure() may have claimed only some pins. Releasing an unclaimed pin has no effect. */
+    closeAll();
+    flowDriver.deinitialize();
+    gpioManager->release(valveConfig.sourcePin);
+    gpioManager->release(valveConfig.tankPin);
+    gpioManager->release(valveConfig.drainPin);
+    for (int i = 0; i < valveConfig.zoneCount; i++) {
+        gpioManager->release(valveConfig.zonePins[i]);
+    }
+    configured = false;
+}
+
+/**
+ * @brief Resets the variables of the current step and fills in the initial process variables.
+ *
+ * @param now Current time in microseconds.
+ */
+template <typename Mode>
+void ValveManagerT<Mode>::beginStep(int64_t now) {
+    stepStartTime = now;
+    lastLoopTime = now;
+    lastPulses = flowDriver.getPulses();
+    stepVolume = 0;
+    stepTankVolume = 0;
+    stepBlendTime = 0;
+    if (this->state == VALVES_BLENDED_DISPENSE) {
+        blendStartTime = now;
+    }
+    if ( (Mode::PRESSURE == false) || (pressureManager->getTankVolume(stepInitialTankLevel) != ESP_OK) ) {
+        stepInitialTankLevel = 0;
+    }
+
+    /** A switchover in an earlier step carries over, as the tank stays empty. */
+    if (switchoverTime != 0) {
+        switchoverTime = now;
+    }
+
+    dispenseProcess.zone = plan.steps[dispenseProcess.step].zone;
+    dispenseProcess.time = 0;
+    dispenseProcess.outputVolume = 0;
+    dispenseProcess.flowRate = 0;
+    dispenseProcess.tankLevel = stepInitialTankLevel;
+    dispenseProcess.fusedVolume = 0;
+    if (Mode::TANK && Mode::PRESSURE) {
+        dispenseProcess.correction = estimator.getCorrection();
+        estimator.beginStep();
+    }
+}
+
+/**
+ * @brief Returns the close delay of the open supply valves in miliseconds.
+ */
+template <typename Mode>
+uint16_t ValveManagerT<Mode>::getCloseDelay() {
+    uint16_t source = valveConfig.sourceLatency.closeDelay;
+    uint16_t tank = valveConfig.tankLatency.closeDelay;
+
+    switch (state) {
+        case VALVES_TANK_DISPENSE:
+            return tank;
+        case VALVES_SOURCE_DISPENSE:
+            return source;
+
+        /** The flow stops once the slower of the two has closed. */
+        case VALVES_BLENDED_DISPENSE:
+            return (source > tank) ? source : tank;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * @brief Opens the next installed supply valve to characterise, or ends the process after the last one.
+ * The source is characterised before the tank.
+ *
+ * @param now Current time in microseconds.
+ * @return esp_err_t Return code.
+ */
+template <typename Mode>
+esp_err_t ValveManagerT<Mode>::beginCharacteriseSupply(int64_t now) {
+    int8_t pin = characteriseTank ? valveConfig.tankPin : valveConfig.sourcePin;
+
+    if ( (characteriseTank && (hasTank() == false)) || ((characteriseTank == false) && (hasSource() == false)) ) {
+        closeAll();
+        state = VALVES_IDLE;
+        return ESP_OK;
+    }
+
+    characterisePhase = CHARACTERISE_OPENING;
+    characteriseCycle = 0;
+    openDelaySum = 0;
+    closeDelaySum = 0;
+    closeVolumeSum = 0;
+    phaseStartTime = now;
+    flowDriver.resetOnset();
+    return setValve(pin, true);
+}
+
+/**
+ * @brief Fills in the summary of the current step.
+ *
+ * @param now Current time in microseconds.
+ * @param completed True if the step reached its target, so the overshoot is reported.
+ */
+template <typename Mode>
+void ValveManagerT<Mode>::summarizeStep(int64_t now, bool completed) {
+    dispenseSummary = {};
+    dispenseSummary.zone = dispenseProcess.zone;
+    dispenseSummary.step = dispenseProcess.step;
+    dispenseSummary.duration = (now - stepStartTime) / 1000;
+    dispenseSummary.outputVolume = stepVolume;
+    dispenseSummary.outputTankVolume = (stepTankVolume < stepVolume) ? stepTankVolume : stepVolume;
+    dispenseSummary.outputSourceVolume = stepVolume - dispenseSummary.outputTankVolume;
+    dispenseSummary.blendTime = stepBlendTime;
+    if (switchoverTime != 0) {
+        dispenseSummary.tankSwitchoverTime = (switchoverTime - stepStartTime) / 1000;
+    }
+    dispenseSummary.initialTankLevel = stepInitialTankLevel;
+    dispenseSummary.finalTankLevel = dispenseProcess.tankLevel;
+
+    /** Only reported by the step in which the switchover happened. */
+    dispenseSummary.switchoverSaving = switchoverSaving;
+    switchoverSaving = 0;
+
+    if ( completed && (plan.steps[dispenseProcess.step].targetVolume > 0) ) {
+        dispenseSummary.overshoot = stepVolume - plan.steps[dispenseProcess.step].targetVolume;
+    }
+
+    dispenseSummary.fusedVolume = stepVolume;
+    if (Mode::TANK && Mode::PRESSURE) {
+        dispenseSummary.correction = estimator.getCorrection();
+        dispenseSummary.meterDrift = estimator.isDrifting();
+        dispenseSummary.fusedVolume = estimator.getStepVolume(stepVolume);
+    }
+    if (dispenseSummary.meterDrift) {
+        ESP_LOGW(TAG, "Flow sensor drifting, the tank measures %.3f +- %.3f times the metered volume.", dispenseSummary.correction, estimator.getDeviation());
+    }
+}
+
+/**
+ * @brief If true, the source valve is installed. Constant unless the mode reads the valves from the config.
+ */
+template <typename Mode>
+bool ValveManagerT<Mode>::hasSource() {
+    return Mode::SOURCE && ( (Mode::RUNTIME == false) || (valveConfig.sourcePin >= 0) );
+}
+
+/**
+ * @brief If true, the tank valve is installed. Constant unless the mode reads the valves from the config.
+ */
+template <typename Mode>
+bool ValveManagerT<Mode>::hasTank() {
+    return Mode::TANK && ( (Mode::RUNTIME == false) || (valveConfig.tankPin >= 0) );
+}
+
+/**
+ * @brief If true, the drain valve is installed. Constant unless the mode reads the valves from the config.
+ */
+template <typename Mode>
+bool ValveManagerT<Mode>::hasDrain() {
+    return Mode::DRAIN && ( (Mode::RUNTIME == false) || (valveConfig.drainPin >= 0) );
+}
+
+/** Only the mode of the build is compiled. */
+template class ValveManagerT<DripMode>;
\ No newline at end of file
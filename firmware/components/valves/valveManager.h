@@ -1,6 +1,46 @@
 #ifndef VALVE_MANAGER_H
 #define VALVE_MANAGER_H
 
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#include "config.h"
+#include "operatingMode.h"
+#include "gpioManager.h"
+#include "flowDriver.h"
+#include "pressureManager.h"
+#include "switchoverPredictor.h"
+#include "volumeEstimator.h"
+
+/** Maximum number of steps in a run plan. */
+#define MAX_RUN_STEPS MAX_ZONES
+
+/** The line has settled once no flow pulse arrived for this long, in miliseconds. */
+#define VALVE_QUIET_MS 1000
+/** Maximum time to wait for the line to settle after a close command, in miliseconds. */
+#define VALVE_SETTLE_TIMEOUT_MS 5000
+/** Smoothing factor of the flow rate the in-flight volume is estimated from. */
+#define VALVE_FLOW_RATE_SMOOTHING 0.2f
+
+/** Largest standard deviation of the correction factor at which a new K-factor of the flow sensor is proposed. */
+#define RECALIBRATION_MAX_DEVIATION 0.01f
+/** Smallest metered volume the correction factor must be estimated over before a new K-factor is proposed, in liters. */
+#define RECALIBRATION_MIN_VOLUME 15.0f
+/** Smallest change of the K-factor worth proposing. */
+#define RECALIBRATION_MIN_CHANGE 0.01f
+/** Largest change of the K-factor proposed at once. A larger correction is approached over several recalibrations. */
+#define RECALIBRATION_MAX_STEP 0.05f
+/** Largest change of the K-factor proposed. A larger correction points at the pressure sensor instead. */
+#define RECALIBRATION_MAX_CHANGE 0.25f
+
+/** Number of open and close cycles averaged per supply valve by the characterisation process. */
+#define CHARACTERISE_CYCLES 3
+/** Time the flow runs before each close command, in miliseconds. */
+#define CHARACTERISE_FLOW_MS 3000
+/** Time without a flow pulse after an open command after which the supply is skipped, in miliseconds. */
+#define CHARACTERISE_ONSET_TIMEOUT_MS 10000
+
 /**
  * @brief Describes the possible states of the valves.
  */
@@ -13,10 +53,28 @@ typedef enum ValveStates_e {
     VALVES_TANK_DISPENSE,
     /** The source valve is open for dispensing. */
     VALVES_SOURCE_DISPENSE,
+    /** The tank and source valves are both open for dispensing. */
+    VALVES_BLENDED_DISPENSE,
+    /** Every valve closed at the end of a dispense process. The line is settling, so the overshoot can be measured. */
+    VALVES_CLOSING,
     /** The tank drain valve is open for draining. */
-    VALVES_TANK_DRAIN
+    VALVES_TANK_DRAIN,
+    /** The supply valves are cycled to measure their latency. */
+    VALVES_CHARACTERISE
 } ValveStates_e;
 
+/**
+ * @brief Describes the phases of one open and close cycle of the characterisation process.
+ */
+typedef enum CharacterisePhases_e {
+    /** The supply valve is open, waiting for the first flow pulse. */
+    CHARACTERISE_OPENING,
+    /** The flow is running before the close command. */
+    CHARACTERISE_FLOWING,
+    /** The supply valve is closed, waiting for the last flow pulse. */
+    CHARACTERISE_CLOSING
+} CharacterisePhases_e;
+
 /**
  * @brief Describes the target of a current dispensation process.
  * 
@@ -32,28 +90,72 @@ typedef struct DispenseTarget_t {
     uint32_t targetTime = 0;
     /** Maximum duration of the process in miliseconds. */
     uint32_t timeout = 0;
+    /** Zone valve to dispense through. Must be zero if no zone valves are installed. */
+    uint8_t zone = 0;
 } DispenseTarget_t;
 
+/**
+ * @brief Describes a run of dispense steps executed back to back.
+ * The supply stays open between steps, so there is no idle gap.
+ */
+typedef struct RunPlan_t {
+    /** Number of valid steps. */
+    uint8_t stepCount = 0;
+    DispenseTarget_t steps[MAX_RUN_STEPS];
+} RunPlan_t;
+
 /**
  * @brief Describes the realtime variables of a dispensation process;
  */
 typedef struct DispenseProcess_t {
+    uint8_t zone = 0;
+    /** Index of the current step in the run plan. */
+    uint8_t step = 0;
     uint32_t time = 0;
     float outputVolume = 0;
     float flowRate = 0;
     float tankLevel = 0;
+    /** Output volume corrected by the tank level, in liters. The metered volume until the tank has flowed. */
+    float fusedVolume = 0;
+    /** Estimated ratio of the true to the metered volume. */
+    float correction = 1;
 } DispenseProcess_t;
 
 /**
- * @brief Describes a summary of the process variables for a whole dispensation process.
+ * @brief Describes a summary of the process variables for a whole step of a dispensation process.
  */
 typedef struct DispenseSummary_t {
+    uint8_t zone = 0;
+    /** Index of the step in the run plan. */
+    uint8_t step = 0;
     uint32_t duration = 0;
     float outputVolume = 0;
+    /** 
+     * Volume from each supply. While blending, the tank share is estimated
+     * from the decline of the tank volume and the source gets the rest.
+     */
     float outputTankVolume = 0;
+    float outputSourceVolume = 0;
     uint32_t tankSwitchoverTime = 0;
+    /** Time the source was blended with the tank, in miliseconds. */
+    uint32_t blendTime = 0;
+    /** 
+     * Estimated time the early switchover saved over the tank_timeout rule, in miliseconds.
+     * Zero if the switchover was not early or the saving could not be estimated.
+     */
+    uint32_t switchoverSaving = 0;
     float initialTankLevel = 0;
     float finalTankLevel = 0;
+    /** 
+     * Output volume beyond the target volume in liters, including the volume metered
+     * after the close command. Negative if the step closed short. Zero for time targets.
+     */
+    float overshoot = 0;
+    /** Output volume corrected by the tank level, and the correction factor, as in DispenseProcess_t. */
+    float fusedVolume = 0;
+    float correction = 1;
+    /** Set once the correction factor is confidently beyond the drift threshold, so the flow sensor needs recalibrating. */
+    bool meterDrift = false;
 } DispenseSummary_t;
 
 /** 
@@ -81,15 +183,45 @@ typedef struct DrainSummary_t {
     float finalTankLevel = 0;
 } DrainSummary_t;
 
+/**
+ * @brief Describes the measured latency of one supply valve.
+ */
+typedef struct ValveCharacterisation_t {
+    /** If false the valve is not installed or gave no usable measurement. */
+    bool measured = false;
+    ValveLatency_t latency = {};
+    /** Mean volume metered after the close command, in liters. */
+    float closeVolume = 0;
+} ValveCharacterisation_t;
+
+/**
+ * @brief Describes a summary of the characterisation process.
+ */
+typedef struct CharacteriseSummary_t {
+    ValveCharacterisation_t source;
+    ValveCharacterisation_t tank;
+} CharacteriseSummary_t;
+
 /**
  * @brief Handles the dispensation and draining process.
+ *
+ * The close command of a volume target is issued early by the smoothed flow rate times the close
+ * delay of the open supply, and the line is still metered until it settles to report the overshoot.
+ * While the tank is blended with the source the meter measures their sum, so the tank share is taken
+ * from the decline of the tank volume. The timeout rule never blends, as it has no tank level.
+ *
+ * @tparam Mode OperatingMode of the build. The branches of the valves it leaves out compile out.
  */
-class ValveManager {
+template <typename Mode>
+class ValveManagerT {
 public:
     /**
      * @brief Constructor.
+     * 
+     * @param gpioManager Allocates the valve and flow sensor pins.
+     * @param pressureManager Reads the tank volume.
      */
-    ValveManager();
+    ValveManagerT(GpioManager *gpioManager, PressureManager *pressureManager);
 
     /**
      * @brief Begin the ValveManager.
@@ -99,31 +231,69 @@ public:
     esp_err_t initialize();
 
     /**
-     * @brief Begins a dispensation process.
+     * @brief Applies the config and claims the pins of the installed
+     * valves and flow sensor. Only allowed while idle.
      * 
-     * @param target Target for the process.
-     * @param state Overwritten with the final state of the process.
-     * @param process Overwritten with the final process variables.
+     * @param config Device config.
+     * @return esp_err_t Return code. ESP_ERR_NOT_SUPPORTED if a specialised build
+     * is given other valves or sensors than those of its mode.
+     */
+    esp_err_t configure(Config_t &config);
+
+    /**
+     * @brief Returns the number of zones which can be dispensed to. 
+     * One if no zone valves are installed.
+     */
+    uint8_t getZoneCount();
+
+    /**
+     * @brief Returns the number of flow sensor pulses counted since it was claimed,
+     * or zero if no flow sensor is installed.
+     */
+    uint32_t getFlowPulses();
+
+    /**
+     * @brief Proposes the K-factor of the flow sensor which matches the tank level, once the
+     * correction factor of the tank dispenses is known well enough.
+     *
+     * The correction factor must be estimated over RECALIBRATION_MIN_VOLUME, and the change is
+     * limited to RECALIBRATION_MAX_STEP, so a biased estimate cannot move the K-factor far at once.
+     *
+     * @param pulsesPerLiter Overwritten with the proposed K-factor in pulses per liter.
+     * @return esp_err_t Return code. ESP_ERR_INVALID_STATE if the correction factor is not known
+     * well enough or too close to one to propose a change. ESP_ERR_INVALID_SIZE if the change is beyond
+     * RECALIBRATION_MAX_CHANGE, in which case the K-factor is still given.
+     */
+    esp_err_t proposeRecalibration(float &pulsesPerLiter);
+
+    /**
+     * @brief Begins a dispensation process running each step of the plan in order.
+     * 
+     * @param plan Steps of the process.
+     * @param state Overwritten with the initial state of the process.
+     * @param process Overwritten with the initial process variables.
      * @return esp_err_t Return code.
      */
-    esp_err_t beginDispenstation(DispenseTarget_t &target, ValveStates_e &state, DispenseProcess_t &process);
+    esp_err_t beginDispense(RunPlan_t &plan, ValveStates_e &state, DispenseProcess_t &process);
 
     /**
-     * @brief Updates the dispense process.
+     * @brief Updates the dispense process. When a step completes, the next
+     * zone valve is opened before the last one is closed, without closing the supply.
      * 
-     * @param state Overwritten with the final state.
-     * @param process Overwritten with the final process variables.
-     * @param summary Overwritten with the final process summary.
+     * @param state Overwritten with the current state. VALVES_IDLE once the last step completes.
+     * @param process Overwritten with the current process variables.
+     * @param summary Overwritten with the summary of the completed step if stepComplete is set.
+     * @param stepComplete Set to true if a step completed during this update.
      * @return esp_err_t Return code.
      */
-    esp_err_t loopDispense(ValveStates_e &state, DispenseProcess_t &process, DispenseSummary_t &summary);
+    esp_err_t loopDispense(ValveStates_e &state, DispenseProcess_t &process, DispenseSummary_t &summary, bool &stepComplete);
 
     /**
-     * @brief Ends the dispense process.
+     * @brief Ends the dispense process before the plan completes.
      * 
      * @param state Overwritten with the final state.
      * @param process Overwritten with the final process variables.
-     * @param summary Overwritten with the final process summary.
+     * @param summary Overwritten with the summary of the interrupted step.
      * @return esp_err_t Return code.
      */
     esp_err_t endDispense(ValveStates_e &state, DispenseProcess_t &process, DispenseSummary_t &summary);
@@ -158,15 +328,158 @@ public:
      */
     esp_err_t endDrain(ValveStates_e &state, DrainProcess_t &process, DrainSummary_t &summary);
 
+    /**
+     * @brief Begins the characterisation process, which opens and closes each
+     * installed supply valve into the first zone and measures its latency from the flow pulses.
+     * 
+     * @param state Overwritten with the initial state of the process.
+     * @return esp_err_t Return code. ESP_ERR_NOT_SUPPORTED if no flow sensor is installed.
+     */
+    esp_err_t beginCharacterise(ValveStates_e &state);
+
+    /**
+     * @brief Updates the characterisation process.
+     * 
+     * @param state Overwritten with the current state. VALVES_IDLE once every supply valve is measured.
+     * @param summary Overwritten with the latency of the supply valves measured so far.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t loopCharacterise(ValveStates_e &state, CharacteriseSummary_t &summary);
+
+    /**
+     * @brief Ends the characterisation process.
+     * 
+     * @param state Overwritten with the final state.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t endCharacterise(ValveStates_e &state);
 
 private:
+    GpioManager *gpioManager;
+    PressureManager *pressureManager;
+    FlowDriver flowDriver;
+    SwitchoverPredictor predictor;
+    VolumeEstimator estimator;
+    bool configured;
+    ValveConfig_t valveConfig;
+    float pulsesPerLiter;
+    /** Flow rates in liters per minute. */
+    float staticFlowRate;
+    float minFlowRate;
+    /** Time after which a low tank flow rate switches over to the source, in miliseconds. */
+    uint32_t tankTimeout;
+    bool blendEnabled;
+
     ValveStates_e state;
-    DispenseTarget_t dispenseTarget;
+    RunPlan_t plan;
     DispenseProcess_t dispenseProcess;
     DispenseSummary_t dispenseSummary;
     DrainTarget_t drainTarget;
     DrainProcess_t drainProcess;
     DrainSummary_t drainSummary;
+
+    /** Variables of the current step. Timestamps in microseconds. */
+    int64_t dispenseStartTime;
+    int64_t stepStartTime;
+    int64_t lastLoopTime;
+    int64_t switchoverTime;
+    int64_t blendStartTime;
+    uint32_t stepBlendTime;
+    uint32_t lastPulses;
+    float stepVolume;
+    float stepTankVolume;
+    float stepInitialTankLevel;
+    /** Volume metered from the tank since the start of the dispense process, for the estimator. */
+    float fusionVolume;
+    /** Smoothed tank volume at the last update, for the tank share while blending. */
+    float lastTankVolume;
+    uint32_t switchoverSaving;
+    /** Smoothed flow rate of the process, in liters per minute. */
+    float smoothedFlowRate;
+    /** Time of the close command at the end of the process, and the supply state it closed. */
+    int64_t closeTime;
+    ValveStates_e closeSupplyState;
+
+    /** Variables of the characterisation process. */
+    CharacteriseSummary_t characteriseSummary;
+    CharacterisePhases_e characterisePhase;
+    bool characteriseTank;
+    uint8_t characteriseCycle;
+    int64_t phaseStartTime;
+    uint32_t phasePulses;
+    uint32_t openDelaySum;
+    uint32_t closeDelaySum;
+    float closeVolumeSum;
+
+    /**
+     * @brief Opens or closes a valve. Has no effect if the valve is not installed.
+     * 
+     * @param pin GPIO of the valve, or -1.
+     * @param open True to open.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t setValve(int8_t pin, bool open);
+
+    /**
+     * @brief Returns the GPIO of a zone valve, or -1 if no zone valves are installed.
+     */
+    int8_t zonePin(uint8_t zone);
+
+    /**
+     * @brief Closes every valve.
+     */
+    void closeAll();
+
+    /**
+     * @brief Releases the pins claimed by configure().
+     */
+    void releasePins();
+
+    /**
+     * @brief Resets the variables of the current step and fills in the initial process variables.
+     * 
+     * @param now Current time in microseconds.
+     */
+    void beginStep(int64_t now);
+
+    /**
+     * @brief Returns the close delay of the open supply valves in miliseconds.
+     */
+    uint16_t getCloseDelay();
+
+    /**
+     * @brief Opens the next installed supply valve to characterise, or ends the process after the last one.
+     * 
+     * @param now Current time in microseconds.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t beginCharacteriseSupply(int64_t now);
+
+    /**
+     * @brief Fills in the summary of the current step.
+     * 
+     * @param now Current time in microseconds.
+     * @param completed True if the step reached its target, so the overshoot is reported.
+     */
+    void summarizeStep(int64_t now, bool completed);
+
+    /**
+     * @brief If true, the source valve is installed. Constant unless the mode reads the valves from the config.
+     */
+    bool hasSource();
+
+    /**
+     * @brief If true, the tank valve is installed. Constant unless the mode reads the valves from the config.
+     */
+    bool hasTank();
+
+    /**
+     * @brief If true, the drain valve is installed. Constant unless the mode reads the valves from the config.
+     */
+    bool hasDrain();
 };
 
+/** The ValveManager of the operating mode of the build. */
+typedef ValveManagerT<DripMode> ValveManager;
+
 #endif
\ No newline at end of file
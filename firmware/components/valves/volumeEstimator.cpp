@@ -0,0 +1,317 @@
+#include <math.h>
+#include <stdint.h>
+
+#include "volumeEstimator.h"
+
+/**
+ * @brief Constructor.
+ */
+VolumeEstimator::VolumeEstimator() {
+    correction = 0;
+    variance = 0;
+    hasLevel = false;
+    level = 0;
+    levelVariance = 0;
+    covariance = 0;
+    updateCount = 0;
+    lastMeteredMean = 0;
+    coveredVolume = 0;
+    hasWindow = false;
+    windowStart = 0;
+    count = 0;
+    tankSum = 0;
+    meteredSum = 0;
+    residualSum = 0;
+    residualSquareSum = 0;
+    clipped = false;
+    readingNoise = FUSION_READING_NOISE_ML2;
+    hasStep = false;
+    stepMetered = 0;
+    lastMetered = 0;
+    stepLevel = 0;
+    stepDelivered = 0;
+    stepLevelVariance = 0;
+    stepDeliveredVariance = 0;
+    stepCovariance = 0;
+    reset();
+}
+
+/**
+ * @brief Forgets the correction factor, e.g. once the flow sensor is recalibrated.
+ */
+void VolumeEstimator::reset() {
+    correction = FUSION_Q16(1.0f);
+    variance = FUSION_Q24(FUSION_INITIAL_DEVIATION * FUSION_INITIAL_DEVIATION);
+    updateCount = 0;
+    coveredVolume = 0;
+    begin();
+}
+
+/**
+ * @brief Restarts the windows at the start of a tank dispense. The correction factor is kept.
+ */
+void VolumeEstimator::begin() {
+    hasWindow = false;
+    hasLevel = false;
+    clearWindow(0);
+    beginStep();
+}
+
+/**
+ * @brief Restarts the estimate of the volume delivered by the current step.
+ */
+void VolumeEstimator::beginStep() {
+    hasStep = false;
+    stepDelivered = 0;
+}
+
+/**
+ * @brief Adds a tank volume reading.
+ *
+ * @param time Time of the reading in miliseconds.
+ * @param meteredVolume Volume metered from the tank since begin(), in liters.
+ * @param tankVolume Tank volume in liters.
+ */
+void VolumeEstimator::update(uint32_t time, float meteredVolume, float tankVolume) {
+    int32_t tank = (int32_t) (tankVolume * 1000.0f + 0.5f);
+    int32_t metered = (int32_t) (meteredVolume * 1000.0f + 0.5f);
+    int64_t residual = 0;
+
+    if (hasWindow == false) {
+        clearWindow(time);
+        hasWindow = true;
+    } else if (time - windowStart >= FUSION_WINDOW_MS) {
+        closeWindow();
+        clearWindow(time);
+    }
+
+    /** The residual is flat while the meter agrees with the tank, so its spread is the sensor noise. */
+    residual = (int64_t) tank + metered;
+    count++;
+    tankSum += tank;
+    meteredSum += metered;
+    residualSum += residual;
+    residualSquareSum += residual * residual;
+
+    /** An empty tank reads zero however much more flows, so the window says nothing about the meter. */
+    if (tank <= 0) {
+        clipped = true;
+    }
+
+    updateStep(metered, tank);
+}
+
+/**
+ * @brief Updates the estimate of the volume delivered by the step with a reading.
+ *
+ * @param metered Metered volume since begin() in mililiters.
+ * @param tank Tank volume in mililiters.
+ */
+void VolumeEstimator::updateStep(int32_t metered, int32_t tank) {
+    int64_t meterVariance = 0;
+    int64_t before = 0;
+    int64_t after = 0;
+    int64_t innovation = 0;
+    int64_t innovationVariance = 0;
+    int64_t levelGain = 0;
+    int64_t deliveredGain = 0;
+
+    if (hasStep == false) {
+        stepMetered = metered;
+        lastMetered = metered;
+        stepDelivered = 0;
+        stepDeliveredVariance = 0;
+        stepCovariance = 0;
+        if (tank <= 0) {
+            return;
+        }
+        stepLevel = tank;
+        stepLevelVariance = readingNoise;
+        hasStep = true;
+        return;
+    }
+
+    /**
+     * The metered volume is off by a factor, so its error grows with the volume rather than
+     * its square root. The variance grows by the difference of the squared metered volumes.
+     */
+    meterVariance = (variance > FUSION_Q24(FUSION_METER_DEVIATION * FUSION_METER_DEVIATION)) ? variance : FUSION_Q24(FUSION_METER_DEVIATION * FUSION_METER_DEVIATION);
+    before = lastMetered - stepMetered;
+    after = metered - stepMetered;
+    stepDelivered += (int64_t) correction * (metered - lastMetered);
+    stepDeliveredVariance += ((after * after - before * before) * meterVariance) >> 24;
+    lastMetered = metered;
+
+    /** The tank reads zero once empty, however much more the meter counts. */
+    if (tank <= 0) {
+        return;
+    }
+
+    /** The reading is the level at the start of the step less the delivered volume. */
+    innovation = tank - stepLevel + (stepDelivered >> 16);
+    levelGain = stepLevelVariance - stepCovariance;
+    deliveredGain = stepCovariance - stepDeliveredVariance;
+    innovationVariance = levelGain - deliveredGain + readingNoise;
+    if (innovationVariance < FUSION_MIN_NOISE_ML2) {
+        innovationVariance = FUSION_MIN_NOISE_ML2;
+    }
+    if (innovation * innovation > FUSION_GATE_SIGMAS * FUSION_GATE_SIGMAS * innovationVariance) {
+        return;
+    }
+
+    stepLevel += levelGain * innovation / innovationVariance;
+    stepDelivered += (deliveredGain * innovation << 16) / innovationVariance;
+    stepLevelVariance -= levelGain * levelGain / innovationVariance;
+    stepCovariance -= levelGain * deliveredGain / innovationVariance;
+    stepDeliveredVariance -= deliveredGain * deliveredGain / innovationVariance;
+    if (stepLevelVariance < 0) {
+        stepLevelVariance = 0;
+    }
+    if (stepDeliveredVariance < 0) {
+        stepDeliveredVariance = 0;
+    }
+}
+
+/**
+ * @brief Returns the estimated ratio of the true to the metered volume. One until the first update.
+ */
+float VolumeEstimator::getCorrection() {
+    return correction / 65536.0f;
+}
+
+/**
+ * @brief Returns the output volume of the current step with its tank part replaced by the
+ * fused estimate of the volume the tank delivered. The rest stays metered.
+ *
+ * @param stepVolume Volume metered by the current step, in liters.
+ */
+float VolumeEstimator::getStepVolume(float stepVolume) {
+    if (hasStep == false) {
+        return stepVolume;
+    }
+    return stepVolume + (stepDelivered / 65536.0f - (lastMetered - stepMetered)) / 1000.0f;
+}
+
+/**
+ * @brief Returns the standard deviation of the correction factor.
+ */
+float VolumeEstimator::getDeviation() {
+    return sqrtf(variance / 16777216.0f);
+}
+
+/**
+ * @brief Returns the metered volume spanned by the windows the correction factor
+ * was estimated from since the last reset, in liters.
+ */
+float VolumeEstimator::getCoveredVolume() {
+    return coveredVolume / 1000.0f;
+}
+
+/**
+ * @brief If true, the correction factor is beyond the drift threshold by more than
+ * three standard deviations, so the flow sensor no longer matches the tank.
+ */
+bool VolumeEstimator::isDrifting() {
+    int64_t deviation = (int64_t) correction - FUSION_Q16(1.0f);
+
+    if (updateCount == 0) {
+        return false;
+    }
+    if ( (deviation < FUSION_Q16(FUSION_DRIFT_THRESHOLD)) && (deviation > -FUSION_Q16(FUSION_DRIFT_THRESHOLD)) ) {
+        return false;
+    }
+
+    /** Both sides in Q32. */
+    return deviation * deviation > ((int64_t) 9 * variance) << 8;
+}
+
+/**
+ * @brief Closes the current window, and updates the estimates from its means.
+ */
+void VolumeEstimator::closeWindow() {
+    int64_t tankMean = 0;
+    int64_t meteredMean = 0;
+    int64_t noise = 0;
+    int64_t levelGain = 0;
+    int64_t correctionGain = 0;
+    int64_t innovation = 0;
+    int64_t innovationVariance = 0;
+    int64_t next = 0;
+
+    /** A window without a spread or with an empty tank is skipped. */
+    if ( (count < 2) || clipped ) {
+        return;
+    }
+
+    tankMean = tankSum / count;
+    meteredMean = meteredSum / count;
+    /** Variance of a reading, kept for the step estimate, and of the mean of the residual. */
+    readingNoise = (residualSquareSum - residualSum * residualSum / count) / (count - 1);
+    if (readingNoise < FUSION_MIN_NOISE_ML2) {
+        readingNoise = FUSION_MIN_NOISE_ML2;
+    }
+    noise = readingNoise / count;
+    if (noise < FUSION_MIN_NOISE_ML2) {
+        noise = FUSION_MIN_NOISE_ML2;
+    }
+
+    /** The first window of a dispense places the level, with the uncertainty of the correction factor. */
+    if (hasLevel == false) {
+        level = tankMean + ((correction * meteredMean) >> 16);
+        levelVariance = noise + ((meteredMean * meteredMean * variance) >> 24);
+        covariance = (meteredMean * variance) >> 8;
+        lastMeteredMean = (int32_t) meteredMean;
+        hasLevel = true;
+        return;
+    }
+
+    /**
+     * The tank mean is the level less the correction factor times the metered mean. The gains
+     * are the covariances of the states with the predicted tank mean.
+     */
+    innovation = tankMean - level + ((correction * meteredMean) >> 16);
+    levelGain = levelVariance - ((meteredMean * covariance) >> 16);
+    correctionGain = covariance - ((meteredMean * variance) >> 8);
+    innovationVariance = levelGain - ((meteredMean * correctionGain) >> 16) + noise;
+    if (innovationVariance < FUSION_MIN_NOISE_ML2) {
+        innovationVariance = FUSION_MIN_NOISE_ML2;
+    }
+    if (innovation * innovation > FUSION_GATE_SIGMAS * FUSION_GATE_SIGMAS * innovationVariance) {
+        return;
+    }
+
+    level += levelGain * innovation / innovationVariance;
+    next = correction + correctionGain * innovation / innovationVariance;
+    if (next < FUSION_Q16(FUSION_MIN_CORRECTION)) {
+        next = FUSION_Q16(FUSION_MIN_CORRECTION);
+    } else if (next > FUSION_Q16(FUSION_MAX_CORRECTION)) {
+        next = FUSION_Q16(FUSION_MAX_CORRECTION);
+    }
+    correction = (int32_t) next;
+
+    levelVariance -= levelGain * levelGain / innovationVariance;
+    covariance -= levelGain * correctionGain / innovationVariance;
+    next = variance - ((correctionGain * correctionGain / innovationVariance) >> 8) + FUSION_Q24(FUSION_PROCESS_VARIANCE);
+    variance = (next < FUSION_Q24(FUSION_PROCESS_VARIANCE)) ? FUSION_Q24(FUSION_PROCESS_VARIANCE) : (int32_t) next;
+    if (levelVariance < 0) {
+        levelVariance = 0;
+    }
+    coveredVolume += meteredMean - lastMeteredMean;
+    lastMeteredMean = (int32_t) meteredMean;
+    updateCount++;
+}
+
+/**
+ * @brief Clears the sums of the current window.
+ *
+ * @param time Time the window starts in miliseconds.
+ */
+void VolumeEstimator::clearWindow(uint32_t time) {
+    windowStart = time;
+    count = 0;
+    tankSum = 0;
+    meteredSum = 0;
+    residualSum = 0;
+    residualSquareSum = 0;
+    clipped = false;
+}
\ No newline at end of file
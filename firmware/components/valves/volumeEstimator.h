@@ -0,0 +1,172 @@
+#ifndef VOLUME_ESTIMATOR_H
+#define VOLUME_ESTIMATOR_H
+
+#include <stdint.h>
+
+/** Period the tank and metered volumes are averaged over before each update, in miliseconds. */
+#define FUSION_WINDOW_MS 5000
+/** Floor of the noise variance of an update, in mililiters squared, so a quiet sensor is not trusted blindly. */
+#define FUSION_MIN_NOISE_ML2 400
+/** Innovations beyond this many standard deviations are rejected, e.g. a refill during the dispense. */
+#define FUSION_GATE_SIGMAS 3
+/** Bounds of the correction factor. */
+#define FUSION_MIN_CORRECTION 0.5f
+#define FUSION_MAX_CORRECTION 2.0f
+/** Standard deviation of the correction factor before the first update. */
+#define FUSION_INITIAL_DEVIATION 0.1f
+/** Variance the correction factor gains per update, so a meter drifting over its life is followed. */
+#define FUSION_PROCESS_VARIANCE 0.00001f
+/** Deviation of the correction factor from one beyond which the meter is reported as drifting. */
+#define FUSION_DRIFT_THRESHOLD 0.05f
+
+/**
+ * Floor of the relative deviation of the metered volume of a step, as the correction factor
+ * carries the error of the pressure calibration it was estimated against.
+ */
+#define FUSION_METER_DEVIATION 0.02f
+/** Noise variance of a single tank reading until a window has measured it, in mililiters squared. */
+#define FUSION_READING_NOISE_ML2 1000000
+
+/** Fixed point formats of the correction factor and its variance. */
+#define FUSION_Q16(x) ((int32_t) ((x) * 65536.0f))
+#define FUSION_Q24(x) ((int32_t) ((x) * 16777216.0f))
+
+/**
+ * @brief Estimates the ratio of the true to the metered volume while dispensing from the tank,
+ * by fusing the tank volume with the flow sensor volume in a Kalman filter. The tank volume is
+ * modelled as its level at the start of the dispense less the correction factor times the metered
+ * volume, and both states are estimated from the means of the readings over windows. The noise of
+ * each update is the spread of the readings within its window, so a noisy pressure sensor is trusted
+ * less. The level is forgotten between dispenses, the correction factor is kept. Fixed point,
+ * as the target has no FPU. Has no hardware dependencies.
+ *
+ * The volume delivered by the current tank step is estimated by a second filter, updated by
+ * every reading. Its states are the tank level at the start of the step and the delivered volume.
+ * Each reading predicts the delivered volume by the metered volume times the correction factor,
+ * whose error grows with the metered volume, and corrects it by the tank level drop.
+ */
+class VolumeEstimator {
+public:
+    /**
+     * @brief Constructor.
+     */
+    VolumeEstimator();
+
+    /**
+     * @brief Forgets the correction factor, e.g. once the flow sensor is recalibrated.
+     */
+    void reset();
+
+    /**
+     * @brief Restarts the windows at the start of a tank dispense. The correction factor is kept.
+     */
+    void begin();
+
+    /**
+     * @brief Restarts the estimate of the volume delivered by the current step.
+     */
+    void beginStep();
+
+    /**
+     * @brief Adds a tank volume reading.
+     *
+     * @param time Time of the reading in miliseconds.
+     * @param meteredVolume Volume metered from the tank since begin(), in liters.
+     * @param tankVolume Tank volume in liters.
+     */
+    void update(uint32_t time, float meteredVolume, float tankVolume);
+
+    /**
+     * @brief Returns the estimated ratio of the true to the metered volume. One until the first update.
+     */
+    float getCorrection();
+
+    /**
+     * @brief Returns the output volume of the current step with its tank part replaced by the
+     * fused estimate of the volume the tank delivered. The rest stays metered.
+     *
+     * @param stepVolume Volume metered by the current step, in liters.
+     */
+    float getStepVolume(float stepVolume);
+
+    /**
+     * @brief Returns the standard deviation of the correction factor.
+     */
+    float getDeviation();
+
+    /**
+     * @brief Returns the metered volume spanned by the windows the correction factor
+     * was estimated from since the last reset, in liters.
+     */
+    float getCoveredVolume();
+
+    /**
+     * @brief If true, the correction factor is beyond the drift threshold by more than
+     * three standard deviations, so the flow sensor no longer matches the tank.
+     */
+    bool isDrifting();
+
+private:
+    /**
+     * Correction factor in Q16 and its variance in Q24. The tank volume at the start of the dispense
+     * in mililiters and its variance in mililiters squared, and their covariance in Q16 mililiters.
+     */
+    int32_t correction;
+    int32_t variance;
+    bool hasLevel;
+    int32_t level;
+    int64_t levelVariance;
+    int64_t covariance;
+    uint32_t updateCount;
+    /** Metered mean of the last window of the dispense in mililiters, and the metered volume spanned by the windows since the last reset. */
+    int32_t lastMeteredMean;
+    int64_t coveredVolume;
+
+    /** Sums of the current window. Volumes in mililiters. */
+    bool hasWindow;
+    uint32_t windowStart;
+    int32_t count;
+    int64_t tankSum;
+    int64_t meteredSum;
+    int64_t residualSum;
+    int64_t residualSquareSum;
+    bool clipped;
+    /** Noise variance of a single reading in mililiters squared, measured by the last window. */
+    int64_t readingNoise;
+
+    /**
+     * Metered volume at the start of the step and at the last reading in mililiters. The tank level
+     * at the start of the step in mililiters, the delivered volume in Q16 mililiters, their variances
+     * in mililiters squared, and their covariance.
+     */
+    bool hasStep;
+    int32_t stepMetered;
+    int32_t lastMetered;
+    int64_t stepLevel;
+    int64_t stepDelivered;
+    int64_t stepLevelVariance;
+    int64_t stepDeliveredVariance;
+    int64_t stepCovariance;
+
+    /**
+     * @brief Updates the estimate of the volume delivered by the step with a reading.
+     *
+     * @param metered Metered volume since begin() in mililiters.
+     * @param tank Tank volume in mililiters.
+     */
+    void updateStep(int32_t metered, int32_t tank);
+
+    /**
+     * @brief Closes the current window, and updates the estimates from its means.
+     */
+    void closeWindow();
+
+    /**
+     * @brief Clears the sums of the current window.
+     *
+     * @param time Time the window starts in miliseconds.
+     */
+    void clearWindow(uint32_t time);
+};
+
+#endif
\ No newline at end of file
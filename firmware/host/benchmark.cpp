@@ -0,0 +1,526 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <math.h>
+#include <time.h>
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "halTime.h"
+#include "halPosix.h"
+
+#include "operatingMode.h"
+#include "device.h"
+#include "plantSimulator.h"
+
+/** Duration of the listen scenario in seconds. */
+#define BENCH_LISTEN_S 3600
+/** Longest a process scenario may run in seconds, in case its end message never comes. */
+#define BENCH_MAX_S 3600
+/** Time the plant keeps running after the end message of a scenario, in seconds. */
+#define BENCH_SETTLE_S 2
+/** Tank volume of the switchover scenarios, in liters. */
+#define BENCH_LOW_TANK_L 25
+/** Ratio of the K-factor of the firmware to that of the plant in the drift scenario. */
+#define BENCH_DRIFT_FACTOR 1.1f
+/** Number of dispenses the K-factor of the drift scenario is recalibrated over. */
+#define BENCH_RECALIBRATION_RUNS 4
+/** Volume drained between the points of the pressure calibration scenario, in liters. */
+#define BENCH_CALIBRATION_STEP_L 12
+/** Diameter and length of the horizontal cylinder the strapping table is checked against, in meters. */
+#define BENCH_HORIZONTAL_DIAMETER_M 0.6f
+#define BENCH_HORIZONTAL_LENGTH_M 1.0f
+/** Height step the strapping table is checked at, in meters. */
+#define BENCH_HORIZONTAL_STEP_M 0.001f
+#define BENCH_MAX_SCENARIOS 20
+/** Least share of the tank volume of the timeout rule the predictor must deliver from a low tank. */
+#define BENCH_MIN_TANK_SHARE 0.75f
+
+/**
+ * @brief Describes the cost and outcome of a scenario.
+ */
+typedef struct BenchResult_t {
+    const char *name;
+    /** Topic suffix ending the scenario, or nullptr to run for maxDuration. */
+    const char *endTopic;
+    /** Payload of the end message. */
+    char message[256];
+    bool ended;
+    bool finished;
+    int64_t startTime;
+    int64_t endTime;
+    int64_t maxEndTime;
+    double cpuStart;
+    double cpuSeconds;
+    double simulatedSeconds;
+    uint32_t iterations;
+    uint32_t messages;
+    uint32_t bytes;
+    /** Dispense target in liters, or zero for a time target. */
+    float target;
+    /** Volumes delivered into the line according to the plant, in liters. */
+    float tankDelivered;
+    float sourceDelivered;
+    uint32_t tailTime;
+} BenchResult_t;
+
+static Device device;
+static PlantSimulator plant;
+static PressureSensorCalibrationPoint_t calibration[MAX_PRESSURE_CALIBRATION_POINTS];
+static PressureSensorCalibrationPoint_t calibrated[MAX_PRESSURE_CALIBRATION_POINTS];
+static BenchResult_t results[BENCH_MAX_SCENARIOS];
+static uint8_t resultCount = 0;
+static BenchResult_t *current = nullptr;
+
+/**
+ * @brief Returns the CPU time of the process in seconds.
+ */
+static double cpuTime() {
+    struct timespec now = {};
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Returns a number field of a flat JSON object, or zero if missing.
+ */
+static float jsonNumber(const char *json, const char *key) {
+    char pattern[16];
+    const char *field = nullptr;
+
+    snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+    field = strstr(json, pattern);
+    return (field == nullptr) ? 0 : strtof(field + strlen(pattern), nullptr);
+}
+
+/**
+ * @brief Ends the measurement of the current scenario, recording the plant counters.
+ */
+static void finish(BenchResult_t &result) {
+    result.finished = true;
+    result.cpuSeconds = cpuTime() - result.cpuStart;
+    result.simulatedSeconds = (halTimeMicros() - result.startTime) / 1e6;
+    result.tankDelivered = plant.getTankDelivered();
+    result.sourceDelivered = plant.getSourceDelivered();
+    result.tailTime = plant.getTailTime();
+}
+
+/**
+ * @brief Counts the telemetry published by the firmware and catches the end message of the scenario.
+ */
+static void onPublish(const char *topic, const char *data, int qos, bool retain, void *arg) {
+    size_t topicLength = strlen(topic);
+    size_t endLength = 0;
+
+    if ( (current == nullptr) || current->finished ) {
+        return;
+    }
+
+    current->messages++;
+    current->bytes += topicLength + strlen(data);
+
+    if ( (current->endTopic != nullptr) && (current->ended == false) ) {
+        endLength = strlen(current->endTopic);
+        if ( (topicLength >= endLength) && (strcmp(topic + topicLength - endLength, current->endTopic) == 0) ) {
+            strlcpy(current->message, data, sizeof(current->message));
+            current->ended = true;
+            current->endTime = halTimeMicros() + (int64_t) BENCH_SETTLE_S * 1000000;
+        }
+    }
+}
+
+/**
+ * @brief Finishes the current scenario while the FSM waits, as its wait may outlast the scenario.
+ */
+static void onIdle(int64_t deadline, void *arg) {
+    int64_t now = halTimeMicros();
+
+    if ( (current == nullptr) || current->finished ) {
+        return;
+    }
+
+    if ( (current->ended && (now >= current->endTime)) || (now >= current->maxEndTime) ) {
+        finish(*current);
+    }
+}
+
+/**
+ * @brief Runs the FSM until the scenario finishes, measuring its CPU time.
+ *
+ * @param name Scenario name.
+ * @param suffix Topic suffix of the command starting the scenario, or nullptr.
+ * @param payload Payload of the command.
+ * @param endTopic Topic suffix of the message ending the scenario, or nullptr.
+ * @param maxDuration Longest the scenario runs, in seconds.
+ * @return BenchResult_t& Result of the scenario.
+ */
+static BenchResult_t& run(const char *name, const char *suffix, const char *payload, const char *endTopic, uint32_t maxDuration) {
+    BenchResult_t &result = results[resultCount++];
+
+    result = {};
+    result.name = name;
+    result.endTopic = endTopic;
+    result.startTime = halTimeMicros();
+    result.maxEndTime = result.startTime + (int64_t) maxDuration * 1000000;
+    result.cpuStart = cpuTime();
+    current = &result;
+
+    if (suffix != nullptr) {
+        device.command(suffix, payload);
+    }
+    while (result.finished == false) {
+        device.step();
+        result.iterations++;
+        onIdle(0, nullptr);
+    }
+    current = nullptr;
+    return result;
+}
+
+/**
+ * @brief Runs a dispense from a tank volume with the given tank config.
+ *
+ * @param name Scenario name.
+ * @param tankVolume Tank volume at the start, in liters.
+ * @param switchoverFraction As in TankConfig_t.
+ * @param blendEnabled As in TankConfig_t.
+ * @param payload Dispense command.
+ * @param tailFlowRate Tank flow rate the plant reports the tail time at, in L/min.
+ */
+static void dispense(const char *name, float tankVolume, float switchoverFraction, bool blendEnabled, const char *payload, float tailFlowRate) {
+    Config_t config = device.getConfig();
+    BenchResult_t *result = nullptr;
+
+    config.tank.switchoverFraction = switchoverFraction;
+    config.tank.blendEnabled = blendEnabled;
+    device.applyConfig(config);
+    plant.setTankVolume(tankVolume);
+    plant.resetCounters(tailFlowRate);
+
+    result = &run(name, "out/on", payload, "out/log/sm", BENCH_MAX_S);
+    result->target = jsonNumber(payload, "tv");
+}
+
+/**
+ * @brief Returns the volume of the horizontal cylinder at a water height, in liters.
+ */
+static float horizontalVolume(float height) {
+    float radius = BENCH_HORIZONTAL_DIAMETER_M / 2;
+
+    return BENCH_HORIZONTAL_LENGTH_M * 1000 * (radius * radius * acosf((radius - height) / radius) - (radius - height) * sqrtf(2 * radius * height - height * height));
+}
+
+/**
+ * @brief Strapping table of the horizontal cylinder at evenly spaced heights, interpolated
+ * by the tank geometry of the firmware and linearly. Returns the largest error of each against the cylinder.
+ *
+ * @param cubicError Overwritten with the largest error of the monotone cubic, in liters.
+ * @param linearError Overwritten with the largest error of linear interpolation, in liters.
+ * @return esp_err_t Return code.
+ */
+static esp_err_t checkStrapping(float &cubicError, float &linearError) {
+    esp_err_t err = ESP_OK;
+    TankConfig_t tank = {};
+    TankGeometry geometry;
+    float height = 0;
+    float exact = 0;
+    float linear = 0;
+    uint8_t i = 0;
+
+    tank.shape = TANK_TABLE;
+    tank.strappingPointCount = MAX_TANK_STRAPPING_POINTS;
+    for (i = 0; i < MAX_TANK_STRAPPING_POINTS; i++) {
+        height = BENCH_HORIZONTAL_DIAMETER_M * i / (MAX_TANK_STRAPPING_POINTS - 1);
+        tank.strapping[i].height = lroundf(height * 1000);
+        tank.strapping[i].volume = lroundf(horizontalVolume(tank.strapping[i].height / 1000.0f) * 1000);
+    }
+    err = geometry.configure(tank, 0, 1);
+    if (err != ESP_OK) return err;
+
+    cubicError = 0;
+    linearError = 0;
+    i = 1;
+    for (height = 0; height <= BENCH_HORIZONTAL_DIAMETER_M; height += BENCH_HORIZONTAL_STEP_M) {
+        exact = horizontalVolume(height);
+        while ( (i < MAX_TANK_STRAPPING_POINTS - 1) && (height * 1000 > tank.strapping[i].height) ) {
+            i++;
+        }
+        linear = (tank.strapping[i - 1].volume + (height * 1000 - tank.strapping[i - 1].height)
+            * (tank.strapping[i].volume - tank.strapping[i - 1].volume) / (tank.strapping[i].height - tank.strapping[i - 1].height)) / 1000;
+        if (fabsf(geometry.getVolume(height) - exact) > fabsf(cubicError)) {
+            cubicError = geometry.getVolume(height) - exact;
+        }
+        if (fabsf(linear - exact) > fabsf(linearError)) {
+            linearError = linear - exact;
+        }
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Returns the result of a scenario, or nullptr if it was not run.
+ *
+ * @param name Scenario name.
+ */
+static BenchResult_t *findResult(const char *name) {
+    for (uint8_t i = 0; i < resultCount; i++) {
+        if (strcmp(results[i].name, name) == 0) {
+            return &results[i];
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Checks the switchover against the plant, so a regression of the predictor fails the suite.
+ * A full tank must not switch over, and a low tank must not switch over before its flow fell
+ * below the threshold, less the horizon it is projected over, nor deliver much less than
+ * under the timeout rule.
+ *
+ * @param horizon Switchover horizon in seconds.
+ * @return uint8_t Number of failed checks, each printed to stderr.
+ */
+static uint8_t checkSwitchover(float horizon) {
+    const char *fullTank[] = {"tank-volume", "time", "tank-comp"};
+    const char *lowTank[] = {"switchover", "blend"};
+    BenchResult_t *timeoutRule = findResult("timeout-rule");
+    BenchResult_t *result = nullptr;
+    uint8_t failed = 0;
+
+    for (const char *name : fullTank) {
+        result = findResult(name);
+        if ( (result != nullptr) && (jsonNumber(result->message, "tts") > 0) ) {
+            fprintf(stderr, "%s: a full tank switched over after %.1f s\n", name, jsonNumber(result->message, "tts"));
+            failed++;
+        }
+    }
+
+    for (const char *name : lowTank) {
+        result = findResult(name);
+        if ( (result == nullptr) || (timeoutRule == nullptr) ) {
+            continue;
+        }
+        if (jsonNumber(result->message, "tts") < result->tailTime / 1000.0f - horizon) {
+            fprintf(stderr, "%s: switched over after %.1f s, the tank flow fell below the threshold after %.1f s\n",
+                name, jsonNumber(result->message, "tts"), result->tailTime / 1000.0f);
+            failed++;
+        }
+        if (result->tankDelivered < BENCH_MIN_TANK_SHARE * timeoutRule->tankDelivered) {
+            fprintf(stderr, "%s: delivered %.3f liters from the tank, the timeout rule %.3f liters\n",
+                name, result->tankDelivered, timeoutRule->tankDelivered);
+            failed++;
+        }
+    }
+    return failed;
+}
+
+/**
+ * @brief Prints the cost of a scenario, normalized to one simulated hour, and the mean CPU time of an FSM iteration.
+ */
+static void printCost(BenchResult_t &result) {
+    double hours = result.simulatedSeconds / 3600;
+
+    printf("%-14s %8.1f %10.3f %10.0f %8.2f %10.0f %10.0f\n",
+        result.name,
+        result.simulatedSeconds,
+        result.cpuSeconds * 1000 / hours,
+        result.iterations / hours,
+        result.cpuSeconds * 1e6 / result.iterations,
+        result.messages / hours,
+        result.bytes / hours
+    );
+}
+
+/**
+ * @brief Prints the dispense summary of a scenario against the plant.
+ */
+static void printDispense(BenchResult_t &result) {
+    float delivered = result.tankDelivered + result.sourceDelivered;
+
+    printf("%-14s %7.2f %8.3f %8.3f %8.3f %7.4f %8.3f %8.3f %8.3f %8.3f %7.1f %7.1f %7.1f %7.1f\n",
+        result.name,
+        result.target,
+        jsonNumber(result.message, "vt"),
+        delivered,
+        jsonNumber(result.message, "vf"),
+        jsonNumber(result.message, "kf"),
+        jsonNumber(result.message, "tv"),
+        result.tankDelivered,
+        jsonNumber(result.message, "ov"),
+        (result.target > 0) ? delivered - result.target : 0,
+        jsonNumber(result.message, "tts"),
+        result.tailTime / 1000.0,
+        jsonNumber(result.message, "tss"),
+        jsonNumber(result.message, "tb")
+    );
+}
+
+/**
+ * @brief Runs the firmware against a simulated tank, source, and flow sensor,
+ * and reports the host CPU time and telemetry of each scenario per simulated
+ * hour, and each dispense summary against the volumes the plant delivered.
+ */
+int main(int argc, char **argv) {
+    PlantConfig_t plantConfig = {};
+    Config_t config = {};
+    float tailFlowRate = 0;
+    float recalibrated[BENCH_RECALIBRATION_RUNS] = {};
+    uint8_t calibratedCount = 0;
+    float calibrationError = 0;
+    float error = 0;
+    float cubicError = 0;
+    float linearError = 0;
+    char payload[64];
+
+    halPosixSetLogLevel(ESP_LOG_ERROR);
+    halPosixSetPublishHook(&onPublish, nullptr);
+    halPosixSetIdleHook(&onIdle, nullptr);
+
+    if (device.boot() != ESP_OK) {
+        fprintf(stderr, "Device failed to boot.\n");
+        return 1;
+    }
+
+    /** The FSM alone, before the plant timer runs. */
+    run("listen", nullptr, nullptr, nullptr, BENCH_LISTEN_S);
+
+    config = device.getConfig();
+    plantConfig.tank = config.tank;
+    if (plant.start(config.valves, config.pressureSensor.pin, plantConfig) != ESP_OK) {
+        fprintf(stderr, "Plant failed to start.\n");
+        return 1;
+    }
+    config.pressureSensor.calibrationPointCount = plant.getCalibrationTable(calibration);
+    config.pressureCalibrationTable = calibration;
+    if (device.applyConfig(config) != ESP_OK) {
+        fprintf(stderr, "Device rejected the plant config.\n");
+        return 1;
+    }
+
+    /** The tail starts where the predictor would switch over at the default config. */
+    tailFlowRate = config.tank.switchoverFraction * config.source.staticFlowRate;
+
+    /** Only the scenarios of the supplies of the operating mode of the build are run. */
+    if (DripMode::TANK) {
+        dispense("tank-volume", plant.getTankCapacity(), config.tank.switchoverFraction, false, "{\"tv\":20}", tailFlowRate);
+    }
+    if (DripMode::SOURCE) {
+        dispense("source-volume", 0, config.tank.switchoverFraction, false, "{\"tv\":20}", tailFlowRate);
+    }
+    if (DripMode::BLEND) {
+        dispense("timeout-rule", BENCH_LOW_TANK_L, 0, false, "{\"tv\":60}", tailFlowRate);
+    }
+    if (DripMode::BLEND && DripMode::PRESSURE) {
+        dispense("switchover", BENCH_LOW_TANK_L, config.tank.switchoverFraction, false, "{\"tv\":60}", tailFlowRate);
+        dispense("blend", BENCH_LOW_TANK_L, config.tank.switchoverFraction, true, "{\"tv\":60}", tailFlowRate);
+    }
+    dispense("time", plant.getTankCapacity(), config.tank.switchoverFraction, false, "{\"tt\":600000,\"to\":660000}", tailFlowRate);
+
+    /** Measures the valve latency, then repeats the volume targets with the close compensated. */
+    BenchResult_t &characterise = run("characterise", "valves/characterise", "{}", "valves/latency", BENCH_MAX_S);
+    if (DripMode::TANK) {
+        dispense("tank-comp", plant.getTankCapacity(), config.tank.switchoverFraction, false, "{\"tv\":20}", tailFlowRate);
+    }
+    if (DripMode::SOURCE) {
+        dispense("source-comp", 0, config.tank.switchoverFraction, false, "{\"tv\":20}", tailFlowRate);
+    }
+
+    /**
+     * A flow sensor reading 10% low, which the tank level should catch within the dispense.
+     * Each dispense applies a bounded step of the K-factor of the tank level, which the next one
+     * runs with. They run from a full tank, where the K-factor of the plant barely droops.
+     */
+    if (DripMode::TANK && DripMode::PRESSURE) {
+        config = device.getConfig();
+        config.flowSensor.defaultPulsesPerLiter *= BENCH_DRIFT_FACTOR;
+        config.flowSensor.recalibration = FLOW_RECALIBRATION_APPLY;
+        device.applyConfig(config);
+        for (uint8_t i = 0; i < BENCH_RECALIBRATION_RUNS; i++) {
+            dispense((i == 0) ? "meter-drift" : "recalibrating", plant.getTankCapacity(), 0, false, "{\"tv\":20}", tailFlowRate);
+            recalibrated[i] = device.getConfig().flowSensor.defaultPulsesPerLiter;
+        }
+        dispense("recalibrated", plant.getTankCapacity(), 0, false, "{\"tv\":20}", tailFlowRate);
+        config.flowSensor.defaultPulsesPerLiter /= BENCH_DRIFT_FACTOR;
+        config.flowSensor.recalibration = FLOW_RECALIBRATION_OFF;
+        device.applyConfig(config);
+    }
+
+    /**
+     * A full tank drained in metered steps with the sensor uncalibrated. The table of the fit is
+     * compared with the table of the plant over the voltage range of the tank.
+     */
+    if (DripMode::TANK && DripMode::PRESSURE) {
+        config = device.getConfig();
+        config.pressureSensor.calibrationPointCount = 0;
+        device.applyConfig(config);
+        plant.setTankVolume(plant.getTankCapacity());
+        plant.resetCounters(tailFlowRate);
+        snprintf(payload, sizeof(payload), "{\"v\":%.3f,\"dv\":%d}", plant.getTankCapacity(), BENCH_CALIBRATION_STEP_L);
+        run("pressure-cal", "pressure/calibrate", payload, "config", BENCH_MAX_S * 2);
+
+        config = device.getConfig();
+        calibratedCount = config.pressureSensor.calibrationPointCount;
+        memcpy(calibrated, config.pressureCalibrationTable, sizeof(calibrated));
+        for (uint16_t mv = calibration[0].analogVoltage; (calibratedCount >= 2) && (mv <= calibration[PLANT_CALIBRATION_POINTS - 1].analogVoltage); mv += 10) {
+            error = PressureManager::interpolate(calibrated, calibratedCount, mv) - PressureManager::interpolate(calibration, PLANT_CALIBRATION_POINTS, mv);
+            if (fabsf(error) > fabsf(calibrationError)) {
+                calibrationError = error;
+            }
+        }
+
+        config.pressureSensor.calibrationPointCount = PLANT_CALIBRATION_POINTS;
+        config.pressureCalibrationTable = calibration;
+        device.applyConfig(config);
+    }
+
+    /** The tank level by the geometry of the tank and the scale of the sensor, without a calibration table. */
+    if (DripMode::TANK && DripMode::PRESSURE) {
+        config = device.getConfig();
+        config.pressureSensor.calibrationPointCount = 0;
+        config.pressureSensor.offset = plantConfig.sensorOffset;
+        config.pressureSensor.gain = plantConfig.sensorGain;
+        device.applyConfig(config);
+        dispense("geometry", BENCH_LOW_TANK_L, 0, false, "{\"tv\":20}", tailFlowRate);
+
+        config.pressureSensor.calibrationPointCount = PLANT_CALIBRATION_POINTS;
+        config.pressureSensor.gain = 0;
+        device.applyConfig(config);
+    }
+
+    printf("%-14s %8s %10s %10s %8s %10s %10s\n", "scenario", "sim s", "cpu ms/h", "loops/h", "us/loop", "msgs/h", "bytes/h");
+    for (uint8_t i = 0; i < resultCount; i++) {
+        printCost(results[i]);
+    }
+
+    printf("\nlatency %s\n", characterise.ended ? characterise.message : "not measured");
+    if (recalibrated[0] > 0) {
+        printf("recalibrated from %.2f to", config.flowSensor.defaultPulsesPerLiter * BENCH_DRIFT_FACTOR);
+        for (uint8_t i = 0; i < BENCH_RECALIBRATION_RUNS; i++) {
+            printf(" %.2f", recalibrated[i]);
+        }
+        printf(" pulses/L, plant %.2f\n", plantConfig.pulsesPerLiter);
+    }
+    if (checkStrapping(cubicError, linearError) == ESP_OK) {
+        printf("strapping table of %u points, largest error against a horizontal cylinder %+.2f liters, linear %+.2f liters\n",
+            MAX_TANK_STRAPPING_POINTS, cubicError, linearError);
+    }
+    if (calibratedCount > 0) {
+        printf("pressure calibration of %u points from %u to %u mV, largest error %+.2f liters against the plant\n",
+            calibratedCount, calibrated[0].analogVoltage, calibrated[calibratedCount - 1].analogVoltage, calibrationError);
+    }
+    printf("\n");
+
+    printf("%-14s %7s %8s %8s %8s %7s %8s %8s %8s %8s %7s %7s %7s %7s\n",
+        "dispense", "target", "metered", "true", "fused", "kf", "tank", "tank tru", "ov", "ov true", "tts", "tail", "tss", "tb");
+    for (uint8_t i = 0; i < resultCount; i++) {
+        if (strcmp(results[i].endTopic == nullptr ? "" : results[i].endTopic, "out/log/sm") == 0) {
+            printDispense(results[i]);
+        }
+    }
+
+    if (checkSwitchover(config.tank.switchoverHorizon) > 0) {
+        return 1;
+    }
+    return 0;
+}
\ No newline at end of file
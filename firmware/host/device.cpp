@@ -0,0 +1,92 @@
+#include <cstdio>
+#include <cstring>
+
+#include "esp_err.h"
+#include "halPosix.h"
+
+#include "device.h"
+
+/**
+ * @brief Constructor.
+ */
+Device::Device() :
+    pressureManager(&gpioManager),
+    valveManager(&gpioManager, &pressureManager),
+    flowManager(&valveManager),
+    pressureCalibrator(&valveManager, &pressureManager),
+    stateManager(&configManager, &mqttManager, &connectionManager, &valveManager, &powerManager, &gpioManager, &scheduleManager, &pressureManager, &flowManager, &pressureCalibrator, &traceManager, &resourceManager) {
+}
+
+/**
+ * @brief Boots the FSM until it listens for commands.
+ *
+ * @param maxSteps Maximum number of FSM iterations.
+ * @return esp_err_t Return code. ESP_ERR_TIMEOUT if the FSM is not listening after maxSteps.
+ */
+esp_err_t Device::boot(uint32_t maxSteps) {
+    stateManager.initialize();
+    for (uint32_t i = 0; i < maxSteps; i++) {
+        stateManager.handle_current_state();
+        if (connectionManager.isConnected() && (mqttManager.numMessagesInQueue() == 0)) {
+            return ESP_OK;
+        }
+    }
+
+    return ESP_ERR_TIMEOUT;
+}
+
+/**
+ * @brief Runs one iteration of the FSM.
+ */
+void Device::step() {
+    stateManager.handle_current_state();
+}
+
+/**
+ * @brief Delivers a command from the broker.
+ *
+ * @param suffix Topic after the base topic, e.g. "out/on".
+ * @param payload JSON payload.
+ */
+void Device::command(const char *suffix, const char *payload) {
+    Config_t config = getConfig();
+    char topic[MQTT_TOPIC_MAX_BYTES];
+
+    snprintf(topic, sizeof(topic), "%s%s", config.connection.baseTopic, suffix);
+    halPosixMqttDeliver(topic, payload, strlen(payload));
+}
+
+/**
+ * @brief Returns the device config.
+ */
+Config_t Device::getConfig() {
+    Config_t config = {};
+
+    configManager.getConfig(config);
+    return config;
+}
+
+/**
+ * @brief Replaces the device config and reconfigures the sensors and valves, as a config change would.
+ *
+ * @param config New config.
+ * @return esp_err_t Return code.
+ */
+esp_err_t Device::applyConfig(Config_t &config) {
+    esp_err_t err = ESP_OK;
+
+    err = configManager.setConfig(config);
+    if (err != ESP_OK) return err;
+
+    config = getConfig();
+    err = flowManager.configure(config.flowSensor);
+    if (err != ESP_OK) return err;
+
+    err = pressureManager.configure(config);
+    if (err != ESP_OK) return err;
+
+    err = pressureCalibrator.configure(config);
+    if (err != ESP_OK) return err;
+
+    return valveManager.configure(config);
+}
\ No newline at end of file
@@ -0,0 +1,80 @@
+#ifndef DEVICE_H
+#define DEVICE_H
+
+#include <stdint.h>
+
+#include "configManager.h"
+#include "mqttManager.h"
+#include "connectionManager.h"
+#include "valveManager.h"
+#include "powerManager.h"
+#include "gpioManager.h"
+#include "scheduleManager.h"
+#include "pressureManager.h"
+#include "flowManager.h"
+#include "pressureCalibrator.h"
+#include "traceManager.h"
+#include "resourceManager.h"
+#include "stateManager.h"
+
+/**
+ * @brief The managers of the firmware wired together as in app_main(),
+ * run on the calling thread against the POSIX backend of the HAL.
+ */
+class Device {
+public:
+    /**
+     * @brief Constructor.
+     */
+    Device();
+
+    /**
+     * @brief Boots the FSM until it listens for commands.
+     *
+     * @param maxSteps Maximum number of FSM iterations.
+     * @return esp_err_t Return code. ESP_ERR_TIMEOUT if the FSM is not listening after maxSteps.
+     */
+    esp_err_t boot(uint32_t maxSteps = 1000);
+
+    /**
+     * @brief Runs one iteration of the FSM.
+     */
+    void step();
+
+    /**
+     * @brief Delivers a command from the broker.
+     *
+     * @param suffix Topic after the base topic, e.g. "out/on".
+     * @param payload JSON payload.
+     */
+    void command(const char *suffix, const char *payload);
+
+    /**
+     * @brief Returns the device config.
+     */
+    Config_t getConfig();
+
+    /**
+     * @brief Replaces the device config and reconfigures the sensors and valves, as a config change would.
+     *
+     * @param config New config.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t applyConfig(Config_t &config);
+
+    ConfigManager configManager;
+    MqttManager mqttManager;
+    ConnectionManager connectionManager;
+    GpioManager gpioManager;
+    PressureManager pressureManager;
+    ValveManager valveManager;
+    PowerManager powerManager;
+    ScheduleManager scheduleManager;
+    FlowManager flowManager;
+    PressureCalibrator pressureCalibrator;
+    TraceManager traceManager;
+    ResourceManager resourceManager;
+    StateManager stateManager;
+};
+
+#endif
\ No newline at end of file
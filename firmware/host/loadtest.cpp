@@ -0,0 +1,388 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "halTime.h"
+#include "halPosix.h"
+
+#include "device.h"
+
+/** Maximum number of commands and valve openings of a scenario. */
+#define LOAD_MAX_COMMANDS 128
+#define LOAD_MAX_OPENINGS 256
+/** Time after the last command for the jobs to finish, in seconds. */
+#define LOAD_DRAIN_S 60
+/** Dispense job of each command, ending on its time target. */
+#define LOAD_JOB_TIME_MS 2000
+/** Flow sensor pulse period while a supply valve is open, about 12 L/min at the default calibration. */
+#define LOAD_PULSE_PERIOD_US 4000
+
+/**
+ * @brief Describes the load and the link impairments of a scenario.
+ */
+typedef struct LoadScenario_t {
+    const char *name;
+    HalPosixLink_t link;
+    /** Number of bursts, commands per burst, and time between bursts in miliseconds. */
+    uint16_t bursts;
+    uint8_t burstSize;
+    uint32_t burstInterval;
+    /** The broker goes offline for outageDuration every outageInterval miliseconds. Zero for no outages. */
+    uint32_t outageInterval;
+    uint32_t outageDuration;
+    /** Time of the first burst in miliseconds, so the bursts can fall into the outages. */
+    uint32_t burstOffset;
+} LoadScenario_t;
+
+/**
+ * @brief Tracks one command from the load generator.
+ */
+typedef struct LoadCommand_t {
+    uint32_t id;
+    int64_t sendTime;
+    int64_t ackTime;
+    bool rejected;
+    /** Set if the first acknowledgement showed the job active, so its actuation was not queued. */
+    bool begunOnReceipt;
+} LoadCommand_t;
+
+/**
+ * @brief Describes the outcome of a scenario.
+ */
+typedef struct LoadResult_t {
+    LoadCommand_t commands[LOAD_MAX_COMMANDS];
+    uint16_t commandCount;
+    uint16_t sent;
+    int64_t startTime;
+    int64_t endTime;
+    uint32_t messages;
+    uint32_t bytes;
+    uint32_t connections;
+    /** Times a supply valve opened. */
+    int64_t openings[LOAD_MAX_OPENINGS];
+    uint16_t openingCount;
+    bool supplyOpen;
+    bool finished;
+    /** State of the load generator. */
+    uint16_t burst;
+    int64_t nextBurst;
+    int64_t nextOutage;
+    bool offline;
+} LoadResult_t;
+
+static Device device;
+static HalTimer_t loadTimer = nullptr;
+static HalTimer_t pulseTimer = nullptr;
+static int8_t flowPin = -1;
+static const LoadScenario_t *scenario = nullptr;
+static LoadResult_t result;
+static uint32_t nextId = 1;
+static int8_t sourcePin = -1;
+static int8_t tankPin = -1;
+
+/**
+ * @brief Returns the command of a job ID, or nullptr.
+ */
+static LoadCommand_t* findCommand(uint32_t id) {
+    for (uint16_t i = 0; i < result.commandCount; i++) {
+        if (result.commands[i].id == id) {
+            return &result.commands[i];
+        }
+    }
+
+    return nullptr;
+}
+
+/**
+ * @brief Records the acknowledgement of each job listed in a queue status.
+ */
+static void onQueueStatus(const char *data, int64_t now) {
+    const char *position = strstr(data, "\"a\":");
+    char *end = nullptr;
+    uint32_t id = 0;
+    bool active = true;
+    LoadCommand_t *command = nullptr;
+
+    if (position == nullptr) {
+        return;
+    }
+
+    /** The active job comes first, then the waiting jobs. */
+    position += 4;
+    while (*position != '\0') {
+        id = strtoul(position, &end, 10);
+        if (end == position) {
+            position++;
+            continue;
+        }
+        position = end;
+
+        command = findCommand(id);
+        if ( (command != nullptr) && (command->ackTime == 0) ) {
+            command->ackTime = now;
+            command->begunOnReceipt = active;
+        }
+        active = false;
+    }
+}
+
+/**
+ * @brief Records the acknowledgements of the firmware and counts its telemetry.
+ */
+static void onPublish(const char *topic, const char *data, int qos, bool retain, void *arg) {
+    int64_t now = halTimeMicros();
+    const char *rejected = nullptr;
+    LoadCommand_t *command = nullptr;
+
+    if ( (scenario == nullptr) || result.finished ) {
+        return;
+    }
+
+    result.messages++;
+    result.bytes += strlen(topic) + strlen(data);
+
+    if (strstr(topic, "queue/status") != nullptr) {
+        onQueueStatus(data, now);
+    } else if (strstr(topic, "diagnostics/connection") != nullptr) {
+        result.connections++;
+    } else if ( (rejected = strstr(data, "rejected job ")) != nullptr ) {
+        command = findCommand(strtoul(rejected + strlen("rejected job "), nullptr, 10));
+        if ( (command != nullptr) && (command->ackTime == 0) ) {
+            command->ackTime = now;
+            command->rejected = true;
+        }
+    }
+}
+
+/**
+ * @brief Records the rising edges of the supply valves. Called whenever the FSM
+ * blocks, which it does after every change of the outputs.
+ */
+static void pollValves() {
+    bool open = halPosixGetLevel(sourcePin) || halPosixGetLevel(tankPin);
+
+    if (open && (result.supplyOpen == false) && (result.openingCount < LOAD_MAX_OPENINGS)) {
+        result.openings[result.openingCount++] = halTimeMicros();
+    }
+    result.supplyOpen = open;
+}
+
+/**
+ * @brief Returns the time the supply opened for a job begun on receipt,
+ * which is the first opening after the command was sent, or zero.
+ */
+static int64_t findActuation(LoadCommand_t &command) {
+    for (uint16_t i = 0; i < result.openingCount; i++) {
+        if (result.openings[i] >= command.sendTime) {
+            return result.openings[i];
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Emits flow sensor pulses while a supply valve is open, so the dispense slices are published.
+ */
+static void onPulse(void *arg) {
+    if (halPosixGetLevel(sourcePin) || halPosixGetLevel(tankPin)) {
+        halPosixPulse(flowPin);
+    }
+    halTimerStartOnce(pulseTimer, LOAD_PULSE_PERIOD_US);
+}
+
+/**
+ * @brief Ends the scenario once the jobs had time to finish.
+ */
+static void onIdle(int64_t deadline, void *arg) {
+    if ( (scenario == nullptr) || result.finished ) {
+        return;
+    }
+
+    pollValves();
+    if (halTimeMicros() >= result.endTime) {
+        result.finished = true;
+    }
+}
+
+/**
+ * @brief Sends the due bursts and switches the broker on and off. Runs as a timer on the virtual clock.
+ */
+static void onLoadTimer(void *arg) {
+    int64_t now = halTimeMicros();
+    int64_t next = result.endTime;
+    char payload[64];
+    LoadCommand_t *command = nullptr;
+
+    if (scenario == nullptr) {
+        return;
+    }
+
+    if ( (result.burst < scenario->bursts) && (now >= result.nextBurst) ) {
+        for (uint8_t i = 0; (i < scenario->burstSize) && (result.commandCount < LOAD_MAX_COMMANDS); i++) {
+            command = &result.commands[result.commandCount++];
+            *command = {};
+            command->id = nextId++;
+            command->sendTime = now;
+            snprintf(payload, sizeof(payload), "{\"id\":%lu,\"tt\":%d}", (unsigned long) command->id, LOAD_JOB_TIME_MS);
+            device.command("out/on", payload);
+            result.sent++;
+        }
+        result.burst++;
+        result.nextBurst += (int64_t) scenario->burstInterval * 1000;
+    }
+
+    if ( (scenario->outageInterval > 0) && (now >= result.nextOutage) ) {
+        result.offline = !result.offline;
+        halPosixMqttSetOnline(!result.offline);
+        result.nextOutage += (int64_t) (result.offline ? scenario->outageDuration : scenario->outageInterval - scenario->outageDuration) * 1000;
+    }
+
+    if (result.burst < scenario->bursts) {
+        next = std::min(next, result.nextBurst);
+    }
+    if (scenario->outageInterval > 0) {
+        next = std::min(next, result.nextOutage);
+    }
+    if (next > now) {
+        halTimerStartOnce(loadTimer, next - now);
+    }
+}
+
+/**
+ * @brief Runs a scenario until its jobs finished.
+ */
+static void run(const LoadScenario_t &config) {
+    HalPosixLink_t link = config.link;
+
+    result = {};
+    result.startTime = halTimeMicros();
+    result.nextBurst = result.startTime + (int64_t) config.burstOffset * 1000;
+    result.nextOutage = result.startTime + (int64_t) config.outageInterval * 1000 / 2;
+    result.endTime = result.nextBurst + (int64_t) config.bursts * config.burstInterval * 1000 + (int64_t) LOAD_DRAIN_S * 1000000;
+    scenario = &config;
+    halPosixSetLink(link);
+    halTimerStartOnce(loadTimer, 0);
+
+    while (result.finished == false) {
+        device.step();
+        pollValves();
+    }
+
+    halTimerStop(loadTimer);
+    halPosixMqttSetOnline(true);
+    scenario = nullptr;
+}
+
+/**
+ * @brief Returns a percentile of the latencies in miliseconds, or -1 if there are none.
+ */
+static float percentile(float *values, uint16_t count, float fraction) {
+    if (count == 0) {
+        return -1;
+    }
+
+    std::sort(values, values + count);
+    return values[(uint16_t) (fraction * (count - 1) + 0.5f)];
+}
+
+/**
+ * @brief Prints the outcome of a scenario.
+ *
+ * @return uint16_t Number of commands neither acknowledged nor rejected.
+ */
+static uint16_t print(const LoadScenario_t &config) {
+    float acks[LOAD_MAX_COMMANDS];
+    float actuations[LOAD_MAX_COMMANDS];
+    uint16_t ackCount = 0;
+    uint16_t actuationCount = 0;
+    uint16_t rejected = 0;
+    uint16_t lost = 0;
+    double seconds = (result.endTime - result.startTime) / 1e6;
+    int64_t actuationTime = 0;
+    LoadCommand_t *command = nullptr;
+
+    for (uint16_t i = 0; i < result.commandCount; i++) {
+        command = &result.commands[i];
+        if (command->ackTime == 0) {
+            lost++;
+            continue;
+        }
+        rejected += command->rejected;
+        acks[ackCount++] = (command->ackTime - command->sendTime) / 1000.0f;
+        actuationTime = command->begunOnReceipt ? findActuation(*command) : 0;
+        if (actuationTime > 0) {
+            actuations[actuationCount++] = (actuationTime - command->sendTime) / 1000.0f;
+        }
+    }
+
+    printf("%-10s %5u %5u %5u %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f %8.2f %8.0f %5lu\n",
+        config.name,
+        result.sent,
+        rejected,
+        lost,
+        percentile(acks, ackCount, 0.5f),
+        percentile(acks, ackCount, 0.99f),
+        percentile(acks, ackCount, 1.0f),
+        percentile(actuations, actuationCount, 0.5f),
+        percentile(actuations, actuationCount, 0.99f),
+        percentile(actuations, actuationCount, 1.0f),
+        result.messages / seconds,
+        result.bytes / seconds,
+        (unsigned long) result.connections
+    );
+    return lost;
+}
+
+/**
+ * @brief Drives bursts of dispense commands through the loopback broker, over
+ * a link with injected latency, loss and outages, and reports the latency from
+ * each command to its acknowledgement on queue/status and to the opening of a
+ * supply valve, the telemetry throughput, and the reconnections. Fails if any
+ * command was lost without a rejection.
+ */
+int main(int argc, char **argv) {
+    static const LoadScenario_t scenarios[] = {
+        {"ideal", {}, 30, 1, 10000, 0, 0, 0},
+        {"burst", {}, 8, 6, 30000, 0, 0, 0},
+        {"latency", {40000, 20000, 0, 200000, 1}, 30, 1, 10000, 0, 0, 0},
+        {"loss", {20000, 5000, 0.05f, 200000, 1}, 8, 6, 30000, 0, 0, 0},
+        {"outage", {20000, 5000, 0, 200000, 1}, 60, 1, 5000, 60000, 12000, 0},
+        /** Each burst is held by the broker for the persistent session, and arrives at once on reconnecting. */
+        {"reconnect", {20000, 5000, 0, 200000, 1}, 4, 6, 60000, 60000, 20000, 40000},
+    };
+    Config_t config = {};
+    uint16_t lost = 0;
+
+    halPosixSetLogLevel(ESP_LOG_ERROR);
+    halPosixSetPublishHook(&onPublish, nullptr);
+    halPosixSetIdleHook(&onIdle, nullptr);
+
+    if (device.boot() != ESP_OK) {
+        fprintf(stderr, "Device failed to boot.\n");
+        return 1;
+    }
+
+    config = device.getConfig();
+    sourcePin = config.valves.sourcePin;
+    tankPin = config.valves.tankPin;
+    flowPin = config.valves.flowSensorPin;
+    halTimerCreate(&onLoadTimer, nullptr, "load", &loadTimer);
+    halTimerCreate(&onPulse, nullptr, "pulse", &pulseTimer);
+    halTimerStartOnce(pulseTimer, LOAD_PULSE_PERIOD_US);
+
+    printf("%-10s %5s %5s %5s %8s %8s %8s %8s %8s %8s %8s %8s %5s\n",
+        "scenario", "cmds", "rej", "lost", "ack p50", "ack p99", "ack max", "act p50", "act p99", "act max", "msgs/s", "bytes/s", "conn");
+    for (const LoadScenario_t &scenario : scenarios) {
+        run(scenario);
+        lost += print(scenario);
+    }
+    if (lost > 0) {
+        fprintf(stderr, "%u commands lost without a rejection.\n", lost);
+        return 1;
+    }
+    return 0;
+}
\ No newline at end of file
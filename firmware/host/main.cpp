@@ -0,0 +1,106 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "halTime.h"
+#include "halPosix.h"
+
+#include "device.h"
+
+/** Maximum length of a script line. */
+#define SCRIPT_LINE_MAX_BYTES 600
+
+/**
+ * @brief Describes the progress through the command script.
+ */
+typedef struct Script_t {
+    Device *device;
+    FILE *input;
+    /** Time the current wait ends at, in microseconds. */
+    int64_t waitUntil;
+    /** Set once the script has ended. */
+    bool done;
+} Script_t;
+
+/**
+ * @brief Runs the script while the firmware blocks. Waits are run in virtual time,
+ * and each other line is delivered as a command once the previous wait has passed.
+ */
+static void onIdle(int64_t deadline, void *arg) {
+    Script_t *script = static_cast<Script_t*>(arg);
+    char line[SCRIPT_LINE_MAX_BYTES];
+    char *payload = nullptr;
+    int64_t now = 0;
+
+    while (script->done == false) {
+        now = halTimeMicros();
+        if (now < script->waitUntil) {
+            if (script->waitUntil > deadline) {
+                return;
+            }
+            halPosixAdvance(script->waitUntil - now);
+            continue;
+        }
+
+        if (fgets(line, sizeof(line), script->input) == nullptr) {
+            script->done = true;
+            return;
+        }
+        line[strcspn(line, "\r\n")] = '\0';
+        if ( (line[0] == '\0') || (line[0] == '#') ) {
+            continue;
+        }
+
+        if (strncmp(line, "wait ", 5) == 0) {
+            script->waitUntil = now + (int64_t) (atof(line + 5) * 1000000);
+            continue;
+        }
+
+        /** The topic suffix ends at the first space, the rest is the payload. */
+        payload = strchr(line, ' ');
+        if (payload != nullptr) {
+            *payload++ = '\0';
+        } else {
+            payload = line + strlen(line);
+        }
+        script->device->command(line, payload);
+        return;
+    }
+}
+
+/**
+ * @brief Runs the firmware against the loopback broker. Reads lines of
+ * "<topic suffix> <payload>" or "wait <seconds>" from stdin, and prints each
+ * message published by the firmware as "<topic> <payload>".
+ * Exits at the end of the script.
+ */
+int main(int argc, char **argv) {
+    static Device device;
+    Script_t script = {};
+
+    /** Keep published messages in order with the log on stderr. */
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+
+    if ( (argc > 1) && (strcmp(argv[1], "-v") == 0) ) {
+        halPosixSetLogLevel(ESP_LOG_DEBUG);
+    } else if ( (argc > 1) && (strcmp(argv[1], "-q") == 0) ) {
+        halPosixSetLogLevel(ESP_LOG_WARN);
+    }
+
+    if (device.boot() != ESP_OK) {
+        fprintf(stderr, "Device failed to boot.\n");
+        return 1;
+    }
+
+    script.device = &device;
+    script.input = stdin;
+    halPosixSetIdleHook(&onIdle, &script);
+
+    while (script.done == false) {
+        device.step();
+    }
+
+    return 0;
+}
\ No newline at end of file
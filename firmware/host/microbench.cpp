@@ -0,0 +1,136 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "esp_log.h"
+#include "halTime.h"
+#include "halPosix.h"
+
+#include "microbench.h"
+#include "device.h"
+
+/** Calls per batch. */
+#define HOST_MICROBENCH_ITERATIONS 20000
+/** Width of the kernel name column. */
+#define HOST_MICROBENCH_NAME_WIDTH 28
+/** Pressure sensor reading of the dispense loop, in millivolts. */
+#define HOST_MICROBENCH_TANK_MV 1200
+
+static Device device;
+static PressureSensorCalibrationPoint_t calibration[2] = {{400, 0}, {2000, 150}};
+
+/**
+ * @brief Returns the cost of a kernel in a baseline printed by this program, or a negative number if missing.
+ */
+static float findBaseline(FILE *baseline, const char *name) {
+    char line[128];
+    size_t length = strlen(name);
+
+    rewind(baseline);
+    while (fgets(line, sizeof(line), baseline) != nullptr) {
+        if ( (strncmp(line, name, length) == 0) && (line[length] == ' ') ) {
+            return strtof(line + HOST_MICROBENCH_NAME_WIDTH, nullptr);
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Times ValveManager::loopDispense() of the operating mode of the build, in nanoseconds
+ * per call. It drives the valves, so unlike the kernels of the bench component it only runs on the host.
+ * The virtual time stands still, so the dispense never ends and each call takes the same branches.
+ *
+ * @param result Overwritten with the result.
+ * @return esp_err_t Return code.
+ */
+static esp_err_t measureDispenseLoop(MicrobenchResult_t &result) {
+    esp_err_t err = ESP_OK;
+    Config_t config = {};
+    RunPlan_t plan = {};
+    ValveStates_e state = VALVES_UNKNOWN;
+    DispenseProcess_t process = {};
+    DispenseSummary_t summary = {};
+    bool stepComplete = false;
+    uint32_t start = 0;
+    uint32_t elapsed = 0;
+    uint32_t fastest = UINT32_MAX;
+
+    halPosixSetLogLevel(ESP_LOG_ERROR);
+    err = device.boot();
+    if (err != ESP_OK) return err;
+
+    config = device.getConfig();
+    config.pressureSensor.calibrationPointCount = 2;
+    config.pressureCalibrationTable = calibration;
+    err = device.applyConfig(config);
+    if (err != ESP_OK) return err;
+    if (config.pressureSensor.pin >= 0) {
+        halPosixSetAdc(config.pressureSensor.pin, HOST_MICROBENCH_TANK_MV);
+    }
+
+    plan.stepCount = 1;
+    plan.steps[0].targetTime = UINT32_MAX;
+    err = device.valveManager.beginDispense(plan, state, process);
+    if (err != ESP_OK) return err;
+
+    for (int batch = 0; batch < MICROBENCH_BATCHES; batch++) {
+        start = halCycleCount();
+        for (uint32_t i = 0; i < HOST_MICROBENCH_ITERATIONS; i++) {
+            device.valveManager.loopDispense(state, process, summary, stepComplete);
+        }
+        elapsed = halCycleCount() - start;
+        if (elapsed < fastest) {
+            fastest = elapsed;
+        }
+    }
+
+    result.name = "dispense loop";
+    result.iterations = HOST_MICROBENCH_ITERATIONS;
+    result.ticksPerCall = (float) fastest / HOST_MICROBENCH_ITERATIONS;
+    return device.valveManager.endDispense(state, process, summary);
+}
+
+/**
+ * @brief Times the per-loop kernels on the host in nanoseconds per call.
+ * Given the path of a baseline printed earlier, e.g. baseline/microbench.txt,
+ * the change against it is printed alongside.
+ */
+int main(int argc, char **argv) {
+    MicrobenchResult_t results[MICROBENCH_MAX_KERNELS + 1];
+    uint8_t count = microbenchRun(results, MICROBENCH_MAX_KERNELS, HOST_MICROBENCH_ITERATIONS);
+    FILE *baseline = nullptr;
+    float reference = 0;
+
+    if (argc > 1) {
+        baseline = fopen(argv[1], "r");
+        if (baseline == nullptr) {
+            fprintf(stderr, "Cannot open %s.\n", argv[1]);
+            return 1;
+        }
+    }
+
+    if (measureDispenseLoop(results[count]) != ESP_OK) {
+        fprintf(stderr, "Dispense loop failed to start.\n");
+        return 1;
+    }
+    count++;
+
+    for (uint8_t i = 0; i < count; i++) {
+        printf("%-*s %10.1f", HOST_MICROBENCH_NAME_WIDTH - 1, results[i].name, results[i].ticksPerCall);
+        if (baseline != nullptr) {
+            reference = findBaseline(baseline, results[i].name);
+            if (reference > 0) {
+                printf(" %+8.1f%%", (results[i].ticksPerCall / reference - 1) * 100);
+            } else {
+                printf(" %9s", "new");
+            }
+        }
+        printf("\n");
+    }
+
+    if (baseline != nullptr) {
+        fclose(baseline);
+    }
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,358 @@
+#include <cmath>
+
+#include "esp_err.h"
+#include "halTime.h"
+#include "halPosix.h"
+
+#include "plantSimulator.h"
+
+/**
+ * @brief Constructor.
+ */
+PlantSimulator::PlantSimulator() {
+    config = {};
+    timer = nullptr;
+    flowPin = -1;
+    sensorPin = -1;
+    source = {};
+    tank = {};
+    drain = {};
+    tankArea = 0;
+    tankHeight = 0;
+    tankVolume = 0;
+    lastTime = 0;
+    tankFlow = 0;
+    sourceFlow = 0;
+    drainFlow = 0;
+    pulsePhase = 0;
+    pulses = 0;
+    tankDelivered = 0;
+    sourceDelivered = 0;
+    resetTime = 0;
+    tailFlowRate = 0;
+    tailTime = 0;
+    randomState = 1;
+}
+
+/**
+ * @brief Sets the plant config without simulating, so its tank and sensor can be queried.
+ *
+ * @param valves Pins of the valves and flow sensor.
+ * @param sensorPin Pin of the pressure sensor, or -1.
+ * @param config Plant config.
+ * @return esp_err_t Return code. ESP_ERR_INVALID_ARG if the tank has no volume.
+ */
+esp_err_t PlantSimulator::configure(ValveConfig_t &valves, int8_t sensorPin, PlantConfig_t &config) {
+    this->config = config;
+    this->sensorPin = sensorPin;
+    flowPin = valves.flowSensorPin;
+    source = {valves.sourcePin, config.sourceValve, false, 0, 0};
+    tank = {valves.tankPin, config.tankValve, false, 0, 0};
+    drain = {valves.drainPin, config.drainValve, false, 0, 0};
+    randomState = (config.seed == 0) ? 1 : config.seed;
+
+    if (config.tank.shape == TANK_TABLE) {
+        if (geometry.configure(config.tank, 0, 1) != ESP_OK) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        tankArea = 0;
+        tankHeight = geometry.getFullReading();
+        return ESP_OK;
+    } else if (config.tank.shape == TANK_CYLINDER) {
+        tankArea = M_PI * (config.tank.dimension1 / 2) * (config.tank.dimension1 / 2);
+        tankHeight = config.tank.dimension2;
+    } else {
+        tankArea = config.tank.dimension1 * config.tank.dimension2;
+        tankHeight = config.tank.dimension3;
+    }
+
+    return ( (tankArea <= 0) || (tankHeight <= 0) ) ? ESP_ERR_INVALID_ARG : ESP_OK;
+}
+
+/**
+ * @brief Starts simulating. Call after the firmware has claimed its pins.
+ *
+ * @param valves Pins of the valves and flow sensor.
+ * @param sensorPin Pin of the pressure sensor, or -1.
+ * @param config Plant config.
+ * @return esp_err_t Return code.
+ */
+esp_err_t PlantSimulator::start(ValveConfig_t &valves, int8_t sensorPin, PlantConfig_t &config) {
+    esp_err_t err = ESP_OK;
+
+    err = configure(valves, sensorPin, config);
+    if (err != ESP_OK) return err;
+
+    if (timer == nullptr) {
+        err = halTimerCreate(&onTimer, this, "plant", &timer);
+        if (err != ESP_OK) return err;
+    }
+
+    lastTime = halTimeMicros();
+    resetCounters(0);
+    updateFlows();
+    updateSensor();
+    return halTimerStartOnce(timer, PLANT_TICK_US);
+}
+
+/**
+ * @brief Sets the volume of water in the tank, in liters.
+ */
+void PlantSimulator::setTankVolume(float volume) {
+    float capacity = getTankCapacity();
+
+    tankVolume = (volume < 0) ? 0 : (volume > capacity) ? capacity : volume;
+    updateFlows();
+    updateSensor();
+}
+
+/**
+ * @brief Returns the volume of water in the tank, in liters.
+ */
+float PlantSimulator::getTankVolume() {
+    return tankVolume;
+}
+
+/**
+ * @brief Returns the capacity of the tank, in liters.
+ */
+float PlantSimulator::getTankCapacity() {
+    if (config.tank.shape == TANK_TABLE) {
+        return geometry.getCapacity();
+    }
+    return tankArea * tankHeight * 1000;
+}
+
+/**
+ * @brief Fills a pressure sensor calibration table spanning the tank, without noise.
+ *
+ * @param points Overwritten with PLANT_CALIBRATION_POINTS points.
+ * @return uint8_t Number of points.
+ */
+uint8_t PlantSimulator::getCalibrationTable(PressureSensorCalibrationPoint_t *points) {
+    float capacity = getTankCapacity();
+
+    /** Like a tank filled in whole liters, so only the voltage is rounded. */
+    for (int i = 0; i < PLANT_CALIBRATION_POINTS; i++) {
+        points[i].volume = (uint16_t) floorf(capacity * i / (PLANT_CALIBRATION_POINTS - 1));
+        points[i].analogVoltage = lroundf(sensorVoltage(tankLevel(points[i].volume)));
+    }
+
+    return PLANT_CALIBRATION_POINTS;
+}
+
+/**
+ * @brief Clears the delivered volumes and the tail time.
+ *
+ * @param tailFlowRate Tank flow rate marking the start of its low-head tail, in L/min.
+ */
+void PlantSimulator::resetCounters(float tailFlowRate) {
+    this->tailFlowRate = tailFlowRate;
+    resetTime = halTimeMicros();
+    tailTime = 0;
+    pulses = 0;
+    tankDelivered = 0;
+    sourceDelivered = 0;
+}
+
+float PlantSimulator::getTankDelivered() {
+    return tankDelivered;
+}
+
+float PlantSimulator::getSourceDelivered() {
+    return sourceDelivered;
+}
+
+/**
+ * @brief Returns the time from the counter reset to the open tank valve
+ * first flowing below the tail flow rate, in miliseconds, or zero.
+ */
+uint32_t PlantSimulator::getTailTime() {
+    return tailTime;
+}
+
+/**
+ * @brief Returns the flow sensor pulses emitted since the counters were reset.
+ */
+uint32_t PlantSimulator::getPulses() {
+    return pulses;
+}
+
+/**
+ * @brief Advances the plant to the current time and schedules the next step.
+ */
+void PlantSimulator::onTimer(void *arg) {
+    PlantSimulator *self = static_cast<PlantSimulator*>(arg);
+    int64_t next = PLANT_TICK_US;
+    double rate = 0;
+    double untilPulse = 0;
+
+    self->integrate(halTimeMicros());
+
+    /** End the step at the next pulse, so each pulse is timestamped exactly. */
+    rate = self->pulseRate();
+    if (rate > 0) {
+        untilPulse = ceil((1 - self->pulsePhase) / rate * 1e6);
+        if (untilPulse < next) {
+            next = (untilPulse < 1) ? 1 : (int64_t) untilPulse;
+        }
+    }
+    halTimerStartOnce(self->timer, next);
+}
+
+/**
+ * @brief Integrates the plant over a step, emitting the pulses due on the way.
+ */
+void PlantSimulator::integrate(int64_t now) {
+    float dt = (now - lastTime) / 1e6f;
+
+    if (dt <= 0) {
+        return;
+    }
+
+    /** Flows are held over the step, and the pulse phase absorbs rounding of the step length. */
+    pulsePhase += pulseRate() * dt;
+    while (pulsePhase >= 1 - 1e-6) {
+        pulsePhase = (pulsePhase >= 1) ? pulsePhase - 1 : 0;
+        pulses++;
+        halPosixPulse(flowPin);
+    }
+
+    tankVolume -= (tankFlow + drainFlow) * dt / 60;
+    if (tankVolume < 0) {
+        tankVolume = 0;
+    }
+    tankDelivered += tankFlow * dt / 60;
+    sourceDelivered += sourceFlow * dt / 60;
+
+    moveValve(source, now, dt);
+    moveValve(tank, now, dt);
+    moveValve(drain, now, dt);
+    updateFlows();
+
+    if ( (tailTime == 0) && tank.commanded && (tank.opening >= 1) && (tankFlow < tailFlowRate) ) {
+        tailTime = (now - resetTime) / 1000;
+    }
+
+    updateSensor();
+    lastTime = now;
+}
+
+/**
+ * @brief Moves a valve towards its commanded position.
+ */
+void PlantSimulator::moveValve(ValveState_t &valve, int64_t now, float dt) {
+    bool commanded = (valve.pin >= 0) && halPosixGetLevel(valve.pin);
+    uint16_t delay = 0;
+    uint16_t ramp = 0;
+
+    if (commanded != valve.commanded) {
+        valve.commanded = commanded;
+        valve.commandTime = now;
+        return;
+    }
+
+    delay = commanded ? valve.dynamics.openDelay : valve.dynamics.closeDelay;
+    ramp = commanded ? valve.dynamics.openRamp : valve.dynamics.closeRamp;
+    if ((now - valve.commandTime) < (int64_t) delay * 1000) {
+        return;
+    }
+
+    if (ramp == 0) {
+        valve.opening = commanded ? 1 : 0;
+    } else {
+        valve.opening += (commanded ? 1 : -1) * dt * 1000 / ramp;
+    }
+    valve.opening = (valve.opening < 0) ? 0 : (valve.opening > 1) ? 1 : valve.opening;
+}
+
+/**
+ * @brief Computes the flow rates from the valve openings and the tank level.
+ */
+void PlantSimulator::updateFlows() {
+    float height = tankLevel(tankVolume);
+
+    tankFlow = 0;
+    drainFlow = 0;
+    if (tankVolume > 0) {
+        tankFlow = tank.opening * config.tankCoefficient * sqrtf(height + config.tankElevation);
+        drainFlow = drain.opening * config.drainCoefficient * sqrtf(height);
+    }
+    sourceFlow = source.opening * config.sourceCoefficient * sqrtf(config.sourcePressure);
+}
+
+/**
+ * @brief Sets the pressure sensor ADC input from the tank level, with noise.
+ */
+void PlantSimulator::updateSensor() {
+    float height = tankLevel(tankVolume);
+
+    if (sensorPin >= 0) {
+        halPosixSetAdc(sensorPin, lroundf(sensorVoltage(height) + config.sensorNoise * gaussian()));
+    }
+}
+
+/**
+ * @brief Returns the height of a volume of water in the tank, in meters.
+ *
+ * @param volume Volume in liters.
+ */
+float PlantSimulator::tankLevel(float volume) {
+    float low = 0;
+    float high = tankHeight;
+    float middle = 0;
+
+    if (config.tank.shape != TANK_TABLE) {
+        return volume / (tankArea * 1000);
+    }
+
+    /** The strapping table gives the volume of a height, so the height of a volume is found by bisection. */
+    for (int i = 0; i < PLANT_LEVEL_ITERATIONS; i++) {
+        middle = (low + high) / 2;
+        if (geometry.getVolume(middle) < volume) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    return (low + high) / 2;
+}
+
+/**
+ * @brief Returns the pulse rate of the flow sensor, in pulses per second.
+ */
+double PlantSimulator::pulseRate() {
+    float flow = tankFlow + sourceFlow;
+    float kFactor = 0;
+
+    if ( (flowPin < 0) || (flow < config.stallFlowRate) ) {
+        return 0;
+    }
+
+    /** Paddle wheel sensors under-read at low flow, as the rotor slips. */
+    kFactor = config.pulsesPerLiter * (1 - config.kFactorDroop * expf(-flow / config.kFactorFlowRate));
+    return flow / 60.0 * kFactor;
+}
+
+/**
+ * @brief Returns the pressure sensor voltage at a water height, in millivolts.
+ */
+float PlantSimulator::sensorVoltage(float height) {
+    return config.sensorOffset + config.sensorGain * height;
+}
+
+/**
+ * @brief Returns a normally distributed number with zero mean and unit deviation.
+ */
+float PlantSimulator::gaussian() {
+    float u[2] = {};
+
+    /** Xorshift, then the Box-Muller transform. */
+    for (int i = 0; i < 2; i++) {
+        randomState ^= randomState << 13;
+        randomState ^= randomState >> 17;
+        randomState ^= randomState << 5;
+        u[i] = (randomState + 1.0f) / 4294967297.0f;
+    }
+    return sqrtf(-2 * logf(u[0])) * cosf(2 * M_PI * u[1]);
+}
\ No newline at end of file
@@ -0,0 +1,237 @@
+#ifndef PLANT_SIMULATOR_H
+#define PLANT_SIMULATOR_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "halTime.h"
+
+#include "config.h"
+#include "tankGeometry.h"
+
+/** Integration step of the plant, in microseconds. */
+#define PLANT_TICK_US 10000
+/** Number of points of the generated pressure sensor calibration table. */
+#define PLANT_CALIBRATION_POINTS 8
+/** Number of halvings the water height of a strapping table tank is found by. */
+#define PLANT_LEVEL_ITERATIONS 24
+
+/**
+ * @brief Describes the dynamics of a solenoid valve.
+ */
+typedef struct PlantValve_t {
+    /** Time from a command to the valve starting to move, in miliseconds. */
+    uint16_t openDelay = 0;
+    uint16_t closeDelay = 0;
+    /** Time the valve takes to move fully once it starts, in miliseconds. */
+    uint16_t openRamp = 0;
+    uint16_t closeRamp = 0;
+} PlantValve_t;
+
+/**
+ * @brief Describes the plumbing, supplies and sensors of the simulated plant.
+ */
+typedef struct PlantConfig_t {
+    /** Tank geometry, as in the firmware config. A TANK_TABLE shape holds what its strapping table gives. */
+    TankConfig_t tank = {};
+    /** Height of the tank floor above the outlet, in meters. */
+    float tankElevation = 0.05f;
+    /** Tank outflow per square root of the head in meters, in L/min. */
+    float tankCoefficient = 12.7f;
+    /** Source pressure in bar. */
+    float sourcePressure = 3.0f;
+    /** Source outflow per square root of the pressure in bar, in L/min. */
+    float sourceCoefficient = 7.19f;
+    /** Drain outflow per square root of the water height in meters, in L/min. */
+    float drainCoefficient = 20.0f;
+    /** Flow sensor K-factor at high flow, in pulses per liter. */
+    float pulsesPerLiter = 1265.289f;
+    /** Fraction of the K-factor lost towards zero flow. */
+    float kFactorDroop = 0.12f;
+    /** Flow rate the K-factor droop decays over, in L/min. */
+    float kFactorFlowRate = 3.0f;
+    /** Flow rate below which the rotor of the flow sensor stalls, in L/min. */
+    float stallFlowRate = 0.3f;
+    /** Pressure sensor output at an empty tank, in millivolts. */
+    float sensorOffset = 400.0f;
+    /** Pressure sensor output per meter of water, in millivolts. */
+    float sensorGain = 1000.0f;
+    /** Standard deviation of the pressure sensor noise, in millivolts. */
+    float sensorNoise = 6.0f;
+    PlantValve_t sourceValve = {60, 120, 80, 150};
+    PlantValve_t tankValve = {80, 150, 100, 200};
+    PlantValve_t drainValve = {80, 150, 100, 200};
+    /** Seed of the sensor noise, so runs are repeatable. */
+    uint32_t seed = 1;
+} PlantConfig_t;
+
+/**
+ * @brief Simulates a gravity tank and a pressurised source feeding a line
+ * through solenoid valves, metered by a flow sensor, with a pressure sensor
+ * at the tank floor. Runs on a timer of the POSIX HAL, reading the valve
+ * outputs and driving the flow sensor input and the pressure sensor ADC.
+ *
+ * The outflow of each supply follows the orifice equation, so the tank flow
+ * falls with the square root of its head. The line is assumed not to restrict
+ * either supply, so the flows of a blended dispense add up. Flow pulses are
+ * emitted at their exact times within each step.
+ */
+class PlantSimulator {
+public:
+    /**
+     * @brief Constructor.
+     */
+    PlantSimulator();
+
+    /**
+     * @brief Sets the plant config without simulating, so its tank and sensor can be queried.
+     *
+     * @param valves Pins of the valves and flow sensor.
+     * @param sensorPin Pin of the pressure sensor, or -1.
+     * @param config Plant config.
+     * @return esp_err_t Return code. ESP_ERR_INVALID_ARG if the tank has no volume.
+     */
+    esp_err_t configure(ValveConfig_t &valves, int8_t sensorPin, PlantConfig_t &config);
+
+    /**
+     * @brief Starts simulating. Call after the firmware has claimed its pins.
+     *
+     * @param valves Pins of the valves and flow sensor.
+     * @param sensorPin Pin of the pressure sensor, or -1.
+     * @param config Plant config.
+     * @return esp_err_t Return code.
+     */
+    esp_err_t start(ValveConfig_t &valves, int8_t sensorPin, PlantConfig_t &config);
+
+    /**
+     * @brief Sets the volume of water in the tank, in liters.
+     */
+    void setTankVolume(float volume);
+
+    /**
+     * @brief Returns the volume of water in the tank, in liters.
+     */
+    float getTankVolume();
+
+    /**
+     * @brief Returns the capacity of the tank, in liters.
+     */
+    float getTankCapacity();
+
+    /**
+     * @brief Fills a pressure sensor calibration table spanning the tank, without noise.
+     *
+     * @param points Overwritten with PLANT_CALIBRATION_POINTS points.
+     * @return uint8_t Number of points.
+     */
+    uint8_t getCalibrationTable(PressureSensorCalibrationPoint_t *points);
+
+    /**
+     * @brief Clears the delivered volumes and the tail time.
+     *
+     * @param tailFlowRate Tank flow rate marking the start of its low-head tail, in L/min.
+     */
+    void resetCounters(float tailFlowRate);
+
+    /** Volumes delivered into the line since the counters were reset, in liters. */
+    float getTankDelivered();
+    float getSourceDelivered();
+
+    /**
+     * @brief Returns the time from the counter reset to the open tank valve
+     * first flowing below the tail flow rate, in miliseconds, or zero.
+     */
+    uint32_t getTailTime();
+
+    /**
+     * @brief Returns the flow sensor pulses emitted since the counters were reset.
+     */
+    uint32_t getPulses();
+
+private:
+    typedef struct ValveState_t {
+        int8_t pin;
+        PlantValve_t dynamics;
+        bool commanded;
+        /** Time of the last command change, in microseconds. */
+        int64_t commandTime;
+        /** Opening from 0 to 1. */
+        float opening;
+    } ValveState_t;
+
+    PlantConfig_t config;
+    HalTimer_t timer;
+    int8_t flowPin;
+    int8_t sensorPin;
+    ValveState_t source;
+    ValveState_t tank;
+    ValveState_t drain;
+    float tankArea;
+    float tankHeight;
+    /** Strapping table of a TANK_TABLE shape, in meters. */
+    TankGeometry geometry;
+    float tankVolume;
+    int64_t lastTime;
+    /** Flow rates of the current step, in L/min. */
+    float tankFlow;
+    float sourceFlow;
+    float drainFlow;
+    /** Fraction of the next flow sensor pulse already passed. */
+    double pulsePhase;
+    uint32_t pulses;
+    float tankDelivered;
+    float sourceDelivered;
+    int64_t resetTime;
+    float tailFlowRate;
+    uint32_t tailTime;
+    uint32_t randomState;
+
+    /**
+     * @brief Advances the plant to the current time and schedules the next step.
+     */
+    static void onTimer(void *arg);
+
+    /**
+     * @brief Integrates the plant over a step, emitting the pulses due on the way.
+     */
+    void integrate(int64_t now);
+
+    /**
+     * @brief Moves a valve towards its commanded position.
+     */
+    void moveValve(ValveState_t &valve, int64_t now, float dt);
+
+    /**
+     * @brief Computes the flow rates from the valve openings and the tank level.
+     */
+    void updateFlows();
+
+    /**
+     * @brief Sets the pressure sensor ADC input from the tank level, with noise.
+     */
+    void updateSensor();
+
+    /**
+     * @brief Returns the height of a volume of water in the tank, in meters.
+     *
+     * @param volume Volume in liters.
+     */
+    float tankLevel(float volume);
+
+    /**
+     * @brief Returns the pulse rate of the flow sensor, in pulses per second.
+     */
+    double pulseRate();
+
+    /**
+     * @brief Returns the pressure sensor voltage at a water height, in millivolts.
+     */
+    float sensorVoltage(float height);
+
+    /**
+     * @brief Returns a normally distributed number with zero mean and unit deviation.
+     */
+    float gaussian();
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,104 @@
+#include <cstdio>
+#include <cstring>
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "halTime.h"
+#include "halPosix.h"
+
+#include "device.h"
+
+/** Time after boot the credentials are stored, as by the provisioning app, in seconds. */
+#define PROVISION_DELAY_S 300
+/** Maximum FSM iterations until connected, at one per poll of the provisioning. */
+#define PROVISION_MAX_STEPS 1000
+
+/**
+ * @brief Describes what the firmware did while and after provisioning.
+ */
+typedef struct ProvisionRun_t {
+    /** Time the credentials are stored at, in microseconds. */
+    int64_t provisionTime;
+    bool stored;
+    /** Set if the firmware was provisioning when the credentials were stored. */
+    bool provisioning;
+    /** Set if the firmware connected before the credentials were stored. */
+    bool connectedEarly;
+    uint32_t connections;
+    uint32_t errors;
+} ProvisionRun_t;
+
+static Device device;
+static ProvisionRun_t run;
+
+/**
+ * @brief Returns true if a topic ends with a suffix.
+ */
+static bool endsWith(const char *topic, const char *suffix) {
+    size_t topicLength = strlen(topic);
+    size_t suffixLength = strlen(suffix);
+
+    return (topicLength >= suffixLength) && (strcmp(topic + topicLength - suffixLength, suffix) == 0);
+}
+
+/**
+ * @brief Counts the connection reports and the error logs of the firmware.
+ */
+static void onPublish(const char *topic, const char *data, int qos, bool retain, void *arg) {
+    if (endsWith(topic, "diagnostics/connection")) {
+        run.connections++;
+    } else if (endsWith(topic, "log/error")) {
+        run.errors++;
+        fprintf(stderr, "Error at %.1f s: %s\n", halTimeMicros() / 1e6, data);
+    }
+}
+
+/**
+ * @brief Stores the credentials once their time has come, advancing the time to it.
+ */
+static void onIdle(int64_t deadline, void *arg) {
+    int64_t now = halTimeMicros();
+
+    if ( run.stored || (run.provisionTime > deadline) ) {
+        return;
+    }
+
+    if (run.provisionTime > now) {
+        halPosixAdvance(run.provisionTime - now);
+    }
+    run.provisioning = device.connectionManager.isProvisioning();
+    run.connectedEarly = device.connectionManager.isConnected();
+    halPosixSetWifiCredentials(true);
+    run.stored = true;
+}
+
+/**
+ * @brief Boots the firmware without WiFi credentials, and checks that it provisions
+ * rather than failing, and connects once the credentials are stored. Exits with 1 if not.
+ */
+int main(int argc, char **argv) {
+    esp_err_t err = ESP_OK;
+    bool passed = false;
+
+    halPosixSetLogLevel(ESP_LOG_ERROR);
+    halPosixSetPublishHook(&onPublish, nullptr);
+    halPosixSetIdleHook(&onIdle, nullptr);
+    halPosixSetWifiCredentials(false);
+    run.provisionTime = halTimeMicros() + (int64_t) PROVISION_DELAY_S * 1000000;
+
+    err = device.boot(PROVISION_MAX_STEPS);
+
+    printf("credentials stored   %s at %.1f s\n", run.stored ? "yes" : "no", run.provisionTime / 1e6);
+    printf("provisioning         %s\n", run.provisioning ? "yes" : "no");
+    printf("connected before     %s\n", run.connectedEarly ? "yes" : "no");
+    printf("connected after      %s at %.1f s\n", (err == ESP_OK) ? "yes" : "no", halTimeMicros() / 1e6);
+    printf("connection reports   %lu\n", (unsigned long) run.connections);
+    printf("error logs           %lu\n", (unsigned long) run.errors);
+
+    passed = (err == ESP_OK) && run.stored && run.provisioning && (run.connectedEarly == false) && (run.connections > 0) && (run.errors == 0);
+    if (passed == false) {
+        fprintf(stderr, "Provisioning failed.\n");
+        return 1;
+    }
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,420 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <time.h>
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "halTime.h"
+#include "halPosix.h"
+
+#include "device.h"
+#include "plantSimulator.h"
+#include "traceManager.h"
+
+/** Largest trace recorded or replayed, in bytes. */
+#define REPLAY_TRACE_MAX_BYTES (16 * 1024 * 1024)
+/** Time the plant keeps running after the dispense summary before the capture stops, in seconds. */
+#define REPLAY_SETTLE_S 2
+/** Longest the recorded dispense may run, in seconds. */
+#define REPLAY_MAX_S 3600
+/** Dispense of the recorded scenario, switching over from a low tank to the source. */
+#define REPLAY_DISPENSE "{\"tv\":30}"
+#define REPLAY_TANK_L 25
+
+/** FNV-1a parameters. */
+#define REPLAY_FNV_OFFSET 0xcbf29ce484222325ULL
+#define REPLAY_FNV_PRIME 0x100000001b3ULL
+
+/**
+ * @brief Describes the telemetry published while a trace is captured or replayed.
+ */
+typedef struct ReplayOutput_t {
+    /** Time published messages are relative to, in microseconds. */
+    int64_t startTime;
+    /** Messages published after this time are not counted. */
+    int64_t endTime;
+    uint64_t digest;
+    uint32_t messages;
+    bool verbose;
+} ReplayOutput_t;
+
+static Device device;
+static PlantSimulator plant;
+static PlantConfig_t plantConfig = {};
+static PressureSensorCalibrationPoint_t calibration[PLANT_CALIBRATION_POINTS];
+static uint8_t trace[REPLAY_TRACE_MAX_BYTES];
+static size_t traceLength = 0;
+static ReplayOutput_t output = {};
+
+/** State of the recorder. */
+static uint32_t chunkCount = 0;
+static bool chunkMissing = false;
+static bool dispenseEnded = false;
+static bool stopSent = false;
+static int64_t stopTime = 0;
+
+/** State of the replay. */
+static HalTimer_t replayTimer = nullptr;
+static size_t replayOffset = 0;
+static int64_t replayShift = 0;
+static TraceRecord_t record = {};
+static bool replayDone = false;
+static uint32_t recordCount = 0;
+static uint32_t lostCount = 0;
+
+/**
+ * @brief Returns the CPU time of the process in seconds.
+ */
+static double cpuTime() {
+    struct timespec now = {};
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Returns true if a topic ends with a suffix.
+ */
+static bool endsWith(const char *topic, const char *suffix) {
+    size_t topicLength = strlen(topic);
+    size_t suffixLength = strlen(suffix);
+
+    return (topicLength >= suffixLength) && (strcmp(topic + topicLength - suffixLength, suffix) == 0);
+}
+
+/**
+ * @brief Adds bytes to a FNV-1a digest.
+ */
+static void hash(uint64_t &digest, const void *data, size_t length) {
+    const uint8_t *bytes = static_cast<const uint8_t*>(data);
+
+    for (size_t i = 0; i < length; i++) {
+        digest = (digest ^ bytes[i]) * REPLAY_FNV_PRIME;
+    }
+}
+
+/**
+ * @brief Appends the base64 field "d" of a trace chunk to the trace.
+ *
+ * @return esp_err_t Return code. ESP_ERR_INVALID_ARG if the field is malformed.
+ */
+static esp_err_t appendChunk(const char *json) {
+    static const char ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    const char *field = strstr(json, "\"d\":\"");
+    const char *symbol = nullptr;
+    uint32_t bits = 0;
+    int count = 0;
+
+    if (field == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    for (const char *c = field + 5; (*c != '"') && (*c != '=') && (*c != '\0'); c++) {
+        symbol = strchr(ALPHABET, *c);
+        if ( (symbol == nullptr) || (traceLength >= REPLAY_TRACE_MAX_BYTES) ) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        bits = (bits << 6) | (symbol - ALPHABET);
+        count += 6;
+        if (count >= 8) {
+            count -= 8;
+            trace[traceLength++] = (bits >> count) & 0xFF;
+        }
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Collects the trace chunks, and digests the rest of the telemetry within the capture.
+ * Info logs are left out, as the capture commands are only logged while recording.
+ */
+static void onPublish(const char *topic, const char *data, int qos, bool retain, void *arg) {
+    int64_t time = halTimeMicros() - output.startTime;
+
+    if (endsWith(topic, "trace/data")) {
+        if (strtoul(strstr(data, "\"n\":") + 4, nullptr, 10) != chunkCount) {
+            chunkMissing = true;
+        }
+        chunkCount++;
+        if (appendChunk(data) != ESP_OK) {
+            chunkMissing = true;
+        }
+        return;
+    }
+
+    if (endsWith(topic, "out/log/sm")) {
+        dispenseEnded = true;
+        stopTime = halTimeMicros() + (int64_t) REPLAY_SETTLE_S * 1000000;
+    }
+
+    if ( (output.startTime == 0) || (halTimeMicros() > output.endTime) || endsWith(topic, "log/info") ) {
+        return;
+    }
+
+    hash(output.digest, &time, sizeof(time));
+    hash(output.digest, topic, strlen(topic) + 1);
+    hash(output.digest, data, strlen(data) + 1);
+    output.messages++;
+    if (output.verbose) {
+        printf("%10.6f %s %s\n", time / 1e6, topic, data);
+    }
+}
+
+/**
+ * @brief Stops the capture once the plant has settled after the dispense, while the FSM waits.
+ */
+static void onRecordIdle(int64_t deadline, void *arg) {
+    int64_t now = halTimeMicros();
+
+    if ( (dispenseEnded == false) || stopSent || (deadline < stopTime) ) {
+        return;
+    }
+
+    if (stopTime > now) {
+        halPosixAdvance(stopTime - now);
+    }
+    output.endTime = halTimeMicros();
+    device.command("trace/capture", "{\"on\":false}");
+    stopSent = true;
+}
+
+/**
+ * @brief Feeds the records due to the HAL, and schedules the next.
+ */
+static void onReplayTimer(void *arg) {
+    esp_err_t err = ESP_OK;
+    int64_t now = halTimeMicros();
+    char topic[TRACE_TOPIC_MAX_BYTES + 1];
+
+    while (replayDone == false) {
+        switch (record.type) {
+            case TRACE_RECORD_PULSE:
+                halPosixPulse(record.pin);
+                break;
+
+            case TRACE_RECORD_ADC:
+                halPosixSetAdc(record.pin, record.millivolts);
+                break;
+
+            case TRACE_RECORD_MQTT:
+                memcpy(topic, record.topic, record.topicLength);
+                topic[record.topicLength] = '\0';
+                halPosixMqttDeliver(topic, record.data, record.dataLength);
+                break;
+
+            case TRACE_RECORD_LOST:
+            default:
+                lostCount += record.lost;
+                break;
+        }
+        recordCount++;
+
+        err = TraceManager::decode(trace, traceLength, replayOffset, record);
+        if (err == ESP_ERR_NOT_FOUND) {
+            replayDone = true;
+            output.endTime = now;
+        } else if (err != ESP_OK) {
+            fprintf(stderr, "Trace truncated at byte %zu.\n", replayOffset);
+            replayDone = true;
+            output.endTime = now;
+        } else if (record.time + replayShift > now) {
+            halTimerStartOnce(replayTimer, record.time + replayShift - now);
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Applies the default config with the calibration table of the simulated
+ * pressure sensor, so a recording and its replays run with the same config.
+ */
+static esp_err_t configure() {
+    esp_err_t err = ESP_OK;
+    Config_t config = device.getConfig();
+
+    plantConfig.tank = config.tank;
+    err = plant.configure(config.valves, config.pressureSensor.pin, plantConfig);
+    if (err != ESP_OK) return err;
+
+    config.pressureSensor.calibrationPointCount = plant.getCalibrationTable(calibration);
+    config.pressureCalibrationTable = calibration;
+    return device.applyConfig(config);
+}
+
+/**
+ * @brief Captures a dispense from the simulated plant through the trace capture
+ * of the firmware, and writes the trace.
+ */
+static int recordTrace(const char *path) {
+    Config_t config = device.getConfig();
+    FILE *file = nullptr;
+    int64_t startTime = 0;
+    size_t offset = 0;
+
+    if (plant.start(config.valves, config.pressureSensor.pin, plantConfig) != ESP_OK) {
+        fprintf(stderr, "Plant failed to start.\n");
+        return 1;
+    }
+    plant.setTankVolume(REPLAY_TANK_L);
+    halPosixSetIdleHook(&onRecordIdle, nullptr);
+
+    device.command("trace/capture", "{\"on\":true}");
+    device.step();
+    output.startTime = halTimeMicros();
+    output.endTime = INT64_MAX;
+    device.command("out/on", REPLAY_DISPENSE);
+
+    while ( (stopSent == false) || device.traceManager.isActive() ) {
+        device.step();
+        if ( (stopSent == false) && (halTimeMicros() - output.startTime > (int64_t) REPLAY_MAX_S * 1000000) ) {
+            fprintf(stderr, "Dispense did not end.\n");
+            return 1;
+        }
+    }
+
+    if ( chunkMissing || (TraceManager::decodeHeader(trace, traceLength, offset, startTime) != ESP_OK) ) {
+        fprintf(stderr, "Trace chunks missing or malformed.\n");
+        return 1;
+    }
+
+    file = fopen(path, "wb");
+    if ( (file == nullptr) || (fwrite(trace, 1, traceLength, file) != traceLength) ) {
+        fprintf(stderr, "Failed to write %s.\n", path);
+        return 1;
+    }
+    fclose(file);
+
+    printf("recorded %zu bytes in %lu chunks, %u pulses, %.1f s\n",
+        traceLength, (unsigned long) chunkCount, (unsigned) plant.getPulses(), (output.endTime - output.startTime) / 1e6);
+    printf("digest %016llx over %lu messages\n", (unsigned long long) output.digest, (unsigned long) output.messages);
+    return 0;
+}
+
+/**
+ * @brief Reads a trace, either as written by the recorder, or as the payloads
+ * of its chunks one per line, as received from the broker.
+ *
+ * @return esp_err_t Return code. ESP_ERR_INVALID_ARG if a chunk is missing or malformed.
+ */
+static esp_err_t loadTrace(const char *path) {
+    FILE *file = fopen(path, "rb");
+    char line[TX_PAYLOAD_MAX_BYTES + 2];
+    uint32_t magic = 0;
+    const char *sequence = nullptr;
+
+    if (file == nullptr) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    if ( (fread(&magic, 1, sizeof(magic), file) == sizeof(magic)) && (magic == TRACE_MAGIC) ) {
+        rewind(file);
+        traceLength = fread(trace, 1, sizeof(trace), file);
+        fclose(file);
+        return ESP_OK;
+    }
+
+    rewind(file);
+    while (fgets(line, sizeof(line), file) != nullptr) {
+        sequence = strstr(line, "\"n\":");
+        if (sequence == nullptr) {
+            continue;
+        }
+        if ( (strtoul(sequence + 4, nullptr, 10) != chunkCount++) || (appendChunk(line) != ESP_OK) ) {
+            fclose(file);
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    fclose(file);
+    return ESP_OK;
+}
+
+/**
+ * @brief Replays a trace at full speed and digests the telemetry published.
+ */
+static int replayTrace(const char *path) {
+    esp_err_t err = ESP_OK;
+    int64_t startTime = 0;
+    double cpuStart = 0;
+    double cpuSeconds = 0;
+
+    err = loadTrace(path);
+    if (err != ESP_OK) {
+        fprintf(stderr, "Failed to load %s: %s.\n", path, esp_err_to_name(err));
+        return 1;
+    }
+
+    err = TraceManager::decodeHeader(trace, traceLength, replayOffset, startTime);
+    if (err != ESP_OK) {
+        fprintf(stderr, "Not a trace: %s.\n", esp_err_to_name(err));
+        return 1;
+    }
+
+    /** Line the trace up with the capture if it started later after boot, so absolute times match too. */
+    if (startTime > halTimeMicros()) {
+        halPosixAdvance(startTime - halTimeMicros());
+    }
+    replayShift = halTimeMicros() - startTime;
+    output.startTime = halTimeMicros();
+    output.endTime = INT64_MAX;
+
+    record.time = startTime;
+    err = TraceManager::decode(trace, traceLength, replayOffset, record);
+    if (err != ESP_OK) {
+        fprintf(stderr, "Trace has no records.\n");
+        return 1;
+    }
+
+    cpuStart = cpuTime();
+    halTimerCreate(&onReplayTimer, nullptr, "replay", &replayTimer);
+    halTimerStartOnce(replayTimer, record.time + replayShift - halTimeMicros());
+    while (replayDone == false) {
+        device.step();
+    }
+    /** Let the FSM handle the inputs of the last record. */
+    device.step();
+    cpuSeconds = cpuTime() - cpuStart;
+
+    printf("replayed %lu records, %lu lost, %.1f s in %.1f ms cpu\n",
+        (unsigned long) recordCount, (unsigned long) lostCount, (output.endTime - output.startTime) / 1e6, cpuSeconds * 1000);
+    printf("digest %016llx over %lu messages\n", (unsigned long long) output.digest, (unsigned long) output.messages);
+    return 0;
+}
+
+/**
+ * @brief Records a trace of a dispense from the simulated plant, or replays a trace
+ * through the unmodified managers at full speed. The digest of the telemetry
+ * published within the trace compares a recording with its replay, or the replays
+ * of two firmware versions.
+ *
+ * Usage: drip_replay [-v] record <trace>
+ *        drip_replay [-v] <trace>
+ */
+int main(int argc, char **argv) {
+    int arg = 1;
+
+    output.digest = REPLAY_FNV_OFFSET;
+    if ( (arg < argc) && (strcmp(argv[arg], "-v") == 0) ) {
+        output.verbose = true;
+        arg++;
+    }
+    if ( (arg >= argc) || ((strcmp(argv[arg], "record") == 0) && (arg + 1 >= argc)) ) {
+        fprintf(stderr, "Usage: %s [-v] record <trace>\n       %s [-v] <trace>\n", argv[0], argv[0]);
+        return 2;
+    }
+
+    halPosixSetLogLevel(ESP_LOG_ERROR);
+    halPosixSetPublishHook(&onPublish, nullptr);
+
+    if ( (device.boot() != ESP_OK) || (configure() != ESP_OK) ) {
+        fprintf(stderr, "Device failed to boot.\n");
+        return 1;
+    }
+
+    if (strcmp(argv[arg], "record") == 0) {
+        return recordTrace(argv[arg + 1]);
+    }
+    return replayTrace(argv[arg]);
+}
\ No newline at end of file
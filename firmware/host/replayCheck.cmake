@@ -0,0 +1,17 @@
+# Records a trace and replays it, and fails unless the replay publishes the same messages.
+execute_process(COMMAND ${REPLAY} record ${TRACE} RESULT_VARIABLE result OUTPUT_VARIABLE recorded)
+if(NOT result EQUAL 0)
+	message(FATAL_ERROR "Recording failed:\n${recorded}")
+endif()
+
+execute_process(COMMAND ${REPLAY} ${TRACE} RESULT_VARIABLE result OUTPUT_VARIABLE replayed)
+if(NOT result EQUAL 0)
+	message(FATAL_ERROR "Replay failed:\n${replayed}")
+endif()
+
+string(REGEX MATCH "digest [0-9a-f]+ over [0-9]+ messages" recordedDigest "${recorded}")
+string(REGEX MATCH "digest [0-9a-f]+ over [0-9]+ messages" replayedDigest "${replayed}")
+if((recordedDigest STREQUAL "") OR NOT (recordedDigest STREQUAL replayedDigest))
+	message(FATAL_ERROR "Replay diverged, recorded ${recordedDigest}, replayed ${replayedDigest}.")
+endif()
+message(STATUS "Replay matched, ${replayedDigest}.")
\ No newline at end of file
@@ -0,0 +1,214 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "halTime.h"
+#include "halSystem.h"
+#include "halPosix.h"
+
+#include "device.h"
+#include "plantSimulator.h"
+
+/** Number of simulated days by default. */
+#define SOAK_DAYS_DEFAULT 7
+#define SOAK_DAY_S (24 * 3600)
+
+/**
+ * @brief Describes a command of the daily routine.
+ */
+typedef struct SoakEvent_t {
+    /** Time of the command since midnight, in seconds. */
+    uint32_t time;
+    /** Topic suffix, or nullptr to refill the tank. */
+    const char *suffix;
+    const char *payload;
+} SoakEvent_t;
+
+/**
+ * @brief The commands of an irrigation day, in time order. Covers the queue, the trace capture,
+ * a config change, drains, the valve characterisation and every report on demand.
+ */
+static const SoakEvent_t DAY[] = {
+    {0, nullptr, nullptr},
+    {6 * 3600, "trace/capture", "{\"on\":true}"},
+    {6 * 3600 + 1, "out/on", "{\"p\":[{\"z\":0,\"tv\":20},{\"z\":0,\"tv\":10}]}"},
+    {6 * 3600 + 2, "out/on", "{\"tt\":120000,\"to\":150000}"},
+    {6 * 3600 + 600, "trace/capture", "{\"on\":false}"},
+    {12 * 3600, "resources/request", "{}"},
+    {12 * 3600 + 60, "config/change", "{\"tz\":\"CET-1CEST,M3.5.0,M10.5.0/3\"}"},
+    {18 * 3600, "drain/on", "{\"tt\":60000,\"to\":90000}"},
+    {18 * 3600 + 1, "out/on", "{\"tt\":300000,\"to\":330000}"},
+    {20 * 3600, "valves/characterise", "{}"},
+    {23 * 3600, "resources/request", "{}"}
+};
+#define SOAK_EVENT_COUNT (sizeof(DAY) / sizeof(DAY[0]))
+
+/**
+ * @brief Describes the progress through the days and the telemetry counted on the way.
+ */
+typedef struct SoakRun_t {
+    int64_t dayStart;
+    uint8_t nextEvent;
+    uint32_t summaries;
+    uint32_t errors;
+    uint32_t messages;
+} SoakRun_t;
+
+static Device device;
+static PlantSimulator plant;
+static PlantConfig_t plantConfig;
+static PressureSensorCalibrationPoint_t calibration[MAX_PRESSURE_CALIBRATION_POINTS];
+static SoakRun_t run;
+/** Every allocation of the process, before and after boot. */
+static volatile uint64_t allocations = 0;
+
+#ifdef __GLIBC__
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+
+/**
+ * The allocator is interposed so the guard of the firmware sees every allocation of the process,
+ * including those of the C and C++ libraries on behalf of the firmware. The harness itself does
+ * not allocate while the firmware runs.
+ */
+extern "C" void *malloc(size_t size) {
+    allocations = allocations + 1;
+    halPosixCountAllocation();
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size) {
+    allocations = allocations + 1;
+    halPosixCountAllocation();
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size) {
+    allocations = allocations + 1;
+    halPosixCountAllocation();
+    return __libc_realloc(ptr, size);
+}
+#endif
+
+/**
+ * @brief Returns true if a topic ends with a suffix.
+ */
+static bool endsWith(const char *topic, const char *suffix) {
+    size_t topicLength = strlen(topic);
+    size_t suffixLength = strlen(suffix);
+
+    return (topicLength >= suffixLength) && (strcmp(topic + topicLength - suffixLength, suffix) == 0);
+}
+
+/**
+ * @brief Counts the telemetry published by the firmware.
+ */
+static void onPublish(const char *topic, const char *data, int qos, bool retain, void *arg) {
+    run.messages++;
+    if (endsWith(topic, "out/log/sm")) {
+        run.summaries++;
+    } else if (endsWith(topic, "log/error")) {
+        run.errors++;
+        fprintf(stderr, "Error at %.1f s: %s\n", halTimeMicros() / 1e6, data);
+    }
+}
+
+/**
+ * @brief Delivers the commands of the day due before the deadline of the wait, advancing the time to each.
+ */
+static void onIdle(int64_t deadline, void *arg) {
+    const SoakEvent_t *event = nullptr;
+    int64_t eventTime = 0;
+    int64_t now = 0;
+
+    while (run.nextEvent < SOAK_EVENT_COUNT) {
+        event = &DAY[run.nextEvent];
+        eventTime = run.dayStart + (int64_t) event->time * 1000000;
+        if (eventTime > deadline) {
+            return;
+        }
+
+        now = halTimeMicros();
+        if (eventTime > now) {
+            halPosixAdvance(eventTime - now);
+        }
+        run.nextEvent++;
+
+        if (event->suffix == nullptr) {
+            plant.setTankVolume(plant.getTankCapacity());
+            continue;
+        }
+        device.command(event->suffix, event->payload);
+        return;
+    }
+}
+
+/**
+ * @brief Runs the firmware through simulated irrigation days against the plant, and checks
+ * that the FSM makes no heap allocation once booted. Exits with 1 if it does.
+ */
+int main(int argc, char **argv) {
+    Config_t config = {};
+    uint32_t days = (argc > 1) ? strtoul(argv[1], nullptr, 10) : SOAK_DAYS_DEFAULT;
+    uint64_t bootAllocations = 0;
+    uint64_t runAllocations = 0;
+    uint32_t guardCount = 0;
+    uint32_t iterations = 0;
+
+#ifndef __GLIBC__
+    fprintf(stderr, "Allocations can only be counted with glibc.\n");
+    return 1;
+#endif
+
+    halPosixSetLogLevel(ESP_LOG_ERROR);
+    halPosixSetPublishHook(&onPublish, nullptr);
+    halPosixSetIdleHook(&onIdle, nullptr);
+
+    if (device.boot() != ESP_OK) {
+        fprintf(stderr, "Device failed to boot.\n");
+        return 1;
+    }
+
+    config = device.getConfig();
+    plantConfig.tank = config.tank;
+    if (plant.start(config.valves, config.pressureSensor.pin, plantConfig) != ESP_OK) {
+        fprintf(stderr, "Plant failed to start.\n");
+        return 1;
+    }
+    config.pressureSensor.calibrationPointCount = plant.getCalibrationTable(calibration);
+    config.pressureCalibrationTable = calibration;
+    if (device.applyConfig(config) != ESP_OK) {
+        fprintf(stderr, "Device rejected the plant config.\n");
+        return 1;
+    }
+    bootAllocations = allocations;
+
+    for (uint32_t day = 0; day < days; day++) {
+        run.dayStart = halTimeMicros();
+        run.nextEvent = 0;
+        while (halTimeMicros() < run.dayStart + (int64_t) SOAK_DAY_S * 1000000) {
+            device.step();
+            iterations++;
+        }
+    }
+    /** Read before printing, as the first print allocates the buffer of stdout. */
+    guardCount = halHeapGuardCount();
+    runAllocations = allocations - bootAllocations;
+
+    printf("days %lu, iterations %lu, messages %lu, summaries %lu, errors %lu\n",
+        (unsigned long) days,
+        (unsigned long) iterations,
+        (unsigned long) run.messages,
+        (unsigned long) run.summaries,
+        (unsigned long) run.errors
+    );
+    printf("allocations at boot %llu, by the firmware after boot %lu, by the process after boot %llu\n",
+        (unsigned long long) bootAllocations,
+        (unsigned long) guardCount,
+        (unsigned long long) runAllocations
+    );
+    return (guardCount == 0) ? 0 : 1;
+}
\ No newline at end of file
@@ -1,15 +1,34 @@
 #include <stdio.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "esp_log.h"
 
 #include "configManager.h"
 #include "mqttManager.h"
 #include "connectionManager.h"
 #include "valveManager.h"
+#include "powerManager.h"
+#include "gpioManager.h"
+#include "scheduleManager.h"
+#include "pressureManager.h"
+#include "flowManager.h"
+#include "pressureCalibrator.h"
+#include "traceManager.h"
+#include "resourceManager.h"
 #include "stateManager.h"
 
-/** Main task stack size, in words (4 bytes on Esp32c3) */
-#define STACK_SIZE 512
+static const char* TAG = "Main";
+
+/**
+ * FSM task stack size, in bytes as on every ESP-IDF target. The deepest handlers copy the
+ * config and decode a schedule, about 3 kB with the log formatting. The margin is reported
+ * as the "FSM" stack of the resource report.
+ */
+#define STACK_SIZE (6 * 1024)
+
+/** Stack and control block of the FSM task, so it is created without the heap. */
+static StackType_t fsmStack[STACK_SIZE];
+static StaticTask_t fsmTaskBuffer;
 
 /**
  * @brief Runs the finite state machine.
@@ -17,12 +36,20 @@
  * @param pvParameters Allows parameters to be passed from the main function. Currently unused. 
  */
 void vMainTask(void *pvParameters) {
-    /** Initialize managers. */
-    ConfigManager configManager = ConfigManager();
-    MqttManager mqttManager = MqttManager();
-    ConnectionManager connectionManager = ConnectionManager();
-    ValveManager valveManager = ValveManager();
-    StateManager stateManager = StateManager(&configManager, &mqttManager, &connectionManager, &valveManager);
+    /** Initialize managers. They are static, so their buffers are not on the stack of the task. */
+    static ConfigManager configManager = ConfigManager();
+    static MqttManager mqttManager = MqttManager();
+    static ConnectionManager connectionManager = ConnectionManager();
+    static GpioManager gpioManager = GpioManager();
+    static PressureManager pressureManager = PressureManager(&gpioManager);
+    static ValveManager valveManager = ValveManager(&gpioManager, &pressureManager);
+    static PowerManager powerManager = PowerManager();
+    static ScheduleManager scheduleManager = ScheduleManager();
+    static FlowManager flowManager = FlowManager(&valveManager);
+    static PressureCalibrator pressureCalibrator = PressureCalibrator(&valveManager, &pressureManager);
+    static TraceManager traceManager = TraceManager();
+    static ResourceManager resourceManager = ResourceManager();
+    static StateManager stateManager = StateManager(&configManager, &mqttManager, &connectionManager, &valveManager, &powerManager, &gpioManager, &scheduleManager, &pressureManager, &flowManager, &pressureCalibrator, &traceManager, &resourceManager);
 
     /** Initialize the FSM. */
     stateManager.initialize();
@@ -40,20 +67,20 @@ void vMainTask(void *pvParameters) {
  * @brief Entrypoint. 
  */
 extern "C" void app_main(void) {
-    BaseType_t xReturned;
     TaskHandle_t xHandle = NULL;
 
     /** Run task through FreeRTOS. */
-    xReturned = xTaskCreate(vMainTask, 
+    xHandle = xTaskCreateStatic(vMainTask, 
         "FSM", 
         STACK_SIZE, 
         (void*) nullptr, 
         tskIDLE_PRIORITY, 
-        &xHandle
+        fsmStack,
+        &fsmTaskBuffer
     );
 
-    /** Should not reach here. */
-    if (xReturned == pdPASS) {
-        vTaskDelete(xHandle);
+    /** The FSM task runs on after app_main returns. */
+    if (xHandle == NULL) {
+        ESP_LOGE(TAG, "Failed to create the FSM task.");
     }
 }
\ No newline at end of file